@@ -509,6 +509,29 @@ static int _dep_scan_domains(struct device *dev,
 	return ret;
 }
 
+/**
+ * _dep_remove_domains() - Drop the dependency requests of a device
+ * @dev:	device whose requests are dropped
+ * @dep_info:	dep_info corresponding to the device
+ *
+ * Undoes _dep_scan_domains(). The dependent domains are scaled down the
+ * next time their main domain is.
+ */
+static void _dep_remove_domains(struct device *dev,
+		struct omap_vdd_dep_info *dep_info)
+{
+	if (!dep_info)
+		return;
+
+	while (dep_info->nr_dep_entries) {
+		if (dep_info->_dep_voltdm)
+			_remove_vdd_user(
+				_voltdm_to_dvfs_info(dep_info->_dep_voltdm),
+				dev);
+		dep_info++;
+	}
+}
+
 /**
  * _dep_scale_domains() - Cause a scale of all dependent domains
  * @req_dev:	device requesting the scale
@@ -773,58 +796,29 @@ out:
 	return ret;
 }
 
-/* Public functions */
-
-/**
- * omap_dvfs_suspend() - Suspend DVFS
- * @suspend:	true - suspend, false - resume
- *
- * This API suspend DVFS if called with suspend = true and after that any
- * DVFS transitions will be prohibited and omap_device_scale()
- * will return -EPERM.
- *
- * suspend = fasle will restore normal DVFS work.
- */
-void omap_dvfs_suspend(bool suspend)
-{
-	mutex_lock(&omap_dvfs_lock);
-	dvfs_suspended = suspend;
-	mutex_unlock(&omap_dvfs_lock);
-}
-
 /**
- * omap_device_scale() - Set a new rate at which the device is to operate
+ * _omap_device_scale() - Place or drop a rate request for a device
+ * @req_dev:	device making the request
  * @target_dev:	pointer to the device that is to be scaled
- * @rate:	the rnew rate for the device.
+ * @rate:	the new rate for the device
  *
- * This API gets the device opp table associated with this device and
- * tries putting the device to the requested rate and the voltage domain
- * associated with the device to the voltage corresponding to the
- * requested rate. Since multiple devices can be assocciated with a
- * voltage domain this API finds out the possible voltage the
- * voltage domain can enter and then decides on the final device
- * rate.
- *
- * IMPORTANT NOTE: This API assumes that there is ONLY one requestor per
- * target device. If there are multiple an abstraction API needs to be
- * created on a need basis to consolidate and arbitrate among requestors
- * and provide a singular request to this API.
+ * Common code of omap_device_scale() and omap_device_scale_floor(). The
+ * voltage request is tracked per @req_dev, so requests of different
+ * requestors on the same vdd add up to the highest of them. A @rate of 0
+ * from a @req_dev other than @target_dev drops its request.
  *
  * Return 0 on success else the error value
  */
-int omap_device_scale(struct device *target_dev, unsigned long rate)
+static int _omap_device_scale(struct device *req_dev,
+			      struct device *target_dev, unsigned long rate)
 {
 	struct opp *opp;
-	unsigned long volt, freq = rate;
+	unsigned long volt = 0, freq = rate;
 	struct omap_vdd_dvfs_info *tdvfs_info;
 	struct platform_device *pdev;
 	struct omap_device *od;
+	bool drop = !rate && req_dev != target_dev;
 	int ret = 0;
-	/*
-	 * For our internal tracking system - the request and target devices
-	 * are the same
-	 */
-	struct device *req_dev = target_dev;
 
 	pdev = container_of(target_dev, struct platform_device, dev);
 	if (IS_ERR_OR_NULL(pdev)) {
@@ -846,7 +840,8 @@ int omap_device_scale(struct device *target_dev, unsigned long rate)
 	/* Lock me to ensure cross domain scaling is secure */
 	mutex_lock(&omap_dvfs_lock);
 
-	if (dvfs_suspended) {
+	/* Dropping a request must not be lost, even while suspended */
+	if (dvfs_suspended && !drop) {
 		dev_dbg(target_dev, "%s: %pF dvfs_suspended (freq%ld)\n",
 			__func__, (void *)_RET_IP_, rate);
 		mutex_unlock(&omap_dvfs_lock);
@@ -857,6 +852,24 @@ int omap_device_scale(struct device *target_dev, unsigned long rate)
 	omap_dvfs_pm_qos_handle.dev = target_dev;
 	pm_qos_update_request(&omap_dvfs_pm_qos_handle, 0);
 
+	tdvfs_info = _dev_to_dvfs_info(target_dev);
+	if (IS_ERR_OR_NULL(tdvfs_info)) {
+		dev_err(target_dev, "%s: %pF no vdd![f=%ld]\n",
+			__func__, (void *)_RET_IP_, freq);
+		ret = -ENODEV;
+		goto out;
+	}
+
+	if (drop) {
+		ret = _remove_vdd_user(tdvfs_info, req_dev);
+		if (ret)
+			goto out;
+		_dep_remove_domains(req_dev, tdvfs_info->voltdm->dep_vdd_info);
+		if (dvfs_suspended)
+			goto out;
+		goto scale;
+	}
+
 	rcu_read_lock();
 	opp = opp_find_freq_ceil(target_dev, &freq);
 	if (IS_ERR(opp)) {
@@ -869,14 +882,6 @@ int omap_device_scale(struct device *target_dev, unsigned long rate)
 	volt = opp_get_voltage(opp);
 	rcu_read_unlock();
 
-	tdvfs_info = _dev_to_dvfs_info(target_dev);
-	if (IS_ERR_OR_NULL(tdvfs_info)) {
-		dev_err(target_dev, "%s: %pF no vdd![f=%ld, v=%ld]\n",
-			__func__, (void *)_RET_IP_, freq, volt);
-		ret = -ENODEV;
-		goto out;
-	}
-
 	ret = _add_vdd_user(tdvfs_info, req_dev, volt);
 	if (ret) {
 		dev_err(target_dev, "%s: %pF failed %d[f=%ld, v=%ld]\n",
@@ -885,7 +890,7 @@ int omap_device_scale(struct device *target_dev, unsigned long rate)
 	}
 
 	/* Check for any dep domains and add the user request */
-	ret = _dep_scan_domains(target_dev,
+	ret = _dep_scan_domains(req_dev,
 			tdvfs_info->voltdm->dep_vdd_info, volt);
 	if (ret) {
 		dev_err(target_dev,
@@ -894,12 +899,14 @@ int omap_device_scale(struct device *target_dev, unsigned long rate)
 		goto out;
 	}
 
+scale:
 	/* Do the actual scaling */
 	ret = _dvfs_scale(req_dev, target_dev, tdvfs_info);
 	if (ret) {
 		dev_err(target_dev, "%s:scale by %pF failed %d[f=%ld, v=%ld]\n",
 			__func__, (void *)_RET_IP_, ret, freq, volt);
-		_remove_vdd_user(tdvfs_info, target_dev);
+		if (!drop)
+			_remove_vdd_user(tdvfs_info, req_dev);
 		/* Fall through */
 	}
 	/* Fall through */
@@ -909,8 +916,105 @@ out:
 	mutex_unlock(&omap_dvfs_lock);
 	return ret;
 }
+
+/* Public functions */
+
+/**
+ * omap_dvfs_suspend() - Suspend DVFS
+ * @suspend:	true - suspend, false - resume
+ *
+ * This API suspend DVFS if called with suspend = true and after that any
+ * DVFS transitions will be prohibited and omap_device_scale()
+ * will return -EPERM.
+ *
+ * suspend = fasle will restore normal DVFS work.
+ */
+void omap_dvfs_suspend(bool suspend)
+{
+	mutex_lock(&omap_dvfs_lock);
+	dvfs_suspended = suspend;
+	mutex_unlock(&omap_dvfs_lock);
+}
+
+/**
+ * omap_device_scale() - Set a new rate at which the device is to operate
+ * @target_dev:	pointer to the device that is to be scaled
+ * @rate:	the rnew rate for the device.
+ *
+ * This API gets the device opp table associated with this device and
+ * tries putting the device to the requested rate and the voltage domain
+ * associated with the device to the voltage corresponding to the
+ * requested rate. Since multiple devices can be assocciated with a
+ * voltage domain this API finds out the possible voltage the
+ * voltage domain can enter and then decides on the final device
+ * rate.
+ *
+ * IMPORTANT NOTE: This API assumes that there is ONLY one requestor per
+ * target device. If there are multiple an abstraction API needs to be
+ * created on a need basis to consolidate and arbitrate among requestors
+ * and provide a singular request to this API. Requestors that only want
+ * the device to run at least at some rate for a while can use
+ * omap_device_scale_floor() instead.
+ *
+ * Return 0 on success else the error value
+ */
+int omap_device_scale(struct device *target_dev, unsigned long rate)
+{
+	/*
+	 * For our internal tracking system - the request and target devices
+	 * are the same
+	 */
+	return _omap_device_scale(target_dev, target_dev, rate);
+}
 EXPORT_SYMBOL(omap_device_scale);
 
+/**
+ * omap_device_scale_floor() - Keep a device at or above a rate
+ * @req_dev:	device making the request, distinct from @target_dev
+ * @target_dev:	pointer to the device that is to be scaled
+ * @rate:	the minimum rate for the device, 0 to drop the floor
+ *
+ * Unlike omap_device_scale(), the request is tracked apart from the one
+ * of the device owner: the vdd of @target_dev runs at the voltage of the
+ * higher of both, so this can only raise the device rate and dropping the
+ * floor lets it return to what the owner asked for. A requestor must use
+ * a separate @req_dev for each target on the same vdd.
+ *
+ * Return 0 on success else the error value
+ */
+int omap_device_scale_floor(struct device *req_dev, struct device *target_dev,
+			    unsigned long rate)
+{
+	if (IS_ERR_OR_NULL(req_dev) || req_dev == target_dev)
+		return -EINVAL;
+
+	return _omap_device_scale(req_dev, target_dev, rate);
+}
+EXPORT_SYMBOL(omap_device_scale_floor);
+
+/**
+ * omap_dvfs_get_volt_slew() - Rate at which a device's voltage changes
+ * @dev:	device registered with DVFS
+ *
+ * Returns the slew rate in uV/us of the PMIC supplying the vdd of @dev,
+ * or 0 if it is not known.
+ */
+unsigned int omap_dvfs_get_volt_slew(struct device *dev)
+{
+	struct omap_vdd_dvfs_info *dvfs_info;
+	unsigned int slew = 0;
+
+	mutex_lock(&omap_dvfs_lock);
+	dvfs_info = _dev_to_dvfs_info(dev);
+	if (dvfs_info && dvfs_info->voltdm->pmic &&
+	    dvfs_info->voltdm->pmic->slew_rate > 0)
+		slew = dvfs_info->voltdm->pmic->slew_rate;
+	mutex_unlock(&omap_dvfs_lock);
+
+	return slew;
+}
+EXPORT_SYMBOL(omap_dvfs_get_volt_slew);
+
 #ifdef CONFIG_PM_DEBUG
 static int dvfs_dump_vdd(struct seq_file *sf, void *unused)
 {
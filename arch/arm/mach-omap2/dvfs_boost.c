@@ -0,0 +1,133 @@
+/*
+ * OMAP4/5 DVFS floors for cpufreq boosts
+ *
+ * Copyright (C) 2012 Texas Instruments Incorporated - http://www.ti.com
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * When a cpufreq governor boosts the CPUs on user input, the frame that
+ * follows also needs the GPU and the L3 interconnect. Raise their DVFS
+ * floor to the highest OPP for the length of the boost, on top of what
+ * their drivers ask for, so they do not have to ramp up first.
+ */
+
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/err.h>
+#include <linux/cpufreq.h>
+#include <linux/mutex.h>
+#include <linux/opp.h>
+#include <linux/platform_device.h>
+
+#include <plat/cpu.h>
+#include <plat/omap_device.h>
+#include <plat/dvfs.h>
+
+/**
+ * struct dvfs_boost_target - device raised on boost
+ * @oh_name:	hwmod of the device
+ * @dev:	the device
+ * @req_dev:	device the floor is requested for, one per target
+ * @rate:	floor rate
+ * @floored:	the floor is in place and must be dropped at the end
+ */
+struct dvfs_boost_target {
+	const char *oh_name;
+	struct device *dev;
+	struct device *req_dev;
+	unsigned long rate;
+	bool floored;
+};
+
+/* notifiers on a blocking chain may run concurrently */
+static DEFINE_MUTEX(dvfs_boost_lock);
+
+static struct dvfs_boost_target dvfs_boost_targets[] = {
+	{ .oh_name = "gpu" },
+	{ .oh_name = "l3_main_1" },
+};
+
+static int dvfs_boost_notifier(struct notifier_block *nb,
+			       unsigned long val, void *data)
+{
+	struct dvfs_boost_target *t;
+	bool start = val == CPUFREQ_BOOST_START;
+	int i, ret;
+
+	mutex_lock(&dvfs_boost_lock);
+	for (i = 0; i < ARRAY_SIZE(dvfs_boost_targets); i++) {
+		t = &dvfs_boost_targets[i];
+		/* there is no floor to drop if START failed */
+		if (!t->rate || (!start && !t->floored))
+			continue;
+
+		ret = omap_device_scale_floor(t->req_dev, t->dev,
+					      start ? t->rate : 0);
+		if (ret)
+			dev_dbg(t->req_dev, "%s: %s floor failed %d\n",
+				__func__, t->oh_name, ret);
+		else
+			t->floored = start;
+	}
+	mutex_unlock(&dvfs_boost_lock);
+
+	return NOTIFY_OK;
+}
+
+static struct notifier_block dvfs_boost_nb = {
+	.notifier_call = dvfs_boost_notifier,
+};
+
+static int __init dvfs_boost_init(void)
+{
+	struct dvfs_boost_target *t;
+	struct platform_device *pdev;
+	struct opp *opp;
+	unsigned long freq;
+	int i, n = 0;
+
+	if (!cpu_is_omap44xx() && !cpu_is_omap54xx())
+		return 0;
+
+	for (i = 0; i < ARRAY_SIZE(dvfs_boost_targets); i++) {
+		t = &dvfs_boost_targets[i];
+
+		t->dev = omap_device_get_by_hwmod_name(t->oh_name);
+		if (IS_ERR(t->dev)) {
+			pr_warn("%s: no device for %s\n", __func__, t->oh_name);
+			continue;
+		}
+
+		freq = ULONG_MAX;
+		rcu_read_lock();
+		opp = opp_find_freq_floor(t->dev, &freq);
+		rcu_read_unlock();
+		if (IS_ERR(opp)) {
+			pr_warn("%s: no OPP for %s\n", __func__, t->oh_name);
+			continue;
+		}
+
+		pdev = platform_device_register_simple("omap-dvfs-boost", i,
+						       NULL, 0);
+		if (IS_ERR(pdev))
+			continue;
+
+		t->req_dev = &pdev->dev;
+		t->rate = freq;
+		n++;
+	}
+
+	if (!n)
+		return 0;
+
+	return cpufreq_register_notifier(&dvfs_boost_nb,
+					 CPUFREQ_BOOST_NOTIFIER);
+}
+late_initcall(dvfs_boost_init);
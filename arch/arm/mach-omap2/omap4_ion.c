@@ -10,6 +10,8 @@
  * published by the Free Software Foundation.
  */
 
+#include <linux/dma-contiguous.h>
+#include <linux/dma-mapping.h>
 #include <linux/ion.h>
 #include <linux/memblock.h>
 #include <linux/omap_ion.h>
@@ -17,6 +19,17 @@
 
 #include "omap4_ion.h"
 
+#ifdef CONFIG_CMA
+/* only here to own the CMA area, never registered */
+static struct platform_device omap4_ion_cma_device = {
+	.name = "ion-omap-cma",
+	.id = -1,
+	.dev = {
+		.coherent_dma_mask = DMA_BIT_MASK(32),
+	},
+};
+#endif
+
 static struct ion_platform_heap omap4_ion_heaps[] = {
 	{
 		.type = ION_HEAP_TYPE_CARVEOUT,
@@ -51,11 +64,41 @@ static struct ion_platform_heap omap4_ion_heaps[] = {
 		.id = OMAP_ION_HEAP_TILER_RESERVATION,
 		.name = "tiler_reservation",
 	},
+#ifdef CONFIG_CMA
+	{
+		.type = ION_HEAP_TYPE_DMA,
+		.id = OMAP_ION_HEAP_CMA,
+		.name = "cma",
+		.priv = &omap4_ion_cma_device.dev,
+	},
+#endif
+};
+
+/*
+ * Video buffers try the carveout first.  When it is exhausted or too
+ * fragmented even after compaction, spill into CMA instead of failing.
+ */
+static const unsigned int omap4_ion_video_heaps[] = {
+	OMAP_ION_HEAP_SECURE_INPUT,
+#ifdef CONFIG_CMA
+	OMAP_ION_HEAP_CMA,
+#endif
+};
+
+static struct ion_platform_policy omap4_ion_policies[] = {
+	{
+		.id = OMAP_ION_HEAP_VIDEO,
+		.name = "video",
+		.nr = ARRAY_SIZE(omap4_ion_video_heaps),
+		.heap_ids = omap4_ion_video_heaps,
+	},
 };
 
 static struct ion_platform_data omap4_ion_data = {
-	.nr = 5,
+	.nr = ARRAY_SIZE(omap4_ion_heaps),
 	.heaps = omap4_ion_heaps,
+	.nr_policies = ARRAY_SIZE(omap4_ion_policies),
+	.policies = omap4_ion_policies,
 };
 
 static struct platform_device omap4_ion_device = {
@@ -88,4 +131,12 @@ void __init omap4_ion_init(void)
 				       omap4_ion_data.heaps[i].size,
 				       omap4_ion_data.heaps[i].base);
 		}
+
+#ifdef CONFIG_CMA
+	ret = dma_declare_contiguous(&omap4_ion_cma_device.dev,
+				     OMAP4_ION_HEAP_CMA_SIZE, 0, 0);
+	if (ret)
+		pr_err("dma_declare_contiguous of %x for ion failed %d\n",
+		       OMAP4_ION_HEAP_CMA_SIZE, ret);
+#endif
 }
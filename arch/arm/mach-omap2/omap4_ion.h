@@ -35,6 +35,8 @@
 #endif
 #endif
 
+#define OMAP4_ION_HEAP_CMA_SIZE		(SZ_1M * 32)
+
 #define PHYS_ADDR_SMC_SIZE	(SZ_1M * 3)
 #define PHYS_ADDR_SMC_MEM	(0x80000000 + SZ_1G - PHYS_ADDR_SMC_SIZE)
 
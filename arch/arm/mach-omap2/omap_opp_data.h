@@ -78,6 +78,31 @@ struct omap_opp_def {
 	.u_volt		= _uv,					\
 }
 
+/**
+ * struct omap_opp_power_def - OMAP OPP power estimate
+ * @dev_info:	device the OPP belongs to
+ * @freq:	Frequency in hertz of the OPP
+ * @busy_power:	power in mW while the device runs at this OPP
+ * @idle_power:	power in mW while the device idles at this OPP's voltage
+ *
+ * Used to build the energy model that lets cpufreq governors pick the
+ * cheapest OPP for a given load. For the MPU, figures are for one CPU.
+ */
+struct omap_opp_power_def {
+	struct device_info *dev_info;
+	unsigned long freq;
+	unsigned int busy_power;
+	unsigned int idle_power;
+};
+
+#define OPP_POWER_INITIALIZER(_dev_info, _freq, _busy, _idle)	\
+{								\
+	.dev_info	= _dev_info,				\
+	.freq		= _freq,				\
+	.busy_power	= _busy,				\
+	.idle_power	= _idle,				\
+}
+
 /*
  * Initialization wrapper used to define SmartReflex process data
  * XXX Is this needed?  Just use C99 initializers in data files?
@@ -124,6 +149,8 @@ struct omap_opp_def {
 /* Use this to initialize the default table */
 extern int __initdata omap_init_opp_table(struct omap_opp_def *opp_def,
 		u32 opp_def_size);
+extern int __init omap_init_opp_power_table(
+		struct omap_opp_power_def *power_def, u32 power_def_size);
 extern int __initdata set_device_opp(void);
 
 
@@ -31,6 +31,8 @@
 
 static struct omap_opp_def *opp_table;
 static u32 opp_table_size;
+static struct omap_opp_power_def *opp_power_table;
+static u32 opp_power_table_size;
 
 static void __init omap_opp_set_min_rate(struct omap_opp_def *opp_def)
 {
@@ -146,6 +148,69 @@ int __init omap_init_opp_table(struct omap_opp_def *opp_def,
 	return 0;
 }
 
+/**
+ * omap_init_opp_power_table() - Initialize OPP power table per CPU type
+ * @power_def:		power estimates for this silicon
+ * @power_def_size:	number of entries for this silicon
+ *
+ * Store the power estimates so that omap_opp_get_power() can look them up.
+ */
+int __init omap_init_opp_power_table(struct omap_opp_power_def *power_def,
+			u32 power_def_size)
+{
+	if (!power_def || !power_def_size) {
+		pr_err("%s: invalid params!\n", __func__);
+		return -EINVAL;
+	}
+
+	if (!opp_power_table) {
+		opp_power_table = power_def;
+		opp_power_table_size = power_def_size;
+	}
+
+	return 0;
+}
+
+/**
+ * omap_opp_get_power() - Look up the power estimate of an OPP
+ * @hwmod_name:	hwmod name of the device
+ * @freq:	frequency of the OPP in hertz
+ * @busy_power:	set to the power in mW while running
+ * @idle_power:	set to the power in mW while idle
+ *
+ * OPP frequencies get rounded to what the clock can do when they are
+ * registered, so the entry closest to @freq is used.
+ *
+ * Returns 0 on success, -ENODEV if there is no estimate for the device.
+ */
+int omap_opp_get_power(const char *hwmod_name, unsigned long freq,
+		       unsigned int *busy_power, unsigned int *idle_power)
+{
+	struct omap_opp_power_def *def, *best = NULL;
+	unsigned long diff, best_diff = ULONG_MAX;
+	int i;
+
+	for (i = 0; i < opp_power_table_size; i++) {
+		def = &opp_power_table[i];
+		if (strcmp(hwmod_name, def->dev_info->hwmod_name))
+			continue;
+
+		diff = def->freq > freq ? def->freq - freq : freq - def->freq;
+		if (diff < best_diff) {
+			best = def;
+			best_diff = diff;
+		}
+	}
+
+	if (!best)
+		return -ENODEV;
+
+	*busy_power = best->busy_power;
+	*idle_power = best->idle_power;
+	return 0;
+}
+EXPORT_SYMBOL(omap_opp_get_power);
+
 /**
  * set_device_opp() - set the default OPP for devices that are not
  * registered
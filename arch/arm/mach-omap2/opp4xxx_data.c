@@ -267,6 +267,18 @@ static struct omap_opp_def omap443x_opp_def_list[] = {
 	/* TODO: add DSS */
 };
 
+/*
+ * MPU power per CPU, estimated from the OPP voltages: switched
+ * capacitance of 0.4nF plus leakage, idle is WFI with the CPU clock gated.
+ */
+static struct omap_opp_power_def omap443x_opp_power_list[] = {
+	OPP_POWER_INITIALIZER(&mpu_dev_info, 300000000, 153, 33),
+	OPP_POWER_INITIALIZER(&mpu_dev_info, 600000000, 389, 60),
+	OPP_POWER_INITIALIZER(&mpu_dev_info, 800000000, 620, 86),
+	OPP_POWER_INITIALIZER(&mpu_dev_info, 1008000000, 844, 106),
+	OPP_POWER_INITIALIZER(&mpu_dev_info, 1200000000, 993, 113),
+};
+
 #define OMAP4460_VDD_MPU_OPP50_UV		1025000
 #define OMAP4460_VDD_MPU_OPP100_UV		1203000
 #define OMAP4460_VDD_MPU_OPPTURBO_UV		1317000
@@ -409,6 +421,15 @@ static struct omap_opp_def omap446x_opp_def_list[] = {
 	/* TODO: Add DSS */
 };
 
+/* MPU power per CPU, estimated as for OMAP4430 */
+static struct omap_opp_power_def omap446x_opp_power_list[] = {
+	OPP_POWER_INITIALIZER(&omap4460_mpu_dev_info, 350000000, 174, 34),
+	OPP_POWER_INITIALIZER(&omap4460_mpu_dev_info, 700000000, 449, 64),
+	OPP_POWER_INITIALIZER(&omap4460_mpu_dev_info, 920000000, 695, 89),
+	OPP_POWER_INITIALIZER(&omap4460_mpu_dev_info, 1200000000, 980, 111),
+	OPP_POWER_INITIALIZER(&omap4460_mpu_dev_info, 1500000000, 1226, 125),
+};
+
 /*
  * Structures containing OMAP4470 voltage supported and various
  * voltage dependent data for each VDD.
@@ -642,6 +663,15 @@ static struct omap_opp_def omap447x_opp_high_def_list[] = {
 	/* TODO: Add DSS */
 };
 
+/* MPU power per CPU, estimated as for OMAP4430, same for both OPP sets */
+static struct omap_opp_power_def omap447x_opp_power_list[] = {
+	OPP_POWER_INITIALIZER(&omap4460_mpu_dev_info, 396800000, 199, 36),
+	OPP_POWER_INITIALIZER(&omap4460_mpu_dev_info, 800000000, 504, 66),
+	OPP_POWER_INITIALIZER(&omap4460_mpu_dev_info, 1100000000, 814, 94),
+	OPP_POWER_INITIALIZER(&omap4460_mpu_dev_info, 1300000000, 1048, 114),
+	OPP_POWER_INITIALIZER(&omap4460_mpu_dev_info, 1500000000, 1221, 124),
+};
+
 /*
  * opp_def_list_enable_opp() - enable opp by dev_info and frequency
  */
@@ -755,6 +785,8 @@ int __init omap4_opp_init(void)
 
 		r = omap_init_opp_table(omap443x_opp_def_list,
 			ARRAY_SIZE(omap443x_opp_def_list));
+		omap_init_opp_power_table(omap443x_opp_power_list,
+			ARRAY_SIZE(omap443x_opp_power_list));
 	} else if (cpu_is_omap446x()) {
 		omap4_abb_trim_update(omap446x_ldo_abb_trim_data);
 		if (omap4_has_perf_silicon()) {
@@ -769,11 +801,15 @@ int __init omap4_opp_init(void)
 		}
 		r = omap_init_opp_table(omap446x_opp_def_list,
 			ARRAY_SIZE(omap446x_opp_def_list));
+		omap_init_opp_power_table(omap446x_opp_power_list,
+			ARRAY_SIZE(omap446x_opp_power_list));
 	} else if (cpu_is_omap447x()) {
 		struct clk *dpll_core_ck;
 		unsigned long rate = 0;
 
 		omap4_abb_trim_update(omap447x_ldo_abb_trim_data);
+		omap_init_opp_power_table(omap447x_opp_power_list,
+			ARRAY_SIZE(omap447x_opp_power_list));
 
 		dpll_core_ck = clk_get(NULL, "dpll_core_ck");
 		BUG_ON(IS_ERR_OR_NULL(dpll_core_ck));
@@ -219,6 +219,17 @@ static struct omap_opp_def omap543x_opp_def_list[] = {
 	OPP_INITIALIZER(&gpu_dev_info, true, 531840000, OMAP54XX_VDD_MM_OPP_OD),
 };
 
+/*
+ * MPU power per CPU, estimated from the OPP voltages: switched
+ * capacitance of 0.55nF plus leakage, idle is WFI with the CPU clock gated.
+ */
+static struct omap_opp_power_def omap543x_opp_power_list[] = {
+	OPP_POWER_INITIALIZER(&mpu_dev_info, 499200000, 254, 52),
+	OPP_POWER_INITIALIZER(&mpu_dev_info, 1000000000, 689, 102),
+	OPP_POWER_INITIALIZER(&mpu_dev_info, 1500000000, 1406, 182),
+	OPP_POWER_INITIALIZER(&mpu_dev_info, 1699200000, 1604, 194),
+};
+
 /* OPP table modification function for use as needed */
 static int __init __maybe_unused opp_def_list_modify_opp(
 					  struct omap_opp_def *list,
@@ -280,6 +291,8 @@ int __init omap5_opp_init(void)
 
 	r = omap_init_opp_table(omap543x_opp_def_list,
 				ARRAY_SIZE(omap543x_opp_def_list));
+	omap_init_opp_power_table(omap543x_opp_power_list,
+				  ARRAY_SIZE(omap543x_opp_power_list));
 
 	return r;
 }
@@ -571,8 +571,12 @@ static int omap2_pm_qos_tput_handler(struct notifier_block *nb,
 	 * FIXME: fix algorithm to work on ALL SoCs in a proper manner
 	 * The equation used below is approximation for OMAP3 only.
 	 */
-	/* Convert the throughput(in KiB/s) into Hz. */
-	new_value = (new_value * 1000) / 4;
+	/*
+	 * Convert the throughput(in KiB/s) into Hz. The summed requests
+	 * can overflow 32 bits here; saturate and let the floor lookup
+	 * below pick the top OPP.
+	 */
+	new_value = min_t(u64, ((u64)new_value * 1000) / 4, ULONG_MAX);
 
 	freq_valid = new_value;
 	rcu_read_lock();
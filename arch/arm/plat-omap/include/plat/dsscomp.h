@@ -40,6 +40,9 @@ int dsscomp_get_mgr(struct dsscomp *comp, struct dss2_mgr_info *mgr);
 int dsscomp_setup(struct dsscomp *comp, enum dsscomp_setup_mode mode,
 			struct dss2_rect_t win);
 int dsscomp_delayed_apply(struct dsscomp *comp);
+struct sync_fence;
+int dsscomp_delayed_apply_sync(struct dsscomp *comp,
+			       struct sync_fence **release);
 void dsscomp_drop(struct dsscomp *c);
 
 struct tiler_pa_info;
@@ -47,6 +50,12 @@ int dsscomp_gralloc_queue(struct dsscomp_setup_dispc_data *d,
 			struct tiler_pa_info **pas,
 			bool early_callback,
 			void (*cb_fn)(void *, int), void *cb_arg);
+int dsscomp_gralloc_queue_sync(struct dsscomp_setup_dispc_data *d,
+			struct tiler_pa_info **pas,
+			struct sync_fence **acquire,
+			struct sync_fence **release,
+			bool early_callback,
+			void (*cb_fn)(void *, int), void *cb_arg);
 
 void dsscomp_set_platform_data(struct dsscomp_platform_data *data);
 
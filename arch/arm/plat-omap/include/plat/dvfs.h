@@ -14,6 +14,10 @@
 #ifndef __ARCH_ARM_MACH_OMAP2_DVFS_H
 #define __ARCH_ARM_MACH_OMAP2_DVFS_H
 
+/* opp.c is built regardless of CONFIG_PM */
+int omap_opp_get_power(const char *hwmod_name, unsigned long freq,
+		       unsigned int *busy_power, unsigned int *idle_power);
+
 #ifdef CONFIG_PM
 #include <linux/mutex.h>
 extern struct mutex omap_dvfs_lock;
@@ -21,11 +25,14 @@ extern struct mutex omap_dvfs_lock;
 int omap_dvfs_register_device(struct device *dev, char *voltdm_name,
 				char *clk_name);
 int omap_device_scale(struct device *target_dev, unsigned long rate);
+int omap_device_scale_floor(struct device *req_dev, struct device *target_dev,
+			    unsigned long rate);
 static inline bool omap_dvfs_is_any_dev_scaling(void)
 {
 	return mutex_is_locked(&omap_dvfs_lock);
 }
 int omap_opp_register(struct device *dev, const char *hwmod_name);
+unsigned int omap_dvfs_get_volt_slew(struct device *dev);
 void omap_dvfs_suspend(bool suspend);
 
 #else
@@ -39,10 +46,20 @@ static inline int omap_device_scale(struct device *target_dev,
 {
 	return 0;
 }
+static inline int omap_device_scale_floor(struct device *req_dev,
+					  struct device *target_dev,
+					  unsigned long rate)
+{
+	return 0;
+}
 static inline bool omap_dvfs_is_any_dev_scaling(void)
 {
 	return false;
 }
+static inline unsigned int omap_dvfs_get_volt_slew(struct device *dev)
+{
+	return 0;
+}
 void omap_dvfs_suspend(bool suspend) {}
 #endif
 #endif
@@ -108,13 +108,17 @@ static unsigned int __cpufreq_get(unsigned int cpu);
 static void handle_update(struct work_struct *work);
 
 /**
- * Two notifier lists: the "policy" list is involved in the
+ * Three notifier lists: the "policy" list is involved in the
  * validation process for a new CPU frequency policy; the
  * "transition" list for kernel code that needs to handle
- * changes to devices when the CPU clock speed changes.
- * The mutex locks both lists.
+ * changes to devices when the CPU clock speed changes; the
+ * "boost" list for platform code that scales other devices
+ * along with a governor boost.
+ * The blocking lists are serialized by their own rw semaphores; the
+ * transition list is an SRCU notifier.
  */
 static BLOCKING_NOTIFIER_HEAD(cpufreq_policy_notifier_list);
+static BLOCKING_NOTIFIER_HEAD(cpufreq_boost_notifier_list);
 static struct srcu_notifier_head cpufreq_transition_notifier_list;
 
 static bool init_cpufreq_transition_notifier_list_called;
@@ -284,6 +288,20 @@ void cpufreq_notify_transition(struct cpufreq_freqs *freqs, unsigned int state)
 }
 EXPORT_SYMBOL_GPL(cpufreq_notify_transition);
 
+/**
+ * cpufreq_notify_boost - call the boost notifier chain
+ * @state: CPUFREQ_BOOST_START or CPUFREQ_BOOST_END
+ *
+ * Called by governors from process context when they start or stop
+ * boosting the CPUs, so that the devices the CPUs depend on can follow.
+ */
+void cpufreq_notify_boost(unsigned int state)
+{
+	pr_debug("notification %u of boost\n", state);
+	blocking_notifier_call_chain(&cpufreq_boost_notifier_list, state, NULL);
+}
+EXPORT_SYMBOL_GPL(cpufreq_notify_boost);
+
 
 
 /*********************************************************************
@@ -1384,12 +1402,14 @@ static struct syscore_ops cpufreq_syscore_ops = {
 /**
  *	cpufreq_register_notifier - register a driver with cpufreq
  *	@nb: notifier function to register
- *      @list: CPUFREQ_TRANSITION_NOTIFIER or CPUFREQ_POLICY_NOTIFIER
+ *      @list: CPUFREQ_TRANSITION_NOTIFIER, CPUFREQ_POLICY_NOTIFIER or
+ *		CPUFREQ_BOOST_NOTIFIER
  *
- *	Add a driver to one of two lists: either a list of drivers that
+ *	Add a driver to one of three lists: either a list of drivers that
  *      are notified about clock rate changes (once before and once after
- *      the transition), or a list of drivers that are notified about
- *      changes in cpufreq policy.
+ *      the transition), a list of drivers that are notified about
+ *      changes in cpufreq policy, or a list of drivers that are notified
+ *      when a governor starts and stops boosting.
  *
  *	This function may sleep, and has the same return conditions as
  *	blocking_notifier_chain_register.
@@ -1409,6 +1429,10 @@ int cpufreq_register_notifier(struct notifier_block *nb, unsigned int list)
 		ret = blocking_notifier_chain_register(
 				&cpufreq_policy_notifier_list, nb);
 		break;
+	case CPUFREQ_BOOST_NOTIFIER:
+		ret = blocking_notifier_chain_register(
+				&cpufreq_boost_notifier_list, nb);
+		break;
 	default:
 		ret = -EINVAL;
 	}
@@ -1421,7 +1445,8 @@ EXPORT_SYMBOL(cpufreq_register_notifier);
 /**
  *	cpufreq_unregister_notifier - unregister a driver with cpufreq
  *	@nb: notifier block to be unregistered
- *      @list: CPUFREQ_TRANSITION_NOTIFIER or CPUFREQ_POLICY_NOTIFIER
+ *      @list: CPUFREQ_TRANSITION_NOTIFIER, CPUFREQ_POLICY_NOTIFIER or
+ *		CPUFREQ_BOOST_NOTIFIER
  *
  *	Remove a driver from the CPU frequency notifier list.
  *
@@ -1441,6 +1466,10 @@ int cpufreq_unregister_notifier(struct notifier_block *nb, unsigned int list)
 		ret = blocking_notifier_chain_unregister(
 				&cpufreq_policy_notifier_list, nb);
 		break;
+	case CPUFREQ_BOOST_NOTIFIER:
+		ret = blocking_notifier_chain_unregister(
+				&cpufreq_boost_notifier_list, nb);
+		break;
 	default:
 		ret = -EINVAL;
 	}
@@ -19,6 +19,8 @@
 #include <linux/cpu.h>
 #include <linux/cpumask.h>
 #include <linux/cpufreq.h>
+#include <linux/hrtimer.h>
+#include <linux/input.h>
 #include <linux/module.h>
 #include <linux/moduleparam.h>
 #include <linux/rwsem.h>
@@ -55,6 +57,10 @@ struct cpufreq_interactive_cpuinfo {
 	u64 hispeed_validate_time;
 	struct rw_semaphore enable_sem;
 	int governor_enabled;
+	struct update_util_data update_util;
+	u64 last_sched_eval;	/* rq clock of the last scheduler evaluation */
+	struct hrtimer kick_timer;	/* wakes speedchange_task */
+	unsigned int cpu;
 };
 
 static DEFINE_PER_CPU(struct cpufreq_interactive_cpuinfo, cpuinfo);
@@ -118,6 +124,58 @@ static int timer_slack_val = DEFAULT_TIMER_SLACK;
 
 static bool io_is_busy;
 
+/*
+ * Evaluate load when the scheduler reports enqueue, dequeue and tick
+ * events rather than only from the sampling timer, which then only runs
+ * to lower the speed of idle CPUs.
+ */
+static bool use_sched_load = true;
+
+/* Minimum time between two scheduler driven evaluations of a CPU */
+#define DEFAULT_SCHED_RATE (2 * USEC_PER_MSEC)
+static unsigned long sched_rate = DEFAULT_SCHED_RATE;
+
+/*
+ * When a task moves to a CPU, raise that CPU's target right away to the
+ * speed the task's recent utilization needs there.
+ */
+static bool migration_boost = true;
+
+/*
+ * Do the same when a task whose utilization is at or above this
+ * percentage wakes up on a CPU, 0 to disable.
+ */
+#define DEFAULT_WAKEUP_BOOST_LOAD 50
+static unsigned long wakeup_boost_load = DEFAULT_WAKEUP_BOOST_LOAD;
+
+/*
+ * If the cpufreq driver provides an energy model, run at the speed that
+ * costs the least energy over the next timer_rate among those fast enough
+ * for the load, rather than at the slowest of them.
+ */
+static bool energy_aware;
+
+/*
+ * Boost on touch, pen and key input without waiting for userspace to
+ * write boostpulse: speed to boost to (0 for hispeed_freq), how long the
+ * boost lasts in usecs (0 to disable) and the minimum time between two
+ * boosts.  Boosting also raises the devices registered on the cpufreq
+ * boost notifier list.
+ */
+static unsigned int input_boost_freq;
+static unsigned long input_boost_duration = DEFAULT_MIN_SAMPLE_TIME;
+#define DEFAULT_INPUT_BOOST_INTERVAL (40 * USEC_PER_MSEC)
+static unsigned long input_boost_interval = DEFAULT_INPUT_BOOST_INTERVAL;
+/* protects the input boost state and counters below */
+static spinlock_t input_boost_lock;
+static u64 input_boost_endtime;
+static u64 input_boost_last;
+static unsigned long input_boost_count;
+static unsigned long input_boost_suppressed;
+/* sends the boost notifications, only touched by input_boost_work */
+static struct delayed_work input_boost_work;
+static bool input_boost_notified;
+
 static int cpufreq_governor_interactive(struct cpufreq_policy *policy,
 		unsigned int event);
 
@@ -340,6 +398,60 @@ static unsigned int choose_freq(
 	return freq;
 }
 
+/*
+ * Among the speeds from @freq up to policy->max, all of which meet the
+ * target load, return the one which costs the least energy to run the
+ * current load for timer_rate, switching to it included.  Running faster
+ * pays off when it lets the CPU idle long enough at a cheaper voltage,
+ * staying put when the switch costs more than it saves.
+ */
+static unsigned int choose_freq_energy(
+	struct cpufreq_interactive_cpuinfo *pcpu, unsigned int loadadjfreq,
+	unsigned int freq)
+{
+	struct cpufreq_energy_model *model;
+	struct cpufreq_energy_state *state, *cur = NULL, *best = NULL;
+	unsigned int busy, lat;
+	u64 energy, best_energy = ULLONG_MAX;
+
+	model = cpufreq_energy_model_get(pcpu->policy->cpu);
+	if (!model)
+		return freq;
+
+	for (state = model->states; state->frequency != CPUFREQ_TABLE_END;
+	     state++)
+		if (state->frequency == pcpu->target_freq)
+			cur = state;
+
+	for (state = model->states; state->frequency != CPUFREQ_TABLE_END;
+	     state++) {
+		if (state->frequency < freq ||
+		    state->frequency > pcpu->policy->max)
+			continue;
+
+		/* percentage of the window spent running at this speed */
+		busy = min(loadadjfreq / state->frequency, 100U);
+		energy = (u64)timer_rate *
+			(busy * state->busy_power +
+			 (100 - busy) * state->idle_power);
+		do_div(energy, 100);
+
+		if (cur) {
+			lat = cpufreq_energy_transition_latency(model, cur,
+								state);
+			energy += (u64)lat * max(cur->busy_power,
+						 state->busy_power);
+		}
+
+		if (energy < best_energy) {
+			best_energy = energy;
+			best = state;
+		}
+	}
+
+	return best ? best->frequency : freq;
+}
+
 static u64 update_load(int cpu)
 {
 	struct cpufreq_interactive_cpuinfo *pcpu = &per_cpu(cpuinfo, cpu);
@@ -365,33 +477,49 @@ static u64 update_load(int cpu)
 	return now;
 }
 
-static void cpufreq_interactive_timer(unsigned long data)
+/*
+ * Re-evaluate the target speed of a CPU from its load since the previous
+ * evaluation.  Returns 1 if the target changed and speedchange_task must
+ * be woken, 0 if it did not change, or -1 if the decision was deferred and
+ * the load should be sampled again later.
+ */
+static int cpufreq_interactive_eval(unsigned int cpu, bool sched)
 {
 	u64 now;
 	unsigned int delta_time;
 	u64 cputime_speedadj;
 	int cpu_load;
 	struct cpufreq_interactive_cpuinfo *pcpu =
-		&per_cpu(cpuinfo, data);
+		&per_cpu(cpuinfo, cpu);
 	unsigned int new_freq;
 	unsigned int loadadjfreq;
 	unsigned int index;
 	unsigned long flags;
 	bool boosted;
-
-	if (!down_read_trylock(&pcpu->enable_sem))
-		return;
-	if (!pcpu->governor_enabled)
-		goto exit;
+	unsigned int input_freq = 0;
+	u64 input_endtime;
 
 	spin_lock_irqsave(&pcpu->load_lock, flags);
-	now = update_load(data);
+	now = update_load(cpu);
 	delta_time = (unsigned int)(now - pcpu->cputime_speedadj_timestamp);
 	cputime_speedadj = pcpu->cputime_speedadj;
+	if (delta_time) {
+		/* the next evaluation looks at the load from now on */
+		pcpu->cputime_speedadj = 0;
+		pcpu->cputime_speedadj_timestamp = now;
+	}
 	spin_unlock_irqrestore(&pcpu->load_lock, flags);
 
-	if (WARN_ON_ONCE(!delta_time))
-		goto rearm;
+	/* scheduler events may come faster than the idle time clock */
+	if (!delta_time) {
+		WARN_ON_ONCE(!sched);
+		return -1;
+	}
+
+	/* a u64 may be read torn without the lock */
+	spin_lock_irqsave(&input_boost_lock, flags);
+	input_endtime = input_boost_endtime;
+	spin_unlock_irqrestore(&input_boost_lock, flags);
 
 	spin_lock_irqsave(&pcpu->target_freq_lock, flags);
 	do_div(cputime_speedadj, delta_time);
@@ -412,15 +540,27 @@ static void cpufreq_interactive_timer(unsigned long data)
 		new_freq = choose_freq(pcpu, loadadjfreq);
 	}
 
+	if (now < input_endtime) {
+		input_freq = input_boost_freq ? input_boost_freq : hispeed_freq;
+		if (new_freq < input_freq)
+			new_freq = input_freq;
+	}
+
+	if (energy_aware)
+		new_freq = choose_freq_energy(pcpu, loadadjfreq, new_freq);
+
+	trace_cpufreq_interactive_load(cpu, cpu_load, pcpu->policy->cur,
+				       new_freq, delta_time, sched);
+
 	if (pcpu->target_freq >= hispeed_freq &&
 	    new_freq > pcpu->target_freq &&
 	    now - pcpu->hispeed_validate_time <
 	    freq_to_above_hispeed_delay(pcpu->target_freq)) {
 		trace_cpufreq_interactive_notyet(
-			data, cpu_load, pcpu->target_freq,
+			cpu, cpu_load, pcpu->target_freq,
 			pcpu->policy->cur, new_freq);
 		spin_unlock_irqrestore(&pcpu->target_freq_lock, flags);
-		goto rearm;
+		return -1;
 	}
 
 	pcpu->hispeed_validate_time = now;
@@ -429,7 +569,7 @@ static void cpufreq_interactive_timer(unsigned long data)
 					   new_freq, CPUFREQ_RELATION_L,
 					   &index)) {
 		spin_unlock_irqrestore(&pcpu->target_freq_lock, flags);
-		goto rearm;
+		return -1;
 	}
 
 	new_freq = pcpu->freq_table[index].frequency;
@@ -441,10 +581,10 @@ static void cpufreq_interactive_timer(unsigned long data)
 	if (new_freq < pcpu->floor_freq) {
 		if (now - pcpu->floor_validate_time < min_sample_time) {
 			trace_cpufreq_interactive_notyet(
-				data, cpu_load, pcpu->target_freq,
+				cpu, cpu_load, pcpu->target_freq,
 				pcpu->policy->cur, new_freq);
 			spin_unlock_irqrestore(&pcpu->target_freq_lock, flags);
-			goto rearm;
+			return -1;
 		}
 	}
 
@@ -453,41 +593,60 @@ static void cpufreq_interactive_timer(unsigned long data)
 	 * or above the selected frequency for a minimum of min_sample_time,
 	 * if not boosted to hispeed_freq.  If boosted to hispeed_freq then we
 	 * allow the speed to drop as soon as the boostpulse duration expires
-	 * (or the indefinite boost is turned off).
+	 * (or the indefinite boost is turned off).  Same for input boosts.
 	 */
 
-	if (!boosted || new_freq > hispeed_freq) {
+	if ((!boosted || new_freq > hispeed_freq) &&
+	    (!input_freq || new_freq > input_freq)) {
 		pcpu->floor_freq = new_freq;
 		pcpu->floor_validate_time = now;
 	}
 
 	if (pcpu->target_freq == new_freq) {
 		trace_cpufreq_interactive_already(
-			data, cpu_load, pcpu->target_freq,
+			cpu, cpu_load, pcpu->target_freq,
 			pcpu->policy->cur, new_freq);
 		spin_unlock_irqrestore(&pcpu->target_freq_lock, flags);
-		goto rearm_if_notmax;
+		return 0;
 	}
 
-	trace_cpufreq_interactive_target(data, cpu_load, pcpu->target_freq,
+	trace_cpufreq_interactive_target(cpu, cpu_load, pcpu->target_freq,
 					 pcpu->policy->cur, new_freq);
 
 	pcpu->target_freq = new_freq;
 	spin_unlock_irqrestore(&pcpu->target_freq_lock, flags);
 	spin_lock_irqsave(&speedchange_cpumask_lock, flags);
-	cpumask_set_cpu(data, &speedchange_cpumask);
+	cpumask_set_cpu(cpu, &speedchange_cpumask);
 	spin_unlock_irqrestore(&speedchange_cpumask_lock, flags);
-	wake_up_process(speedchange_task);
+	return 1;
+}
+
+static void cpufreq_interactive_timer(unsigned long data)
+{
+	struct cpufreq_interactive_cpuinfo *pcpu =
+		&per_cpu(cpuinfo, data);
+	int ret;
+
+	if (!down_read_trylock(&pcpu->enable_sem))
+		return;
+	if (!pcpu->governor_enabled)
+		goto exit;
+
+	ret = cpufreq_interactive_eval(data, false);
+	if (ret > 0)
+		wake_up_process(speedchange_task);
 
-rearm_if_notmax:
 	/*
 	 * Already set max speed and don't see a need to change that,
 	 * wait until next idle to re-evaluate, don't need timer.
 	 */
-	if (pcpu->target_freq == pcpu->policy->max)
+	if (ret >= 0 && pcpu->target_freq == pcpu->policy->max)
+		goto exit;
+
+	/* The scheduler reports the load of busy CPUs */
+	if (use_sched_load && !idle_cpu(data))
 		goto exit;
 
-rearm:
 	if (!timer_pending(&pcpu->cpu_timer))
 		cpufreq_interactive_timer_resched(pcpu);
 
@@ -496,6 +655,118 @@ exit:
 	return;
 }
 
+/*
+ * Raise the target of a CPU to the speed a task that just woke up or moved
+ * there needs, given its utilization measured at the current speed.  The
+ * floor is set as for a boost, so that the next load evaluations, which
+ * have not seen the task run yet, do not undo it before min_sample_time.
+ * Returns 1 if the target changed.
+ */
+static int cpufreq_interactive_task_boost(
+	struct cpufreq_interactive_cpuinfo *pcpu, unsigned int flags,
+	unsigned long util)
+{
+	unsigned int loadadjfreq, new_freq;
+	unsigned int index;
+	unsigned long irqflags;
+	u64 now;
+	int ret = 0;
+
+	if (flags & SCHED_CPUFREQ_MIGRATION) {
+		if (!migration_boost)
+			return 0;
+	} else if (!wakeup_boost_load ||
+		   util * 100 < wakeup_boost_load * SCHED_UTIL_SCALE) {
+		return 0;
+	}
+
+	spin_lock_irqsave(&pcpu->target_freq_lock, irqflags);
+	loadadjfreq = (unsigned int)((u64)util * pcpu->policy->cur * 100 >>
+				     SCHED_UTIL_SHIFT);
+	new_freq = choose_freq(pcpu, loadadjfreq);
+	if (new_freq <= pcpu->target_freq ||
+	    cpufreq_frequency_table_target(pcpu->policy, pcpu->freq_table,
+					   new_freq, CPUFREQ_RELATION_L,
+					   &index))
+		goto out;
+
+	new_freq = pcpu->freq_table[index].frequency;
+	trace_cpufreq_interactive_taskboost(pcpu->cpu, util,
+					    pcpu->target_freq, new_freq,
+					    flags & SCHED_CPUFREQ_MIGRATION);
+
+	now = ktime_to_us(ktime_get());
+	pcpu->target_freq = new_freq;
+	pcpu->floor_freq = new_freq;
+	pcpu->floor_validate_time = now;
+	pcpu->hispeed_validate_time = now;
+	ret = 1;
+
+out:
+	spin_unlock_irqrestore(&pcpu->target_freq_lock, irqflags);
+	if (ret) {
+		spin_lock_irqsave(&speedchange_cpumask_lock, irqflags);
+		cpumask_set_cpu(pcpu->cpu, &speedchange_cpumask);
+		spin_unlock_irqrestore(&speedchange_cpumask_lock, irqflags);
+	}
+	return ret;
+}
+
+/*
+ * Wake speedchange_task from scheduler context.  On ARM an irq_work only
+ * runs from the next tick, which NO_HZ may put off, so use a pinned hrtimer
+ * shortly ahead instead.  It is armed without waking ksoftirqd, which would
+ * take the runqueue lock held here.
+ */
+#define SPEEDCHANGE_KICK_NS	(10 * NSEC_PER_USEC)
+
+static enum hrtimer_restart cpufreq_interactive_kick_timer(
+	struct hrtimer *timer)
+{
+	wake_up_process(speedchange_task);
+	return HRTIMER_NORESTART;
+}
+
+static void cpufreq_interactive_kick(struct cpufreq_interactive_cpuinfo *pcpu)
+{
+	if (!hrtimer_is_queued(&pcpu->kick_timer))
+		__hrtimer_start_range_ns(&pcpu->kick_timer,
+					 ns_to_ktime(SPEEDCHANGE_KICK_NS), 0,
+					 HRTIMER_MODE_REL_PINNED, 0);
+}
+
+/*
+ * Scheduler callback, runs under the runqueue lock of pcpu->cpu.  The
+ * update_util pointer is only set while the governor is enabled, so
+ * enable_sem is not needed here; releasing it could wake a writer under
+ * the runqueue lock.
+ */
+static void cpufreq_interactive_update_util(struct update_util_data *data,
+					    u64 time, unsigned int flags,
+					    unsigned long util)
+{
+	struct cpufreq_interactive_cpuinfo *pcpu =
+		container_of(data, struct cpufreq_interactive_cpuinfo,
+			     update_util);
+
+	if (!pcpu->governor_enabled)
+		return;
+
+	if (flags && util &&
+	    cpufreq_interactive_task_boost(pcpu, flags, util))
+		cpufreq_interactive_kick(pcpu);
+
+	if (!use_sched_load)
+		return;
+
+	if (time - pcpu->last_sched_eval < (u64)sched_rate * NSEC_PER_USEC)
+		return;
+	pcpu->last_sched_eval = time;
+
+	if (cpufreq_interactive_eval(pcpu->cpu, true) > 0)
+		cpufreq_interactive_kick(pcpu);
+}
+
 static void cpufreq_interactive_idle_start(void)
 {
 	struct cpufreq_interactive_cpuinfo *pcpu =
@@ -539,8 +810,12 @@ static void cpufreq_interactive_idle_end(void)
 		return;
 	}
 
-	/* Arm the timer for 1-2 ticks later if not already. */
-	if (!timer_pending(&pcpu->cpu_timer)) {
+	if (use_sched_load) {
+		/* Busy again, the scheduler reports the load from now on */
+		del_timer(&pcpu->cpu_timer);
+		del_timer(&pcpu->cpu_slack_timer);
+	} else if (!timer_pending(&pcpu->cpu_timer)) {
+		/* Arm the timer for 1-2 ticks later if not already. */
 		cpufreq_interactive_timer_resched(pcpu);
 	} else if (time_after_eq(jiffies, pcpu->cpu_timer.expires)) {
 		del_timer(&pcpu->cpu_timer);
@@ -613,7 +888,7 @@ static int cpufreq_interactive_speedchange_task(void *data)
 	return 0;
 }
 
-static void cpufreq_interactive_boost(void)
+static void cpufreq_interactive_boost(unsigned int freq)
 {
 	int i;
 	int anyboost = 0;
@@ -625,8 +900,8 @@ static void cpufreq_interactive_boost(void)
 	for_each_online_cpu(i) {
 		pcpu = &per_cpu(cpuinfo, i);
 		spin_lock_irqsave(&pcpu->target_freq_lock, flags[1]);
-		if (pcpu->target_freq < hispeed_freq) {
-			pcpu->target_freq = hispeed_freq;
+		if (pcpu->target_freq < freq) {
+			pcpu->target_freq = freq;
 			cpumask_set_cpu(i, &speedchange_cpumask);
 			pcpu->hispeed_validate_time =
 				ktime_to_us(ktime_get());
@@ -638,7 +913,7 @@ static void cpufreq_interactive_boost(void)
 		 * validated.
 		 */
 
-		pcpu->floor_freq = hispeed_freq;
+		pcpu->floor_freq = freq;
 		pcpu->floor_validate_time = ktime_to_us(ktime_get());
 		spin_unlock_irqrestore(&pcpu->target_freq_lock, flags[1]);
 	}
@@ -649,6 +924,160 @@ static void cpufreq_interactive_boost(void)
 		wake_up_process(speedchange_task);
 }
 
+/*
+ * Tell the boost notifier list when an input boost starts and when it
+ * ends.  Runs on the non-reentrant workqueue, so the notifications are
+ * serialized and come in START/END pairs.
+ */
+static void cpufreq_interactive_input_boost_work(struct work_struct *work)
+{
+	unsigned long flags;
+	u64 now, endtime;
+
+	spin_lock_irqsave(&input_boost_lock, flags);
+	endtime = input_boost_endtime;
+	spin_unlock_irqrestore(&input_boost_lock, flags);
+	now = ktime_to_us(ktime_get());
+
+	if (now < endtime) {
+		if (!input_boost_notified) {
+			input_boost_notified = true;
+			cpufreq_notify_boost(CPUFREQ_BOOST_START);
+		}
+		/* check again when it expires, later input may extend it */
+		queue_delayed_work(system_nrt_wq, &input_boost_work,
+				   usecs_to_jiffies(endtime - now));
+	} else if (input_boost_notified) {
+		input_boost_notified = false;
+		cpufreq_notify_boost(CPUFREQ_BOOST_END);
+	}
+}
+
+static void cpufreq_interactive_input_event(struct input_handle *handle,
+		unsigned int type, unsigned int code, int value)
+{
+	unsigned long flags;
+	u64 now;
+
+	/* one boost decision per input frame */
+	if (type != EV_SYN || code != SYN_REPORT || !input_boost_duration)
+		return;
+
+	now = ktime_to_us(ktime_get());
+	spin_lock_irqsave(&input_boost_lock, flags);
+	if (input_boost_last &&
+	    now - input_boost_last < input_boost_interval) {
+		input_boost_suppressed++;
+		spin_unlock_irqrestore(&input_boost_lock, flags);
+		return;
+	}
+	input_boost_last = now;
+	input_boost_endtime = now + input_boost_duration;
+	input_boost_count++;
+	spin_unlock_irqrestore(&input_boost_lock, flags);
+
+	trace_cpufreq_interactive_boost("input");
+	cpufreq_interactive_boost(input_boost_freq ?
+				  input_boost_freq : hispeed_freq);
+	queue_delayed_work(system_nrt_wq, &input_boost_work, 0);
+}
+
+static int cpufreq_interactive_input_connect(struct input_handler *handler,
+		struct input_dev *dev, const struct input_device_id *id)
+{
+	struct input_handle *handle;
+	int error;
+
+	handle = kzalloc(sizeof(struct input_handle), GFP_KERNEL);
+	if (!handle)
+		return -ENOMEM;
+
+	handle->dev = dev;
+	handle->handler = handler;
+	handle->name = "cpufreq_interactive";
+
+	error = input_register_handle(handle);
+	if (error)
+		goto err_free;
+
+	error = input_open_device(handle);
+	if (error)
+		goto err_unregister;
+
+	return 0;
+
+err_unregister:
+	input_unregister_handle(handle);
+err_free:
+	kfree(handle);
+	return error;
+}
+
+static void cpufreq_interactive_input_disconnect(struct input_handle *handle)
+{
+	input_close_device(handle);
+	input_unregister_handle(handle);
+	kfree(handle);
+}
+
+static const struct input_device_id cpufreq_interactive_ids[] = {
+	/* multi-touch touchscreen */
+	{
+		.flags = INPUT_DEVICE_ID_MATCH_EVBIT |
+			 INPUT_DEVICE_ID_MATCH_ABSBIT,
+		.evbit = { BIT_MASK(EV_ABS) },
+		.absbit = { [BIT_WORD(ABS_MT_POSITION_X)] =
+			    BIT_MASK(ABS_MT_POSITION_X) |
+			    BIT_MASK(ABS_MT_POSITION_Y) },
+	},
+	/* single touch touchscreen and touchpad */
+	{
+		.flags = INPUT_DEVICE_ID_MATCH_KEYBIT |
+			 INPUT_DEVICE_ID_MATCH_ABSBIT,
+		.keybit = { [BIT_WORD(BTN_TOUCH)] = BIT_MASK(BTN_TOUCH) },
+		.absbit = { [BIT_WORD(ABS_X)] =
+			    BIT_MASK(ABS_X) | BIT_MASK(ABS_Y) },
+	},
+	/* pen */
+	{
+		.flags = INPUT_DEVICE_ID_MATCH_EVBIT |
+			 INPUT_DEVICE_ID_MATCH_KEYBIT,
+		.evbit = { BIT_MASK(EV_KEY) },
+		.keybit = { [BIT_WORD(BTN_TOOL_PEN)] =
+			    BIT_MASK(BTN_TOOL_PEN) },
+	},
+	/* keyboards and keypads */
+	{
+		.flags = INPUT_DEVICE_ID_MATCH_EVBIT |
+			 INPUT_DEVICE_ID_MATCH_KEYBIT,
+		.evbit = { BIT_MASK(EV_KEY) },
+		.keybit = { [BIT_WORD(KEY_ENTER)] = BIT_MASK(KEY_ENTER) },
+	},
+	/* power and volume buttons */
+	{
+		.flags = INPUT_DEVICE_ID_MATCH_EVBIT |
+			 INPUT_DEVICE_ID_MATCH_KEYBIT,
+		.evbit = { BIT_MASK(EV_KEY) },
+		.keybit = { [BIT_WORD(KEY_POWER)] = BIT_MASK(KEY_POWER) },
+	},
+	{
+		.flags = INPUT_DEVICE_ID_MATCH_EVBIT |
+			 INPUT_DEVICE_ID_MATCH_KEYBIT,
+		.evbit = { BIT_MASK(EV_KEY) },
+		.keybit = { [BIT_WORD(KEY_VOLUMEUP)] =
+			    BIT_MASK(KEY_VOLUMEUP) },
+	},
+	{ },
+};
+
+static struct input_handler cpufreq_interactive_input_handler = {
+	.event		= cpufreq_interactive_input_event,
+	.connect	= cpufreq_interactive_input_connect,
+	.disconnect	= cpufreq_interactive_input_disconnect,
+	.name		= "cpufreq_interactive",
+	.id_table	= cpufreq_interactive_ids,
+};
+
 static int cpufreq_interactive_notifier(
 	struct notifier_block *nb, unsigned long val, void *data)
 {
@@ -958,7 +1387,7 @@ static ssize_t store_boost(struct kobject *kobj, struct attribute *attr,
 
 	if (boost_val) {
 		trace_cpufreq_interactive_boost("on");
-		cpufreq_interactive_boost();
+		cpufreq_interactive_boost(hispeed_freq);
 	} else {
 		boostpulse_endtime = ktime_to_us(ktime_get());
 		trace_cpufreq_interactive_unboost("off");
@@ -981,7 +1410,7 @@ static ssize_t store_boostpulse(struct kobject *kobj, struct attribute *attr,
 
 	boostpulse_endtime = ktime_to_us(ktime_get()) + boostpulse_duration_val;
 	trace_cpufreq_interactive_boost("pulse");
-	cpufreq_interactive_boost();
+	cpufreq_interactive_boost(hispeed_freq);
 	return count;
 }
 
@@ -1033,6 +1462,211 @@ static ssize_t store_io_is_busy(struct kobject *kobj,
 static struct global_attr io_is_busy_attr = __ATTR(io_is_busy, 0644,
 		show_io_is_busy, store_io_is_busy);
 
+static ssize_t show_use_sched_load(struct kobject *kobj,
+			struct attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", use_sched_load);
+}
+
+static ssize_t store_use_sched_load(struct kobject *kobj,
+			struct attribute *attr, const char *buf, size_t count)
+{
+	int ret;
+	unsigned long val;
+
+	ret = kstrtoul(buf, 0, &val);
+	if (ret < 0)
+		return ret;
+	if (val > 1)
+		return -EINVAL;
+	use_sched_load = val;
+	return count;
+}
+
+static struct global_attr use_sched_load_attr = __ATTR(use_sched_load, 0644,
+		show_use_sched_load, store_use_sched_load);
+
+static ssize_t show_sched_rate(struct kobject *kobj,
+			struct attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", sched_rate);
+}
+
+static ssize_t store_sched_rate(struct kobject *kobj,
+			struct attribute *attr, const char *buf, size_t count)
+{
+	int ret;
+	unsigned long val;
+
+	ret = kstrtoul(buf, 0, &val);
+	if (ret < 0)
+		return ret;
+	if (!val || val > USEC_PER_SEC)
+		return -EINVAL;
+	sched_rate = val;
+	return count;
+}
+
+static struct global_attr sched_rate_attr = __ATTR(sched_rate, 0644,
+		show_sched_rate, store_sched_rate);
+
+static ssize_t show_migration_boost(struct kobject *kobj,
+			struct attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", migration_boost);
+}
+
+static ssize_t store_migration_boost(struct kobject *kobj,
+			struct attribute *attr, const char *buf, size_t count)
+{
+	int ret;
+	unsigned long val;
+
+	ret = kstrtoul(buf, 0, &val);
+	if (ret < 0)
+		return ret;
+	if (val > 1)
+		return -EINVAL;
+	migration_boost = val;
+	return count;
+}
+
+static struct global_attr migration_boost_attr = __ATTR(migration_boost,
+		0644, show_migration_boost, store_migration_boost);
+
+static ssize_t show_wakeup_boost_load(struct kobject *kobj,
+			struct attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", wakeup_boost_load);
+}
+
+static ssize_t store_wakeup_boost_load(struct kobject *kobj,
+			struct attribute *attr, const char *buf, size_t count)
+{
+	int ret;
+	unsigned long val;
+
+	ret = kstrtoul(buf, 0, &val);
+	if (ret < 0)
+		return ret;
+	if (val > 100)
+		return -EINVAL;
+	wakeup_boost_load = val;
+	return count;
+}
+
+static struct global_attr wakeup_boost_load_attr = __ATTR(wakeup_boost_load,
+		0644, show_wakeup_boost_load, store_wakeup_boost_load);
+
+static ssize_t show_energy_aware(struct kobject *kobj,
+			struct attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", energy_aware);
+}
+
+static ssize_t store_energy_aware(struct kobject *kobj,
+			struct attribute *attr, const char *buf, size_t count)
+{
+	int ret;
+	unsigned long val;
+
+	ret = kstrtoul(buf, 0, &val);
+	if (ret < 0)
+		return ret;
+	energy_aware = val;
+	return count;
+}
+
+static struct global_attr energy_aware_attr = __ATTR(energy_aware, 0644,
+		show_energy_aware, store_energy_aware);
+
+static ssize_t show_input_boost_freq(struct kobject *kobj,
+			struct attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", input_boost_freq);
+}
+
+static ssize_t store_input_boost_freq(struct kobject *kobj,
+			struct attribute *attr, const char *buf, size_t count)
+{
+	int ret;
+	unsigned long val;
+
+	ret = kstrtoul(buf, 0, &val);
+	if (ret < 0)
+		return ret;
+	input_boost_freq = val;
+	return count;
+}
+
+static struct global_attr input_boost_freq_attr = __ATTR(input_boost_freq,
+		0644, show_input_boost_freq, store_input_boost_freq);
+
+static ssize_t show_input_boost_duration(struct kobject *kobj,
+			struct attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", input_boost_duration);
+}
+
+static ssize_t store_input_boost_duration(struct kobject *kobj,
+			struct attribute *attr, const char *buf, size_t count)
+{
+	int ret;
+	unsigned long val;
+
+	ret = kstrtoul(buf, 0, &val);
+	if (ret < 0)
+		return ret;
+	input_boost_duration = val;
+	return count;
+}
+
+static struct global_attr input_boost_duration_attr =
+	__ATTR(input_boost_duration, 0644, show_input_boost_duration,
+	       store_input_boost_duration);
+
+static ssize_t show_input_boost_interval(struct kobject *kobj,
+			struct attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", input_boost_interval);
+}
+
+static ssize_t store_input_boost_interval(struct kobject *kobj,
+			struct attribute *attr, const char *buf, size_t count)
+{
+	int ret;
+	unsigned long val;
+
+	ret = kstrtoul(buf, 0, &val);
+	if (ret < 0)
+		return ret;
+	input_boost_interval = val;
+	return count;
+}
+
+static struct global_attr input_boost_interval_attr =
+	__ATTR(input_boost_interval, 0644, show_input_boost_interval,
+	       store_input_boost_interval);
+
+static ssize_t show_input_boost_count(struct kobject *kobj,
+			struct attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", input_boost_count);
+}
+
+static struct global_attr input_boost_count_attr = __ATTR(input_boost_count,
+		0444, show_input_boost_count, NULL);
+
+static ssize_t show_input_boost_suppressed(struct kobject *kobj,
+			struct attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", input_boost_suppressed);
+}
+
+static struct global_attr input_boost_suppressed_attr =
+	__ATTR(input_boost_suppressed, 0444, show_input_boost_suppressed,
+	       NULL);
+
 static struct attribute *interactive_attributes[] = {
 	&target_loads_attr.attr,
 	&above_hispeed_delay_attr.attr,
@@ -1045,6 +1679,16 @@ static struct attribute *interactive_attributes[] = {
 	&boostpulse.attr,
 	&boostpulse_duration.attr,
 	&io_is_busy_attr.attr,
+	&use_sched_load_attr.attr,
+	&sched_rate_attr.attr,
+	&migration_boost_attr.attr,
+	&wakeup_boost_load_attr.attr,
+	&input_boost_freq_attr.attr,
+	&input_boost_duration_attr.attr,
+	&input_boost_interval_attr.attr,
+	&input_boost_count_attr.attr,
+	&input_boost_suppressed_attr.attr,
+	&energy_aware_attr.attr,
 	NULL,
 };
 
@@ -1109,6 +1753,7 @@ static int cpufreq_governor_interactive(struct cpufreq_policy *policy,
 			cpufreq_interactive_timer_start(j);
 			pcpu->governor_enabled = 1;
 			up_write(&pcpu->enable_sem);
+			cpufreq_set_update_util_data(j, &pcpu->update_util);
 		}
 
 		/*
@@ -1130,13 +1775,22 @@ static int cpufreq_governor_interactive(struct cpufreq_policy *policy,
 		idle_notifier_register(&cpufreq_interactive_idle_nb);
 		cpufreq_register_notifier(
 			&cpufreq_notifier_block, CPUFREQ_TRANSITION_NOTIFIER);
+		if (input_register_handler(&cpufreq_interactive_input_handler))
+			pr_warn("%s: failed to register input handler\n",
+				__func__);
 		mutex_unlock(&gov_lock);
 		break;
 
 	case CPUFREQ_GOV_STOP:
 		mutex_lock(&gov_lock);
+		for_each_cpu(j, policy->cpus)
+			cpufreq_set_update_util_data(j, NULL);
+		/* wait for scheduler callbacks still looking at the policy */
+		synchronize_sched();
+
 		for_each_cpu(j, policy->cpus) {
 			pcpu = &per_cpu(cpuinfo, j);
+			hrtimer_cancel(&pcpu->kick_timer);
 			down_write(&pcpu->enable_sem);
 			pcpu->governor_enabled = 0;
 			del_timer_sync(&pcpu->cpu_timer);
@@ -1149,6 +1803,16 @@ static int cpufreq_governor_interactive(struct cpufreq_policy *policy,
 			return 0;
 		}
 
+		input_unregister_handler(&cpufreq_interactive_input_handler);
+		spin_lock_irqsave(&input_boost_lock, flags);
+		input_boost_endtime = 0;
+		spin_unlock_irqrestore(&input_boost_lock, flags);
+		cancel_delayed_work_sync(&input_boost_work);
+		if (input_boost_notified) {
+			input_boost_notified = false;
+			cpufreq_notify_boost(CPUFREQ_BOOST_END);
+		}
+
 		cpufreq_unregister_notifier(
 			&cpufreq_notifier_block, CPUFREQ_TRANSITION_NOTIFIER);
 		idle_notifier_unregister(&cpufreq_interactive_idle_nb);
@@ -1226,11 +1890,19 @@ static int __init cpufreq_interactive_init(void)
 		spin_lock_init(&pcpu->load_lock);
 		spin_lock_init(&pcpu->target_freq_lock);
 		init_rwsem(&pcpu->enable_sem);
+		pcpu->update_util.func = cpufreq_interactive_update_util;
+		hrtimer_init(&pcpu->kick_timer, CLOCK_MONOTONIC,
+			     HRTIMER_MODE_REL);
+		pcpu->kick_timer.function = cpufreq_interactive_kick_timer;
+		pcpu->cpu = i;
 	}
 
 	spin_lock_init(&target_loads_lock);
 	spin_lock_init(&speedchange_cpumask_lock);
 	spin_lock_init(&above_hispeed_delay_lock);
+	spin_lock_init(&input_boost_lock);
+	INIT_DELAYED_WORK(&input_boost_work,
+			  cpufreq_interactive_input_boost_work);
 	mutex_init(&gov_lock);
 	speedchange_task =
 		kthread_create(cpufreq_interactive_speedchange_task, NULL,
@@ -231,6 +231,63 @@ struct cpufreq_frequency_table *cpufreq_frequency_get_table(unsigned int cpu)
 }
 EXPORT_SYMBOL_GPL(cpufreq_frequency_get_table);
 
+static DEFINE_PER_CPU(struct cpufreq_energy_model *, cpufreq_energy_model);
+/**
+ * show_energy_model - show the energy model for the specified CPU
+ *
+ * One line per state: frequency (kHz), voltage (uV), busy and idle
+ * power (mW), then the supply slew rate (uV/us) and switch latency (us).
+ */
+static ssize_t show_energy_model(struct cpufreq_policy *policy, char *buf)
+{
+	struct cpufreq_energy_model *model;
+	struct cpufreq_energy_state *state;
+	ssize_t count = 0;
+
+	model = per_cpu(cpufreq_energy_model, policy->cpu);
+	if (!model)
+		return -ENODEV;
+
+	for (state = model->states; state->frequency != CPUFREQ_TABLE_END;
+	     state++)
+		count += sprintf(&buf[count], "%u %u %u %u\n",
+				 state->frequency, state->u_volt,
+				 state->busy_power, state->idle_power);
+	count += sprintf(&buf[count], "slew %u latency %u\n",
+			 model->volt_slew, model->switch_latency);
+
+	return count;
+}
+
+struct freq_attr cpufreq_freq_attr_energy_model = {
+	.attr = { .name = "energy_model",
+		  .mode = 0444,
+		},
+	.show = show_energy_model,
+};
+EXPORT_SYMBOL_GPL(cpufreq_freq_attr_energy_model);
+
+void cpufreq_energy_model_get_attr(struct cpufreq_energy_model *model,
+				   unsigned int cpu)
+{
+	pr_debug("setting energy model for cpu %u to %p\n", cpu, model);
+	per_cpu(cpufreq_energy_model, cpu) = model;
+}
+EXPORT_SYMBOL_GPL(cpufreq_energy_model_get_attr);
+
+void cpufreq_energy_model_put_attr(unsigned int cpu)
+{
+	pr_debug("clearing energy model for cpu %u\n", cpu);
+	per_cpu(cpufreq_energy_model, cpu) = NULL;
+}
+EXPORT_SYMBOL_GPL(cpufreq_energy_model_put_attr);
+
+struct cpufreq_energy_model *cpufreq_energy_model_get(unsigned int cpu)
+{
+	return per_cpu(cpufreq_energy_model, cpu);
+}
+EXPORT_SYMBOL_GPL(cpufreq_energy_model_get);
+
 MODULE_AUTHOR("Dominik Brodowski <linux@brodo.de>");
 MODULE_DESCRIPTION("CPUfreq frequency table helpers");
 MODULE_LICENSE("GPL");
@@ -25,6 +25,7 @@
 #include <linux/opp.h>
 #include <linux/cpu.h>
 #include <linux/module.h>
+#include <linux/slab.h>
 #include <linux/thermal_framework.h>
 #include <linux/omap4_duty_cycle.h>
 
@@ -43,6 +44,9 @@
 /* OPP tolerance in percentage */
 #define	OPP_TOLERANCE	4
 
+/* Time the MPU is stalled while its DPLL relocks, in us */
+#define	OMAP_MPU_SWITCH_LATENCY	50
+
 /*
  * Custom OMAP cpufreq flags to pass in .target() callback.
  * This approach allows to sync pm_notifier of OMAP CPUfreq driver and
@@ -53,6 +57,7 @@
 
 static struct cpufreq_frequency_table *freq_table;
 static atomic_t freq_table_users = ATOMIC_INIT(0);
+static struct cpufreq_energy_model energy_model;
 static struct clk *mpu_clk;
 static char *mpu_clk_name;
 static struct device *mpu_dev;
@@ -244,8 +249,60 @@ static int omap_target(struct cpufreq_policy *policy,
 
 static inline void freq_table_free(void)
 {
-	if (atomic_dec_and_test(&freq_table_users))
+	if (atomic_dec_and_test(&freq_table_users)) {
+		kfree(energy_model.states);
+		energy_model.states = NULL;
 		opp_free_cpufreq_table(mpu_dev, &freq_table);
+	}
+}
+
+/*
+ * Energy model of the MPU, from the voltage and power estimate of each
+ * OPP, for governors that pick the OPP costing the least energy.  Not
+ * set up if the SoC has no power estimates.
+ */
+static void omap_energy_model_init(void)
+{
+	struct cpufreq_energy_state *states, *state;
+	unsigned long freq;
+	struct opp *opp;
+	int i;
+
+	for (i = 0; freq_table[i].frequency != CPUFREQ_TABLE_END; i++)
+		;
+
+	states = kcalloc(i + 1, sizeof(*states), GFP_KERNEL);
+	if (!states)
+		return;
+
+	state = states;
+	for (i = 0; freq_table[i].frequency != CPUFREQ_TABLE_END; i++) {
+		if (freq_table[i].frequency == CPUFREQ_ENTRY_INVALID)
+			continue;
+
+		freq = freq_table[i].frequency * 1000;
+		rcu_read_lock();
+		opp = opp_find_freq_exact(mpu_dev, freq, true);
+		if (!IS_ERR(opp))
+			state->u_volt = opp_get_voltage(opp);
+		rcu_read_unlock();
+
+		if (!state->u_volt ||
+		    omap_opp_get_power("mpu", freq, &state->busy_power,
+				       &state->idle_power)) {
+			kfree(states);
+			return;
+		}
+
+		state->frequency = freq_table[i].frequency;
+		state++;
+	}
+	state->frequency = CPUFREQ_TABLE_END;
+
+	energy_model.states = states;
+	energy_model.volt_slew = omap_dvfs_get_volt_slew(mpu_dev);
+	/* DPLL relock, the voltage ramp is accounted from volt_slew */
+	energy_model.switch_latency = OMAP_MPU_SWITCH_LATENCY;
 }
 
 #ifdef CONFIG_THERMAL_FRAMEWORK
@@ -527,8 +584,11 @@ static int __cpuinit omap_cpu_init(struct cpufreq_policy *policy)
 
 	policy->cur = policy->min = policy->max = omap_getspeed(policy->cpu);
 
-	if (atomic_inc_return(&freq_table_users) == 1)
+	if (atomic_inc_return(&freq_table_users) == 1) {
 		result = opp_init_cpufreq_table(mpu_dev, &freq_table);
+		if (!result)
+			omap_energy_model_init();
+	}
 
 	if (result) {
 		dev_err(mpu_dev, "%s: cpu%d: failed creating freq table[%d]\n",
@@ -541,6 +601,8 @@ static int __cpuinit omap_cpu_init(struct cpufreq_policy *policy)
 		goto fail_table;
 
 	cpufreq_frequency_table_get_attr(freq_table, policy->cpu);
+	if (energy_model.states)
+		cpufreq_energy_model_get_attr(&energy_model, policy->cpu);
 
 	policy->min = policy->cpuinfo.min_freq;
 	policy->max = policy->cpuinfo.max_freq;
@@ -575,6 +637,7 @@ fail_ck:
 
 static int omap_cpu_exit(struct cpufreq_policy *policy)
 {
+	cpufreq_energy_model_put_attr(policy->cpu);
 	freq_table_free();
 	clk_put(mpu_clk);
 	return 0;
@@ -582,6 +645,7 @@ static int omap_cpu_exit(struct cpufreq_policy *policy)
 
 static struct freq_attr *omap_cpufreq_attr[] = {
 	&cpufreq_freq_attr_scaling_available_freqs,
+	&cpufreq_freq_attr_energy_model,
 	NULL,
 };
 
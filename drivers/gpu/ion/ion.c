@@ -15,6 +15,7 @@
  *
  */
 
+#include <asm/cacheflush.h>
 #include <linux/device.h>
 #include <linux/file.h>
 #include <linux/freezer.h>
@@ -39,6 +40,9 @@
 
 #include "ion_priv.h"
 
+#define CREATE_TRACE_POINTS
+#include <trace/events/ion.h>
+
 /**
  * struct ion_device - the metadata of the ion device node
  * @dev:		the actual misc device
@@ -47,6 +51,8 @@
  * @lock:		rwsem protecting the tree of heaps and clients
  * @heaps:		list of all the heaps in the system
  * @user_clients:	list of all the clients created from userspace
+ * @cache_flush_all_threshold:	cache operations on more bytes than this
+ *			flush the whole cache instead of walking the range
  */
 struct ion_device {
 	struct miscdevice dev;
@@ -54,12 +60,18 @@ struct ion_device {
 	struct mutex buffer_lock;
 	struct rw_semaphore lock;
 	struct plist_head heaps;
+	struct ion_platform_policy *policies;
+	int nr_policies;
 	long (*custom_ioctl) (struct ion_client *client, unsigned int cmd,
 			      unsigned long arg);
 	struct rb_root clients;
 	struct dentry *debug_root;
+	u32 cache_flush_all_threshold;
 };
 
+/* above about twice the L2 size a full flush is cheaper than a range */
+#define ION_CACHE_FLUSH_ALL_THRESHOLD	(2 << 20)
+
 /**
  * struct ion_client - a process/hw block local address space
  * @node:		node in the tree of all clients
@@ -153,6 +165,7 @@ static struct ion_buffer *ion_buffer_create(struct ion_heap *heap,
 	struct ion_buffer *buffer;
 	struct sg_table *table;
 	struct scatterlist *sg;
+	ktime_t start;
 	int i, ret;
 
 	buffer = kzalloc(sizeof(struct ion_buffer), GFP_KERNEL);
@@ -162,19 +175,22 @@ static struct ion_buffer *ion_buffer_create(struct ion_heap *heap,
 	buffer->heap = heap;
 	buffer->flags = flags;
 	kref_init(&buffer->ref);
+	/* heaps that move buffers may take the lock from inside allocate */
+	INIT_LIST_HEAD(&buffer->vmas);
+	mutex_init(&buffer->lock);
 
+	start = ktime_get();
 	ret = heap->ops->allocate(heap, buffer, len, align, flags);
 
-	if (ret) {
-		if (!(heap->flags & ION_HEAP_FLAG_DEFER_FREE))
-			goto err2;
-
+	if (ret && (heap->flags & ION_HEAP_FLAG_DEFER_FREE)) {
 		ion_heap_freelist_drain(heap, 0);
 		ret = heap->ops->allocate(heap, buffer, len, align,
 					  flags);
-		if (ret)
-			goto err2;
 	}
+	if (!(heap->flags & ION_HEAP_FLAG_OWN_ALLOC_STATS))
+		ion_heap_account_alloc(heap, len, start, ret);
+	if (ret)
+		goto err2;
 
 	buffer->dev = dev;
 	buffer->size = len;
@@ -196,7 +212,7 @@ static struct ion_buffer *ion_buffer_create(struct ion_heap *heap,
 		buffer->pages = vmalloc(sizeof(struct page *) * num_pages);
 		if (!buffer->pages) {
 			ret = -ENOMEM;
-			goto err1;
+			goto err;
 		}
 
 		for_each_sg(table->sgl, sg, table->nents, i) {
@@ -212,8 +228,6 @@ static struct ion_buffer *ion_buffer_create(struct ion_heap *heap,
 
 	buffer->dev = dev;
 	buffer->size = len;
-	INIT_LIST_HEAD(&buffer->vmas);
-	mutex_init(&buffer->lock);
 	/* this will set up dma addresses for the sglist -- it is not
 	   technically correct as per the dma api -- a specific
 	   device isn't really taking ownership here.  However, in practice on
@@ -232,7 +246,6 @@ static struct ion_buffer *ion_buffer_create(struct ion_heap *heap,
 err:
 	heap->ops->unmap_dma(heap, buffer);
 	heap->ops->free(buffer);
-err1:
 	if (buffer->pages)
 		vfree(buffer->pages);
 err2:
@@ -242,10 +255,14 @@ err2:
 
 void ion_buffer_destroy(struct ion_buffer *buffer)
 {
+	ktime_t start = ktime_get();
+
 	if (WARN_ON(buffer->kmap_cnt > 0))
 		buffer->heap->ops->unmap_kernel(buffer->heap, buffer);
 	buffer->heap->ops->unmap_dma(buffer->heap, buffer);
 	buffer->heap->ops->free(buffer);
+	trace_ion_free(buffer->heap->id, buffer->size, buffer->flags,
+		       ktime_us_delta(ktime_get(), start));
 	if (buffer->pages)
 		vfree(buffer->pages);
 	kfree(buffer);
@@ -261,7 +278,8 @@ static void _ion_buffer_destroy(struct kref *kref)
 	rb_erase(&buffer->node, &dev->buffers);
 	mutex_unlock(&dev->buffer_lock);
 
-	if (heap->flags & ION_HEAP_FLAG_DEFER_FREE)
+	if ((heap->flags & ION_HEAP_FLAG_DEFER_FREE) &&
+	    !(buffer->flags & ION_FLAG_NO_DEFER_FREE))
 		ion_heap_freelist_add(heap, buffer);
 	else
 		ion_buffer_destroy(buffer);
@@ -277,6 +295,13 @@ static int ion_buffer_put(struct ion_buffer *buffer)
 	return kref_put(&buffer->ref, _ion_buffer_destroy);
 }
 
+static void ion_buffer_pin(struct ion_buffer *buffer)
+{
+	mutex_lock(&buffer->lock);
+	buffer->private_flags |= ION_PRIV_FLAG_PINNED;
+	mutex_unlock(&buffer->lock);
+}
+
 static void ion_buffer_add_to_handle(struct ion_buffer *buffer)
 {
 	mutex_lock(&buffer->lock);
@@ -445,6 +470,30 @@ static int ion_handle_add(struct ion_client *client, struct ion_handle *handle)
 	return 0;
 }
 
+/* this function should only be called while dev->lock is held */
+static struct ion_buffer *ion_policy_alloc(struct ion_device *dev,
+					   struct ion_platform_policy *policy,
+					   unsigned long len,
+					   unsigned long align,
+					   unsigned long flags)
+{
+	struct ion_buffer *buffer = NULL;
+	struct ion_heap *heap;
+	int i;
+
+	for (i = 0; i < policy->nr; i++) {
+		plist_for_each_entry(heap, &dev->heaps, node) {
+			if (heap->id != policy->heap_ids[i])
+				continue;
+			buffer = ion_buffer_create(heap, dev, len, align, flags);
+			if (!IS_ERR(buffer))
+				return buffer;
+			break;
+		}
+	}
+	return buffer;
+}
+
 struct ion_handle *ion_alloc(struct ion_client *client, size_t len,
 			     size_t align, unsigned int heap_id_mask,
 			     unsigned int flags)
@@ -453,7 +502,8 @@ struct ion_handle *ion_alloc(struct ion_client *client, size_t len,
 	struct ion_device *dev = client->dev;
 	struct ion_buffer *buffer = NULL;
 	struct ion_heap *heap;
-	int ret;
+	ktime_t start = ktime_get();
+	int i, ret;
 
 	pr_debug("%s: len %d align %d heap_id_mask %u flags %x\n", __func__,
 		 len, align, heap_id_mask, flags);
@@ -469,6 +519,16 @@ struct ion_handle *ion_alloc(struct ion_client *client, size_t len,
 	len = PAGE_ALIGN(len);
 
 	down_read(&dev->lock);
+	/* policies requested by the caller go first, in their own order */
+	for (i = 0; i < dev->nr_policies; i++) {
+		struct ion_platform_policy *policy = &dev->policies[i];
+
+		if (!((1 << policy->id) & heap_id_mask))
+			continue;
+		buffer = ion_policy_alloc(dev, policy, len, align, flags);
+		if (!IS_ERR_OR_NULL(buffer))
+			goto unlock;
+	}
 	plist_for_each_entry(heap, &dev->heaps, node) {
 		/* if the caller didn't specify this heap id */
 		if (!((1 << heap->id) & heap_id_mask))
@@ -477,8 +537,13 @@ struct ion_handle *ion_alloc(struct ion_client *client, size_t len,
 		if (!IS_ERR(buffer))
 			break;
 	}
+unlock:
 	up_read(&dev->lock);
 
+	trace_ion_alloc(IS_ERR_OR_NULL(buffer) ? -1 : buffer->heap->id, len,
+			flags, heap_id_mask, ktime_us_delta(ktime_get(), start),
+			buffer == NULL ? -ENODEV : PTR_RET(buffer));
+
 	if (buffer == NULL)
 		return ERR_PTR(-ENODEV);
 
@@ -548,6 +613,7 @@ int ion_phys(struct ion_client *client, struct ion_handle *handle,
 		return -ENODEV;
 	}
 	mutex_unlock(&client->lock);
+	ion_buffer_pin(buffer);
 	ret = buffer->heap->ops->phys(buffer->heap, buffer, addr, len);
 	return ret;
 }
@@ -565,6 +631,7 @@ int ion_phys_frm_dev(struct ion_device *dev, struct ion_handle *handle,
 		pr_err("%s: ion_phys is not implemented by this heap.\n", __func__);
 		return -ENODEV;
 	}
+	ion_buffer_pin(buffer);
 	ret = buffer->heap->ops->phys(buffer->heap, buffer, addr, len);
 	return ret;
 }
@@ -809,6 +876,7 @@ struct sg_table *ion_sg_table(struct ion_client *client,
 		return ERR_PTR(-EINVAL);
 	}
 	buffer = handle->buffer;
+	ion_buffer_pin(buffer);
 	table = buffer->sg_table;
 	mutex_unlock(&client->lock);
 	return table;
@@ -825,6 +893,7 @@ static struct sg_table *ion_map_dma_buf(struct dma_buf_attachment *attachment,
 	struct dma_buf *dmabuf = attachment->dmabuf;
 	struct ion_buffer *buffer = dmabuf->priv;
 
+	ion_buffer_pin(buffer);
 	ion_buffer_sync_for_device(buffer, attachment->dev, direction);
 	return buffer->sg_table;
 }
@@ -940,6 +1009,7 @@ static int ion_mmap(struct dma_buf *dmabuf, struct vm_area_struct *vma)
 		return -EINVAL;
 	}
 
+	ion_buffer_pin(buffer);
 	if (ion_buffer_fault_user_mappings(buffer)) {
 		vma->vm_private_data = buffer;
 		vma->vm_ops = &ion_vma_ops;
@@ -1118,10 +1188,157 @@ end:
 }
 EXPORT_SYMBOL(ion_import_dma_buf);
 
-static int ion_sync_for_device(struct ion_client *client, int fd)
+static void ion_flush_cache_all_local(void *unused)
+{
+	flush_cache_all();
+}
+
+static void ion_flush_cache_all(void)
+{
+	on_each_cpu(ion_flush_cache_all_local, NULL, 1);
+	outer_flush_all();
+}
+
+static void ion_cache_op_page(struct page *page, unsigned long offset,
+			      size_t len, unsigned int op)
+{
+	dma_addr_t addr = pfn_to_dma(NULL, page_to_pfn(page)) + offset;
+
+	if (op & ION_CACHE_CLEAN)
+		arm_dma_ops.sync_single_for_device(NULL, addr, len,
+						   DMA_TO_DEVICE);
+	if (op & ION_CACHE_INV)
+		arm_dma_ops.sync_single_for_cpu(NULL, addr, len,
+						DMA_FROM_DEVICE);
+}
+
+/* drop pages [start, end) of a buffer from its user mappings */
+static void ion_buffer_zap_pages(struct ion_buffer *buffer,
+				 unsigned long start, unsigned long end)
+{
+	struct ion_vma_list *vma_list;
+
+	list_for_each_entry(vma_list, &buffer->vmas, list) {
+		struct vm_area_struct *vma = vma_list->vma;
+		unsigned long vstart = vma->vm_pgoff;
+		unsigned long vend = vstart +
+			((vma->vm_end - vma->vm_start) >> PAGE_SHIFT);
+
+		vstart = max(vstart, start);
+		vend = min(vend, end);
+		if (vstart >= vend)
+			continue;
+		zap_page_range(vma, vma->vm_start +
+			       ((vstart - vma->vm_pgoff) << PAGE_SHIFT),
+			       (vend - vstart) << PAGE_SHIFT, NULL);
+	}
+}
+
+/*
+ * Buffers with faulted user mappings know which pages were written since
+ * they were last cleaned, so a clean only has to visit those.  The user
+ * mappings of the cleaned pages are zapped to catch the next write.
+ */
+static void ion_buffer_cache_op_pages(struct ion_buffer *buffer,
+				      size_t offset, size_t len,
+				      unsigned int op)
+{
+	unsigned long first = offset >> PAGE_SHIFT;
+	unsigned long last = (offset + len - 1) >> PAGE_SHIFT;
+	unsigned long run = first;	/* first page of a run of dirty ones */
+	size_t bytes = 0;
+	bool flush_all;
+	unsigned long i;
+
+	for (i = first; i <= last; i++)
+		if (op != ION_CACHE_CLEAN ||
+		    ion_buffer_page_is_dirty(buffer->pages[i]))
+			bytes += PAGE_SIZE;
+	flush_all = bytes > buffer->dev->cache_flush_all_threshold;
+	if (flush_all)
+		ion_flush_cache_all();
+
+	for (i = first; i <= last; i++) {
+		struct page *page = buffer->pages[i];
+		bool dirty = ion_buffer_page_is_dirty(page);
+
+		if (!flush_all && (op != ION_CACHE_CLEAN || dirty))
+			ion_cache_op_page(ion_buffer_page(page), 0, PAGE_SIZE,
+					  op);
+		if (!(op & ION_CACHE_CLEAN))
+			continue;
+
+		/* only dirty pages are mapped, zap them a run at a time */
+		if (dirty) {
+			ion_buffer_page_clean(buffer->pages + i);
+			continue;
+		}
+		if (run < i)
+			ion_buffer_zap_pages(buffer, run, i);
+		run = i + 1;
+	}
+	if ((op & ION_CACHE_CLEAN) && run <= last)
+		ion_buffer_zap_pages(buffer, run, last + 1);
+}
+
+static void ion_buffer_cache_op_sg(struct ion_buffer *buffer, size_t offset,
+				   size_t len, unsigned int op)
+{
+	struct sg_table *table = buffer->sg_table;
+	struct scatterlist *sg;
+	size_t pos = 0;
+	int i;
+
+	if (len > buffer->dev->cache_flush_all_threshold) {
+		ion_flush_cache_all();
+		return;
+	}
+
+	for_each_sg(table->sgl, sg, table->nents, i) {
+		size_t sg_len = sg_dma_len(sg);
+		size_t start, end;
+
+		if (pos + sg_len <= offset) {
+			pos += sg_len;
+			continue;
+		}
+		if (pos >= offset + len)
+			break;
+		start = max(pos, offset) - pos;
+		end = min(pos + sg_len, offset + len) - pos;
+		ion_cache_op_page(sg_page(sg), sg->offset + start,
+				  end - start, op);
+		pos += sg_len;
+	}
+}
+
+static int ion_buffer_cache_op(struct ion_buffer *buffer, size_t offset,
+			       size_t len, unsigned int op)
+{
+	if (op < ION_CACHE_CLEAN || op > ION_CACHE_CLEAN_INV)
+		return -EINVAL;
+	if (offset >= buffer->size)
+		return -EINVAL;
+	if (len == 0)
+		len = buffer->size - offset;
+	if (len > buffer->size - offset)
+		return -EINVAL;
+
+	mutex_lock(&buffer->lock);
+	if (ion_buffer_fault_user_mappings(buffer))
+		ion_buffer_cache_op_pages(buffer, offset, len, op);
+	else
+		ion_buffer_cache_op_sg(buffer, offset, len, op);
+	mutex_unlock(&buffer->lock);
+	return 0;
+}
+
+static int ion_cache_op(struct ion_client *client, int fd, size_t offset,
+			size_t len, unsigned int op)
 {
 	struct dma_buf *dmabuf;
 	struct ion_buffer *buffer;
+	int ret;
 
 	dmabuf = dma_buf_get(fd);
 	if (IS_ERR(dmabuf))
@@ -1136,10 +1353,9 @@ static int ion_sync_for_device(struct ion_client *client, int fd)
 	}
 	buffer = dmabuf->priv;
 
-	dma_sync_sg_for_device(NULL, buffer->sg_table->sgl,
-			       buffer->sg_table->nents, DMA_BIDIRECTIONAL);
+	ret = ion_buffer_cache_op(buffer, offset, len, op);
 	dma_buf_put(dmabuf);
-	return 0;
+	return ret;
 }
 
 static long ion_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
@@ -1227,9 +1443,29 @@ static long ion_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 		if (copy_from_user(&data, (void __user *)arg,
 				   sizeof(struct ion_fd_data)))
 			return -EFAULT;
-		ion_sync_for_device(client, data.fd);
+		ion_cache_op(client, data.fd, 0, 0, ION_CACHE_CLEAN);
 		break;
 	}
+	case ION_IOC_SYNC_RANGE:
+	{
+		struct ion_sync_range_data data;
+
+		if (copy_from_user(&data, (void __user *)arg,
+				   sizeof(struct ion_sync_range_data)))
+			return -EFAULT;
+		return ion_cache_op(client, data.fd, data.offset, data.length,
+				    ION_CACHE_CLEAN);
+	}
+	case ION_IOC_CACHE_OP:
+	{
+		struct ion_cache_op_data data;
+
+		if (copy_from_user(&data, (void __user *)arg,
+				   sizeof(struct ion_cache_op_data)))
+			return -EFAULT;
+		return ion_cache_op(client, data.fd, data.offset, data.length,
+				    data.op);
+	}
 	case ION_IOC_CUSTOM:
 	{
 		struct ion_device *dev = client->dev;
@@ -1351,6 +1587,8 @@ static int ion_debug_heap_show(struct seq_file *s, void *unused)
 		seq_printf(s, "%16.s %16u\n", "deferred free",
 				heap->free_list_size);
 	seq_printf(s, "----------------------------------------------------\n");
+	ion_heap_stats_show(heap, s);
+	seq_printf(s, "----------------------------------------------------\n");
 
 	if (heap->debug_show)
 		heap->debug_show(heap, s, unused);
@@ -1408,6 +1646,15 @@ DEFINE_SIMPLE_ATTRIBUTE(debug_shrink_fops, debug_shrink_get,
                         debug_shrink_set, "%llu\n");
 #endif
 
+void ion_device_add_policies(struct ion_device *dev,
+			     struct ion_platform_policy *policies, int nr)
+{
+	down_write(&dev->lock);
+	dev->policies = policies;
+	dev->nr_policies = nr;
+	up_write(&dev->lock);
+}
+
 void ion_device_add_heap(struct ion_device *dev, struct ion_heap *heap)
 {
 	if (!heap->ops->allocate || !heap->ops->free || !heap->ops->map_dma ||
@@ -1463,6 +1710,9 @@ struct ion_device *ion_device_create(long (*custom_ioctl)
 	idev->debug_root = debugfs_create_dir("ion", NULL);
 	if (!idev->debug_root)
 		pr_err("ion: failed to create debug files.\n");
+	idev->cache_flush_all_threshold = ION_CACHE_FLUSH_ALL_THRESHOLD;
+	debugfs_create_u32("cache_flush_all_threshold", 0644, idev->debug_root,
+			   &idev->cache_flush_all_threshold);
 
 	idev->custom_ioctl = custom_ioctl;
 	idev->buffers = RB_ROOT;
@@ -19,27 +19,56 @@
 #include <linux/genalloc.h>
 #include <linux/io.h>
 #include <linux/ion.h>
+#include <linux/list_sort.h>
 #include <linux/mm.h>
+#include <linux/mutex.h>
 #include <linux/scatterlist.h>
+#include <linux/seq_file.h>
 #include <linux/slab.h>
 #include <linux/vmalloc.h>
 #include "ion_priv.h"
 
+#include <asm/cacheflush.h>
 #include <asm/mach/map.h>
 
+/**
+ * struct ion_carveout_heap - a heap backed by a reserved physical region
+ * @heap:		the ion heap
+ * @pool:		allocator for the region
+ * @base:		physical base of the region
+ * @lock:		serializes the pool and @buffers against compaction
+ * @buffers:		ion_carveout_buffer_info of every live buffer
+ * @compactions:	number of times the region was compacted
+ * @moved:		number of bytes moved by compaction
+ */
 struct ion_carveout_heap {
 	struct ion_heap heap;
 	struct gen_pool *pool;
 	ion_phys_addr_t base;
+	struct mutex lock;
+	struct list_head buffers;
+	unsigned long compactions;
+	unsigned long moved;
+};
+
+struct ion_carveout_buffer_info {
+	struct list_head list;
+	struct ion_buffer *buffer;
+	ion_phys_addr_t phys;
 };
 
+#define to_carveout_heap(x) container_of(x, struct ion_carveout_heap, heap)
+
 ion_phys_addr_t ion_carveout_allocate(struct ion_heap *heap,
 				      unsigned long size,
 				      unsigned long align)
 {
-	struct ion_carveout_heap *carveout_heap =
-		container_of(heap, struct ion_carveout_heap, heap);
-	unsigned long offset = gen_pool_alloc(carveout_heap->pool, size);
+	struct ion_carveout_heap *carveout_heap = to_carveout_heap(heap);
+	unsigned long offset;
+
+	mutex_lock(&carveout_heap->lock);
+	offset = gen_pool_alloc(carveout_heap->pool, size);
+	mutex_unlock(&carveout_heap->lock);
 
 	if (!offset)
 		return ION_CARVEOUT_ALLOCATE_FAIL;
@@ -50,19 +79,128 @@ ion_phys_addr_t ion_carveout_allocate(struct ion_heap *heap,
 void ion_carveout_free(struct ion_heap *heap, ion_phys_addr_t addr,
 		       unsigned long size)
 {
-	struct ion_carveout_heap *carveout_heap =
-		container_of(heap, struct ion_carveout_heap, heap);
+	struct ion_carveout_heap *carveout_heap = to_carveout_heap(heap);
 
 	if (addr == ION_CARVEOUT_ALLOCATE_FAIL)
 		return;
+	mutex_lock(&carveout_heap->lock);
 	gen_pool_free(carveout_heap->pool, addr, size);
+	mutex_unlock(&carveout_heap->lock);
+}
+
+static int ion_carveout_buffer_cmp(void *priv, struct list_head *a,
+				   struct list_head *b)
+{
+	struct ion_carveout_buffer_info *ia, *ib;
+
+	ia = list_entry(a, struct ion_carveout_buffer_info, list);
+	ib = list_entry(b, struct ion_carveout_buffer_info, list);
+	if (ia->phys < ib->phys)
+		return -1;
+	return ia->phys > ib->phys;
+}
+
+/*
+ * Copy size bytes from src down to dst.  The two ranges may overlap, so
+ * map the span covering both once and let memmove sort out the direction.
+ * Cached buffers may still have dirty lines from an earlier kernel
+ * mapping; write those back first so nothing is lost or later evicted on
+ * top of whoever gets the old range.
+ */
+static int ion_carveout_heap_move(struct ion_buffer *buffer,
+				  ion_phys_addr_t dst, ion_phys_addr_t src)
+{
+	size_t span = src + buffer->size - dst;
+	void *vaddr;
+
+	if (buffer->flags & ION_FLAG_CACHED) {
+		vaddr = __arm_ioremap(src, buffer->size, MT_MEMORY);
+		if (!vaddr)
+			return -ENOMEM;
+		dmac_flush_range(vaddr, vaddr + buffer->size);
+		outer_flush_range(src, src + buffer->size);
+		__arm_iounmap(vaddr);
+	}
+
+	vaddr = __arm_ioremap(dst, span, MT_MEMORY_NONCACHED);
+	if (!vaddr)
+		return -ENOMEM;
+	memmove(vaddr, vaddr + (src - dst), buffer->size);
+	__arm_iounmap(vaddr);
+	return 0;
+}
+
+/*
+ * Slide every buffer whose physical address nobody has seen down into the
+ * lowest free extent that fits it.  Buffers that were handed out by
+ * physical address, sg_table or userspace mapping are pinned and stay
+ * where they are, as do buffers that are kernel mapped or busy.
+ *
+ * Called with carveout_heap->lock held.  That keeps the pool and the
+ * buffer list stable.  unmap_dma takes a buffer off the list under the
+ * same lock before it frees the sg_table, so a buffer that is being
+ * destroyed is never looked at.
+ */
+static void ion_carveout_heap_compact(struct ion_carveout_heap *carveout_heap)
+{
+	struct ion_carveout_buffer_info *info;
+	unsigned long i;
+
+	carveout_heap->compactions++;
+	list_sort(NULL, &carveout_heap->buffers, ion_carveout_buffer_cmp);
+	list_for_each_entry(info, &carveout_heap->buffers, list) {
+		struct ion_buffer *buffer = info->buffer;
+		unsigned long npages = PAGE_ALIGN(buffer->size) / PAGE_SIZE;
+		ion_phys_addr_t dst;
+
+		/* not done being created yet */
+		if (!buffer->sg_table || !buffer->sg_table->sgl)
+			continue;
+		if (!mutex_trylock(&buffer->lock))
+			continue;
+		if ((buffer->private_flags & ION_PRIV_FLAG_PINNED) ||
+		    buffer->kmap_cnt)
+			goto next;
+
+		/*
+		 * gen_pool is first fit, and the range just released is itself
+		 * big enough, so dst never ends up above the old address.
+		 */
+		gen_pool_free(carveout_heap->pool, info->phys, buffer->size);
+		dst = gen_pool_alloc(carveout_heap->pool, buffer->size);
+		BUG_ON(!dst || dst > info->phys);
+		if (dst == info->phys)
+			goto next;
+
+		if (ion_carveout_heap_move(buffer, dst, info->phys)) {
+			gen_pool_free(carveout_heap->pool, dst, buffer->size);
+			BUG_ON(gen_pool_alloc(carveout_heap->pool,
+					      buffer->size) != info->phys);
+			mutex_unlock(&buffer->lock);
+			break;
+		}
+		info->phys = dst;
+		sg_set_page(buffer->sg_table->sgl, phys_to_page(dst),
+			    buffer->size, 0);
+		sg_dma_address(buffer->sg_table->sgl) = dst;
+		/* the fault handler's page array, keeping the dirty bits */
+		for (i = 0; buffer->pages && i < npages; i++)
+			buffer->pages[i] = (struct page *)
+				((unsigned long)(phys_to_page(dst) + i) |
+				 ((unsigned long)buffer->pages[i] & 1UL));
+		carveout_heap->moved += buffer->size;
+next:
+		mutex_unlock(&buffer->lock);
+	}
 }
 
 static int ion_carveout_heap_phys(struct ion_heap *heap,
 				  struct ion_buffer *buffer,
 				  ion_phys_addr_t *addr, size_t *len)
 {
-	*addr = buffer->priv_phys;
+	struct ion_carveout_buffer_info *info = buffer->priv_virt;
+
+	*addr = info->phys;
 	*len = buffer->size;
 	return 0;
 }
@@ -72,21 +210,51 @@ static int ion_carveout_heap_allocate(struct ion_heap *heap,
 				      unsigned long size, unsigned long align,
 				      unsigned long flags)
 {
-	buffer->priv_phys = ion_carveout_allocate(heap, size, align);
-	return buffer->priv_phys == ION_CARVEOUT_ALLOCATE_FAIL ? -ENOMEM : 0;
+	struct ion_carveout_heap *carveout_heap = to_carveout_heap(heap);
+	struct ion_carveout_buffer_info *info;
+
+	info = kzalloc(sizeof(struct ion_carveout_buffer_info), GFP_KERNEL);
+	if (!info)
+		return -ENOMEM;
+
+	mutex_lock(&carveout_heap->lock);
+	info->phys = gen_pool_alloc(carveout_heap->pool, size);
+	if (!info->phys && gen_pool_avail(carveout_heap->pool) >= size) {
+		ion_carveout_heap_compact(carveout_heap);
+		info->phys = gen_pool_alloc(carveout_heap->pool, size);
+	}
+	if (!info->phys) {
+		mutex_unlock(&carveout_heap->lock);
+		kfree(info);
+		return -ENOMEM;
+	}
+	info->buffer = buffer;
+	list_add_tail(&info->list, &carveout_heap->buffers);
+	mutex_unlock(&carveout_heap->lock);
+
+	buffer->priv_virt = info;
+	return 0;
 }
 
 static void ion_carveout_heap_free(struct ion_buffer *buffer)
 {
-	struct ion_heap *heap = buffer->heap;
+	struct ion_carveout_heap *carveout_heap =
+		to_carveout_heap(buffer->heap);
+	struct ion_carveout_buffer_info *info = buffer->priv_virt;
 
-	ion_carveout_free(heap, buffer->priv_phys, buffer->size);
-	buffer->priv_phys = ION_CARVEOUT_ALLOCATE_FAIL;
+	mutex_lock(&carveout_heap->lock);
+	list_del(&info->list);
+	gen_pool_free(carveout_heap->pool, info->phys, buffer->size);
+	mutex_unlock(&carveout_heap->lock);
+	kfree(info);
+	buffer->priv_virt = NULL;
 }
 
 struct sg_table *ion_carveout_heap_map_dma(struct ion_heap *heap,
 					      struct ion_buffer *buffer)
 {
+	struct ion_carveout_heap *carveout_heap = to_carveout_heap(heap);
+	struct ion_carveout_buffer_info *info = buffer->priv_virt;
 	struct sg_table *table;
 	int ret;
 
@@ -98,27 +266,36 @@ struct sg_table *ion_carveout_heap_map_dma(struct ion_heap *heap,
 		kfree(table);
 		return ERR_PTR(ret);
 	}
-	sg_set_page(table->sgl, phys_to_page(buffer->priv_phys), buffer->size,
-		    0);
+	mutex_lock(&carveout_heap->lock);
+	sg_set_page(table->sgl, phys_to_page(info->phys), buffer->size, 0);
+	mutex_unlock(&carveout_heap->lock);
 	return table;
 }
 
 void ion_carveout_heap_unmap_dma(struct ion_heap *heap,
 				 struct ion_buffer *buffer)
 {
+	struct ion_carveout_heap *carveout_heap = to_carveout_heap(heap);
+	struct ion_carveout_buffer_info *info = buffer->priv_virt;
+
+	/* the buffer is going away, compaction must not move it any more */
+	mutex_lock(&carveout_heap->lock);
+	list_del_init(&info->list);
 	sg_free_table(buffer->sg_table);
+	mutex_unlock(&carveout_heap->lock);
 }
 
 void *ion_carveout_heap_map_kernel(struct ion_heap *heap,
 				   struct ion_buffer *buffer)
 {
+	struct ion_carveout_buffer_info *info = buffer->priv_virt;
 	void *ret;
 	int mtype = MT_MEMORY_NONCACHED;
 
 	if (buffer->flags & ION_FLAG_CACHED)
 		mtype = MT_MEMORY;
 
-	ret = __arm_ioremap(buffer->priv_phys, buffer->size,
+	ret = __arm_ioremap(info->phys, buffer->size,
 			      mtype);
 	if (ret == NULL)
 		return ERR_PTR(-ENOMEM);
@@ -137,8 +314,10 @@ void ion_carveout_heap_unmap_kernel(struct ion_heap *heap,
 int ion_carveout_heap_map_user(struct ion_heap *heap, struct ion_buffer *buffer,
 			       struct vm_area_struct *vma)
 {
+	struct ion_carveout_buffer_info *info = buffer->priv_virt;
+
 	return remap_pfn_range(vma, vma->vm_start,
-			       __phys_to_pfn(buffer->priv_phys) + vma->vm_pgoff,
+			       __phys_to_pfn(info->phys) + vma->vm_pgoff,
 			       vma->vm_end - vma->vm_start,
 			       pgprot_noncached(vma->vm_page_prot));
 }
@@ -154,6 +333,20 @@ static struct ion_heap_ops carveout_heap_ops = {
 	.unmap_kernel = ion_carveout_heap_unmap_kernel,
 };
 
+static int ion_carveout_heap_debug_show(struct ion_heap *heap,
+					struct seq_file *s, void *unused)
+{
+	struct ion_carveout_heap *carveout_heap = to_carveout_heap(heap);
+
+	mutex_lock(&carveout_heap->lock);
+	ion_gen_pool_show_extents(carveout_heap->pool, s);
+	seq_printf(s, "%16.s %16lu\n", "compactions",
+		   carveout_heap->compactions);
+	seq_printf(s, "%16.s %16lu\n", "moved", carveout_heap->moved);
+	mutex_unlock(&carveout_heap->lock);
+	return 0;
+}
+
 struct ion_heap *ion_carveout_heap_create(struct ion_platform_heap *heap_data)
 {
 	struct ion_carveout_heap *carveout_heap;
@@ -170,16 +363,18 @@ struct ion_heap *ion_carveout_heap_create(struct ion_platform_heap *heap_data)
 	carveout_heap->base = heap_data->base;
 	gen_pool_add(carveout_heap->pool, carveout_heap->base, heap_data->size,
 		     -1);
+	mutex_init(&carveout_heap->lock);
+	INIT_LIST_HEAD(&carveout_heap->buffers);
 	carveout_heap->heap.ops = &carveout_heap_ops;
 	carveout_heap->heap.type = ION_HEAP_TYPE_CARVEOUT;
+	carveout_heap->heap.debug_show = ion_carveout_heap_debug_show;
 
 	return &carveout_heap->heap;
 }
 
 void ion_carveout_heap_destroy(struct ion_heap *heap)
 {
-	struct ion_carveout_heap *carveout_heap =
-	     container_of(heap, struct  ion_carveout_heap, heap);
+	struct ion_carveout_heap *carveout_heap = to_carveout_heap(heap);
 
 	gen_pool_destroy(carveout_heap->pool);
 	kfree(carveout_heap);
@@ -16,12 +16,14 @@
 
 #include <linux/err.h>
 #include <linux/freezer.h>
+#include <linux/genalloc.h>
 #include <linux/ion.h>
 #include <linux/kthread.h>
 #include <linux/mm.h>
 #include <linux/rtmutex.h>
 #include <linux/sched.h>
 #include <linux/scatterlist.h>
+#include <linux/seq_file.h>
 #include <linux/vmalloc.h>
 #include "ion_priv.h"
 
@@ -100,20 +102,42 @@ int ion_heap_map_user(struct ion_heap *heap, struct ion_buffer *buffer,
 	return 0;
 }
 
+#define ION_HEAP_ZERO_BATCH	32
+
+static int ion_heap_zero_pages(struct vm_struct *vm_struct,
+			       struct page **pages, int num, pgprot_t pgprot)
+{
+	struct page **tmp = pages;
+	int ret;
+
+	ret = map_vm_area(vm_struct, pgprot, &tmp);
+	if (ret)
+		return ret;
+	memset(vm_struct->addr, 0, PAGE_SIZE * num);
+	unmap_kernel_range((unsigned long)vm_struct->addr, PAGE_SIZE * num);
+	return 0;
+}
+
+/*
+ * Zeroes the buffer ION_HEAP_ZERO_BATCH pages at a time, through a single
+ * kernel mapping per batch instead of one map and tlb flush per page.
+ */
 int ion_heap_buffer_zero(struct ion_buffer *buffer)
 {
 	struct sg_table *table = buffer->sg_table;
+	struct page *pages[ION_HEAP_ZERO_BATCH];
 	pgprot_t pgprot;
 	struct scatterlist *sg;
 	struct vm_struct *vm_struct;
 	int i, j, ret = 0;
+	int p = 0;
 
 	if (buffer->flags & ION_FLAG_CACHED)
 		pgprot = PAGE_KERNEL;
 	else
 		pgprot = pgprot_writecombine(PAGE_KERNEL);
 
-	vm_struct = get_vm_area(PAGE_SIZE, VM_ALLOC);
+	vm_struct = get_vm_area(PAGE_SIZE * ION_HEAP_ZERO_BATCH, VM_ALLOC);
 	if (!vm_struct)
 		return -ENOMEM;
 
@@ -122,16 +146,18 @@ int ion_heap_buffer_zero(struct ion_buffer *buffer)
 		unsigned long len = sg_dma_len(sg);
 
 		for (j = 0; j < len / PAGE_SIZE; j++) {
-			struct page *sub_page = page + j;
-			struct page **pages = &sub_page;
-			ret = map_vm_area(vm_struct, pgprot, &pages);
-			if (ret)
-				goto end;
-			memset(vm_struct->addr, 0, PAGE_SIZE);
-			unmap_kernel_range((unsigned long)vm_struct->addr,
-					   PAGE_SIZE);
+			pages[p++] = page + j;
+			if (p == ION_HEAP_ZERO_BATCH) {
+				ret = ion_heap_zero_pages(vm_struct, pages, p,
+							  pgprot);
+				if (ret)
+					goto end;
+				p = 0;
+			}
 		}
 	}
+	if (p)
+		ret = ion_heap_zero_pages(vm_struct, pages, p, pgprot);
 end:
 	free_vm_area(vm_struct);
 	return ret;
@@ -184,52 +210,182 @@ size_t ion_heap_freelist_size(struct ion_heap *heap)
 	return size;
 }
 
-size_t ion_heap_freelist_drain(struct ion_heap *heap, size_t size)
+static int ion_heap_stat_bucket(unsigned long val)
 {
-	struct ion_buffer *buffer, *tmp;
-	size_t total_drained = 0;
+	return min(fls_long(val), ION_HEAP_STAT_BUCKETS - 1);
+}
 
-	if (ion_heap_freelist_size(heap) == 0)
-		return 0;
+void ion_heap_account_alloc(struct ion_heap *heap, size_t len, ktime_t start,
+			    int error)
+{
+	struct ion_heap_stats *stats = &heap->stats;
+	s64 us = ktime_us_delta(ktime_get(), start);
+	int max;
+
+	atomic_inc(&stats->latency[ion_heap_stat_bucket(us)]);
+	if (error) {
+		atomic_inc(&stats->failures);
+	} else {
+		atomic_inc(&stats->allocs);
+		atomic_inc(&stats->size[min_t(int, get_order(len),
+					      ION_HEAP_STAT_BUCKETS - 1)]);
+	}
+	max = atomic_read(&stats->max_latency_us);
+	while (us > max) {
+		int old = atomic_cmpxchg(&stats->max_latency_us, max, us);
+
+		if (old == max)
+			break;
+		max = old;
+	}
+}
+
+void ion_heap_stats_show(struct ion_heap *heap, struct seq_file *s)
+{
+	struct ion_heap_stats *stats = &heap->stats;
+	int i;
+
+	seq_printf(s, "%d allocations, %d failed, slowest %d us\n",
+		   atomic_read(&stats->allocs), atomic_read(&stats->failures),
+		   atomic_read(&stats->max_latency_us));
+	seq_printf(s, "%16.s %16.s\n", "latency (us) <", "count");
+	for (i = 0; i < ION_HEAP_STAT_BUCKETS; i++) {
+		int count = atomic_read(&stats->latency[i]);
+
+		if (!count)
+			continue;
+		if (i == ION_HEAP_STAT_BUCKETS - 1)
+			seq_printf(s, "%16.s %16d\n", "more", count);
+		else
+			seq_printf(s, "%16lu %16d\n", 1UL << i, count);
+	}
+	seq_printf(s, "%16.s %16.s\n", "size (KB) <=", "count");
+	for (i = 0; i < ION_HEAP_STAT_BUCKETS; i++) {
+		int count = atomic_read(&stats->size[i]);
+
+		if (!count)
+			continue;
+		if (i == ION_HEAP_STAT_BUCKETS - 1)
+			seq_printf(s, "%16.s %16d\n", "more", count);
+		else
+			seq_printf(s, "%16lu %16d\n", (PAGE_SIZE << i) / 1024,
+				   count);
+	}
+}
+
+struct ion_gen_pool_extents {
+	size_t total_free;
+	size_t largest_free;
+};
+
+static void ion_gen_pool_chunk_extents(struct gen_pool *pool,
+				       struct gen_pool_chunk *chunk,
+				       void *data)
+{
+	struct ion_gen_pool_extents *extents = data;
+	int order = pool->min_alloc_order;
+	unsigned long nbits = (chunk->end_addr - chunk->start_addr) >> order;
+	unsigned long start = 0;
+	unsigned long end;
+
+	while (start < nbits) {
+		size_t len;
+
+		start = find_next_zero_bit(chunk->bits, nbits, start);
+		if (start >= nbits)
+			break;
+		end = find_next_bit(chunk->bits, nbits, start);
+		len = (end - start) << order;
+		extents->total_free += len;
+		extents->largest_free = max(extents->largest_free, len);
+		start = end;
+	}
+}
+
+void ion_gen_pool_show_extents(struct gen_pool *pool, struct seq_file *s)
+{
+	struct ion_gen_pool_extents extents = { 0, 0 };
+	unsigned int frag = 0;
+
+	gen_pool_for_each_chunk(pool, ion_gen_pool_chunk_extents, &extents);
+	if (extents.total_free)
+		frag = 100 - div_u64((u64)extents.largest_free * 100,
+				     extents.total_free);
+	seq_printf(s, "%16.s %16zu\n", "total free", extents.total_free);
+	seq_printf(s, "%16.s %16zu\n", "largest free", extents.largest_free);
+	seq_printf(s, "%16.s %15u%%\n", "fragmentation", frag);
+}
+
+/*
+ * Moves up to size bytes worth of buffers, oldest first, off the free list
+ * onto batch.  A size of 0 takes the whole list.
+ */
+static size_t ion_heap_freelist_take(struct ion_heap *heap, size_t size,
+				     struct list_head *batch)
+{
+	struct ion_buffer *buffer, *tmp;
+	size_t total = 0;
 
 	rt_mutex_lock(&heap->lock);
 	if (size == 0)
 		size = heap->free_list_size;
 
-	list_for_each_entry_safe(buffer, tmp, &heap->free_list, list) {
-		if (total_drained >= size)
+	list_for_each_entry_safe_reverse(buffer, tmp, &heap->free_list,
+					 list) {
+		if (total >= size)
 			break;
-		list_del(&buffer->list);
-		ion_buffer_destroy(buffer);
+		list_move_tail(&buffer->list, batch);
 		heap->free_list_size -= buffer->size;
-		total_drained += buffer->size;
+		total += buffer->size;
 	}
 	rt_mutex_unlock(&heap->lock);
 
+	return total;
+}
+
+static size_t _ion_heap_freelist_drain(struct ion_heap *heap, size_t size,
+				       bool skip_pools)
+{
+	struct ion_buffer *buffer, *tmp;
+	size_t total_drained;
+	LIST_HEAD(batch);
+
+	if (ion_heap_freelist_size(heap) == 0)
+		return 0;
+
+	total_drained = ion_heap_freelist_take(heap, size, &batch);
+	list_for_each_entry_safe(buffer, tmp, &batch, list) {
+		list_del(&buffer->list);
+		if (skip_pools)
+			buffer->private_flags |= ION_PRIV_FLAG_SHRINKER_FREE;
+		ion_buffer_destroy(buffer);
+	}
+
 	return total_drained;
 }
 
+size_t ion_heap_freelist_drain(struct ion_heap *heap, size_t size)
+{
+	return _ion_heap_freelist_drain(heap, size, false);
+}
+
+size_t ion_heap_freelist_shrink(struct ion_heap *heap, size_t size)
+{
+	return _ion_heap_freelist_drain(heap, size, true);
+}
+
+/*
+ * Everything queued while the previous batch was being freed is taken in
+ * one go, so releasing a burst of buffers costs one round of the lock.
+ */
 int ion_heap_deferred_free(void *data)
 {
 	struct ion_heap *heap = data;
 
 	while (true) {
-		struct ion_buffer *buffer;
-
 		wait_event_freezable(heap->waitqueue,
 				     ion_heap_freelist_size(heap) > 0);
-
-		rt_mutex_lock(&heap->lock);
-		if (list_empty(&heap->free_list)) {
-			rt_mutex_unlock(&heap->lock);
-			continue;
-		}
-		buffer = list_first_entry(&heap->free_list, struct ion_buffer,
-					  list);
-		list_del(&buffer->list);
-		heap->free_list_size -= buffer->size;
-		rt_mutex_unlock(&heap->lock);
-		ion_buffer_destroy(buffer);
+		ion_heap_freelist_drain(heap, 0);
 	}
 
 	return 0;
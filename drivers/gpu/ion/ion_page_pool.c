@@ -20,7 +20,9 @@
 #include <linux/fs.h>
 #include <linux/list.h>
 #include <linux/module.h>
+#include <linux/percpu.h>
 #include <linux/slab.h>
+#include <linux/smp.h>
 #include "ion_priv.h"
 
 struct ion_page_pool_item {
@@ -94,12 +96,80 @@ static struct page *ion_page_pool_remove(struct ion_page_pool *pool, bool high)
 	return page;
 }
 
+/*
+ * The per cpu caches are only touched by their own cpu with interrupts
+ * off, so the fast path takes no lock at all.  The shrinker empties them
+ * from an IPI.
+ */
+static struct page *ion_page_pool_pcp_get(struct ion_page_pool *pool)
+{
+	struct ion_page_pool_pcp *pcp;
+	struct page *page = NULL;
+	unsigned long flags;
+
+	local_irq_save(flags);
+	pcp = this_cpu_ptr(pool->pcp);
+	if (pcp->count) {
+		page = pcp->pages[--pcp->count];
+		pcp->hits++;
+	}
+	local_irq_restore(flags);
+	return page;
+}
+
+static bool ion_page_pool_pcp_put(struct ion_page_pool *pool,
+				  struct page *page)
+{
+	struct ion_page_pool_pcp *pcp;
+	unsigned long flags;
+	bool ret = false;
+
+	local_irq_save(flags);
+	pcp = this_cpu_ptr(pool->pcp);
+	if (pcp->count < pool->pcp_max) {
+		pcp->pages[pcp->count++] = page;
+		ret = true;
+	}
+	local_irq_restore(flags);
+	return ret;
+}
+
+struct ion_page_pool_drain {
+	struct ion_page_pool *pool;
+	atomic_t nr_drained;
+};
+
+static void ion_page_pool_pcp_drain(void *data)
+{
+	struct ion_page_pool_drain *drain = data;
+	struct ion_page_pool *pool = drain->pool;
+	struct ion_page_pool_pcp *pcp = this_cpu_ptr(pool->pcp);
+
+	atomic_add(pcp->count, &drain->nr_drained);
+	while (pcp->count)
+		ion_page_pool_free_pages(pool, pcp->pages[--pcp->count]);
+}
+
+static int ion_page_pool_pcp_total(struct ion_page_pool *pool)
+{
+	int total = 0;
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		total += per_cpu_ptr(pool->pcp, cpu)->count;
+	return total;
+}
+
 void *ion_page_pool_alloc(struct ion_page_pool *pool)
 {
 	struct page *page = NULL;
 
 	BUG_ON(!pool);
 
+	page = ion_page_pool_pcp_get(pool);
+	if (page)
+		return page;
+
 	mutex_lock(&pool->mutex);
 	if (pool->high_count)
 		page = ion_page_pool_remove(pool, true);
@@ -107,21 +177,70 @@ void *ion_page_pool_alloc(struct ion_page_pool *pool)
 		page = ion_page_pool_remove(pool, false);
 	mutex_unlock(&pool->mutex);
 
-	if (!page)
-		page = ion_page_pool_alloc_pages(pool);
+	if (page) {
+		this_cpu_inc(pool->pcp->pool_hits);
+		return page;
+	}
 
-	return page;
+	this_cpu_inc(pool->pcp->misses);
+	return ion_page_pool_alloc_pages(pool);
 }
 
 void ion_page_pool_free(struct ion_page_pool *pool, struct page* page)
 {
 	int ret;
 
+	if (ion_page_pool_pcp_put(pool, page))
+		return;
+
 	ret = ion_page_pool_add(pool, page);
 	if (ret)
 		ion_page_pool_free_pages(pool, page);
 }
 
+int ion_page_pool_fill(struct ion_page_pool *pool, int nr)
+{
+	int i;
+
+	for (i = 0; i < nr; i++) {
+		struct page *page = ion_page_pool_alloc_pages(pool);
+
+		if (!page)
+			break;
+		if (ion_page_pool_add(pool, page)) {
+			ion_page_pool_free_pages(pool, page);
+			break;
+		}
+	}
+	return i;
+}
+
+int ion_page_pool_count(struct ion_page_pool *pool)
+{
+	int count;
+
+	mutex_lock(&pool->mutex);
+	count = pool->high_count + pool->low_count;
+	mutex_unlock(&pool->mutex);
+	return count;
+}
+
+void ion_page_pool_get_stats(struct ion_page_pool *pool,
+			     struct ion_page_pool_stats *stats)
+{
+	int cpu;
+
+	memset(stats, 0, sizeof(*stats));
+	for_each_possible_cpu(cpu) {
+		struct ion_page_pool_pcp *pcp = per_cpu_ptr(pool->pcp, cpu);
+
+		stats->pcp_count += pcp->count;
+		stats->pcp_hits += pcp->hits;
+		stats->pool_hits += pcp->pool_hits;
+		stats->misses += pcp->misses;
+	}
+}
+
 static int ion_page_pool_total(struct ion_page_pool *pool, bool high)
 {
 	int total = 0;
@@ -129,6 +248,9 @@ static int ion_page_pool_total(struct ion_page_pool *pool, bool high)
 	total += high ? (pool->high_count + pool->low_count) *
 		(1 << pool->order) :
 			pool->low_count * (1 << pool->order);
+	/* the per cpu caches hold both kinds, only count them for highmem */
+	if (high)
+		total += ion_page_pool_pcp_total(pool) * (1 << pool->order);
 	return total;
 }
 
@@ -161,15 +283,37 @@ int ion_page_pool_shrink(struct ion_page_pool *pool, gfp_t gfp_mask,
 		nr_freed += (1 << pool->order);
 	}
 
+	/* the shared lists are empty, take the per cpu caches as well */
+	if (high && i < nr_to_scan) {
+		struct ion_page_pool_drain drain = {
+			.pool = pool,
+			.nr_drained = ATOMIC_INIT(0),
+		};
+
+		on_each_cpu(ion_page_pool_pcp_drain, &drain, 1);
+		nr_freed += atomic_read(&drain.nr_drained) *
+			    (1 << pool->order);
+	}
+
 	return nr_freed;
 }
 
 struct ion_page_pool *ion_page_pool_create(gfp_t gfp_mask, unsigned int order)
 {
-	struct ion_page_pool *pool = kmalloc(sizeof(struct ion_page_pool),
+	struct ion_page_pool *pool = kzalloc(sizeof(struct ion_page_pool),
 					     GFP_KERNEL);
 	if (!pool)
 		return NULL;
+	pool->pcp = alloc_percpu(struct ion_page_pool_pcp);
+	if (!pool->pcp) {
+		kfree(pool);
+		return NULL;
+	}
+	/*
+	 * keep the same amount of memory per cpu for every order, but at
+	 * least one page for the large ones
+	 */
+	pool->pcp_max = max(1, ION_PAGE_POOL_PCP_PAGES >> order);
 	pool->high_count = 0;
 	pool->low_count = 0;
 	INIT_LIST_HEAD(&pool->low_items);
@@ -184,6 +328,13 @@ struct ion_page_pool *ion_page_pool_create(gfp_t gfp_mask, unsigned int order)
 
 void ion_page_pool_destroy(struct ion_page_pool *pool)
 {
+	struct ion_page_pool_drain drain = {
+		.pool = pool,
+		.nr_drained = ATOMIC_INIT(0),
+	};
+
+	on_each_cpu(ion_page_pool_pcp_drain, &drain, 1);
+	free_percpu(pool->pcp);
 	kfree(pool);
 }
 
@@ -18,6 +18,7 @@
 #define _ION_PRIV_H
 
 #include <linux/ion.h>
+#include <linux/ktime.h>
 #include <linux/kref.h>
 #include <linux/mm_types.h>
 #include <linux/mutex.h>
@@ -56,6 +57,7 @@ struct ion_handle {
  * @dev:		back pointer to the ion_device
  * @heap:		back pointer to the heap the buffer came from
  * @flags:		buffer specific flags
+ * @private_flags:	internal buffer specific flags
  * @size:		size of the buffer
  * @priv_virt:		private data to the buffer representable as
  *			a void *
@@ -84,6 +86,7 @@ struct ion_buffer {
 	struct ion_device *dev;
 	struct ion_heap *heap;
 	unsigned long flags;
+	unsigned long private_flags;
 	size_t size;
 	union {
 		void *priv_virt;
@@ -138,6 +141,51 @@ struct ion_heap_ops {
  * heap flags - flags between the heaps and core ion code
  */
 #define ION_HEAP_FLAG_DEFER_FREE (1 << 0)
+/*
+ * The heap does the real work of an allocation outside of ops->allocate
+ * and accounts it with ion_heap_account_alloc itself.
+ */
+#define ION_HEAP_FLAG_OWN_ALLOC_STATS (1 << 3)
+
+/**
+ * private flags - flags internal to ion
+ */
+/*
+ * Buffer is being freed from a shrinker function. Skip any possible
+ * heap-specific caching mechanism (e.g. page pools). Guarantees that
+ * any buffer storage that came from the system allocator will be
+ * returned to the system allocator.
+ */
+#define ION_PRIV_FLAG_SHRINKER_FREE (1 << 0)
+/*
+ * The buffer's physical address has been handed out, through ion_phys,
+ * an sg_table or a userspace mapping.  Heaps that can move buffers to
+ * defragment must leave it where it is from now on.  Set under
+ * buffer->lock.
+ */
+#define ION_PRIV_FLAG_PINNED (1 << 1)
+
+#define ION_HEAP_STAT_BUCKETS	20
+
+/**
+ * struct ion_heap_stats - allocation statistics of a heap
+ * @latency:		histogram of allocation latency, bucket n counts
+ *			allocations that took less than 2^n us
+ * @size:		histogram of allocation size, bucket n counts
+ *			allocations of up to 2^n pages
+ * @allocs:		number of successful allocations
+ * @failures:		number of failed allocations
+ * @max_latency_us:	slowest allocation, successful or not
+ *
+ * The last bucket of each histogram also counts everything above it.
+ */
+struct ion_heap_stats {
+	atomic_t latency[ION_HEAP_STAT_BUCKETS];
+	atomic_t size[ION_HEAP_STAT_BUCKETS];
+	atomic_t allocs;
+	atomic_t failures;
+	atomic_t max_latency_us;
+};
 
 /**
  * struct ion_heap - represents a heap in the system
@@ -161,6 +209,7 @@ struct ion_heap_ops {
  * @task:		task struct of deferred free thread
  * @debug_show:		called when heap debug file is read to add any
  *			heap specific debug info to output
+ * @stats:		allocation latency and size statistics
  *
  * Represents a pool of memory from which buffers can be made.  In some
  * systems the only heap is regular system memory allocated via vmalloc.
@@ -182,6 +231,7 @@ struct ion_heap {
 	wait_queue_head_t waitqueue;
 	struct task_struct *task;
 	int (*debug_show)(struct ion_heap *heap, struct seq_file *, void *);
+	struct ion_heap_stats stats;
 };
 
 /**
@@ -225,6 +275,15 @@ void ion_device_destroy(struct ion_device *dev);
  */
 void ion_device_add_heap(struct ion_device *dev, struct ion_heap *heap);
 
+/**
+ * ion_device_add_policies - adds allocation policies to the ion device
+ * @dev:		the device
+ * @policies:		array of policies, must outlive the device
+ * @nr:			number of entries in @policies
+ */
+void ion_device_add_policies(struct ion_device *dev,
+			     struct ion_platform_policy *policies, int nr);
+
 /**
  * some helpers for common operations on buffers using the sg_table
  * and vaddr fields
@@ -248,6 +307,35 @@ int ion_heap_buffer_zero(struct ion_buffer *buffer);
 struct page *ion_heap_alloc_pages(struct ion_buffer *buffer, gfp_t gfp_flags,
 				  unsigned int order);
 
+/**
+ * ion_heap_account_alloc - add an allocation attempt to the heap statistics
+ * @heap:		the heap
+ * @len:		size of the allocation
+ * @start:		when the allocation started
+ * @error:		0 if it succeeded, the -errno otherwise
+ */
+void ion_heap_account_alloc(struct ion_heap *heap, size_t len, ktime_t start,
+			    int error);
+
+/**
+ * ion_heap_stats_show - print the heap statistics
+ * @heap:		the heap
+ * @s:			seq_file of the heap debug file
+ */
+void ion_heap_stats_show(struct ion_heap *heap, struct seq_file *s);
+
+/**
+ * ion_gen_pool_show_extents - print the free space layout of a gen_pool
+ * @pool:		the pool backing a carveout style heap
+ * @s:			seq_file of the heap debug file
+ *
+ * Prints the total free space, the largest free extent and a fragmentation
+ * index: the percentage of free space that is not part of the largest
+ * extent.
+ */
+struct gen_pool;
+void ion_gen_pool_show_extents(struct gen_pool *pool, struct seq_file *s);
+
 /**
  * ion_heap_init_deferred_free -- initialize deferred free functionality
  * @heap:		the heap
@@ -279,6 +367,20 @@ void ion_heap_freelist_add(struct ion_heap *heap, struct ion_buffer *buffer);
  */
 size_t ion_heap_freelist_drain(struct ion_heap *heap, size_t size);
 
+/**
+ * ion_heap_freelist_shrink - drain the deferred free list, skipping any
+ *				heap-specific pooling or caching mechanisms
+ * @heap:		the heap
+ * @size:		amount of memory to drain in bytes
+ *
+ * Drains the indicated amount of memory from the deferred freelist
+ * immediately, like ion_heap_freelist_drain, but the buffers are freed
+ * with ION_PRIV_FLAG_SHRINKER_FREE set so the heap returns their memory
+ * straight to the system instead of zeroing it for its own pools.  Meant
+ * to be called from a shrinker.
+ */
+size_t ion_heap_freelist_shrink(struct ion_heap *heap, size_t size);
+
 /**
  * ion_heap_freelist_size - returns the size of the freelist in bytes
  * @heap:		the heap
@@ -329,6 +431,26 @@ void ion_carveout_free(struct ion_heap *heap, ion_phys_addr_t addr,
  * invalidated from the cache, provides a significant peformance benefit on
  * many systems */
 
+#define ION_PAGE_POOL_PCP_PAGES	16
+
+/**
+ * struct ion_page_pool_pcp - per cpu cache in front of a pagepool
+ * @count:		number of pages in @pages
+ * @pages:		the cached pages, used as a stack
+ * @hits:		allocations served from this cache
+ * @pool_hits:		allocations on this cpu served from the shared lists
+ * @misses:		allocations on this cpu that went to the page allocator
+ *
+ * Only ever touched by its own cpu with interrupts disabled.
+ */
+struct ion_page_pool_pcp {
+	int count;
+	struct page *pages[ION_PAGE_POOL_PCP_PAGES];
+	unsigned long hits;
+	unsigned long pool_hits;
+	unsigned long misses;
+};
+
 /**
  * struct ion_page_pool - pagepool struct
  * @high_count:		number of highmem items in the pool
@@ -345,6 +467,10 @@ void ion_carveout_free(struct ion_heap *heap, ion_phys_addr_t addr,
  * @gfp_mask:		gfp_mask to use from alloc
  * @order:		order of pages in the pool
  * @list:		plist node for list of pools
+ * @pcp:		per cpu caches, tried before taking @mutex
+ * @pcp_max:		number of pages each per cpu cache may hold
+ * @low_wm:		the heap refills the pool when it has fewer items
+ * @high_wm:		number of items the heap refills the pool to
  *
  * Allows you to keep a pool of pre allocated pages to use from your heap.
  * Keeping a pool of pages that is ready for dma, ie any cached mapping have
@@ -360,6 +486,24 @@ struct ion_page_pool {
 	gfp_t gfp_mask;
 	unsigned int order;
 	struct plist_node list;
+	struct ion_page_pool_pcp __percpu *pcp;
+	int pcp_max;
+	int low_wm;
+	int high_wm;
+};
+
+/**
+ * struct ion_page_pool_stats - pagepool counters summed over all cpus
+ * @pcp_count:		pages in the per cpu caches
+ * @pcp_hits:		allocations served from a per cpu cache
+ * @pool_hits:		allocations served from the shared lists
+ * @misses:		allocations that went to the page allocator
+ */
+struct ion_page_pool_stats {
+	int pcp_count;
+	unsigned long pcp_hits;
+	unsigned long pool_hits;
+	unsigned long misses;
 };
 
 struct ion_page_pool *ion_page_pool_create(gfp_t gfp_mask, unsigned int order);
@@ -367,6 +511,23 @@ void ion_page_pool_destroy(struct ion_page_pool *);
 void *ion_page_pool_alloc(struct ion_page_pool *);
 void ion_page_pool_free(struct ion_page_pool *, struct page *);
 
+/** ion_page_pool_fill - add freshly allocated items to the shared lists
+ * @pool:		the pool
+ * @nr:			number of items to add
+ *
+ * returns the number of items added, which is less than @nr if the page
+ * allocator could not provide them with the pool's gfp_mask
+ */
+int ion_page_pool_fill(struct ion_page_pool *pool, int nr);
+
+/** ion_page_pool_count - number of items on the shared lists
+ * @pool:		the pool
+ */
+int ion_page_pool_count(struct ion_page_pool *pool);
+
+void ion_page_pool_get_stats(struct ion_page_pool *pool,
+			     struct ion_page_pool_stats *stats);
+
 /** ion_page_pool_shrink - shrinks the size of the memory cached in the pool
  * @pool:		the pool
  * @gfp_mask:		the memory type to reclaim
@@ -17,8 +17,10 @@
 #include <asm/page.h>
 #include <linux/dma-mapping.h>
 #include <linux/err.h>
+#include <linux/freezer.h>
 #include <linux/highmem.h>
 #include <linux/ion.h>
+#include <linux/kthread.h>
 #include <linux/mm.h>
 #include <linux/scatterlist.h>
 #include <linux/seq_file.h>
@@ -33,6 +35,10 @@ static unsigned int low_order_gfp_flags  = (GFP_HIGHUSER | __GFP_ZERO |
 					 __GFP_NOWARN);
 static const unsigned int orders[] = {8, 4, 0};
 static const int num_orders = ARRAY_SIZE(orders);
+/* pool watermarks in items, order 0 pages are never prefilled */
+static const int low_wms[] = {1, 8, 0};
+static const int high_wms[] = {4, 32, 0};
+#define ION_POOL_REFILL_INTERVAL	(2 * HZ)
 static int order_to_index(unsigned int order)
 {
 	int i;
@@ -51,6 +57,9 @@ static unsigned int order_to_size(int order)
 struct ion_system_heap {
 	struct ion_heap heap;
 	struct ion_page_pool **pools;
+	struct task_struct *refill_task;
+	wait_queue_head_t refill_wait;
+	bool refill_requested;
 };
 
 struct page_info {
@@ -95,7 +104,7 @@ static void free_buffer_page(struct ion_system_heap *heap,
 	bool split_pages = ion_buffer_fault_user_mappings(buffer);
 	int i;
 
-	if (!cached) {
+	if (!cached && !(buffer->private_flags & ION_PRIV_FLAG_SHRINKER_FREE)) {
 		struct ion_page_pool *pool = heap->pools[order_to_index(order)];
 		ion_page_pool_free(pool, page);
 	} else if (split_pages) {
@@ -107,6 +116,63 @@ static void free_buffer_page(struct ion_system_heap *heap,
 }
 
 
+static bool ion_system_heap_memory_low(void)
+{
+	return global_page_state(NR_FREE_PAGES) < totalram_pages / 16;
+}
+
+static void ion_system_heap_kick_refill(struct ion_system_heap *sys_heap)
+{
+	int i;
+
+	for (i = 0; i < num_orders; i++) {
+		struct ion_page_pool *pool = sys_heap->pools[i];
+
+		if (pool->high_count + pool->low_count < pool->low_wm) {
+			sys_heap->refill_requested = true;
+			wake_up(&sys_heap->refill_wait);
+			return;
+		}
+	}
+}
+
+/*
+ * Keeps the high order pools between their watermarks so that large
+ * allocations find ready pages instead of going to the page allocator
+ * with a no-retry gfp mask.  Pools are only filled while memory is
+ * plentiful; under pressure they are cut back to their low watermark.
+ */
+static int ion_system_heap_refill(void *data)
+{
+	struct ion_system_heap *sys_heap = data;
+	int i;
+
+	set_freezable();
+	while (!kthread_should_stop()) {
+		for (i = 0; i < num_orders; i++) {
+			struct ion_page_pool *pool = sys_heap->pools[i];
+			int count;
+
+			if (!pool->high_wm)
+				continue;
+			count = ion_page_pool_count(pool);
+			if (ion_system_heap_memory_low()) {
+				if (count > pool->low_wm)
+					ion_page_pool_shrink(pool, __GFP_HIGHMEM,
+							     count - pool->low_wm);
+			} else if (count < pool->high_wm) {
+				ion_page_pool_fill(pool, pool->high_wm - count);
+			}
+		}
+		wait_event_freezable_timeout(sys_heap->refill_wait,
+					     sys_heap->refill_requested ||
+					     kthread_should_stop(),
+					     ION_POOL_REFILL_INTERVAL);
+		sys_heap->refill_requested = false;
+	}
+	return 0;
+}
+
 static struct page_info *alloc_largest_available(struct ion_system_heap *heap,
 						 struct ion_buffer *buffer,
 						 unsigned long size,
@@ -161,6 +227,7 @@ static int ion_system_heap_allocate(struct ion_heap *heap,
 		max_order = info->order;
 		i++;
 	}
+	ion_system_heap_kick_refill(sys_heap);
 
 	table = kmalloc(sizeof(struct sg_table), GFP_KERNEL);
 	if (!table)
@@ -205,7 +272,7 @@ void ion_system_heap_free(struct ion_buffer *buffer)
 
 	/* uncached pages come from the page pools, zero them before returning
 	   for security purposes (other allocations are zerod at alloc time */
-	if (!cached)
+	if (!cached && !(buffer->private_flags & ION_PRIV_FLAG_SHRINKER_FREE))
 		ion_heap_buffer_zero(buffer);
 
 	for_each_sg(table->sgl, sg, table->nents, i)
@@ -254,7 +321,7 @@ static int ion_system_heap_shrink(struct shrinker *shrinker,
 
 	/* shrink the free list first, no point in zeroing the memory if
 	   we're just going to reclaim it */
-	nr_freed += ion_heap_freelist_drain(heap, sc->nr_to_scan * PAGE_SIZE) /
+	nr_freed += ion_heap_freelist_shrink(heap, sc->nr_to_scan * PAGE_SIZE) /
 		PAGE_SIZE;
 
 	if (nr_freed >= sc->nr_to_scan)
@@ -288,15 +355,40 @@ static int ion_system_heap_debug_show(struct ion_heap *heap, struct seq_file *s,
 	struct ion_system_heap *sys_heap = container_of(heap,
 							struct ion_system_heap,
 							heap);
+	struct zone *zone;
 	int i;
 	for (i = 0; i < num_orders; i++) {
 		struct ion_page_pool *pool = sys_heap->pools[i];
+		struct ion_page_pool_stats stats;
+
+		ion_page_pool_get_stats(pool, &stats);
 		seq_printf(s, "%d order %u highmem pages in pool = %lu total\n",
 			   pool->high_count, pool->order,
 			   (1 << pool->order) * PAGE_SIZE * pool->high_count);
 		seq_printf(s, "%d order %u lowmem pages in pool = %lu total\n",
 			   pool->low_count, pool->order,
 			   (1 << pool->order) * PAGE_SIZE * pool->low_count);
+		seq_printf(s, "%d order %u pages in per cpu caches = %lu total\n",
+			   stats.pcp_count, pool->order,
+			   (1 << pool->order) * PAGE_SIZE * stats.pcp_count);
+		seq_printf(s, "order %u watermarks low %d high %d\n",
+			   pool->order, pool->low_wm, pool->high_wm);
+		seq_printf(s, "order %u hits: per cpu %lu pool %lu, misses %lu\n",
+			   pool->order, stats.pcp_hits, stats.pool_hits,
+			   stats.misses);
+	}
+
+	/* what the page allocator has left for each order, as in buddyinfo */
+	for_each_populated_zone(zone) {
+		unsigned long flags;
+		int order;
+
+		seq_printf(s, "free blocks per order in zone %s:", zone->name);
+		spin_lock_irqsave(&zone->lock, flags);
+		for (order = 0; order < MAX_ORDER; order++)
+			seq_printf(s, " %lu", zone->free_area[order].nr_free);
+		spin_unlock_irqrestore(&zone->lock, flags);
+		seq_printf(s, "\n");
 	}
 	return 0;
 }
@@ -304,6 +396,7 @@ static int ion_system_heap_debug_show(struct ion_heap *heap, struct seq_file *s,
 struct ion_heap *ion_system_heap_create(struct ion_platform_heap *unused)
 {
 	struct ion_system_heap *heap;
+	struct sched_param param = { .sched_priority = 0 };
 	int i;
 
 	heap = kzalloc(sizeof(struct ion_system_heap), GFP_KERNEL);
@@ -325,9 +418,21 @@ struct ion_heap *ion_system_heap_create(struct ion_platform_heap *unused)
 		pool = ion_page_pool_create(gfp_flags, orders[i]);
 		if (!pool)
 			goto err_create_pool;
+		pool->low_wm = low_wms[i];
+		pool->high_wm = high_wms[i];
 		heap->pools[i] = pool;
 	}
 
+	init_waitqueue_head(&heap->refill_wait);
+	heap->refill_task = kthread_run(ion_system_heap_refill, heap,
+					"ion_pool_refill");
+	if (IS_ERR(heap->refill_task)) {
+		pr_err("%s: creating thread for pool refill failed\n",
+		       __func__);
+		goto err_create_pool;
+	}
+	sched_setscheduler(heap->refill_task, SCHED_IDLE, &param);
+
 	heap->heap.shrinker.shrink = ion_system_heap_shrink;
 	heap->heap.shrinker.seeks = DEFAULT_SEEKS;
 	heap->heap.shrinker.batch = 0;
@@ -351,6 +456,7 @@ void ion_system_heap_destroy(struct ion_heap *heap)
 							heap);
 	int i;
 
+	kthread_stop(sys_heap->refill_task);
 	for (i = 0; i < num_orders; i++)
 		ion_page_pool_destroy(sys_heap->pools[i]);
 	kfree(sys_heap->pools);
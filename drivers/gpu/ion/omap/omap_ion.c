@@ -140,6 +140,13 @@ static int omap_ion_probe(struct platform_device *pdev)
 
 	}
 
+	ion_device_add_policies(omap_ion_device, pdata->policies,
+				pdata->nr_policies);
+	for (i = 0; i < pdata->nr_policies; i++)
+		pr_info("%s: adding policy %s with %d heaps as id %u\n",
+			__func__, pdata->policies[i].name,
+			pdata->policies[i].nr, pdata->policies[i].id);
+
 	platform_set_drvdata(pdev, omap_ion_device);
 	return 0;
 err:
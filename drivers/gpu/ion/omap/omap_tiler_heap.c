@@ -21,6 +21,7 @@
 #include <linux/mm.h>
 #include <linux/omap_ion.h>
 #include <linux/scatterlist.h>
+#include <linux/seq_file.h>
 #include <linux/slab.h>
 #include <linux/vmalloc.h>
 #include "../../../drivers/staging/omapdrm/omap_dmm_tiler.h"
@@ -222,6 +223,7 @@ int omap_tiler_alloc(struct ion_heap *heap,
 	int i = 0, ret;
 	uint32_t phys_stride, remainder;
 	dma_addr_t ssptr;
+	ktime_t start = ktime_get();
 
 	if (data->fmt == TILFMT_PAGE && data->h != 1) {
 		pr_err("%s: Page mode (1D) allocations must have a height of "
@@ -317,7 +319,7 @@ int omap_tiler_alloc(struct ion_heap *heap,
 	/* This hack is to avoid the call itself from ion_alloc()
 		when the buffer and handle are created */
 	handle = ion_alloc(client, PAGE_ALIGN(1), 0, OMAP_ION_HEAP_TILER_MASK,
-		heap->flags | OMAP_ION_FLAG_NO_ALLOC_TILER_HEAP);
+		OMAP_ION_FLAG_NO_ALLOC_TILER_HEAP);
 	if (IS_ERR_OR_NULL(handle)) {
 		ret = PTR_ERR(handle);
 		pr_err("%s: failure to allocate handle to manage "
@@ -336,6 +338,7 @@ int omap_tiler_alloc(struct ion_heap *heap,
 	data->handle = handle;
 	data->offset = (size_t)(info->tiler_start & ~PAGE_MASK);
 
+	ion_heap_account_alloc(heap, n_phys_pages << PAGE_SHIFT, start, 0);
 	return 0;
 
 err:
@@ -352,6 +355,7 @@ err_got_tiler:
 	tiler_release(info->tiler_handle);
 err_got_mem:
 	kfree(info);
+	ion_heap_account_alloc(heap, n_phys_pages << PAGE_SHIFT, start, ret);
 	return ret;
 }
 
@@ -496,6 +500,18 @@ static int omap_tiler_heap_map_user(struct ion_heap *heap,
 	return ret;
 }
 
+static int omap_tiler_heap_debug_show(struct ion_heap *heap,
+				      struct seq_file *s, void *unused)
+{
+	struct omap_ion_heap *omap_heap = (struct omap_ion_heap *)heap;
+
+	seq_printf(s, "%16.s %16s\n", "backing pages",
+		   use_dynamic_pages ? "dynamic" : "carveout");
+	if (omap_heap->pool && !use_dynamic_pages)
+		ion_gen_pool_show_extents(omap_heap->pool, s);
+	return 0;
+}
+
 static struct ion_heap_ops omap_tiler_ops = {
 	.allocate = omap_tiler_heap_allocate,
 	.free = omap_tiler_heap_free,
@@ -525,6 +541,9 @@ struct ion_heap *omap_tiler_heap_create(struct ion_platform_heap *data)
 	}
 	heap->heap.ops = &omap_tiler_ops;
 	heap->heap.type = OMAP_ION_HEAP_TILER;
+	/* the handle allocated through ion_alloc is only a placeholder */
+	heap->heap.flags = ION_HEAP_FLAG_OWN_ALLOC_STATS;
+	heap->heap.debug_show = omap_tiler_heap_debug_show;
 	heap->heap.name = data->name;
 	heap->heap.id = data->id;
 
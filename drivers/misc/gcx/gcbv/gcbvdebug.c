@@ -14,6 +14,7 @@
 
 #include <linux/debugfs.h>
 #include <linux/seq_file.h>
+#include <linux/tick.h>
 #include "gcbv.h"
 
 static struct dentry *debug_root;
@@ -198,6 +199,253 @@ static const struct file_operations fops_blt_stats = {
 
 /*****************************************************************************/
 
+/*
+ * Blit benchmark: reading "bench" times back to back asynchronous copies
+ * for a range of surface sizes and reports the blit rate and the CPU time
+ * spent per blit, counted as the time the CPUs were not idle.
+ */
+
+#define BENCH_MAX_WIDTH		1920
+#define BENCH_MAX_HEIGHT	1080
+#define BENCH_BPP		4
+
+/* Pixels copied for each size, within the blit count limits. */
+#define BENCH_PIXELS		(BENCH_MAX_WIDTH * BENCH_MAX_HEIGHT * 64)
+#define BENCH_MIN_BLITS		64
+#define BENCH_MAX_BLITS		2048
+
+static const struct {
+	unsigned int width;
+	unsigned int height;
+} bench_size[] = {
+	{   64,   64 },
+	{  128,  128 },
+	{  256,  256 },
+	{  512,  512 },
+	{ 1280,  720 },
+	{ 1920, 1080 },
+};
+
+struct bench_surface {
+	struct bvbuffdesc desc;
+	struct bvphysdesc pdesc;
+	unsigned long *pages;
+	unsigned int count;
+};
+
+static void bench_free(struct bench_surface *surf)
+{
+	unsigned int i;
+
+	if (surf->desc.map != NULL)
+		bv_unmap(&surf->desc);
+
+	for (i = 0; i < surf->count; i++)
+		__free_page(pfn_to_page(surf->pages[i] >> PAGE_SHIFT));
+
+	kfree(surf->pages);
+}
+
+static int bench_alloc(struct bench_surface *surf)
+{
+	unsigned int count;
+	struct page *page;
+
+	memset(surf, 0, sizeof(*surf));
+
+	count = DIV_ROUND_UP(BENCH_MAX_WIDTH * BENCH_MAX_HEIGHT * BENCH_BPP,
+			     PAGE_SIZE);
+	surf->pages = kcalloc(count, sizeof(unsigned long), GFP_KERNEL);
+	if (surf->pages == NULL)
+		return -ENOMEM;
+
+	for (surf->count = 0; surf->count < count; surf->count++) {
+		page = alloc_page(GFP_KERNEL);
+		if (page == NULL)
+			goto fail;
+
+		surf->pages[surf->count] = page_to_phys(page);
+	}
+
+	surf->pdesc.structsize = sizeof(surf->pdesc);
+	surf->pdesc.pagesize = PAGE_SIZE;
+	surf->pdesc.pagearray = surf->pages;
+	surf->pdesc.pagecount = count;
+
+	surf->desc.structsize = sizeof(surf->desc);
+	surf->desc.length = count << PAGE_SHIFT;
+	surf->desc.auxtype = BVAT_PHYSDESC;
+	surf->desc.auxptr = &surf->pdesc;
+
+	/* Map once so that the blits don't map and unmap the surfaces. */
+	if (bv_map(&surf->desc) == BVERR_NONE)
+		return 0;
+
+fail:
+	bench_free(surf);
+	return -ENOMEM;
+}
+
+/* Total idle time of the online CPUs in microseconds. */
+static u64 bench_idle_us(void)
+{
+	u64 idle, total = 0;
+	int cpu;
+
+	for_each_online_cpu(cpu) {
+		idle = get_cpu_idle_time_us(cpu, NULL);
+		if (idle == -1ULL)
+			return -1ULL;
+
+		total += idle;
+	}
+
+	return total;
+}
+
+/*
+ * Blits complete in order, so once a synchronous blit returns the
+ * asynchronous ones queued before it are done with the surfaces.
+ */
+static int bench_drain(struct bench_surface *src, struct bench_surface *dst)
+{
+	struct bvsurfgeom geom = {
+		.structsize = sizeof(geom),
+		.format = OCDFMT_BGRA24,
+		.width = 1,
+		.height = 1,
+		.virtstride = BENCH_BPP,
+	};
+	struct bvbltparams params = {
+		.structsize = sizeof(params),
+		.flags = BVFLAG_ROP,
+		.op.rop = 0xCCCC,
+		.dstdesc = &dst->desc,
+		.dstgeom = &geom,
+		.dstrect = { 0, 0, 1, 1 },
+		.src1.desc = &src->desc,
+		.src1geom = &geom,
+		.src1rect = { 0, 0, 1, 1 },
+	};
+
+	return (bv_blt(&params) == BVERR_NONE) ? 0 : -EIO;
+}
+
+/* Returns non-zero if blits may still be pending on the surfaces. */
+static int bench_run(struct seq_file *s,
+		     struct bench_surface *src, struct bench_surface *dst,
+		     unsigned int width, unsigned int height)
+{
+	struct bvsurfgeom geom = {
+		.structsize = sizeof(geom),
+		.format = OCDFMT_BGRA24,
+		.width = width,
+		.height = height,
+		.virtstride = width * BENCH_BPP,
+	};
+	struct bvbltparams params = {
+		.structsize = sizeof(params),
+		.flags = BVFLAG_ROP | BVFLAG_ASYNC,
+		.op.rop = 0xCCCC,
+		.dstdesc = &dst->desc,
+		.dstgeom = &geom,
+		.dstrect = { 0, 0, width, height },
+		.src1.desc = &src->desc,
+		.src1geom = &geom,
+		.src1rect = { 0, 0, width, height },
+	};
+	enum bverror bverror = BVERR_NONE;
+	unsigned int count, i;
+	u64 idle, busy, wall;
+	ktime_t start;
+
+	count = clamp_t(unsigned int, BENCH_PIXELS / (width * height),
+			BENCH_MIN_BLITS, BENCH_MAX_BLITS);
+
+	idle = bench_idle_us();
+	start = ktime_get();
+
+	for (i = 0; (i < count) && (bverror == BVERR_NONE); i++) {
+		/* The last blit waits for all of them to finish. */
+		if (i == count - 1)
+			params.flags &= ~BVFLAG_ASYNC;
+
+		bverror = bv_blt(&params);
+	}
+
+	wall = ktime_us_delta(ktime_get(), start);
+
+	seq_printf(s, "%4ux%-4u %6u", width, height, count);
+
+	if (bverror != BVERR_NONE) {
+		seq_printf(s, "  blit %u failed (%d)\n", i, bverror);
+		return bench_drain(src, dst);
+	}
+
+	seq_printf(s, " %8llu",
+		   div64_u64((u64) count * USEC_PER_SEC, wall ? wall : 1));
+
+	if (idle == -1ULL) {
+		seq_printf(s, " %12s\n", "n/a");
+		return 0;
+	}
+
+	idle = bench_idle_us() - idle;
+	wall *= num_online_cpus();
+	busy = (wall > idle) ? wall - idle : 0;
+
+	seq_printf(s, " %12llu\n", div_u64(busy, count));
+	return 0;
+}
+
+static int bench_show(struct seq_file *s, void *data)
+{
+	struct bench_surface src, dst;
+	unsigned int i;
+
+	if (bench_alloc(&src) != 0) {
+		seq_printf(s, "failed to allocate surfaces\n");
+		return 0;
+	}
+
+	if (bench_alloc(&dst) != 0) {
+		seq_printf(s, "failed to allocate surfaces\n");
+		bench_free(&src);
+		return 0;
+	}
+
+	seq_printf(s, "%-9s %6s %8s %12s\n",
+		   "size", "blits", "blits/s", "cpu us/blit");
+
+	for (i = 0; i < countof(bench_size); i++) {
+		if (bench_run(s, &src, &dst,
+			      bench_size[i].width, bench_size[i].height)) {
+			/* The GPU may still write them; leak rather than free. */
+			seq_printf(s, "blits still pending, surfaces leaked\n");
+			return 0;
+		}
+	}
+
+	bench_free(&dst);
+	bench_free(&src);
+
+	return 0;
+}
+
+static int bench_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, bench_show, 0);
+}
+
+static const struct file_operations fops_bench = {
+	.open = bench_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+/*****************************************************************************/
+
 void gcbv_debug_init(void)
 {
 	debug_root = debugfs_create_dir("gcbv", NULL);
@@ -208,6 +456,8 @@ void gcbv_debug_init(void)
 			    &fops_blt_stats);
 	debugfs_create_file("batch_finalize_reason", 0664, debug_root, NULL,
 			    &fops_bfr);
+	debugfs_create_file("bench", 0444, debug_root, NULL,
+			    &fops_bench);
 }
 
 void gcbv_debug_shutdown(void)
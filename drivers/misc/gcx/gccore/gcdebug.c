@@ -510,6 +510,36 @@ static const struct file_operations gc_debug_fops_cur_freq = {
 
 /*****************************************************************************/
 
+static int gc_debug_show_queue(struct seq_file *s, void *data)
+{
+	struct gcqueuestats stats;
+
+	gc_get_queue_stats(&stats);
+
+	seq_printf(s, "executes: %u\n", stats.executes);
+	seq_printf(s, "coalesced: %u\n", stats.coalesced);
+	seq_printf(s, "command buffers: %u\n", stats.cmdbufs);
+	seq_printf(s, "interrupts: %u\n", stats.interrupts);
+	seq_printf(s, "thread wakeups: %u\n", stats.wakeups);
+
+	return 0;
+}
+
+static int gc_debug_open_queue(struct inode *inode, struct file *file)
+{
+	return single_open(file, gc_debug_show_queue, 0);
+}
+
+static const struct file_operations gc_debug_fops_queue = {
+	.open    = gc_debug_open_queue,
+	.write   = NULL,
+	.read    = seq_read,
+	.llseek  = seq_lseek,
+	.release = single_release,
+};
+
+/*****************************************************************************/
+
 void gc_debug_init(void)
 {
 	struct dentry *logDir;
@@ -528,6 +558,8 @@ void gc_debug_init(void)
 			    &gc_cache_status_every_irq);
 	debugfs_create_file("cur_freq", 0664, debug_root, NULL,
 			    &gc_debug_fops_cur_freq);
+	debugfs_create_file("queue", 0444, debug_root, NULL,
+			    &gc_debug_fops_queue);
 
 	logDir = debugfs_create_dir("log", debug_root);
 	if (!logDir)
@@ -397,6 +397,18 @@ enum gcpower gcpwr_get(void)
 	return g_context.gcpower;
 }
 
+void gc_get_queue_stats(struct gcqueuestats *gcqueuestats)
+{
+	struct gcqueue *gcqueue = &g_context.gcqueue;
+
+	/* Return the statistics collected since the driver was loaded. */
+	gcqueuestats->executes = atomic_read(&gcqueue->stats.executes);
+	gcqueuestats->coalesced = atomic_read(&gcqueue->stats.coalesced);
+	gcqueuestats->cmdbufs = atomic_read(&gcqueue->stats.cmdbufs);
+	gcqueuestats->interrupts = atomic_read(&gcqueue->stats.interrupts);
+	gcqueuestats->wakeups = atomic_read(&gcqueue->stats.wakeups);
+}
+
 void gcpwr_reset(struct gccorecontext *gccorecontext)
 {
 	union gcclockcontrol gcclockcontrol;
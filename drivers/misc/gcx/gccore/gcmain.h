@@ -111,4 +111,11 @@ void gcpwr_set(struct gccorecontext *gccorecontext, enum gcpower gcpower);
 void gcpwr_reset(struct gccorecontext *gccorecontext);
 unsigned int gcpwr_get_speed(void);
 
+
+/*******************************************************************************
+ * Command queue statistics.
+ */
+
+void gc_get_queue_stats(struct gcqueuestats *gcqueuestats);
+
 #endif
@@ -85,6 +85,12 @@ GCDBG_FILTERDEF(queue, GCZONE_NONE,
 /* Minimum available space requirement. */
 #define GC_MIN_THRESHOLD	((int) (GC_TAIL_RESERVE + 200))
 
+/* Asynchronous executes that come within this many microseconds of the
+ * last command buffer sent to the GPU are merged into one command buffer,
+ * up to GC_COALESCE_COUNT of them. */
+#define GC_COALESCE_WINDOW	200
+#define GC_COALESCE_COUNT	8
+
 /* Event assignment. */
 #define GC_SIG_BUS_ERROR	31
 #define GC_SIG_MMU_ERROR	30
@@ -134,11 +140,18 @@ static irqreturn_t gcisr(int irq, void *_gccorecontext)
 	}
 
 	/* Command buffer event? */
-	if (triggered != 0)
+	if (triggered != 0) {
 		atomic_add(triggered, &gcqueue->triggered);
+		atomic_inc(&gcqueue->stats.interrupts);
+	}
 
-	/* Release the command buffer thread. */
-	complete(&gcqueue->ready);
+	/* Release the command buffer thread unless it has been released
+	 * already and hasn't picked up the triggered interrupts yet; it
+	 * will process all of them in one pass. */
+	if (atomic_xchg(&gcqueue->isrpending, 1) == 0) {
+		atomic_inc(&gcqueue->stats.wakeups);
+		complete(&gcqueue->ready);
+	}
 
 	/* IRQ handled. */
 	return IRQ_HANDLED;
@@ -574,6 +587,11 @@ static int gccmdthread(void *_gccorecontext)
 		if (signaled < 0)
 			continue;
 
+		/* Let the ISR release the thread again for interrupts that
+		 * trigger from now on. */
+		atomic_set(&gcqueue->isrpending, 0);
+		smp_mb();
+
 		/* Get triggered interrupts. */
 		ints2process = triggered = atomic_read(&gcqueue->triggered);
 		GCDBG(GCZONE_THREAD, "int = 0x%08X.\n", triggered);
@@ -886,6 +904,101 @@ static int gccmdthread(void *_gccorecontext)
 	return 0;
 }
 
+/*******************************************************************************
+ * Execute coalescing.
+ */
+
+static enum gcerror execute_cmdbuf(struct gccorecontext *gccorecontext,
+				   bool switchtonext, bool asynchronous);
+
+static bool coalesce_execute(struct gcqueue *gcqueue,
+			     bool switchtonext, bool asynchronous)
+{
+	/* Storage switches and synchronous executes can't wait. */
+	if (switchtonext || !asynchronous)
+		return false;
+
+	/* The MMU flush is finalized against the end of the buffer. */
+	if (gcqueue->flushlogical != NULL)
+		return false;
+
+	/* Let the storage buffer switch happen. */
+	if (gcqueue->available < GC_MIN_THRESHOLD)
+		return false;
+
+	/* Nothing to overlap with if the GPU is idle. */
+	if (completion_done(&gcqueue->stopped))
+		return false;
+
+	/* Only merge executes that come back to back. */
+	if (gcqueue->coalesced >= GC_COALESCE_COUNT)
+		return false;
+
+	if (ktime_us_delta(ktime_get(), gcqueue->lastexec)
+			> GC_COALESCE_WINDOW)
+		return false;
+
+	/* Send the buffer if no other execute follows in time. */
+	if (gcqueue->coalesced == 0)
+		hrtimer_start(&gcqueue->coalescetimer,
+			      ns_to_ktime(GC_COALESCE_WINDOW * NSEC_PER_USEC),
+			      HRTIMER_MODE_REL);
+
+	gcqueue->coalesced += 1;
+	atomic_inc(&gcqueue->stats.coalesced);
+
+	GCDBG(GCZONE_EXEC, "holding back execute %d.\n", gcqueue->coalesced);
+	return true;
+}
+
+static void flush_coalesced(struct gccorecontext *gccorecontext)
+{
+	enum gcerror gcerror;
+	struct gcqueue *gcqueue;
+
+	GCENTER(GCZONE_EXEC);
+
+	/* Get a shortcut to the queue object. */
+	gcqueue = &gccorecontext->gcqueue;
+
+	/* The queue is protected by the MMU context lock. */
+	GCLOCK(&gccorecontext->mmucontextlock);
+
+	if (gcqueue->coalesced != 0) {
+		GCDBG(GCZONE_EXEC, "sending %d held back executes.\n",
+		      gcqueue->coalesced);
+
+		gcerror = execute_cmdbuf(gccorecontext, false, true);
+		if (gcerror != GCERR_NONE)
+			GCERR("failed to execute (gcerror = 0x%08X).\n",
+			      gcerror);
+	}
+
+	GCUNLOCK(&gccorecontext->mmucontextlock);
+
+	GCEXIT(GCZONE_EXEC);
+}
+
+static void coalesce_work(struct work_struct *work)
+{
+	struct gcqueue *gcqueue;
+
+	gcqueue = container_of(work, struct gcqueue, coalescework);
+	flush_coalesced(container_of(gcqueue, struct gccorecontext, gcqueue));
+}
+
+static enum hrtimer_restart coalesce_timer(struct hrtimer *timer)
+{
+	struct gcqueue *gcqueue;
+
+	/* Can't take the lock here; send the buffer from process context. */
+	gcqueue = container_of(timer, struct gcqueue, coalescetimer);
+	schedule_work(&gcqueue->coalescework);
+
+	return HRTIMER_NORESTART;
+}
+
+
 /*******************************************************************************
  * Command buffer API.
  */
@@ -909,6 +1022,12 @@ enum gcerror gcqueue_start(struct gccorecontext *gccorecontext)
 	/* ISR not installed yet. */
 	gcqueue->isrroutine = -1;
 
+	/* Initialize execute coalescing. */
+	hrtimer_init(&gcqueue->coalescetimer, CLOCK_MONOTONIC,
+		     HRTIMER_MODE_REL);
+	gcqueue->coalescetimer.function = coalesce_timer;
+	INIT_WORK(&gcqueue->coalescework, coalesce_work);
+
 	/* Initialize all storage buffers. */
 	for (i = 0; i < GC_STORAGE_COUNT; i += 1) {
 		/* Get a shortcut to the current storage buffer. */
@@ -948,6 +1067,7 @@ enum gcerror gcqueue_start(struct gccorecontext *gccorecontext)
 	/* Initialize interrupt tracking. */
 	GCLOCK_INIT(&gcqueue->intusedlock);
 	atomic_set(&gcqueue->triggered, 0);
+	atomic_set(&gcqueue->isrpending, 0);
 
 	/* Mark all interrupts as available. */
 	init_completion(&gcqueue->freeint);
@@ -1032,6 +1152,10 @@ enum gcerror gcqueue_stop(struct gccorecontext *gccorecontext)
 	/* Get a shortcut to the queue object. */
 	gcqueue = &gccorecontext->gcqueue;
 
+	/* Stop execute coalescing. */
+	hrtimer_cancel(&gcqueue->coalescetimer);
+	cancel_work_sync(&gcqueue->coalescework);
+
 	/* Stop the command buffer thread. */
 	if (gcqueue->cmdthread != NULL) {
 		GCDBG(GCZONE_INIT, "stopping the command queue thread.\n");
@@ -1467,8 +1591,8 @@ enum gcerror gcqueue_free(struct gccorecontext *gccorecontext,
 	return GCERR_NONE;
 }
 
-enum gcerror gcqueue_execute(struct gccorecontext *gccorecontext,
-			     bool switchtonext, bool asynchronous)
+static enum gcerror execute_cmdbuf(struct gccorecontext *gccorecontext,
+				   bool switchtonext, bool asynchronous)
 {
 	enum gcerror gcerror = GCERR_NONE;
 	struct gcqueue *gcqueue;
@@ -1605,6 +1729,15 @@ enum gcerror gcqueue_execute(struct gccorecontext *gccorecontext,
 
 	/* Append the current command buffer to the queue. */
 	append_cmdbuf(gccorecontext, gcqueue);
+	atomic_inc(&gcqueue->stats.cmdbufs);
+
+	/* Held back executes went out with the buffer. */
+	if (gcqueue->coalesced != 0) {
+		hrtimer_try_to_cancel(&gcqueue->coalescetimer);
+		gcqueue->coalesced = 0;
+	}
+
+	gcqueue->lastexec = ktime_get();
 
 	/* Wait for completion. */
 	if (!asynchronous) {
@@ -1619,6 +1752,27 @@ exit:
 	return gcerror;
 }
 
+enum gcerror gcqueue_execute(struct gccorecontext *gccorecontext,
+			     bool switchtonext, bool asynchronous)
+{
+	struct gcqueue *gcqueue;
+
+	/* Get a shortcut to the queue object. */
+	gcqueue = &gccorecontext->gcqueue;
+
+	/* Nothing to execute? */
+	if (list_empty(&gcqueue->cmdbufhead))
+		return GCERR_NONE;
+
+	atomic_inc(&gcqueue->stats.executes);
+
+	/* Keep the command buffer open for the next execute? */
+	if (coalesce_execute(gcqueue, switchtonext, asynchronous))
+		return GCERR_NONE;
+
+	return execute_cmdbuf(gccorecontext, switchtonext, asynchronous);
+}
+
 enum gcerror gcqueue_wait_idle(struct gccorecontext *gccorecontext)
 {
 	enum gcerror gcerror = GCERR_NONE;
@@ -1628,6 +1782,10 @@ enum gcerror gcqueue_wait_idle(struct gccorecontext *gccorecontext)
 
 	GCENTER(GCZONE_THREAD);
 
+	/* Send the executes held back for coalescing. */
+	hrtimer_cancel(&gcqueue->coalescetimer);
+	flush_coalesced(gccorecontext);
+
 	/* Indicate shutdown immediately. */
 	gcqueue->suspend = true;
 	complete(&gcqueue->ready);
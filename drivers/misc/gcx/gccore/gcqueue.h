@@ -16,6 +16,8 @@
 #define GCQUEUE_H
 
 #include <linux/gccore.h>
+#include <linux/hrtimer.h>
+#include <linux/workqueue.h>
 
 
 /*******************************************************************************
@@ -110,6 +112,32 @@ struct gccmdbuf {
 	struct list_head link;
 };
 
+/* Command queue statistics. */
+struct gcqueuestats {
+	/* Number of non-empty gcqueue_execute calls. */
+	unsigned int executes;
+
+	/* Number of executes merged into the following command buffer. */
+	unsigned int coalesced;
+
+	/* Number of command buffers sent to the GPU. */
+	unsigned int cmdbufs;
+
+	/* Number of command buffer interrupts and the number of times the
+	 * command buffer thread was released by the ISR. */
+	unsigned int interrupts;
+	unsigned int wakeups;
+};
+
+/* Counters behind gcqueuestats; the ISR updates some of them. */
+struct gcqueuecounters {
+	atomic_t executes;
+	atomic_t coalesced;
+	atomic_t cmdbufs;
+	atomic_t interrupts;
+	atomic_t wakeups;
+};
+
 /* Command queue object. */
 struct gcqueue {
 	/* ISR installed flag. */
@@ -137,6 +165,10 @@ struct gcqueue {
 	/* Bit mask containing triggered interrupts. */
 	atomic_t triggered;
 
+	/* Set by the ISR when it releases the command buffer thread, reset
+	 * by the thread before it picks up the triggered interrupts. */
+	atomic_t isrpending;
+
 	/* The tail of the last command buffer. */
 	struct gcmoterminator *gcmoterminator;
 
@@ -177,6 +209,18 @@ struct gcqueue {
 	/* MMU flush pointers. */
 	struct gcmommuflush *flushlogical;
 	unsigned int flushaddress;
+
+	/* Execute coalescing: the time the last command buffer was sent
+	 * to the GPU, the number of executes held back in the current
+	 * command buffer and the timer and work that send it when no
+	 * other execute follows. */
+	ktime_t lastexec;
+	unsigned int coalesced;
+	struct hrtimer coalescetimer;
+	struct work_struct coalescework;
+
+	/* Queue statistics. */
+	struct gcqueuecounters stats;
 };
 
 
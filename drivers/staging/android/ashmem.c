@@ -27,6 +27,8 @@
 #include <linux/personality.h>
 #include <linux/bitops.h>
 #include <linux/mutex.h>
+#include <linux/rbtree.h>
+#include <linux/spinlock.h>
 #include <linux/shmem_fs.h>
 #include "ashmem.h"
 
@@ -37,12 +39,13 @@
 /*
  * ashmem_area - anonymous shared memory area
  * Lifecycle: From our parent file's open() until its release()
- * Locking: Protected by `ashmem_mutex'
+ * Locking: Protected by its own `mutex'
  * Big Note: Mappings do NOT pin this structure; it dies on close()
  */
 struct ashmem_area {
 	char name[ASHMEM_FULL_NAME_LEN]; /* optional name in /proc/pid/maps */
-	struct list_head unpinned_list;	 /* list of all ashmem areas */
+	struct rb_root unpinned_root;	 /* unpinned ranges, by pgstart */
+	struct mutex mutex;		 /* protects the area and its ranges */
 	struct file *file;		 /* the shmem-based backing file */
 	size_t size;			 /* size of the mapping, in bytes */
 	unsigned long prot_mask;	 /* allowed prot bits, as vm_flags */
@@ -51,29 +54,36 @@ struct ashmem_area {
 /*
  * ashmem_range - represents an interval of unpinned (evictable) pages
  * Lifecycle: From unpin to pin
- * Locking: Protected by `ashmem_mutex'
+ * Locking: Protected by its area's `mutex', `lru' also by `ashmem_lru_lock'
+ *
+ * The ranges of an area never overlap, so ordering them by pgstart also
+ * orders them by pgend and the tree can be searched like an interval tree.
  */
 struct ashmem_range {
 	struct list_head lru;		/* entry in LRU list */
-	struct list_head unpinned;	/* entry in its area's unpinned list */
+	struct rb_node node;		/* entry in its area's unpinned tree */
 	struct ashmem_area *asma;	/* associated area */
 	size_t pgstart;			/* starting page, inclusive */
 	size_t pgend;			/* ending page, inclusive */
 	unsigned int purged;		/* ASHMEM_NOT or ASHMEM_WAS_PURGED */
 };
 
-/* LRU list of unpinned pages, protected by ashmem_mutex */
+/* LRU list of unpinned pages, protected by ashmem_lru_lock */
 static LIST_HEAD(ashmem_lru_list);
 
-/* Count of pages on our LRU list, protected by ashmem_mutex */
+/* Count of pages on our LRU list, protected by ashmem_lru_lock */
 static unsigned long lru_count;
 
 /*
- * ashmem_mutex - protects the list of and each individual ashmem_area
+ * ashmem_lru_lock - protects the LRU list and lru_count
+ *
+ * Lock Ordering: asma->mutex -> i_mutex -> i_alloc_sem
+ *		  asma->mutex -> ashmem_lru_lock
  *
- * Lock Ordering: ashmex_mutex -> i_mutex -> i_alloc_sem
+ * The shrinker walks the LRU under ashmem_lru_lock and only trylocks the
+ * area mutex, so it never waits for, nor blocks, unrelated areas.
  */
-static DEFINE_MUTEX(ashmem_mutex);
+static DEFINE_SPINLOCK(ashmem_lru_lock);
 
 static struct kmem_cache *ashmem_area_cachep __read_mostly;
 static struct kmem_cache *ashmem_range_cachep __read_mostly;
@@ -90,13 +100,6 @@ static struct kmem_cache *ashmem_range_cachep __read_mostly;
 #define page_range_subsumed_by_range(range, start, end) \
 	(((range)->pgstart <= (start)) && ((range)->pgend >= (end)))
 
-#define page_in_range(range, page) \
-	(((range)->pgstart <= (page)) && ((range)->pgend >= (page)))
-
-#define page_range_in_range(range, start, end) \
-	(page_in_range(range, start) || page_in_range(range, end) || \
-		page_range_subsumes_range(range, start, end))
-
 #define range_before_page(range, page) \
 	((range)->pgend < (page))
 
@@ -104,29 +107,90 @@ static struct kmem_cache *ashmem_range_cachep __read_mostly;
 
 static inline void lru_add(struct ashmem_range *range)
 {
+	spin_lock(&ashmem_lru_lock);
 	list_add_tail(&range->lru, &ashmem_lru_list);
 	lru_count += range_size(range);
+	spin_unlock(&ashmem_lru_lock);
 }
 
-static inline void lru_del(struct ashmem_range *range)
+/* Caller must hold ashmem_lru_lock */
+static inline void __lru_del(struct ashmem_range *range)
 {
 	list_del(&range->lru);
 	lru_count -= range_size(range);
 }
 
+static inline void lru_del(struct ashmem_range *range)
+{
+	spin_lock(&ashmem_lru_lock);
+	__lru_del(range);
+	spin_unlock(&ashmem_lru_lock);
+}
+
+/*
+ * range_first - find the lowest range of 'asma' ending at or after 'pgstart'
+ *
+ * Returns NULL if there is none. The caller walks on with range_next()
+ * while the ranges start at or before its last page.
+ *
+ * Caller must hold asma->mutex.
+ */
+static struct ashmem_range *range_first(struct ashmem_area *asma,
+					size_t pgstart)
+{
+	struct rb_node *node = asma->unpinned_root.rb_node;
+	struct ashmem_range *range, *first = NULL;
+
+	while (node) {
+		range = rb_entry(node, struct ashmem_range, node);
+		if (range_before_page(range, pgstart)) {
+			node = node->rb_right;
+		} else {
+			first = range;
+			node = node->rb_left;
+		}
+	}
+
+	return first;
+}
+
+static inline struct ashmem_range *range_next(struct ashmem_range *range)
+{
+	struct rb_node *next = rb_next(&range->node);
+
+	return next ? rb_entry(next, struct ashmem_range, node) : NULL;
+}
+
+static void range_insert(struct ashmem_area *asma, struct ashmem_range *range)
+{
+	struct rb_node **p = &asma->unpinned_root.rb_node;
+	struct rb_node *parent = NULL;
+	struct ashmem_range *entry;
+
+	while (*p) {
+		parent = *p;
+		entry = rb_entry(parent, struct ashmem_range, node);
+		if (range->pgstart < entry->pgstart)
+			p = &parent->rb_left;
+		else
+			p = &parent->rb_right;
+	}
+
+	rb_link_node(&range->node, parent, p);
+	rb_insert_color(&range->node, &asma->unpinned_root);
+}
+
 /*
  * range_alloc - allocate and initialize a new ashmem_range structure
  *
  * 'asma' - associated ashmem_area
- * 'prev_range' - the previous ashmem_range in the sorted asma->unpinned list
  * 'purged' - initial purge value (ASMEM_NOT_PURGED or ASHMEM_WAS_PURGED)
  * 'start' - starting page, inclusive
  * 'end' - ending page, inclusive
  *
- * Caller must hold ashmem_mutex.
+ * Caller must hold asma->mutex.
  */
-static int range_alloc(struct ashmem_area *asma,
-		       struct ashmem_range *prev_range, unsigned int purged,
+static int range_alloc(struct ashmem_area *asma, unsigned int purged,
 		       size_t start, size_t end)
 {
 	struct ashmem_range *range;
@@ -140,7 +204,7 @@ static int range_alloc(struct ashmem_area *asma,
 	range->pgend = end;
 	range->purged = purged;
 
-	list_add_tail(&range->unpinned, &prev_range->unpinned);
+	range_insert(asma, range);
 
 	if (range_on_lru(range))
 		lru_add(range);
@@ -150,7 +214,7 @@ static int range_alloc(struct ashmem_area *asma,
 
 static void range_del(struct ashmem_range *range)
 {
-	list_del(&range->unpinned);
+	rb_erase(&range->node, &range->asma->unpinned_root);
 	if (range_on_lru(range))
 		lru_del(range);
 	kmem_cache_free(ashmem_range_cachep, range);
@@ -159,7 +223,10 @@ static void range_del(struct ashmem_range *range)
 /*
  * range_shrink - shrinks a range
  *
- * Caller must hold ashmem_mutex.
+ * The new interval lies within the old one, so the range keeps its place
+ * in the tree.
+ *
+ * Caller must hold asma->mutex.
  */
 static inline void range_shrink(struct ashmem_range *range,
 				size_t start, size_t end)
@@ -169,8 +236,11 @@ static inline void range_shrink(struct ashmem_range *range,
 	range->pgstart = start;
 	range->pgend = end;
 
-	if (range_on_lru(range))
+	if (range_on_lru(range)) {
+		spin_lock(&ashmem_lru_lock);
 		lru_count -= pre - range_size(range);
+		spin_unlock(&ashmem_lru_lock);
+	}
 }
 
 static int ashmem_open(struct inode *inode, struct file *file)
@@ -186,7 +256,8 @@ static int ashmem_open(struct inode *inode, struct file *file)
 	if (unlikely(!asma))
 		return -ENOMEM;
 
-	INIT_LIST_HEAD(&asma->unpinned_list);
+	asma->unpinned_root = RB_ROOT;
+	mutex_init(&asma->mutex);
 	memcpy(asma->name, ASHMEM_NAME_PREFIX, ASHMEM_NAME_PREFIX_LEN);
 	asma->prot_mask = PROT_MASK;
 	file->private_data = asma;
@@ -197,12 +268,12 @@ static int ashmem_open(struct inode *inode, struct file *file)
 static int ashmem_release(struct inode *ignored, struct file *file)
 {
 	struct ashmem_area *asma = file->private_data;
-	struct ashmem_range *range, *next;
+	struct rb_node *node;
 
-	mutex_lock(&ashmem_mutex);
-	list_for_each_entry_safe(range, next, &asma->unpinned_list, unpinned)
-		range_del(range);
-	mutex_unlock(&ashmem_mutex);
+	mutex_lock(&asma->mutex);
+	while ((node = rb_first(&asma->unpinned_root)))
+		range_del(rb_entry(node, struct ashmem_range, node));
+	mutex_unlock(&asma->mutex);
 
 	if (asma->file)
 		fput(asma->file);
@@ -217,7 +288,7 @@ static ssize_t ashmem_read(struct file *file, char __user *buf,
 	struct ashmem_area *asma = file->private_data;
 	int ret = 0;
 
-	mutex_lock(&ashmem_mutex);
+	mutex_lock(&asma->mutex);
 
 	/* If size is not set, or set to 0, always return EOF. */
 	if (asma->size == 0)
@@ -228,7 +299,7 @@ static ssize_t ashmem_read(struct file *file, char __user *buf,
 		goto out_unlock;
 	}
 
-	mutex_unlock(&ashmem_mutex);
+	mutex_unlock(&asma->mutex);
 
 	/*
 	 * asma and asma->file are used outside the lock here.  We assume
@@ -244,7 +315,7 @@ static ssize_t ashmem_read(struct file *file, char __user *buf,
 	return ret;
 
 out_unlock:
-	mutex_unlock(&ashmem_mutex);
+	mutex_unlock(&asma->mutex);
 	return ret;
 }
 
@@ -253,7 +324,7 @@ static loff_t ashmem_llseek(struct file *file, loff_t offset, int origin)
 	struct ashmem_area *asma = file->private_data;
 	int ret;
 
-	mutex_lock(&ashmem_mutex);
+	mutex_lock(&asma->mutex);
 
 	if (asma->size == 0) {
 		ret = -EINVAL;
@@ -273,7 +344,7 @@ static loff_t ashmem_llseek(struct file *file, loff_t offset, int origin)
 	file->f_pos = asma->file->f_pos;
 
 out:
-	mutex_unlock(&ashmem_mutex);
+	mutex_unlock(&asma->mutex);
 	return ret;
 }
 
@@ -289,7 +360,7 @@ static int ashmem_mmap(struct file *file, struct vm_area_struct *vma)
 	struct ashmem_area *asma = file->private_data;
 	int ret = 0;
 
-	mutex_lock(&ashmem_mutex);
+	mutex_lock(&asma->mutex);
 
 	/* user needs to SET_SIZE before mapping */
 	if (unlikely(!asma->size)) {
@@ -332,7 +403,7 @@ static int ashmem_mmap(struct file *file, struct vm_area_struct *vma)
 	vma->vm_flags |= VM_CAN_NONLINEAR;
 
 out:
-	mutex_unlock(&ashmem_mutex);
+	mutex_unlock(&asma->mutex);
 	return ret;
 }
 
@@ -349,11 +420,13 @@ out:
  *
  * We approximate LRU via least-recently-unpinned, jettisoning unpinned partial
  * chunks of ashmem regions LRU-wise one-at-a-time until we hit 'nr_to_scan'
- * pages freed.
+ * pages freed. Ranges of areas whose mutex is busy are skipped and keep
+ * their place on the LRU.
  */
 static int ashmem_shrink(struct shrinker *s, struct shrink_control *sc)
 {
-	struct ashmem_range *range, *next;
+	struct ashmem_range *range;
+	LIST_HEAD(busy);
 
 	/* We might recurse into filesystem code, so bail out if necessary */
 	if (sc->nr_to_scan && !(sc->gfp_mask & __GFP_FS))
@@ -361,23 +434,44 @@ static int ashmem_shrink(struct shrinker *s, struct shrink_control *sc)
 	if (!sc->nr_to_scan)
 		return lru_count;
 
-	if (!mutex_trylock(&ashmem_mutex))
-		return -1;
+	spin_lock(&ashmem_lru_lock);
+	while (!list_empty(&ashmem_lru_list)) {
+		struct ashmem_area *asma;
+		struct inode *inode;
+		loff_t start, end;
 
-	list_for_each_entry_safe(range, next, &ashmem_lru_list, lru) {
-		struct inode *inode = range->asma->file->f_dentry->d_inode;
-		loff_t start = range->pgstart * PAGE_SIZE;
-		loff_t end = (range->pgend + 1) * PAGE_SIZE - 1;
+		range = list_first_entry(&ashmem_lru_list,
+					 struct ashmem_range, lru);
+		asma = range->asma;
+
+		/*
+		 * The range cannot go away while it is on the LRU and we
+		 * hold the lock, and its area cannot go away while we hold
+		 * the area mutex.
+		 */
+		if (!mutex_trylock(&asma->mutex)) {
+			list_move_tail(&range->lru, &busy);
+			continue;
+		}
 
-		vmtruncate_range(inode, start, end);
 		range->purged = ASHMEM_WAS_PURGED;
-		lru_del(range);
+		__lru_del(range);
+		spin_unlock(&ashmem_lru_lock);
 
+		inode = asma->file->f_dentry->d_inode;
+		start = range->pgstart * PAGE_SIZE;
+		end = (range->pgend + 1) * PAGE_SIZE - 1;
+		vmtruncate_range(inode, start, end);
 		sc->nr_to_scan -= range_size(range);
+
+		mutex_unlock(&asma->mutex);
+		spin_lock(&ashmem_lru_lock);
+
 		if (sc->nr_to_scan <= 0)
 			break;
 	}
-	mutex_unlock(&ashmem_mutex);
+	list_splice(&busy, &ashmem_lru_list);
+	spin_unlock(&ashmem_lru_lock);
 
 	return lru_count;
 }
@@ -391,7 +485,7 @@ static int set_prot_mask(struct ashmem_area *asma, unsigned long prot)
 {
 	int ret = 0;
 
-	mutex_lock(&ashmem_mutex);
+	mutex_lock(&asma->mutex);
 
 	/* the user can only remove, not add, protection bits */
 	if (unlikely((asma->prot_mask & prot) != prot)) {
@@ -406,7 +500,7 @@ static int set_prot_mask(struct ashmem_area *asma, unsigned long prot)
 	asma->prot_mask = prot;
 
 out:
-	mutex_unlock(&ashmem_mutex);
+	mutex_unlock(&asma->mutex);
 	return ret;
 }
 
@@ -421,7 +515,7 @@ static int set_name(struct ashmem_area *asma, void __user *name)
 		return len;
 	if (len == ASHMEM_NAME_LEN)
 		lname[ASHMEM_NAME_LEN - 1] = '\0';
-	mutex_lock(&ashmem_mutex);
+	mutex_lock(&asma->mutex);
 
 	/* cannot change an existing mapping's name */
 	if (unlikely(asma->file))
@@ -429,7 +523,7 @@ static int set_name(struct ashmem_area *asma, void __user *name)
 	else
 		strcpy(asma->name + ASHMEM_NAME_PREFIX_LEN, lname);
 
-	mutex_unlock(&ashmem_mutex);
+	mutex_unlock(&asma->mutex);
 	return ret;
 }
 
@@ -439,7 +533,7 @@ static int get_name(struct ashmem_area *asma, void __user *name)
 	char lname[ASHMEM_NAME_LEN];
 	size_t len;
 
-	mutex_lock(&ashmem_mutex);
+	mutex_lock(&asma->mutex);
 	if (asma->name[ASHMEM_NAME_PREFIX_LEN] != '\0') {
 		/*
 		 * Copying only `len', instead of ASHMEM_NAME_LEN, bytes
@@ -451,7 +545,7 @@ static int get_name(struct ashmem_area *asma, void __user *name)
 		len = strlen(ASHMEM_NAME_DEF) + 1;
 		memcpy(lname, ASHMEM_NAME_DEF, len);
 	}
-	mutex_unlock(&ashmem_mutex);
+	mutex_unlock(&asma->mutex);
 	if (unlikely(copy_to_user(name, lname, len)))
 		ret = -EFAULT;
 	return ret;
@@ -461,17 +555,17 @@ static int get_name(struct ashmem_area *asma, void __user *name)
  * ashmem_pin - pin the given ashmem region, returning whether it was
  * previously purged (ASHMEM_WAS_PURGED) or not (ASHMEM_NOT_PURGED).
  *
- * Caller must hold ashmem_mutex.
+ * Caller must hold asma->mutex.
  */
 static int ashmem_pin(struct ashmem_area *asma, size_t pgstart, size_t pgend)
 {
 	struct ashmem_range *range, *next;
 	int ret = ASHMEM_NOT_PURGED;
 
-	list_for_each_entry_safe(range, next, &asma->unpinned_list, unpinned) {
-		/* moved past last applicable page; we can short circuit */
-		if (range_before_page(range, pgstart))
-			break;
+	/* every range visited here intersects [pgstart, pgend] */
+	for (range = range_first(asma, pgstart);
+	     range && range->pgstart <= pgend; range = next) {
+		next = range_next(range);
 
 		/*
 		 * The user can ask us to pin pages that span multiple ranges,
@@ -488,37 +582,34 @@ static int ashmem_pin(struct ashmem_area *asma, size_t pgstart, size_t pgend)
 		 *    so we have to update one side of the range and then
 		 *    create a new range for the other side.
 		 */
-		if (page_range_in_range(range, pgstart, pgend)) {
-			ret |= range->purged;
-
-			/* Case #1: Easy. Just nuke the whole thing. */
-			if (page_range_subsumes_range(range, pgstart, pgend)) {
-				range_del(range);
-				continue;
-			}
-
-			/* Case #2: We overlap from the start, so adjust it */
-			if (range->pgstart >= pgstart) {
-				range_shrink(range, pgend + 1, range->pgend);
-				continue;
-			}
-
-			/* Case #3: We overlap from the rear, so adjust it */
-			if (range->pgend <= pgend) {
-				range_shrink(range, range->pgstart, pgstart-1);
-				continue;
-			}
-
-			/*
-			 * Case #4: We eat a chunk out of the middle. A bit
-			 * more complicated, we allocate a new range for the
-			 * second half and adjust the first chunk's endpoint.
-			 */
-			range_alloc(asma, range, range->purged,
-				    pgend + 1, range->pgend);
+		ret |= range->purged;
+
+		/* Case #1: Easy. Just nuke the whole thing. */
+		if (page_range_subsumes_range(range, pgstart, pgend)) {
+			range_del(range);
+			continue;
+		}
+
+		/* Case #2: We overlap from the start, so adjust it */
+		if (range->pgstart >= pgstart) {
+			range_shrink(range, pgend + 1, range->pgend);
+			continue;
+		}
+
+		/* Case #3: We overlap from the rear, so adjust it */
+		if (range->pgend <= pgend) {
 			range_shrink(range, range->pgstart, pgstart - 1);
-			break;
+			continue;
 		}
+
+		/*
+		 * Case #4: We eat a chunk out of the middle. A bit
+		 * more complicated, we allocate a new range for the
+		 * second half and adjust the first chunk's endpoint.
+		 */
+		range_alloc(asma, range->purged, pgend + 1, range->pgend);
+		range_shrink(range, range->pgstart, pgstart - 1);
+		break;
 	}
 
 	return ret;
@@ -527,59 +618,47 @@ static int ashmem_pin(struct ashmem_area *asma, size_t pgstart, size_t pgend)
 /*
  * ashmem_unpin - unpin the given range of pages. Returns zero on success.
  *
- * Caller must hold ashmem_mutex.
+ * Caller must hold asma->mutex.
  */
 static int ashmem_unpin(struct ashmem_area *asma, size_t pgstart, size_t pgend)
 {
-	struct ashmem_range *range, *next;
+	struct ashmem_range *range;
 	unsigned int purged = ASHMEM_NOT_PURGED;
 
-restart:
-	list_for_each_entry_safe(range, next, &asma->unpinned_list, unpinned) {
-		/* short circuit: this is our insertion point */
-		if (range_before_page(range, pgstart))
-			break;
-
-		/*
-		 * The user can ask us to unpin pages that are already entirely
-		 * or partially pinned. We handle those two cases here.
-		 */
+	/*
+	 * The user can ask us to unpin pages that are already entirely
+	 * or partially pinned. We handle those two cases here, merging
+	 * every range we overlap into the new one.
+	 */
+	while ((range = range_first(asma, pgstart)) &&
+	       range->pgstart <= pgend) {
 		if (page_range_subsumed_by_range(range, pgstart, pgend))
 			return 0;
-		if (page_range_in_range(range, pgstart, pgend)) {
-			pgstart = min_t(size_t, range->pgstart, pgstart),
-			pgend = max_t(size_t, range->pgend, pgend);
-			purged |= range->purged;
-			range_del(range);
-			goto restart;
-		}
+
+		pgstart = min_t(size_t, range->pgstart, pgstart);
+		pgend = max_t(size_t, range->pgend, pgend);
+		purged |= range->purged;
+		range_del(range);
 	}
 
-	return range_alloc(asma, range, purged, pgstart, pgend);
+	return range_alloc(asma, purged, pgstart, pgend);
 }
 
 /*
  * ashmem_get_pin_status - Returns ASHMEM_IS_UNPINNED if _any_ pages in the
  * given interval are unpinned and ASHMEM_IS_PINNED otherwise.
  *
- * Caller must hold ashmem_mutex.
+ * Caller must hold asma->mutex.
  */
 static int ashmem_get_pin_status(struct ashmem_area *asma, size_t pgstart,
 				 size_t pgend)
 {
-	struct ashmem_range *range;
-	int ret = ASHMEM_IS_PINNED;
+	struct ashmem_range *range = range_first(asma, pgstart);
 
-	list_for_each_entry(range, &asma->unpinned_list, unpinned) {
-		if (range_before_page(range, pgstart))
-			break;
-		if (page_range_in_range(range, pgstart, pgend)) {
-			ret = ASHMEM_IS_UNPINNED;
-			break;
-		}
-	}
+	if (range && range->pgstart <= pgend)
+		return ASHMEM_IS_UNPINNED;
 
-	return ret;
+	return ASHMEM_IS_PINNED;
 }
 
 static int ashmem_pin_unpin(struct ashmem_area *asma, unsigned long cmd,
@@ -611,7 +690,7 @@ static int ashmem_pin_unpin(struct ashmem_area *asma, unsigned long cmd,
 	pgstart = pin.offset / PAGE_SIZE;
 	pgend = pgstart + (pin.len / PAGE_SIZE) - 1;
 
-	mutex_lock(&ashmem_mutex);
+	mutex_lock(&asma->mutex);
 
 	switch (cmd) {
 	case ASHMEM_PIN:
@@ -625,7 +704,7 @@ static int ashmem_pin_unpin(struct ashmem_area *asma, unsigned long cmd,
 		break;
 	}
 
-	mutex_unlock(&ashmem_mutex);
+	mutex_unlock(&asma->mutex);
 
 	return ret;
 }
@@ -691,6 +770,34 @@ static const struct file_operations ashmem_fops = {
 	.compat_ioctl = ashmem_ioctl,
 };
 
+/*
+ * ashmem_get_backing_file - get the shmem file behind an ashmem fd
+ *
+ * Returns the backing file with a reference held, or NULL if @file is not
+ * a readable ashmem region that has been mapped at least once. The region
+ * size is returned in @size.
+ */
+struct file *ashmem_get_backing_file(struct file *file, size_t *size)
+{
+	struct ashmem_area *asma;
+	struct file *backing = NULL;
+
+	if (file->f_op != &ashmem_fops)
+		return NULL;
+
+	asma = file->private_data;
+	mutex_lock(&asma->mutex);
+	if (asma->file && (asma->prot_mask & PROT_READ)) {
+		backing = asma->file;
+		get_file(backing);
+		*size = asma->size;
+	}
+	mutex_unlock(&asma->mutex);
+
+	return backing;
+}
+EXPORT_SYMBOL(ashmem_get_backing_file);
+
 static struct miscdevice ashmem_misc = {
 	.minor = MISC_DYNAMIC_MINOR,
 	.name = "ashmem",
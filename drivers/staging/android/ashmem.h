@@ -46,4 +46,18 @@ struct ashmem_pin {
 #define ASHMEM_GET_PIN_STATUS	_IO(__ASHMEMIOC, 9)
 #define ASHMEM_PURGE_ALL_CACHES	_IO(__ASHMEMIOC, 10)
 
+#ifdef __KERNEL__
+struct file;
+
+#ifdef CONFIG_ASHMEM
+struct file *ashmem_get_backing_file(struct file *file, size_t *size);
+#else
+static inline struct file *ashmem_get_backing_file(struct file *file,
+						   size_t *size)
+{
+	return NULL;
+}
+#endif
+#endif	/* __KERNEL__ */
+
 #endif	/* _LINUX_ASHMEM_H */
@@ -35,10 +35,26 @@
 #include <linux/vmalloc.h>
 #include <linux/slab.h>
 #include <linux/security.h>
+#include <linux/shmem_fs.h>
 
+#include "ashmem.h"
 #include "binder.h"
 #include "binder_trace.h"
 
+/*
+ * Locking:
+ *
+ * binder_main_lock protects the global object graph: nodes and refs and
+ * their counts, threads, transaction stacks, todo lists, death
+ * notifications and the global lists below. Every ioctl and poll takes it.
+ *
+ * proc->alloc_lock (mutex) protects the buffer allocator of a process:
+ * proc->buffers, free_buffers, allocated_buffers, pages and
+ * free_async_space. It nests inside binder_main_lock and may sleep while
+ * mapping pages, so it is taken before mm->mmap_sem.
+ *
+ * Order: binder_main_lock -> proc->alloc_lock.
+ */
 static DEFINE_MUTEX(binder_main_lock);
 static DEFINE_MUTEX(binder_deferred_lock);
 static DEFINE_MUTEX(binder_mmap_lock);
@@ -152,20 +168,20 @@ enum binder_stat_types {
 struct binder_stats {
 	int br[_IOC_NR(BR_FAILED_REPLY) + 1];
 	int bc[_IOC_NR(BC_DEAD_BINDER_DONE) + 1];
-	int obj_created[BINDER_STAT_COUNT];
-	int obj_deleted[BINDER_STAT_COUNT];
+	atomic_t obj_created[BINDER_STAT_COUNT];
+	atomic_t obj_deleted[BINDER_STAT_COUNT];
 };
 
 static struct binder_stats binder_stats;
 
 static inline void binder_stats_deleted(enum binder_stat_types type)
 {
-	binder_stats.obj_deleted[type]++;
+	atomic_inc(&binder_stats.obj_deleted[type]);
 }
 
 static inline void binder_stats_created(enum binder_stat_types type)
 {
-	binder_stats.obj_created[type]++;
+	atomic_inc(&binder_stats.obj_created[type]);
 }
 
 struct binder_transaction_log_entry {
@@ -274,9 +290,46 @@ struct binder_buffer {
 	struct binder_node *target_node;
 	size_t data_size;
 	size_t offsets_size;
+	size_t extra_size; /* room for BINDER_TYPE_FD_RANGE pages */
 	uint8_t data[0];
 };
 
+struct binder_lru_page {
+	struct list_head lru;
+	struct page *page_ptr;
+	struct binder_proc *proc;
+	bool borrowed; /* page cache page mapped for BINDER_TYPE_FD_RANGE */
+};
+
+/* Idle pages of all processes, protected by binder_lru_lock */
+static LIST_HEAD(binder_lru);
+static DEFINE_SPINLOCK(binder_lru_lock);
+static atomic_t binder_lru_count = ATOMIC_INIT(0);
+
+#define BINDER_MAP_BATCH	16
+#define BINDER_POOL_MIN_PAGES	4
+#define BINDER_AVG_SHIFT	4
+
+static int binder_pool_max_pages = 64;
+module_param_named(pool_max_pages, binder_pool_max_pages, int,
+		   S_IWUSR | S_IRUGO);
+
+struct binder_alloc_stats {
+	atomic64_t map_ns;
+	atomic_long_t pages_mapped;
+	atomic_long_t pool_hits;
+	atomic_long_t pool_misses;
+	atomic_long_t pages_reclaimed;
+};
+
+static struct binder_alloc_stats binder_alloc_stats;
+
+/* kernel prio scale, as in task_struct->normal_prio */
+struct binder_priority {
+	unsigned int sched_policy;
+	int prio;
+};
+
 enum binder_deferred_state {
 	BINDER_DEFERRED_PUT_FILES    = 0x01,
 	BINDER_DEFERRED_FLUSH        = 0x02,
@@ -299,12 +352,15 @@ struct binder_proc {
 	void *buffer;
 	ptrdiff_t user_buffer_offset;
 
+	struct mutex alloc_lock;
 	struct list_head buffers;
 	struct rb_root free_buffers;
 	struct rb_root allocated_buffers;
 	size_t free_async_space;
 
-	struct page **pages;
+	struct binder_lru_page *pages;
+	int pages_idle;
+	int avg_alloc_pages; /* pages per allocation << BINDER_AVG_SHIFT */
 	size_t buffer_size;
 	uint32_t buffer_free;
 	struct list_head todo;
@@ -315,7 +371,7 @@ struct binder_proc {
 	int requested_threads;
 	int requested_threads_started;
 	int ready_threads;
-	long default_priority;
+	struct binder_priority default_priority;
 	struct dentry *debugfs_entry;
 };
 
@@ -332,6 +388,7 @@ struct binder_thread {
 	struct binder_proc *proc;
 	struct rb_node rb_node;
 	int pid;
+	struct task_struct *task;
 	int looper;
 	struct binder_transaction *transaction_stack;
 	struct list_head todo;
@@ -352,13 +409,14 @@ struct binder_transaction {
 	struct binder_thread *to_thread;
 	struct binder_transaction *to_parent;
 	unsigned need_reply:1;
+	unsigned set_priority_called:1;
 	/* unsigned is_dead:1; */	/* not used at the moment */
 
 	struct binder_buffer *buffer;
 	unsigned int	code;
 	unsigned int	flags;
-	long	priority;
-	long	saved_priority;
+	struct binder_priority	priority;
+	struct binder_priority	saved_priority;
 	uid_t	sender_euid;
 };
 
@@ -502,10 +560,22 @@ out_unlock:
 	return -EBADF;
 }
 
+static inline void binder_mutex_lock(struct mutex *lock, const char *name,
+				     const char *tag)
+{
+	u64 start;
+
+	if (mutex_trylock(lock))
+		return;
+	start = local_clock();
+	mutex_lock(lock);
+	trace_binder_lock_contended(tag, name, local_clock() - start);
+}
+
 static inline void binder_lock(const char *tag)
 {
 	trace_binder_lock(tag);
-	mutex_lock(&binder_main_lock);
+	binder_mutex_lock(&binder_main_lock, "main", tag);
 	trace_binder_locked(tag);
 }
 
@@ -515,21 +585,129 @@ static inline void binder_unlock(const char *tag)
 	mutex_unlock(&binder_main_lock);
 }
 
-static void binder_set_nice(long nice)
+#define binder_alloc_lock(proc) \
+	binder_mutex_lock(&(proc)->alloc_lock, "alloc", __func__)
+#define binder_alloc_unlock(proc) mutex_unlock(&(proc)->alloc_lock)
+
+static bool binder_is_rt_policy(unsigned int policy)
 {
-	long min_nice;
-	if (can_nice(current, nice)) {
-		set_user_nice(current, nice);
+	return policy == SCHED_FIFO || policy == SCHED_RR;
+}
+
+static int binder_to_user_prio(unsigned int policy, int prio)
+{
+	if (binder_is_rt_policy(policy))
+		return MAX_USER_RT_PRIO - 1 - prio;
+	return prio - MAX_RT_PRIO - 20;	/* nice */
+}
+
+static int binder_to_kernel_prio(unsigned int policy, int user_prio)
+{
+	if (binder_is_rt_policy(policy))
+		return MAX_USER_RT_PRIO - 1 - user_prio;
+	return MAX_RT_PRIO + 20 + user_prio;
+}
+
+static void binder_get_priority(struct task_struct *task,
+				struct binder_priority *p)
+{
+	p->sched_policy = task->policy;
+	p->prio = task->normal_prio;
+}
+
+/*
+ * Give task the policy and priority in desired, or the closest it is
+ * allowed by its RLIMIT_RTPRIO and RLIMIT_NICE. An RT request that is not
+ * allowed at all falls back to the lowest nice value the task may use.
+ */
+static void binder_set_priority(struct task_struct *task,
+				struct binder_priority desired)
+{
+	unsigned int policy = desired.sched_policy;
+	int priority = binder_to_user_prio(policy, desired.prio);
+	int old_prio = task->normal_prio;
+	bool has_cap_nice;
+
+	if (task->policy == policy && task->normal_prio == desired.prio)
 		return;
+
+	has_cap_nice = has_capability_noaudit(task, CAP_SYS_NICE);
+	if (binder_is_rt_policy(policy) && !has_cap_nice) {
+		long max_rtprio = task_rlimit(task, RLIMIT_RTPRIO);
+
+		if (max_rtprio == 0) {
+			policy = SCHED_NORMAL;
+			priority = -20;
+		} else if (priority > max_rtprio) {
+			priority = max_rtprio;
+		}
+	}
+	if (!binder_is_rt_policy(policy) && !has_cap_nice) {
+		long min_nice = 20 - task_rlimit(task, RLIMIT_NICE);
+
+		if (min_nice > 19) {
+			binder_user_error("binder: %d RLIMIT_NICE not set\n",
+					  task->pid);
+			return;
+		}
+		if (priority < min_nice)
+			priority = min_nice;
+	}
+	if (policy != desired.sched_policy ||
+	    binder_to_kernel_prio(policy, priority) != desired.prio)
+		binder_debug(BINDER_DEBUG_PRIORITY_CAP,
+			     "binder: %d: priority %d not allowed, using %d "
+			     "instead\n", task->pid, desired.prio,
+			     binder_to_kernel_prio(policy, priority));
+
+	trace_binder_set_priority(task->tgid, task->pid, old_prio,
+				  desired.prio,
+				  binder_to_kernel_prio(policy, priority));
+
+	if (binder_is_rt_policy(policy)) {
+		struct sched_param params = { .sched_priority = priority };
+
+		sched_setscheduler_nocheck(task, policy | SCHED_RESET_ON_FORK,
+					   &params);
+	} else {
+		if (task->policy != policy) {
+			struct sched_param params = { .sched_priority = 0 };
+
+			sched_setscheduler_nocheck(task, policy, &params);
+		}
+		set_user_nice(task, priority);
 	}
-	min_nice = 20 - current->signal->rlim[RLIMIT_NICE].rlim_cur;
-	binder_debug(BINDER_DEBUG_PRIORITY_CAP,
-		     "binder: %d: nice value %ld not allowed use "
-		     "%ld instead\n", current->pid, nice, min_nice);
-	set_user_nice(current, min_nice);
-	if (min_nice < 20)
+}
+
+/*
+ * Move task, which is about to handle t, to the priority t carries. A
+ * synchronous transaction runs at the caller's policy and priority,
+ * including RT; a oneway one keeps the handler's own. Either way the
+ * handler runs at least at the node's min_priority. The handler's own
+ * priority is saved so the reply can restore it.
+ */
+static void binder_transaction_priority(struct task_struct *task,
+					struct binder_transaction *t,
+					struct binder_node *node)
+{
+	struct binder_priority node_prio = {
+		.sched_policy = SCHED_NORMAL,
+		.prio = binder_to_kernel_prio(SCHED_NORMAL, node->min_priority),
+	};
+	struct binder_priority desired;
+
+	if (t->set_priority_called)
 		return;
-	binder_user_error("binder: %d RLIMIT_NICE not set\n", current->pid);
+	t->set_priority_called = 1;
+	binder_get_priority(task, &t->saved_priority);
+
+	if (t->flags & TF_ONE_WAY)
+		desired = t->saved_priority;
+	else
+		desired = t->priority;
+	if (node_prio.prio < desired.prio)
+		desired = node_prio;
+	binder_set_priority(task, desired);
 }
 
 static size_t binder_buffer_size(struct binder_proc *proc,
@@ -624,15 +802,165 @@ static struct binder_buffer *binder_buffer_lookup(struct binder_proc *proc,
 	return NULL;
 }
 
+static void binder_lru_add(struct binder_proc *proc,
+			   struct binder_lru_page *page)
+{
+	spin_lock(&binder_lru_lock);
+	list_add_tail(&page->lru, &binder_lru);
+	spin_unlock(&binder_lru_lock);
+	atomic_inc(&binder_lru_count);
+	proc->pages_idle++;
+}
+
+static void binder_lru_del(struct binder_proc *proc,
+			   struct binder_lru_page *page)
+{
+	spin_lock(&binder_lru_lock);
+	list_del_init(&page->lru);
+	spin_unlock(&binder_lru_lock);
+	atomic_dec(&binder_lru_count);
+	proc->pages_idle--;
+}
+
+static int binder_pool_target(struct binder_proc *proc)
+{
+	int target = DIV_ROUND_UP(proc->avg_alloc_pages * 2,
+				  1 << BINDER_AVG_SHIFT);
+
+	return clamp_t(int, target, BINDER_POOL_MIN_PAGES,
+		       binder_pool_max_pages);
+}
+
+/* Called with alloc_lock held, and with mmap_sem held if vma is set. */
+static void binder_free_page(struct binder_proc *proc,
+			     struct binder_lru_page *page,
+			     struct vm_area_struct *vma)
+{
+	void *page_addr = proc->buffer + (page - proc->pages) * PAGE_SIZE;
+
+	if (vma)
+		zap_page_range(vma, (uintptr_t)page_addr +
+			proc->user_buffer_offset, PAGE_SIZE, NULL);
+	if (page->borrowed) {
+		/* only mapped in userspace */
+		page_cache_release(page->page_ptr);
+		page->borrowed = false;
+	} else {
+		unmap_kernel_range((unsigned long)page_addr, PAGE_SIZE);
+		__free_page(page->page_ptr);
+	}
+	page->page_ptr = NULL;
+}
+
+/*
+ * Map nr freshly allocated pages starting at start into the kernel with a
+ * single map_vm_area call, then into userspace.
+ */
+static int binder_map_pages(struct binder_proc *proc, void *start, int nr,
+			    struct vm_area_struct *vma)
+{
+	struct binder_lru_page *page;
+	struct page *pages[BINDER_MAP_BATCH];
+	struct page **page_array_ptr = pages;
+	struct vm_struct tmp_area;
+	unsigned long user_page_addr;
+	int i;
+	int ret;
+
+	page = &proc->pages[(start - proc->buffer) / PAGE_SIZE];
+	for (i = 0; i < nr; i++)
+		pages[i] = page[i].page_ptr;
+
+	tmp_area.addr = start;
+	tmp_area.size = (nr + 1) * PAGE_SIZE /* guard page? */;
+	ret = map_vm_area(&tmp_area, PAGE_KERNEL, &page_array_ptr);
+	if (ret) {
+		printk(KERN_ERR "binder: %d: binder_alloc_buf failed "
+		       "to map pages at %p in kernel\n", proc->pid, start);
+		/* map_vm_area may have mapped some pages before failing */
+		unmap_kernel_range((unsigned long)start, nr * PAGE_SIZE);
+		return ret;
+	}
+	user_page_addr = (uintptr_t)start + proc->user_buffer_offset;
+	for (i = 0; i < nr; i++) {
+		ret = vm_insert_page(vma, user_page_addr + i * PAGE_SIZE,
+				     pages[i]);
+		if (ret) {
+			printk(KERN_ERR "binder: %d: binder_alloc_buf failed "
+			       "to map page at %lx in userspace\n",
+			       proc->pid, user_page_addr + i * PAGE_SIZE);
+			if (i)
+				zap_page_range(vma, user_page_addr,
+					       i * PAGE_SIZE, NULL);
+			unmap_kernel_range((unsigned long)start,
+					   nr * PAGE_SIZE);
+			return ret;
+		}
+		/* vm_insert_page does not seem to increment the refcount */
+	}
+	return 0;
+}
+
+/*
+ * Pages that are no longer used by any buffer stay mapped on the lru, up
+ * to binder_pool_target() per process, so the next allocation in the same
+ * range does not have to allocate and map them again. The shrinker gives
+ * them back under memory pressure.
+ */
+static void binder_release_page_range(struct binder_proc *proc,
+				      void *start, void *end,
+				      struct vm_area_struct *vma)
+{
+	void *page_addr;
+	struct binder_lru_page *page;
+
+	for (page_addr = start; page_addr < end; page_addr += PAGE_SIZE) {
+		page = &proc->pages[(page_addr - proc->buffer) / PAGE_SIZE];
+		/* unused part of a buffer's FD_RANGE area */
+		if (!page->page_ptr)
+			continue;
+		if (vma && !page->borrowed &&
+		    proc->pages_idle < binder_pool_target(proc))
+			binder_lru_add(proc, page);
+		else
+			binder_free_page(proc, page, vma);
+	}
+}
+
+/*
+ * If every page in the range is an idle pool page, take them all without
+ * touching mmap_sem.
+ */
+static bool binder_take_idle_pages(struct binder_proc *proc,
+				   void *start, void *end)
+{
+	void *page_addr;
+	struct binder_lru_page *page;
+
+	for (page_addr = start; page_addr < end; page_addr += PAGE_SIZE) {
+		page = &proc->pages[(page_addr - proc->buffer) / PAGE_SIZE];
+		if (!page->page_ptr)
+			return false;
+	}
+	for (page_addr = start; page_addr < end; page_addr += PAGE_SIZE) {
+		page = &proc->pages[(page_addr - proc->buffer) / PAGE_SIZE];
+		binder_lru_del(proc, page);
+		atomic_long_inc(&binder_alloc_stats.pool_hits);
+	}
+	return true;
+}
+
 static int binder_update_page_range(struct binder_proc *proc, int allocate,
 				    void *start, void *end,
 				    struct vm_area_struct *vma)
 {
 	void *page_addr;
-	unsigned long user_page_addr;
-	struct vm_struct tmp_area;
-	struct page **page;
+	void *batch_start = NULL;
+	struct binder_lru_page *page;
 	struct mm_struct *mm;
+	int nr = 0;
+	int misses = 0;
+	u64 map_start;
 
 	binder_debug(BINDER_DEBUG_BUFFER_ALLOC,
 		     "binder: %d: %s pages %p-%p\n", proc->pid,
@@ -643,6 +971,9 @@ static int binder_update_page_range(struct binder_proc *proc, int allocate,
 
 	trace_binder_update_page_range(proc, allocate, start, end);
 
+	if (allocate && binder_take_idle_pages(proc, start, end))
+		return 0;
+
 	if (vma)
 		mm = NULL;
 	else
@@ -658,8 +989,10 @@ static int binder_update_page_range(struct binder_proc *proc, int allocate,
 		}
 	}
 
-	if (allocate == 0)
-		goto free_range;
+	if (allocate == 0) {
+		binder_release_page_range(proc, start, end, vma);
+		goto out;
+	}
 
 	if (vma == NULL) {
 		printk(KERN_ERR "binder: %d: binder_alloc_buf failed to "
@@ -667,60 +1000,62 @@ static int binder_update_page_range(struct binder_proc *proc, int allocate,
 		goto err_no_vma;
 	}
 
+	map_start = local_clock();
 	for (page_addr = start; page_addr < end; page_addr += PAGE_SIZE) {
-		int ret;
-		struct page **page_array_ptr;
 		page = &proc->pages[(page_addr - proc->buffer) / PAGE_SIZE];
 
-		BUG_ON(*page);
-		*page = alloc_page(GFP_KERNEL | __GFP_HIGHMEM | __GFP_ZERO);
-		if (*page == NULL) {
+		if (page->page_ptr) {
+			/* idle page, still mapped from an earlier buffer */
+			if (nr && binder_map_pages(proc, batch_start, nr, vma))
+				goto err_map_failed;
+			nr = 0;
+			binder_lru_del(proc, page);
+			atomic_long_inc(&binder_alloc_stats.pool_hits);
+			continue;
+		}
+
+		page->page_ptr = alloc_page(GFP_KERNEL | __GFP_HIGHMEM |
+					    __GFP_ZERO);
+		if (page->page_ptr == NULL) {
 			printk(KERN_ERR "binder: %d: binder_alloc_buf failed "
 			       "for page at %p\n", proc->pid, page_addr);
 			goto err_alloc_page_failed;
 		}
-		tmp_area.addr = page_addr;
-		tmp_area.size = PAGE_SIZE + PAGE_SIZE /* guard page? */;
-		page_array_ptr = page;
-		ret = map_vm_area(&tmp_area, PAGE_KERNEL, &page_array_ptr);
-		if (ret) {
-			printk(KERN_ERR "binder: %d: binder_alloc_buf failed "
-			       "to map page at %p in kernel\n",
-			       proc->pid, page_addr);
-			goto err_map_kernel_failed;
-		}
-		user_page_addr =
-			(uintptr_t)page_addr + proc->user_buffer_offset;
-		ret = vm_insert_page(vma, user_page_addr, page[0]);
-		if (ret) {
-			printk(KERN_ERR "binder: %d: binder_alloc_buf failed "
-			       "to map page at %lx in userspace\n",
-			       proc->pid, user_page_addr);
-			goto err_vm_insert_page_failed;
+		atomic_long_inc(&binder_alloc_stats.pool_misses);
+		misses++;
+		if (nr++ == 0)
+			batch_start = page_addr;
+		if (nr == BINDER_MAP_BATCH) {
+			if (binder_map_pages(proc, batch_start, nr, vma))
+				goto err_map_failed;
+			nr = 0;
 		}
-		/* vm_insert_page does not seem to increment the refcount */
 	}
+	if (nr && binder_map_pages(proc, batch_start, nr, vma))
+		goto err_map_failed;
+	if (misses) {
+		atomic64_add(local_clock() - map_start,
+			     &binder_alloc_stats.map_ns);
+		atomic_long_add(misses, &binder_alloc_stats.pages_mapped);
+	}
+out:
 	if (mm) {
 		up_write(&mm->mmap_sem);
 		mmput(mm);
 	}
 	return 0;
 
-free_range:
-	for (page_addr = end - PAGE_SIZE; page_addr >= start;
-	     page_addr -= PAGE_SIZE) {
-		page = &proc->pages[(page_addr - proc->buffer) / PAGE_SIZE];
-		if (vma)
-			zap_page_range(vma, (uintptr_t)page_addr +
-				proc->user_buffer_offset, PAGE_SIZE, NULL);
-err_vm_insert_page_failed:
-		unmap_kernel_range((unsigned long)page_addr, PAGE_SIZE);
-err_map_kernel_failed:
-		__free_page(*page);
-		*page = NULL;
+err_map_failed:
+	/* binder_map_pages unmapped the failed batch from both sides */
+	page_addr = batch_start + nr * PAGE_SIZE;
 err_alloc_page_failed:
-		;
+	while (nr--) {
+		page_addr -= PAGE_SIZE;
+		page = &proc->pages[(page_addr - proc->buffer) / PAGE_SIZE];
+		__free_page(page->page_ptr);
+		page->page_ptr = NULL;
 	}
+	binder_release_page_range(proc, start, page_addr, vma);
 err_no_vma:
 	if (mm) {
 		up_write(&mm->mmap_sem);
@@ -729,9 +1064,64 @@ err_no_vma:
 	return -ENOMEM;
 }
 
-static struct binder_buffer *binder_alloc_buf(struct binder_proc *proc,
-					      size_t data_size,
-					      size_t offsets_size, int is_async)
+static int binder_shrink(struct shrinker *shrinker, struct shrink_control *sc)
+{
+	unsigned long nr_to_scan = sc->nr_to_scan;
+
+	while (nr_to_scan--) {
+		struct binder_lru_page *page;
+		struct binder_proc *proc;
+		struct vm_area_struct *vma = NULL;
+		struct mm_struct *mm;
+
+		spin_lock(&binder_lru_lock);
+		if (list_empty(&binder_lru)) {
+			spin_unlock(&binder_lru_lock);
+			break;
+		}
+		page = list_first_entry(&binder_lru, struct binder_lru_page,
+					lru);
+		proc = page->proc;
+		if (!mutex_trylock(&proc->alloc_lock)) {
+			list_move_tail(&page->lru, &binder_lru);
+			spin_unlock(&binder_lru_lock);
+			continue;
+		}
+		spin_unlock(&binder_lru_lock);
+
+		mm = get_task_mm(proc->tsk);
+		if (mm) {
+			if (!down_write_trylock(&mm->mmap_sem)) {
+				mutex_unlock(&proc->alloc_lock);
+				mmput(mm);
+				continue;
+			}
+			vma = proc->vma;
+			if (vma && mm != proc->vma_vm_mm)
+				vma = NULL;
+		}
+		binder_lru_del(proc, page);
+		binder_free_page(proc, page, vma);
+		atomic_long_inc(&binder_alloc_stats.pages_reclaimed);
+		if (mm) {
+			up_write(&mm->mmap_sem);
+			mmput(mm);
+		}
+		mutex_unlock(&proc->alloc_lock);
+	}
+	return atomic_read(&binder_lru_count);
+}
+
+static struct shrinker binder_shrinker = {
+	.shrink = binder_shrink,
+	.seeks = DEFAULT_SEEKS,
+};
+
+static struct binder_buffer *__binder_alloc_buf(struct binder_proc *proc,
+						size_t data_size,
+						size_t offsets_size,
+						size_t extra_pages,
+						int is_async)
 {
 	struct rb_node *n = proc->free_buffers.rb_node;
 	struct binder_buffer *buffer;
@@ -739,7 +1129,12 @@ static struct binder_buffer *binder_alloc_buf(struct binder_proc *proc,
 	struct rb_node *best_fit = NULL;
 	void *has_page_addr;
 	void *end_page_addr;
+	void *page_addr;
+	void *extra_start;
+	void *extra_end;
 	size_t size;
+	size_t extra_size;
+	int pages;
 
 	if (proc->vma == NULL) {
 		printk(KERN_ERR "binder: %d: binder_alloc_buf, no vma\n",
@@ -755,6 +1150,16 @@ static struct binder_buffer *binder_alloc_buf(struct binder_proc *proc,
 			"size %zd-%zd\n", proc->pid, data_size, offsets_size);
 		return NULL;
 	}
+	/* the extra pages start on a page boundary, hence the spare page */
+	extra_size = extra_pages ? (extra_pages + 1) * PAGE_SIZE : 0;
+	if (extra_pages > proc->buffer_size / PAGE_SIZE ||
+	    size + extra_size < size) {
+		binder_user_error("binder: %d: got transaction with invalid "
+			"extra size %zd pages\n", proc->pid, extra_pages);
+		return NULL;
+	}
+	pages = DIV_ROUND_UP(size + sizeof(struct binder_buffer), PAGE_SIZE);
+	size += extra_size;
 
 	if (is_async &&
 	    proc->free_async_space < size + sizeof(struct binder_buffer)) {
@@ -805,9 +1210,34 @@ static struct binder_buffer *binder_alloc_buf(struct binder_proc *proc,
 		(void *)PAGE_ALIGN((uintptr_t)buffer->data + buffer_size);
 	if (end_page_addr > has_page_addr)
 		end_page_addr = has_page_addr;
+	/* the extra pages are mapped by the caller, not allocated here */
+	extra_start = (void *)PAGE_ALIGN((uintptr_t)buffer->data + size -
+					 extra_size);
+	extra_end = extra_start + extra_pages * PAGE_SIZE;
+	if (!extra_pages)
+		extra_start = extra_end = end_page_addr;
 	if (binder_update_page_range(proc, 1,
-	    (void *)PAGE_ALIGN((uintptr_t)buffer->data), end_page_addr, NULL))
+	    (void *)PAGE_ALIGN((uintptr_t)buffer->data), extra_start, NULL))
 		return NULL;
+	if (binder_update_page_range(proc, 1, extra_end, end_page_addr,
+				     NULL)) {
+		binder_update_page_range(proc, 0,
+			(void *)PAGE_ALIGN((uintptr_t)buffer->data),
+			extra_start, NULL);
+		return NULL;
+	}
+	/*
+	 * Idle pages left in the extra area now belong to this buffer until
+	 * the caller maps over them or the buffer is freed.
+	 */
+	for (page_addr = extra_start; page_addr < extra_end;
+	     page_addr += PAGE_SIZE) {
+		struct binder_lru_page *page;
+
+		page = &proc->pages[(page_addr - proc->buffer) / PAGE_SIZE];
+		if (page->page_ptr)
+			binder_lru_del(proc, page);
+	}
 
 	rb_erase(best_fit, &proc->free_buffers);
 	buffer->free = 0;
@@ -823,7 +1253,11 @@ static struct binder_buffer *binder_alloc_buf(struct binder_proc *proc,
 		     "%p\n", proc->pid, size, buffer);
 	buffer->data_size = data_size;
 	buffer->offsets_size = offsets_size;
+	buffer->extra_size = extra_size;
 	buffer->async_transaction = is_async;
+	/* running average that sizes the pool of idle pages we keep */
+	proc->avg_alloc_pages += ((pages << BINDER_AVG_SHIFT) -
+				  proc->avg_alloc_pages) / 8;
 	if (is_async) {
 		proc->free_async_space -= size + sizeof(struct binder_buffer);
 		binder_debug(BINDER_DEBUG_BUFFER_ALLOC_ASYNC,
@@ -835,6 +1269,154 @@ static struct binder_buffer *binder_alloc_buf(struct binder_proc *proc,
 	return buffer;
 }
 
+static struct binder_buffer *binder_alloc_buf(struct binder_proc *proc,
+					      size_t data_size,
+					      size_t offsets_size,
+					      size_t extra_pages, int is_async)
+{
+	struct binder_buffer *buffer;
+
+	binder_alloc_lock(proc);
+	buffer = __binder_alloc_buf(proc, data_size, offsets_size,
+				    extra_pages, is_async);
+	binder_alloc_unlock(proc);
+	return buffer;
+}
+
+static void *binder_buffer_extra_start(struct binder_buffer *buffer)
+{
+	return (void *)PAGE_ALIGN((uintptr_t)buffer->data +
+				  ALIGN(buffer->data_size, sizeof(void *)) +
+				  ALIGN(buffer->offsets_size, sizeof(void *)));
+}
+
+/*
+ * Map page cache pages into the target's binder area at kaddr, userspace
+ * only and read-only like the rest of the area. Each page reference is
+ * handed over and dropped again when the buffer is freed, or right away if
+ * the page could not be mapped.
+ */
+static int binder_map_borrowed_pages(struct binder_proc *proc, void *kaddr,
+				     struct page **pages, int nr)
+{
+	struct vm_area_struct *vma;
+	struct mm_struct *mm;
+	unsigned long user_page_addr;
+	int ret = 0;
+	int i = 0;
+
+	mm = get_task_mm(proc->tsk);
+	if (mm == NULL) {
+		ret = -ESRCH;
+		goto err_no_mm;
+	}
+	binder_alloc_lock(proc);
+	down_write(&mm->mmap_sem);
+	vma = proc->vma;
+	if (vma == NULL || mm != proc->vma_vm_mm) {
+		ret = -ESRCH;
+		goto out;
+	}
+	for (i = 0; i < nr; i++) {
+		struct binder_lru_page *page;
+
+		page = &proc->pages[(kaddr - proc->buffer) / PAGE_SIZE + i];
+		if (page->page_ptr) {
+			/*
+			 * pool page left over from an earlier buffer, taken
+			 * off the lru by __binder_alloc_buf
+			 */
+			binder_free_page(proc, page, vma);
+		}
+		user_page_addr = (uintptr_t)kaddr + i * PAGE_SIZE +
+				 proc->user_buffer_offset;
+		ret = vm_insert_page(vma, user_page_addr, pages[i]);
+		if (ret)
+			break;
+		page->page_ptr = pages[i];
+		page->borrowed = true;
+	}
+out:
+	up_write(&mm->mmap_sem);
+	binder_alloc_unlock(proc);
+	mmput(mm);
+err_no_mm:
+	for (; i < nr; i++)
+		page_cache_release(pages[i]);
+	return ret;
+}
+
+/*
+ * Map nr pages of the shmem file backing an ashmem region, starting at page
+ * index, into the target's binder area at kaddr.
+ */
+static int binder_map_fd_range(struct binder_proc *proc, void *kaddr,
+			       struct file *backing, pgoff_t index, int nr)
+{
+	struct page *pages[BINDER_MAP_BATCH];
+	int batch;
+	int ret;
+	int i;
+
+	while (nr) {
+		batch = min(nr, BINDER_MAP_BATCH);
+		for (i = 0; i < batch; i++) {
+			pages[i] = shmem_read_mapping_page(backing->f_mapping,
+							   index + i);
+			if (IS_ERR(pages[i])) {
+				ret = PTR_ERR(pages[i]);
+				while (i--)
+					page_cache_release(pages[i]);
+				return ret;
+			}
+		}
+		ret = binder_map_borrowed_pages(proc, kaddr, pages, batch);
+		if (ret)
+			return ret;
+		kaddr += batch * PAGE_SIZE;
+		index += batch;
+		nr -= batch;
+	}
+	return 0;
+}
+
+/*
+ * Walk the objects of a TF_ZERO_COPY transaction while they are still in
+ * the sender's memory, to size the area its BINDER_TYPE_FD_RANGE objects
+ * are mapped into. The objects are validated again once copied, so a
+ * sender changing them in between only makes the transaction fail.
+ */
+static int binder_count_extra_pages(struct binder_proc *target_proc,
+				    struct binder_transaction_data *tr,
+				    size_t *extra_pages)
+{
+	size_t __user *offp = tr->data.ptr.offsets;
+	size_t __user *off_end = (void __user *)offp + tr->offsets_size;
+	struct binder_fd_range_object fr;
+	size_t off;
+
+	*extra_pages = 0;
+	if (tr->offsets_size > target_proc->buffer_size)
+		return -EINVAL;
+	for (; offp < off_end; offp++) {
+		if (get_user(off, offp))
+			return -EFAULT;
+		if (tr->data_size < sizeof(fr) ||
+		    off > tr->data_size - sizeof(fr))
+			continue;
+		if (copy_from_user(&fr, tr->data.ptr.buffer + off, sizeof(fr)))
+			return -EFAULT;
+		if (fr.type != BINDER_TYPE_FD_RANGE)
+			continue;
+		if (fr.length > target_proc->buffer_size)
+			return -EINVAL;
+		*extra_pages += PAGE_ALIGN(fr.length) >> PAGE_SHIFT;
+		if (*extra_pages > target_proc->buffer_size / PAGE_SIZE)
+			return -EINVAL;
+	}
+	return 0;
+}
+
 static void *buffer_start_page(struct binder_buffer *buffer)
 {
 	return (void *)((uintptr_t)buffer & PAGE_MASK);
@@ -892,15 +1474,16 @@ static void binder_delete_free_buffer(struct binder_proc *proc,
 	}
 }
 
-static void binder_free_buf(struct binder_proc *proc,
-			    struct binder_buffer *buffer)
+static void __binder_free_buf(struct binder_proc *proc,
+			      struct binder_buffer *buffer)
 {
 	size_t size, buffer_size;
 
 	buffer_size = binder_buffer_size(proc, buffer);
 
 	size = ALIGN(buffer->data_size, sizeof(void *)) +
-		ALIGN(buffer->offsets_size, sizeof(void *));
+		ALIGN(buffer->offsets_size, sizeof(void *)) +
+		buffer->extra_size;
 
 	binder_debug(BINDER_DEBUG_BUFFER_ALLOC,
 		     "binder: %d: binder_free_buf %p size %zd buffer"
@@ -947,6 +1530,14 @@ static void binder_free_buf(struct binder_proc *proc,
 	binder_insert_free_buffer(proc, buffer);
 }
 
+static void binder_free_buf(struct binder_proc *proc,
+			    struct binder_buffer *buffer)
+{
+	binder_alloc_lock(proc);
+	__binder_free_buf(proc, buffer);
+	binder_alloc_unlock(proc);
+}
+
 static struct binder_node *binder_get_node(struct binder_proc *proc,
 					   void __user *ptr)
 {
@@ -1064,13 +1655,14 @@ static int binder_dec_node(struct binder_node *node, int strong, int internal)
 	} else {
 		if (hlist_empty(&node->refs) && !node->local_strong_refs &&
 		    !node->local_weak_refs) {
-			list_del_init(&node->work.entry);
 			if (node->proc) {
+				list_del_init(&node->work.entry);
 				rb_erase(&node->rb_node, &node->proc->nodes);
 				binder_debug(BINDER_DEBUG_INTERNAL_REFS,
 					     "binder: refless node %d deleted\n",
 					     node->debug_id);
 			} else {
+				list_del_init(&node->work.entry);
 				hlist_del(&node->dead_node);
 				binder_debug(BINDER_DEBUG_INTERNAL_REFS,
 					     "binder: dead node %d deleted\n",
@@ -1391,6 +1983,13 @@ static void binder_transaction_buffer_release(struct binder_proc *proc,
 				task_close_fd(proc, fp->handle);
 			break;
 
+		case BINDER_TYPE_FD_RANGE:
+			/* the pages go with the buffer in binder_free_buf */
+			binder_debug(BINDER_DEBUG_TRANSACTION,
+				     "        fd range %p\n",
+				     ((struct binder_fd_range_object *)fp)->buffer);
+			break;
+
 		default:
 			printk(KERN_ERR "binder: transaction release %d bad "
 			       "object type %lx\n", debug_id, fp->type);
@@ -1414,6 +2013,8 @@ static void binder_transaction(struct binder_proc *proc,
 	struct binder_transaction *in_reply_to = NULL;
 	struct binder_transaction_log_entry *e;
 	uint32_t return_error;
+	size_t extra_pages = 0;
+	size_t extra_used = 0;
 
 	e = binder_transaction_log_add(&binder_transaction_log);
 	e->call_type = reply ? 2 : !!(tr->flags & TF_ONE_WAY);
@@ -1432,7 +2033,7 @@ static void binder_transaction(struct binder_proc *proc,
 			return_error = BR_FAILED_REPLY;
 			goto err_empty_call_stack;
 		}
-		binder_set_nice(in_reply_to->saved_priority);
+		binder_set_priority(current, in_reply_to->saved_priority);
 		if (in_reply_to->to_thread != thread) {
 			binder_user_error("binder: %d:%d got reply transaction "
 				"with bad transaction stack,"
@@ -1570,12 +2171,22 @@ static void binder_transaction(struct binder_proc *proc,
 	t->to_thread = target_thread;
 	t->code = tr->code;
 	t->flags = tr->flags;
-	t->priority = task_nice(current);
+	binder_get_priority(current, &t->priority);
 
 	trace_binder_transaction(reply, t, target_node);
 
+	if ((t->flags & TF_ZERO_COPY) &&
+	    binder_count_extra_pages(target_proc, tr, &extra_pages)) {
+		binder_user_error("binder: %d:%d got zero copy transaction "
+			"with invalid fd range objects\n",
+			proc->pid, thread->pid);
+		return_error = BR_FAILED_REPLY;
+		goto err_binder_alloc_buf_failed;
+	}
+
 	t->buffer = binder_alloc_buf(target_proc, tr->data_size,
-		tr->offsets_size, !reply && (t->flags & TF_ONE_WAY));
+		tr->offsets_size, extra_pages,
+		!reply && (t->flags & TF_ONE_WAY));
 	if (t->buffer == NULL) {
 		return_error = BR_FAILED_REPLY;
 		goto err_binder_alloc_buf_failed;
@@ -1757,6 +2368,71 @@ static void binder_transaction(struct binder_proc *proc,
 			fp->handle = target_fd;
 		} break;
 
+		case BINDER_TYPE_FD_RANGE: {
+			struct binder_fd_range_object *fr;
+			struct file *file, *backing;
+			size_t region_size;
+			void *kaddr;
+			int nr;
+
+			fr = (struct binder_fd_range_object *)fp;
+			if (!(t->flags & TF_ZERO_COPY) ||
+			    *offp > t->buffer->data_size - sizeof(*fr) ||
+			    t->buffer->data_size < sizeof(*fr)) {
+				binder_user_error("binder: %d:%d got transaction with invalid fd range object at %zd\n",
+					proc->pid, thread->pid, *offp);
+				return_error = BR_FAILED_REPLY;
+				goto err_bad_offset;
+			}
+			file = fget(fr->fd);
+			if (file == NULL) {
+				binder_user_error("binder: %d:%d got transaction with invalid fd, %ld\n",
+					proc->pid, thread->pid, fr->fd);
+				return_error = BR_FAILED_REPLY;
+				goto err_fget_failed;
+			}
+			if (security_binder_transfer_file(proc->tsk, target_proc->tsk, file) < 0) {
+				fput(file);
+				return_error = BR_FAILED_REPLY;
+				goto err_fget_failed;
+			}
+			backing = ashmem_get_backing_file(file, &region_size);
+			fput(file);
+			if (backing == NULL) {
+				binder_user_error("binder: %d:%d got fd range for fd %ld, which is not a mapped ashmem region\n",
+					proc->pid, thread->pid, fr->fd);
+				return_error = BR_FAILED_REPLY;
+				goto err_fget_failed;
+			}
+			nr = PAGE_ALIGN(fr->length) >> PAGE_SHIFT;
+			if (!fr->length || !IS_ALIGNED(fr->offset, PAGE_SIZE) ||
+			    fr->offset > region_size ||
+			    fr->length > region_size - fr->offset ||
+			    extra_used + nr > extra_pages) {
+				binder_user_error("binder: %d:%d got invalid fd range %zd-%zd for fd %ld, size %zd\n",
+					proc->pid, thread->pid, fr->offset,
+					fr->length, fr->fd, region_size);
+				fput(backing);
+				return_error = BR_FAILED_REPLY;
+				goto err_bad_fd_range;
+			}
+			kaddr = binder_buffer_extra_start(t->buffer) +
+				extra_used * PAGE_SIZE;
+			if (binder_map_fd_range(target_proc, kaddr, backing,
+						fr->offset >> PAGE_SHIFT, nr)) {
+				fput(backing);
+				return_error = BR_FAILED_REPLY;
+				goto err_bad_fd_range;
+			}
+			fput(backing);
+			extra_used += nr;
+			binder_debug(BINDER_DEBUG_TRANSACTION,
+				     "        fd %ld range %zd-%zd -> %p\n",
+				     fr->fd, fr->offset, fr->length, kaddr);
+			fr->buffer = kaddr + target_proc->user_buffer_offset;
+			fr->fd = -1;
+		} break;
+
 		default:
 			binder_user_error("binder: %d:%d got transactio"
 				"n with invalid object type, %lx\n",
@@ -1773,6 +2449,13 @@ static void binder_transaction(struct binder_proc *proc,
 		t->need_reply = 1;
 		t->from_parent = thread->transaction_stack;
 		thread->transaction_stack = t;
+		/*
+		 * target_thread is blocked waiting for a reply further down
+		 * its own transaction stack; lift it before waking it.
+		 */
+		if (target_thread)
+			binder_transaction_priority(target_thread->task, t,
+						    target_node);
 	} else {
 		BUG_ON(target_node == NULL);
 		BUG_ON(t->buffer->async_transaction != 1);
@@ -1790,6 +2473,7 @@ static void binder_transaction(struct binder_proc *proc,
 		wake_up_interruptible(target_wait);
 	return;
 
+err_bad_fd_range:
 err_get_unused_fd_failed:
 err_fget_failed:
 err_fd_not_allowed:
@@ -1985,7 +2669,9 @@ int binder_thread_write(struct binder_proc *proc, struct binder_thread *thread,
 				return -EFAULT;
 			ptr += sizeof(void *);
 
+			binder_alloc_lock(proc);
 			buffer = binder_buffer_lookup(proc, data_ptr);
+			binder_alloc_unlock(proc);
 			if (buffer == NULL) {
 				binder_user_error("binder: %d:%d "
 					"BC_FREE_BUFFER u%p no match\n",
@@ -2304,7 +2990,7 @@ retry:
 			wait_event_interruptible(binder_user_error_wait,
 						 binder_stop_on_user_error < 2);
 		}
-		binder_set_nice(proc->default_priority);
+		binder_set_priority(current, proc->default_priority);
 		if (non_block) {
 			if (!binder_has_proc_work(proc, thread))
 				ret = -EAGAIN;
@@ -2470,13 +3156,7 @@ retry:
 			struct binder_node *target_node = t->buffer->target_node;
 			tr.target.ptr = target_node->ptr;
 			tr.cookie =  target_node->cookie;
-			t->saved_priority = task_nice(current);
-			if (t->priority < target_node->min_priority &&
-			    !(t->flags & TF_ONE_WAY))
-				binder_set_nice(t->priority);
-			else if (!(t->flags & TF_ONE_WAY) ||
-				 t->saved_priority > target_node->min_priority)
-				binder_set_nice(target_node->min_priority);
+			binder_transaction_priority(current, t, target_node);
 			cmd = BR_TRANSACTION;
 		} else {
 			tr.target.ptr = NULL;
@@ -2629,6 +3309,8 @@ static struct binder_thread *binder_get_thread(struct binder_proc *proc)
 		binder_stats_created(BINDER_STAT_THREAD);
 		thread->proc = proc;
 		thread->pid = current->pid;
+		get_task_struct(current);
+		thread->task = current;
 		init_waitqueue_head(&thread->wait);
 		INIT_LIST_HEAD(&thread->todo);
 		rb_link_node(&thread->rb_node, parent, p);
@@ -2676,6 +3358,7 @@ static int binder_free_thread(struct binder_proc *proc,
 	if (send_reply)
 		binder_send_failed_reply(send_reply, BR_DEAD_REPLY);
 	binder_release_work(&thread->todo);
+	put_task_struct(thread->task);
 	kfree(thread);
 	binder_stats_deleted(BINDER_STAT_THREAD);
 	return active_transactions;
@@ -2689,12 +3372,14 @@ static unsigned int binder_poll(struct file *filp,
 	int wait_for_proc_work;
 
 	binder_lock(__func__);
-
 	thread = binder_get_thread(proc);
+	if (thread == NULL) {
+		binder_unlock(__func__);
+		return POLLERR;
+	}
 
 	wait_for_proc_work = thread->transaction_stack == NULL &&
 		list_empty(&thread->todo) && thread->return_error == BR_OK;
-
 	binder_unlock(__func__);
 
 	if (wait_for_proc_work) {
@@ -2887,6 +3572,7 @@ static int binder_mmap(struct file *filp, struct vm_area_struct *vma)
 	struct binder_proc *proc = filp->private_data;
 	const char *failure_string;
 	struct binder_buffer *buffer;
+	int i;
 
 	if ((vma->vm_end - vma->vm_start) > SZ_4M)
 		vma->vm_end = vma->vm_start + SZ_4M;
@@ -2936,6 +3622,10 @@ static int binder_mmap(struct file *filp, struct vm_area_struct *vma)
 		goto err_alloc_pages_failed;
 	}
 	proc->buffer_size = vma->vm_end - vma->vm_start;
+	for (i = 0; i < proc->buffer_size / PAGE_SIZE; i++) {
+		INIT_LIST_HEAD(&proc->pages[i].lru);
+		proc->pages[i].proc = proc;
+	}
 
 	vma->vm_ops = &binder_vm_ops;
 	vma->vm_private_data = proc;
@@ -2951,6 +3641,10 @@ static int binder_mmap(struct file *filp, struct vm_area_struct *vma)
 	buffer->free = 1;
 	binder_insert_free_buffer(proc, buffer);
 	proc->free_async_space = proc->buffer_size / 2;
+	/*
+	 * mmap_sem is held here, so alloc_lock cannot be taken. The
+	 * allocator refuses to run until proc->vma is set below.
+	 */
 	barrier();
 	proc->files = get_files_struct(proc->tsk);
 	proc->vma = vma;
@@ -2988,9 +3682,10 @@ static int binder_open(struct inode *nodp, struct file *filp)
 		return -ENOMEM;
 	get_task_struct(current);
 	proc->tsk = current;
+	mutex_init(&proc->alloc_lock);
 	INIT_LIST_HEAD(&proc->todo);
 	init_waitqueue_head(&proc->wait);
-	proc->default_priority = task_nice(current);
+	binder_get_priority(current, &proc->default_priority);
 
 	binder_lock(__func__);
 
@@ -3025,6 +3720,7 @@ static void binder_deferred_flush(struct binder_proc *proc)
 {
 	struct rb_node *n;
 	int wake_count = 0;
+
 	for (n = rb_first(&proc->threads); n != NULL; n = rb_next(n)) {
 		struct binder_thread *thread = rb_entry(n, struct binder_thread, rb_node);
 		thread->looper |= BINDER_LOOPER_STATE_NEED_RETURN;
@@ -3124,6 +3820,7 @@ static void binder_deferred_release(struct binder_proc *proc)
 	binder_release_work(&proc->delivered_death);
 	buffers = 0;
 
+	binder_alloc_lock(proc);
 	while ((n = rb_first(&proc->allocated_buffers))) {
 		struct binder_buffer *buffer = rb_entry(n, struct binder_buffer,
 							rb_node);
@@ -3136,7 +3833,7 @@ static void binder_deferred_release(struct binder_proc *proc)
 			       proc->pid, t->debug_id);
 			/*BUG();*/
 		}
-		binder_free_buf(proc, buffer);
+		__binder_free_buf(proc, buffer);
 		buffers++;
 	}
 
@@ -3146,22 +3843,26 @@ static void binder_deferred_release(struct binder_proc *proc)
 	if (proc->pages) {
 		int i;
 		for (i = 0; i < proc->buffer_size / PAGE_SIZE; i++) {
-			if (proc->pages[i]) {
-				void *page_addr = proc->buffer + i * PAGE_SIZE;
+			struct binder_lru_page *page = &proc->pages[i];
+
+			if (!page->page_ptr)
+				continue;
+			if (!list_empty(&page->lru)) {
+				binder_lru_del(proc, page);
+			} else {
 				binder_debug(BINDER_DEBUG_BUFFER_ALLOC,
 					     "binder_release: %d: "
 					     "page %d at %p not freed\n",
 					     proc->pid, i,
-					     page_addr);
-				unmap_kernel_range((unsigned long)page_addr,
-					PAGE_SIZE);
-				__free_page(proc->pages[i]);
-				page_count++;
+					     proc->buffer + i * PAGE_SIZE);
 			}
+			binder_free_page(proc, page, NULL);
+			page_count++;
 		}
 		kfree(proc->pages);
 		vfree(proc->buffer);
 	}
+	binder_alloc_unlock(proc);
 
 	put_task_struct(proc->tsk);
 
@@ -3233,13 +3934,14 @@ static void print_binder_transaction(struct seq_file *m, const char *prefix,
 				     struct binder_transaction *t)
 {
 	seq_printf(m,
-		   "%s %d: %p from %d:%d to %d:%d code %x flags %x pri %ld r%d",
+		   "%s %d: %p from %d:%d to %d:%d code %x flags %x pri %d:%d r%d",
 		   prefix, t->debug_id, t,
 		   t->from ? t->from->proc->pid : 0,
 		   t->from ? t->from->pid : 0,
 		   t->to_proc ? t->to_proc->pid : 0,
 		   t->to_thread ? t->to_thread->pid : 0,
-		   t->code, t->flags, t->priority, t->need_reply);
+		   t->code, t->flags, t->priority.sched_policy,
+		   t->priority.prio, t->need_reply);
 	if (t->buffer == NULL) {
 		seq_puts(m, " buffer free\n");
 		return;
@@ -3390,9 +4092,11 @@ static void print_binder_proc(struct seq_file *m,
 			print_binder_ref(m, rb_entry(n, struct binder_ref,
 						     rb_node_desc));
 	}
+	binder_alloc_lock(proc);
 	for (n = rb_first(&proc->allocated_buffers); n != NULL; n = rb_next(n))
 		print_binder_buffer(m, "  buffer",
 				    rb_entry(n, struct binder_buffer, rb_node));
+	binder_alloc_unlock(proc);
 	list_for_each_entry(w, &proc->todo, entry)
 		print_binder_work(m, "  ", "  pending transaction", w);
 	list_for_each_entry(w, &proc->delivered_death, entry) {
@@ -3480,14 +4184,32 @@ static void print_binder_stats(struct seq_file *m, const char *prefix,
 	BUILD_BUG_ON(ARRAY_SIZE(stats->obj_created) !=
 		     ARRAY_SIZE(stats->obj_deleted));
 	for (i = 0; i < ARRAY_SIZE(stats->obj_created); i++) {
-		if (stats->obj_created[i] || stats->obj_deleted[i])
+		int created = atomic_read(&stats->obj_created[i]);
+		int deleted = atomic_read(&stats->obj_deleted[i]);
+
+		if (created || deleted)
 			seq_printf(m, "%s%s: active %d total %d\n", prefix,
 				binder_objstat_strings[i],
-				stats->obj_created[i] - stats->obj_deleted[i],
-				stats->obj_created[i]);
+				created - deleted, created);
 	}
 }
 
+static void print_binder_alloc_stats(struct seq_file *m)
+{
+	long hits = atomic_long_read(&binder_alloc_stats.pool_hits);
+	long misses = atomic_long_read(&binder_alloc_stats.pool_misses);
+	long mapped = atomic_long_read(&binder_alloc_stats.pages_mapped);
+	u64 map_ns = atomic64_read(&binder_alloc_stats.map_ns);
+
+	seq_printf(m, "page pool: hits %ld misses %ld hit rate %ld%% "
+		   "idle %d reclaimed %ld\n", hits, misses,
+		   hits + misses ? hits * 100 / (hits + misses) : 0,
+		   atomic_read(&binder_lru_count),
+		   atomic_long_read(&binder_alloc_stats.pages_reclaimed));
+	seq_printf(m, "page map: pages %ld time %llu ns avg %llu ns\n",
+		   mapped, map_ns, mapped ? div64_u64(map_ns, mapped) : 0);
+}
+
 static void print_binder_proc_stats(struct seq_file *m,
 				    struct binder_proc *proc)
 {
@@ -3505,6 +4227,8 @@ static void print_binder_proc_stats(struct seq_file *m,
 			"  free async space %zd\n", proc->requested_threads,
 			proc->requested_threads_started, proc->max_threads,
 			proc->ready_threads, proc->free_async_space);
+	seq_printf(m, "  idle pages: %d/%d\n", proc->pages_idle,
+		   binder_pool_target(proc));
 	count = 0;
 	for (n = rb_first(&proc->nodes); n != NULL; n = rb_next(n))
 		count++;
@@ -3522,8 +4246,10 @@ static void print_binder_proc_stats(struct seq_file *m,
 	seq_printf(m, "  refs: %d s %d w %d\n", count, strong, weak);
 
 	count = 0;
+	binder_alloc_lock(proc);
 	for (n = rb_first(&proc->allocated_buffers); n != NULL; n = rb_next(n))
 		count++;
+	binder_alloc_unlock(proc);
 	seq_printf(m, "  buffers: %d\n", count);
 
 	count = 0;
@@ -3578,6 +4304,7 @@ static int binder_stats_show(struct seq_file *m, void *unused)
 	seq_puts(m, "binder stats:\n");
 
 	print_binder_stats(m, "", &binder_stats);
+	print_binder_alloc_stats(m);
 
 	hlist_for_each_entry(proc, pos, &binder_procs, proc_node)
 		print_binder_proc_stats(m, proc);
@@ -3688,6 +4415,7 @@ static int __init binder_init(void)
 		binder_debugfs_dir_entry_proc = debugfs_create_dir("proc",
 						 binder_debugfs_dir_entry_root);
 	ret = misc_register(&binder_miscdev);
+	register_shrinker(&binder_shrinker);
 	if (binder_debugfs_dir_entry_root) {
 		debugfs_create_file("state",
 				    S_IRUGO,
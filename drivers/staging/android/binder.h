@@ -32,6 +32,7 @@ enum {
 	BINDER_TYPE_HANDLE	= B_PACK_CHARS('s', 'h', '*', B_TYPE_LARGE),
 	BINDER_TYPE_WEAK_HANDLE	= B_PACK_CHARS('w', 'h', '*', B_TYPE_LARGE),
 	BINDER_TYPE_FD		= B_PACK_CHARS('f', 'd', '*', B_TYPE_LARGE),
+	BINDER_TYPE_FD_RANGE	= B_PACK_CHARS('f', 'r', '*', B_TYPE_LARGE),
 };
 
 enum {
@@ -61,6 +62,22 @@ struct flat_binder_object {
 	void			*cookie;
 };
 
+/*
+ * A page aligned range of an ashmem region, sent with TF_ZERO_COPY.
+ * Instead of copying, the driver maps the pages of the region read-only
+ * into the receiver's binder buffer; on receipt 'buffer' points at the
+ * mapped data and 'fd' is -1.  The mapping goes away when the buffer is
+ * freed with BC_FREE_BUFFER.
+ */
+struct binder_fd_range_object {
+	unsigned long		type;
+	unsigned long		flags;
+	signed long		fd;
+	void			*buffer;
+	size_t			offset;		/* into the region, page aligned */
+	size_t			length;
+};
+
 /*
  * On 64-bit platforms where user code may run in 32-bits the driver must
  * translate the buffer (and local binder) addresses apropriately.
@@ -112,6 +129,7 @@ enum transaction_flags {
 	TF_ROOT_OBJECT	= 0x04,	/* contents are the component's root object */
 	TF_STATUS_CODE	= 0x08,	/* contents are a 32-bit status code */
 	TF_ACCEPT_FDS	= 0x10,	/* allow replies with file descriptors */
+	TF_ZERO_COPY	= 0x20,	/* contains BINDER_TYPE_FD_RANGE objects */
 };
 
 struct binder_transaction_data {
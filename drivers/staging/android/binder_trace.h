@@ -63,6 +63,24 @@ DEFINE_BINDER_LOCK_EVENT(binder_lock);
 DEFINE_BINDER_LOCK_EVENT(binder_locked);
 DEFINE_BINDER_LOCK_EVENT(binder_unlock);
 
+TRACE_EVENT(binder_lock_contended,
+	TP_PROTO(const char *tag, const char *lock, u64 wait_ns),
+	TP_ARGS(tag, lock, wait_ns),
+	TP_STRUCT__entry(
+		__field(const char *, tag)
+		__field(const char *, lock)
+		__field(u64, wait_ns)
+	),
+	TP_fast_assign(
+		__entry->tag = tag;
+		__entry->lock = lock;
+		__entry->wait_ns = wait_ns;
+	),
+	TP_printk("tag=%s lock=%s wait_ns=%llu",
+		  __entry->tag, __entry->lock,
+		  (unsigned long long)__entry->wait_ns)
+);
+
 DECLARE_EVENT_CLASS(binder_function_return_class,
 	TP_PROTO(int ret),
 	TP_ARGS(ret),
@@ -131,6 +149,30 @@ TRACE_EVENT(binder_transaction,
 		  __entry->reply, __entry->flags, __entry->code)
 );
 
+TRACE_EVENT(binder_set_priority,
+	TP_PROTO(int proc, int thread, int old_prio,
+		 int desired_prio, int new_prio),
+	TP_ARGS(proc, thread, old_prio, desired_prio, new_prio),
+
+	TP_STRUCT__entry(
+		__field(int, proc)
+		__field(int, thread)
+		__field(int, old_prio)
+		__field(int, desired_prio)
+		__field(int, new_prio)
+	),
+	TP_fast_assign(
+		__entry->proc = proc;
+		__entry->thread = thread;
+		__entry->old_prio = old_prio;
+		__entry->desired_prio = desired_prio;
+		__entry->new_prio = new_prio;
+	),
+	TP_printk("proc=%d thread=%d old=%d => new=%d desired=%d",
+		  __entry->proc, __entry->thread, __entry->old_prio,
+		  __entry->new_prio, __entry->desired_prio)
+);
+
 TRACE_EVENT(binder_transaction_received,
 	TP_PROTO(struct binder_transaction *t),
 	TP_ARGS(t),
@@ -17,6 +17,11 @@
  * percentage of the cached memory is locked this can be very inaccurate
  * and processes may not get killed until the normal oom killer is triggered.
  *
+ * The thresholds are checked whenever global reclaim reports memory
+ * pressure at or above /sys/module/lowmemorykiller/parameters/vmpressure_level
+ * (0 low, 1 medium, 2 critical).  After a kill nothing else is killed until
+ * the victim's memory has been released, or for at most a second.
+ *
  * Copyright (C) 2007-2008 Google, Inc.
  *
  * This software is licensed under the terms of the GNU General Public
@@ -38,8 +43,15 @@
 #include <linux/oom.h>
 #include <linux/sched.h>
 #include <linux/swap.h>
-#include <linux/rcupdate.h>
+#include <linux/ktime.h>
+#include <linux/mutex.h>
 #include <linux/notifier.h>
+#include <linux/rbtree.h>
+#include <linux/spinlock.h>
+#include <linux/vmpressure.h>
+
+#define CREATE_TRACE_POINTS
+#include "lowmemorykiller_trace.h"
 
 static uint32_t lowmem_debug_level = 1;
 static int lowmem_adj[6] = {
@@ -58,6 +70,7 @@ static int lowmem_minfree[6] = {
 static int lowmem_minfree_size = 4;
 
 static unsigned long lowmem_deathpending_timeout;
+static uint32_t lowmem_vmpressure_level = VMPRESSURE_LOW;
 
 #define lowmem_print(level, x...)			\
 	do {						\
@@ -65,74 +78,145 @@ static unsigned long lowmem_deathpending_timeout;
 			pr_info(x);			\
 	} while (0)
 
-static int lowmem_shrink(struct shrinker *s, struct shrink_control *sc)
+/*
+ * Every process, ordered by oom_score_adj, so that picking a victim only
+ * looks at the processes it might actually kill instead of walking the
+ * whole task list.  Kept up to date on fork, exec, exit and oom_score_adj
+ * writes.  Those callers may hold siglock, so interrupts are off while
+ * the lock is held.
+ */
+static struct rb_root lowmem_adj_tree = RB_ROOT;
+static DEFINE_SPINLOCK(lowmem_adj_lock);
+
+/*
+ * The last victim and when it was killed.  Cleared when its task_struct
+ * is freed, after its memory has been released.
+ */
+static DEFINE_SPINLOCK(lowmem_victim_lock);
+static struct task_struct *lowmem_victim;
+static long lowmem_victim_rss_kb;
+static ktime_t lowmem_victim_time;
+
+/* serializes lowmem_scan */
+static DEFINE_MUTEX(lowmem_scan_lock);
+
+/* at most this many of the highest oom_score_adj processes are compared */
+#define LOWMEM_MAX_CANDIDATES	32
+
+static void __lowmem_task_insert(struct task_struct *tsk)
+{
+	struct rb_node **p = &lowmem_adj_tree.rb_node;
+	struct rb_node *parent = NULL;
+	struct task_struct *entry;
+
+	tsk->lowmem_adj = tsk->signal->oom_score_adj;
+	while (*p) {
+		parent = *p;
+		entry = rb_entry(parent, struct task_struct, lowmem_node);
+
+		if (tsk->lowmem_adj < entry->lowmem_adj)
+			p = &(*p)->rb_left;
+		else
+			p = &(*p)->rb_right;
+	}
+	rb_link_node(&tsk->lowmem_node, parent, p);
+	rb_insert_color(&tsk->lowmem_node, &lowmem_adj_tree);
+}
+
+static void __lowmem_task_erase(struct task_struct *tsk)
+{
+	rb_erase(&tsk->lowmem_node, &lowmem_adj_tree);
+	RB_CLEAR_NODE(&tsk->lowmem_node);
+}
+
+void lowmem_task_add(struct task_struct *tsk)
 {
-	struct task_struct *tsk;
+	unsigned long flags;
+
+	spin_lock_irqsave(&lowmem_adj_lock, flags);
+	__lowmem_task_insert(tsk);
+	spin_unlock_irqrestore(&lowmem_adj_lock, flags);
+}
+
+void lowmem_task_remove(struct task_struct *tsk)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&lowmem_adj_lock, flags);
+	if (!RB_EMPTY_NODE(&tsk->lowmem_node))
+		__lowmem_task_erase(tsk);
+	spin_unlock_irqrestore(&lowmem_adj_lock, flags);
+}
+
+void lowmem_task_update(struct task_struct *tsk)
+{
+	unsigned long flags;
+
+	tsk = tsk->group_leader;
+	spin_lock_irqsave(&lowmem_adj_lock, flags);
+	if (!RB_EMPTY_NODE(&tsk->lowmem_node)) {
+		__lowmem_task_erase(tsk);
+		__lowmem_task_insert(tsk);
+	}
+	spin_unlock_irqrestore(&lowmem_adj_lock, flags);
+}
+
+/*
+ * Pick the process with the highest oom_score_adj at or above
+ * min_score_adj, and the largest RSS among those.  Returns it with a
+ * reference held.  The candidates are pinned under lowmem_adj_lock and
+ * only inspected after dropping it, as find_lock_task_mm takes task_lock,
+ * which nests outside siglock.  Processes that are already gone or being
+ * killed are passed over without using up a candidate slot; the mm check
+ * is unlocked, but a leader without an mm may only be skipped once its
+ * other threads have exited too.
+ */
+static struct task_struct *lowmem_select(int min_score_adj, int *rss,
+					 int *score_adj)
+{
+	struct task_struct *candidates[LOWMEM_MAX_CANDIDATES];
 	struct task_struct *selected = NULL;
-	int rem = 0;
-	int tasksize;
-	int i;
-	int min_score_adj = OOM_SCORE_ADJ_MAX + 1;
-	int minfree = 0;
 	int selected_tasksize = 0;
-	int selected_oom_score_adj;
-	int array_size = ARRAY_SIZE(lowmem_adj);
-	int other_free = global_page_state(NR_FREE_PAGES) - totalreserve_pages;
-	int other_file = global_page_state(NR_FILE_PAGES) -
-						global_page_state(NR_SHMEM);
+	int selected_oom_score_adj = min_score_adj;
+	struct rb_node *n;
+	struct task_struct *victim;
+	unsigned long flags;
+	int nr = 0;
+	int i;
 
-	if (lowmem_adj_size < array_size)
-		array_size = lowmem_adj_size;
-	if (lowmem_minfree_size < array_size)
-		array_size = lowmem_minfree_size;
-	for (i = 0; i < array_size; i++) {
-		minfree = lowmem_minfree[i];
-		if (other_free < minfree && other_file < minfree) {
-			min_score_adj = lowmem_adj[i];
+	spin_lock_irqsave(&lowmem_victim_lock, flags);
+	victim = lowmem_victim;
+	spin_unlock_irqrestore(&lowmem_victim_lock, flags);
+
+	spin_lock_irqsave(&lowmem_adj_lock, flags);
+	for (n = rb_last(&lowmem_adj_tree); n && nr < LOWMEM_MAX_CANDIDATES;
+	     n = rb_prev(n)) {
+		struct task_struct *tsk;
+
+		tsk = rb_entry(n, struct task_struct, lowmem_node);
+		if (tsk->lowmem_adj < min_score_adj)
 			break;
-		}
-	}
-	if (sc->nr_to_scan > 0)
-		lowmem_print(3, "lowmem_shrink %lu, %x, ofree %d %d, ma %d\n",
-				sc->nr_to_scan, sc->gfp_mask, other_free,
-				other_file, min_score_adj);
-	rem = global_page_state(NR_ACTIVE_ANON) +
-		global_page_state(NR_ACTIVE_FILE) +
-		global_page_state(NR_INACTIVE_ANON) +
-		global_page_state(NR_INACTIVE_FILE);
-	if (sc->nr_to_scan <= 0 || min_score_adj == OOM_SCORE_ADJ_MAX + 1) {
-		lowmem_print(5, "lowmem_shrink %lu, %x, return %d\n",
-			     sc->nr_to_scan, sc->gfp_mask, rem);
-		return rem;
+		if (tsk->flags & PF_KTHREAD || tsk == victim)
+			continue;
+		if (!ACCESS_ONCE(tsk->mm) && thread_group_empty(tsk))
+			continue;
+		get_task_struct(tsk);
+		candidates[nr++] = tsk;
 	}
-	selected_oom_score_adj = min_score_adj;
+	spin_unlock_irqrestore(&lowmem_adj_lock, flags);
 
-	rcu_read_lock();
-	for_each_process(tsk) {
+	for (i = 0; i < nr; i++) {
 		struct task_struct *p;
 		int oom_score_adj;
+		int tasksize;
 
-		if (tsk->flags & PF_KTHREAD)
-			continue;
-
-		p = find_lock_task_mm(tsk);
+		p = find_lock_task_mm(candidates[i]);
 		if (!p)
 			continue;
-
-		if (test_tsk_thread_flag(p, TIF_MEMDIE) &&
-		    time_before_eq(jiffies, lowmem_deathpending_timeout)) {
-			task_unlock(p);
-			rcu_read_unlock();
-			return 0;
-		}
 		oom_score_adj = p->signal->oom_score_adj;
-		if (oom_score_adj < min_score_adj) {
-			task_unlock(p);
-			continue;
-		}
 		tasksize = get_mm_rss(p->mm);
 		task_unlock(p);
-		if (tasksize <= 0)
+		if (oom_score_adj < min_score_adj || tasksize <= 0)
 			continue;
 		if (selected) {
 			if (oom_score_adj < selected_oom_score_adj)
@@ -141,50 +225,160 @@ static int lowmem_shrink(struct shrinker *s, struct shrink_control *sc)
 			    tasksize <= selected_tasksize)
 				continue;
 		}
-		selected = p;
+		selected = candidates[i];
 		selected_tasksize = tasksize;
 		selected_oom_score_adj = oom_score_adj;
 		lowmem_print(2, "select '%s' (%d), adj %d, size %d, to kill\n",
-			     p->comm, p->pid, oom_score_adj, tasksize);
+			     selected->comm, selected->pid, oom_score_adj,
+			     tasksize);
+	}
+
+	for (i = 0; i < nr; i++)
+		if (candidates[i] != selected)
+			put_task_struct(candidates[i]);
+
+	*rss = selected_tasksize;
+	*score_adj = selected_oom_score_adj;
+	return selected;
+}
+
+static const char * const lowmem_level_names[] = {
+	[VMPRESSURE_LOW] = "low",
+	[VMPRESSURE_MEDIUM] = "medium",
+	[VMPRESSURE_CRITICAL] = "critical",
+};
+
+static void lowmem_scan(unsigned long level,
+			const struct vmpressure_trigger *trigger)
+{
+	struct task_struct *selected;
+	struct task_struct *p;
+	int i;
+	int min_score_adj = OOM_SCORE_ADJ_MAX + 1;
+	int minfree = 0;
+	int selected_tasksize;
+	int selected_oom_score_adj;
+	int array_size = ARRAY_SIZE(lowmem_adj);
+	int other_free = global_page_state(NR_FREE_PAGES) - totalreserve_pages;
+	int other_file = global_page_state(NR_FILE_PAGES) -
+						global_page_state(NR_SHMEM);
+	unsigned long flags;
+	bool pending;
+
+	if (lowmem_adj_size < array_size)
+		array_size = lowmem_adj_size;
+	if (lowmem_minfree_size < array_size)
+		array_size = lowmem_minfree_size;
+	for (i = 0; i < array_size; i++) {
+		minfree = lowmem_minfree[i];
+		if (other_free < minfree && other_file < minfree) {
+			min_score_adj = lowmem_adj[i];
+			break;
+		}
 	}
-	if (selected) {
-		lowmem_print(1, "Killing '%s' (%d), adj %d,\n" \
-				"   to free %ldkB on behalf of '%s' (%d) because\n" \
-				"   cache %ldkB is below limit %ldkB for oom_score_adj %d\n" \
-				"   Free memory is %ldkB above reserved\n",
-			     selected->comm, selected->pid,
-			     selected_oom_score_adj,
+	lowmem_print(3, "lowmem_scan %s, ofree %d %d, ma %d\n",
+		     lowmem_level_names[level], other_free, other_file,
+		     min_score_adj);
+	if (min_score_adj == OOM_SCORE_ADJ_MAX + 1)
+		return;
+
+	/* give the last victim a chance to release its memory first */
+	spin_lock_irqsave(&lowmem_victim_lock, flags);
+	pending = lowmem_victim &&
+		  time_before_eq(jiffies, lowmem_deathpending_timeout);
+	spin_unlock_irqrestore(&lowmem_victim_lock, flags);
+	if (pending)
+		return;
+
+	selected = lowmem_select(min_score_adj, &selected_tasksize,
+				 &selected_oom_score_adj);
+	if (!selected)
+		return;
+
+	lowmem_print(1, "Killing '%s' (%d), adj %d,\n" \
+			"   to free %ldkB on behalf of '%s' (%d) because\n" \
+			"   memory pressure is %s and\n" \
+			"   cache %ldkB is below limit %ldkB for oom_score_adj %d\n" \
+			"   Free memory is %ldkB above reserved\n",
+		     selected->comm, selected->pid,
+		     selected_oom_score_adj,
+		     selected_tasksize * (long)(PAGE_SIZE / 1024),
+		     trigger->comm, trigger->pid,
+		     lowmem_level_names[level],
+		     other_file * (long)(PAGE_SIZE / 1024),
+		     minfree * (long)(PAGE_SIZE / 1024),
+		     min_score_adj,
+		     other_free * (long)(PAGE_SIZE / 1024));
+	trace_lowmemory_kill(selected, selected_oom_score_adj,
 			     selected_tasksize * (long)(PAGE_SIZE / 1024),
-			     current->comm, current->pid,
-			     other_file * (long)(PAGE_SIZE / 1024),
-			     minfree * (long)(PAGE_SIZE / 1024),
-			     min_score_adj,
-			     other_free * (long)(PAGE_SIZE / 1024));
-		lowmem_deathpending_timeout = jiffies + HZ;
-		send_sig(SIGKILL, selected, 0);
-		set_tsk_thread_flag(selected, TIF_MEMDIE);
-		rem -= selected_tasksize;
+			     level, minfree * (long)(PAGE_SIZE / 1024),
+			     other_free * (long)(PAGE_SIZE / 1024),
+			     other_file * (long)(PAGE_SIZE / 1024));
+
+	spin_lock_irqsave(&lowmem_victim_lock, flags);
+	lowmem_victim = selected;
+	lowmem_victim_rss_kb = selected_tasksize * (long)(PAGE_SIZE / 1024);
+	lowmem_victim_time = ktime_get();
+	lowmem_deathpending_timeout = jiffies + HZ;
+	spin_unlock_irqrestore(&lowmem_victim_lock, flags);
+
+	send_sig(SIGKILL, selected, 0);
+	p = find_lock_task_mm(selected);
+	if (p) {
+		set_tsk_thread_flag(p, TIF_MEMDIE);
+		task_unlock(p);
+	}
+	put_task_struct(selected);
+}
+
+static int lowmem_vmpressure_notify(struct notifier_block *nb,
+				    unsigned long level, void *data)
+{
+	if (level < lowmem_vmpressure_level)
+		return NOTIFY_OK;
+
+	if (!mutex_trylock(&lowmem_scan_lock))
+		return NOTIFY_OK;
+	lowmem_scan(level, data);
+	mutex_unlock(&lowmem_scan_lock);
+	return NOTIFY_OK;
+}
+
+static struct notifier_block lowmem_vmpressure_nb = {
+	.notifier_call = lowmem_vmpressure_notify,
+};
+
+static int lowmem_task_free_notify(struct notifier_block *nb,
+				   unsigned long val, void *data)
+{
+	struct task_struct *task = data;
+	unsigned long flags;
+
+	spin_lock_irqsave(&lowmem_victim_lock, flags);
+	if (task == lowmem_victim) {
+		trace_lowmemory_kill_done(task, lowmem_victim_rss_kb,
+				ktime_us_delta(ktime_get(), lowmem_victim_time));
+		lowmem_victim = NULL;
 	}
-	lowmem_print(4, "lowmem_shrink %lu, %x, return %d\n",
-		     sc->nr_to_scan, sc->gfp_mask, rem);
-	rcu_read_unlock();
-	return rem;
+	spin_unlock_irqrestore(&lowmem_victim_lock, flags);
+	return NOTIFY_OK;
 }
 
-static struct shrinker lowmem_shrinker = {
-	.shrink = lowmem_shrink,
-	.seeks = DEFAULT_SEEKS * 16
+static struct notifier_block lowmem_task_free_nb = {
+	.notifier_call = lowmem_task_free_notify,
 };
 
 static int __init lowmem_init(void)
 {
-	register_shrinker(&lowmem_shrinker);
+	task_free_register(&lowmem_task_free_nb);
+	vmpressure_register_notifier(&lowmem_vmpressure_nb);
 	return 0;
 }
 
 static void __exit lowmem_exit(void)
 {
-	unregister_shrinker(&lowmem_shrinker);
+	vmpressure_unregister_notifier(&lowmem_vmpressure_nb);
+	task_free_unregister(&lowmem_task_free_nb);
 }
 
 #ifdef CONFIG_ANDROID_LOW_MEMORY_KILLER_AUTODETECT_OOM_ADJ_VALUES
@@ -217,7 +411,7 @@ static void lowmem_autodetect_oom_adj_values(void)
 	if (oom_score_adj <= OOM_ADJUST_MAX)
 		return;
 
-	lowmem_print(1, "lowmem_shrink: convert oom_adj to oom_score_adj:\n");
+	lowmem_print(1, "lowmem: convert oom_adj to oom_score_adj:\n");
 	for (i = 0; i < array_size; i++) {
 		oom_adj = lowmem_adj[i];
 		oom_score_adj = lowmem_oom_adj_to_oom_score_adj(oom_adj);
@@ -264,7 +458,6 @@ static const struct kparam_array __param_arr_adj = {
 };
 #endif
 
-module_param_named(cost, lowmem_shrinker.seeks, int, S_IRUGO | S_IWUSR);
 #ifdef CONFIG_ANDROID_LOW_MEMORY_KILLER_AUTODETECT_OOM_ADJ_VALUES
 __module_param_call(MODULE_PARAM_PREFIX, adj,
 		    &lowmem_adj_array_ops,
@@ -278,6 +471,8 @@ module_param_array_named(adj, lowmem_adj, int, &lowmem_adj_size,
 module_param_array_named(minfree, lowmem_minfree, uint, &lowmem_minfree_size,
 			 S_IRUGO | S_IWUSR);
 module_param_named(debug_level, lowmem_debug_level, uint, S_IRUGO | S_IWUSR);
+module_param_named(vmpressure_level, lowmem_vmpressure_level, uint,
+		   S_IRUGO | S_IWUSR);
 
 module_init(lowmem_init);
 module_exit(lowmem_exit);
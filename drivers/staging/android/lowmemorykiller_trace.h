@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2013 Google, Inc.
+ *
+ * This software is licensed under the terms of the GNU General Public
+ * License version 2, as published by the Free Software Foundation, and
+ * may be copied, distributed, and modified under those terms.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM lowmemorykiller
+
+#if !defined(_LOWMEMORYKILLER_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _LOWMEMORYKILLER_TRACE_H
+
+#include <linux/sched.h>
+#include <linux/tracepoint.h>
+#include <linux/vmpressure.h>
+
+#define show_vmpressure_level(level)				\
+	__print_symbolic(level,					\
+			 { VMPRESSURE_LOW, "low" },		\
+			 { VMPRESSURE_MEDIUM, "medium" },	\
+			 { VMPRESSURE_CRITICAL, "critical" })
+
+TRACE_EVENT(lowmemory_kill,
+	TP_PROTO(struct task_struct *killed_task, int oom_score_adj,
+		 long rss_kb, unsigned long level, long minfree_kb,
+		 long other_free_kb, long other_file_kb),
+	TP_ARGS(killed_task, oom_score_adj, rss_kb, level, minfree_kb,
+		other_free_kb, other_file_kb),
+
+	TP_STRUCT__entry(
+		__array(char, comm, TASK_COMM_LEN)
+		__field(pid_t, pid)
+		__field(int, oom_score_adj)
+		__field(long, rss_kb)
+		__field(unsigned long, level)
+		__field(long, minfree_kb)
+		__field(long, other_free_kb)
+		__field(long, other_file_kb)
+	),
+	TP_fast_assign(
+		memcpy(__entry->comm, killed_task->comm, TASK_COMM_LEN);
+		__entry->pid = killed_task->pid;
+		__entry->oom_score_adj = oom_score_adj;
+		__entry->rss_kb = rss_kb;
+		__entry->level = level;
+		__entry->minfree_kb = minfree_kb;
+		__entry->other_free_kb = other_free_kb;
+		__entry->other_file_kb = other_file_kb;
+	),
+	TP_printk("%s (%d) adj=%d rss=%ldkB pressure=%s minfree=%ldkB free=%ldkB file=%ldkB",
+		  __entry->comm, __entry->pid, __entry->oom_score_adj,
+		  __entry->rss_kb, show_vmpressure_level(__entry->level),
+		  __entry->minfree_kb, __entry->other_free_kb,
+		  __entry->other_file_kb)
+);
+
+TRACE_EVENT(lowmemory_kill_done,
+	TP_PROTO(struct task_struct *task, long rss_kb, s64 time_us),
+	TP_ARGS(task, rss_kb, time_us),
+
+	TP_STRUCT__entry(
+		__array(char, comm, TASK_COMM_LEN)
+		__field(pid_t, pid)
+		__field(long, rss_kb)
+		__field(s64, time_us)
+	),
+	TP_fast_assign(
+		memcpy(__entry->comm, task->comm, TASK_COMM_LEN);
+		__entry->pid = task->pid;
+		__entry->rss_kb = rss_kb;
+		__entry->time_us = time_us;
+	),
+	TP_printk("%s (%d) rss=%ldkB released in %lldus",
+		  __entry->comm, __entry->pid, __entry->rss_kb,
+		  __entry->time_us)
+);
+
+#endif /* _LOWMEMORYKILLER_TRACE_H */
+
+#undef TRACE_INCLUDE_PATH
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_PATH .
+#define TRACE_INCLUDE_FILE lowmemorykiller_trace
+#include <trace/define_trace.h>
@@ -0,0 +1,61 @@
+/*
+ * Compressed RAM block device
+ *
+ * Copyright (C) 2008, 2009, 2010  Nitin Gupta
+ *
+ * This code is released using a dual license strategy: BSD/GPL
+ * You can choose the licence that better fits your requirements.
+ *
+ * Released under the terms of 3-clause BSD License
+ * Released under the terms of GNU General Public License Version 2.0
+ *
+ * Project home: http://compcache.googlecode.com
+ */
+
+#ifndef _ZRAM_COMP_H_
+#define _ZRAM_COMP_H_
+
+#include <linux/atomic.h>
+
+/* Compression backends, selected per device through comp_algorithm */
+enum zram_comp_id {
+	ZRAM_COMP_LZO,
+#ifdef CONFIG_ZRAM_LZ4_COMPRESS
+	ZRAM_COMP_LZ4,
+#endif
+	__NR_ZRAM_COMP,
+};
+
+struct zram_comp_backend {
+	const char *name;
+	/* scratch space needed by compress() */
+	size_t workmem_size;
+	/*
+	 * Compress one page from src into dst, which is two pages long.
+	 * Returns 0 on success with the compressed length in dst_len.
+	 */
+	int (*compress)(const unsigned char *src, unsigned char *dst,
+			size_t *dst_len, void *workmem);
+	/* Decompress src_len bytes into one full page. Returns 0 on success */
+	int (*decompress)(const unsigned char *src, size_t src_len,
+			  unsigned char *dst);
+};
+
+/*
+ * Per device and per backend counters.  They are not cleared on reset
+ * so that backends can be compared after switching between them.
+ */
+struct zram_comp_stats {
+	atomic64_t orig_size;		/* bytes fed to compress() */
+	atomic64_t compr_size;		/* bytes produced by compress() */
+	atomic64_t num_compress;
+	atomic64_t compress_ns;
+	atomic64_t num_decompress;
+	atomic64_t decompress_ns;
+};
+
+extern const struct zram_comp_backend zram_comp_backends[__NR_ZRAM_COMP];
+
+int zram_comp_find(const char *name);
+
+#endif
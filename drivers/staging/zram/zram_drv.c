@@ -23,15 +23,20 @@
 #include <linux/kernel.h>
 #include <linux/bio.h>
 #include <linux/bitops.h>
+#include <linux/bit_spinlock.h>
 #include <linux/blkdev.h>
 #include <linux/buffer_head.h>
 #include <linux/device.h>
 #include <linux/genhd.h>
 #include <linux/highmem.h>
+#include <linux/jhash.h>
 #include <linux/slab.h>
-#include <linux/lzo.h>
 #include <linux/string.h>
+#include <linux/ktime.h>
 #include <linux/vmalloc.h>
+#include <linux/workqueue.h>
+#include <linux/fs.h>
+#include <linux/jiffies.h>
 
 #include "zram_drv.h"
 
@@ -42,16 +47,6 @@ struct zram *zram_devices;
 /* Module params (documentation at end) */
 static unsigned int num_devices;
 
-static void zram_stat_inc(u32 *v)
-{
-	*v = *v + 1;
-}
-
-static void zram_stat_dec(u32 *v)
-{
-	*v = *v - 1;
-}
-
 static void zram_stat64_add(struct zram *zram, u64 *v, u64 inc)
 {
 	spin_lock(&zram->stat64_lock);
@@ -71,36 +66,279 @@ static void zram_stat64_inc(struct zram *zram, u64 *v)
 	zram_stat64_add(zram, v, 1);
 }
 
+/*
+ * Each table entry is protected by the ZRAM_ACCESS bit of its value,
+ * so I/O to different pages of the device proceeds in parallel.  All
+ * the helpers below expect the slot lock to be held.
+ */
+static void zram_lock_slot(struct zram *zram, u32 index)
+{
+	bit_spin_lock(ZRAM_ACCESS, &zram->table[index].value);
+}
+
+static void zram_unlock_slot(struct zram *zram, u32 index)
+{
+	bit_spin_unlock(ZRAM_ACCESS, &zram->table[index].value);
+}
+
 static int zram_test_flag(struct zram *zram, u32 index,
 			enum zram_pageflags flag)
 {
-	return zram->table[index].flags & BIT(flag);
+	return zram->table[index].value & BIT(flag);
 }
 
 static void zram_set_flag(struct zram *zram, u32 index,
 			enum zram_pageflags flag)
 {
-	zram->table[index].flags |= BIT(flag);
+	zram->table[index].value |= BIT(flag);
 }
 
 static void zram_clear_flag(struct zram *zram, u32 index,
 			enum zram_pageflags flag)
 {
-	zram->table[index].flags &= ~BIT(flag);
+	zram->table[index].value &= ~BIT(flag);
+}
+
+static size_t zram_get_obj_size(struct zram *zram, u32 index)
+{
+	return zram->table[index].value & (BIT(ZRAM_FLAG_SHIFT) - 1);
+}
+
+static void zram_set_obj_size(struct zram *zram, u32 index, size_t size)
+{
+	unsigned long flags = zram->table[index].value >> ZRAM_FLAG_SHIFT;
+
+	zram->table[index].value = (flags << ZRAM_FLAG_SHIFT) | size;
+}
+
+#ifdef CONFIG_ZRAM_WRITEBACK
+/* Records an access to the slot for idle tracking, slot lock held */
+static void zram_accessed(struct zram *zram, u32 index)
+{
+	zram_clear_flag(zram, index, ZRAM_IDLE);
+	zram->table[index].ac_time = jiffies;
+}
+
+/* Returns a free block on the backing device or nr_blocks if it is full */
+static unsigned long zram_alloc_block(struct zram *zram, unsigned long hint)
+{
+	unsigned long blk;
+
+	spin_lock(&zram->bitmap_lock);
+	blk = find_next_zero_bit(zram->bitmap, zram->nr_blocks, hint);
+	if (blk >= zram->nr_blocks && hint)
+		blk = find_first_zero_bit(zram->bitmap, zram->nr_blocks);
+	if (blk < zram->nr_blocks)
+		__set_bit(blk, zram->bitmap);
+	spin_unlock(&zram->bitmap_lock);
+
+	return blk;
+}
+
+static void zram_free_block(struct zram *zram, unsigned long blk)
+{
+	spin_lock(&zram->bitmap_lock);
+	WARN_ON(!test_bit(blk, zram->bitmap));
+	__clear_bit(blk, zram->bitmap);
+	spin_unlock(&zram->bitmap_lock);
+}
+
+static void zram_bdev_read_end_io(struct bio *bio, int err)
+{
+	complete(bio->bi_private);
+}
+
+/* Synchronously reads one block of the backing device into page */
+static int __zram_bdev_read(struct zram *zram, unsigned long blk,
+			    struct page *page)
+{
+	DECLARE_COMPLETION_ONSTACK(done);
+	struct bio *bio;
+	int ret;
+
+	bio = bio_alloc(GFP_NOIO, 1);
+	if (!bio)
+		return -ENOMEM;
+
+	bio->bi_bdev = zram->bdev;
+	bio->bi_sector = blk << SECTORS_PER_PAGE_SHIFT;
+	bio->bi_end_io = zram_bdev_read_end_io;
+	bio->bi_private = &done;
+	bio_add_page(bio, page, PAGE_SIZE, 0);
+
+	submit_bio(READ, bio);
+	wait_for_completion(&done);
+
+	ret = test_bit(BIO_UPTODATE, &bio->bi_flags) ? 0 : -EIO;
+	bio_put(bio);
+
+	if (!ret)
+		zram_stat64_add(zram, &zram->stats.bd_reads, PAGE_SIZE);
+	return ret;
+}
+
+struct zram_bdev_work {
+	struct work_struct work;
+	struct zram *zram;
+	unsigned long blk;
+	struct page *page;
+	int ret;
+};
+
+static void zram_bdev_read_work(struct work_struct *work)
+{
+	struct zram_bdev_work *zw = container_of(work, struct zram_bdev_work,
+						 work);
+
+	zw->ret = __zram_bdev_read(zw->zram, zw->blk, zw->page);
 }
 
-static int page_zero_filled(void *ptr)
+/*
+ * Called from zram_make_request, where generic_make_request only puts
+ * new bios on current->bio_list until we return.  Submit the read from a
+ * worker so that it is issued while we wait for it.
+ */
+static int zram_bdev_read(struct zram *zram, unsigned long blk,
+			  struct page *page)
+{
+	struct zram_bdev_work zw = {
+		.zram = zram,
+		.blk = blk,
+		.page = page,
+	};
+
+	INIT_WORK_ONSTACK(&zw.work, zram_bdev_read_work);
+	queue_work(system_unbound_wq, &zw.work);
+	flush_work(&zw.work);
+	destroy_work_on_stack(&zw.work);
+
+	return zw.ret;
+}
+#else
+static inline void zram_accessed(struct zram *zram, u32 index)
+{
+}
+
+static inline void zram_free_block(struct zram *zram, unsigned long blk)
+{
+}
+
+static inline int zram_bdev_read(struct zram *zram, unsigned long blk,
+				 struct page *page)
+{
+	return -EIO;
+}
+#endif
+
+/*
+ * Grab an idle compression stream, sleeping until another writer
+ * releases one if all of them are busy.
+ */
+static struct zram_strm *zram_strm_find(struct zram *zram)
+{
+	struct zram_strm *strm;
+
+	for (;;) {
+		spin_lock(&zram->strm_lock);
+		if (!list_empty(&zram->idle_strm)) {
+			strm = list_first_entry(&zram->idle_strm,
+						struct zram_strm, list);
+			list_del(&strm->list);
+			spin_unlock(&zram->strm_lock);
+			return strm;
+		}
+		spin_unlock(&zram->strm_lock);
+
+		wait_event(zram->strm_wait, !list_empty(&zram->idle_strm));
+	}
+}
+
+static void zram_strm_release(struct zram *zram, struct zram_strm *strm)
+{
+	spin_lock(&zram->strm_lock);
+	list_add(&strm->list, &zram->idle_strm);
+	spin_unlock(&zram->strm_lock);
+
+	wake_up(&zram->strm_wait);
+}
+
+static void zram_strm_free(struct zram_strm *strm)
+{
+	kfree(strm->workmem);
+	free_pages((unsigned long)strm->buffer, 1);
+	kfree(strm);
+}
+
+static struct zram_strm *zram_strm_alloc(struct zram *zram)
+{
+	struct zram_strm *strm;
+
+	strm = kzalloc(sizeof(*strm), GFP_KERNEL);
+	if (!strm)
+		return NULL;
+
+	strm->workmem = kzalloc(zram_comp_backends[zram->comp].workmem_size,
+				GFP_KERNEL);
+	strm->buffer = (void *)__get_free_pages(GFP_KERNEL | __GFP_ZERO, 1);
+	if (!strm->workmem || !strm->buffer) {
+		zram_strm_free(strm);
+		return NULL;
+	}
+
+	return strm;
+}
+
+static int zram_compress(struct zram *zram, struct zram_strm *strm,
+			 const unsigned char *src, size_t *clen)
+{
+	struct zram_comp_stats *stats = &zram->comp_stats[zram->comp];
+	ktime_t start = ktime_get();
+	int ret;
+
+	ret = zram_comp_backends[zram->comp].compress(src, strm->buffer, clen,
+						      strm->workmem);
+	if (likely(!ret)) {
+		atomic64_add(ktime_to_ns(ktime_sub(ktime_get(), start)),
+			     &stats->compress_ns);
+		atomic64_inc(&stats->num_compress);
+		atomic64_add(PAGE_SIZE, &stats->orig_size);
+		atomic64_add(*clen, &stats->compr_size);
+	}
+
+	return ret;
+}
+
+static int zram_decompress(struct zram *zram, const unsigned char *src,
+			   size_t clen, unsigned char *dst)
+{
+	struct zram_comp_stats *stats = &zram->comp_stats[zram->comp];
+	ktime_t start = ktime_get();
+	int ret;
+
+	ret = zram_comp_backends[zram->comp].decompress(src, clen, dst);
+	if (likely(!ret)) {
+		atomic64_add(ktime_to_ns(ktime_sub(ktime_get(), start)),
+			     &stats->decompress_ns);
+		atomic64_inc(&stats->num_decompress);
+	}
+
+	return ret;
+}
+
+/* Checks whether the page is one word repeated, zero being most common */
+static int page_same_filled(void *ptr, unsigned long *element)
 {
 	unsigned int pos;
 	unsigned long *page;
 
 	page = (unsigned long *)ptr;
 
-	for (pos = 0; pos != PAGE_SIZE / sizeof(*page); pos++) {
-		if (page[pos])
+	for (pos = 1; pos != PAGE_SIZE / sizeof(*page); pos++) {
+		if (page[pos] != page[0])
 			return 0;
 	}
 
+	*element = page[0];
 	return 1;
 }
 
@@ -133,50 +371,89 @@ static void zram_set_disksize(struct zram *zram, size_t totalram_bytes)
 	zram->disksize &= PAGE_MASK;
 }
 
+/* Called with the slot lock held */
 static void zram_free_page(struct zram *zram, size_t index)
 {
 	void *handle = zram->table[index].handle;
+	size_t size = zram_get_obj_size(zram, index);
+
+	zram_clear_flag(zram, index, ZRAM_IDLE);
+	zram_clear_flag(zram, index, ZRAM_UNDER_WB);
+
+	/* Written back pages only hold a block on the backing device */
+	if (zram_test_flag(zram, index, ZRAM_WB)) {
+		zram_clear_flag(zram, index, ZRAM_WB);
+		zram_free_block(zram, zram->table[index].element);
+		zram->table[index].element = 0;
+#ifdef CONFIG_ZRAM_WRITEBACK
+		atomic_dec(&zram->stats.bd_count);
+#endif
+		return;
+	}
 
-	if (unlikely(!handle)) {
-		/*
-		 * No memory is allocated for zero filled pages.
-		 * Simply clear zero page flag.
-		 */
-		if (zram_test_flag(zram, index, ZRAM_ZERO)) {
-			zram_clear_flag(zram, index, ZRAM_ZERO);
-			zram_stat_dec(&zram->stats.pages_zero);
-		}
+	/*
+	 * No memory is allocated for same filled pages.
+	 * Simply clear same page flag.
+	 */
+	if (zram_test_flag(zram, index, ZRAM_SAME)) {
+		zram_clear_flag(zram, index, ZRAM_SAME);
+		if (zram->table[index].element)
+			atomic_dec(&zram->stats.pages_same);
+		else
+			atomic_dec(&zram->stats.pages_zero);
+		zram->table[index].element = 0;
 		return;
 	}
 
+	if (unlikely(!handle))
+		return;
+
 	if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED))) {
 		__free_page(handle);
 		zram_clear_flag(zram, index, ZRAM_UNCOMPRESSED);
-		zram_stat_dec(&zram->stats.pages_expand);
+		atomic_dec(&zram->stats.pages_expand);
 		goto out;
 	}
 
-	zs_free(zram->mem_pool, handle);
+	if (zram_test_flag(zram, index, ZRAM_DEDUP)) {
+		zs_dedup_put(zram->mem_pool, handle);
+		zram_clear_flag(zram, index, ZRAM_DEDUP);
+	} else {
+		zs_free(zram->mem_pool, handle);
+	}
 
-	if (zram->table[index].size <= PAGE_SIZE / 2)
-		zram_stat_dec(&zram->stats.good_compress);
+	if (size <= PAGE_SIZE / 2)
+		atomic_dec(&zram->stats.good_compress);
 
 out:
-	zram_stat64_sub(zram, &zram->stats.compr_size,
-			zram->table[index].size);
-	zram_stat_dec(&zram->stats.pages_stored);
+	zram_stat64_sub(zram, &zram->stats.compr_size, size);
+	atomic_dec(&zram->stats.pages_stored);
 
 	zram->table[index].handle = NULL;
-	zram->table[index].size = 0;
+	zram_set_obj_size(zram, index, 0);
+}
+
+static void fill_same(void *ptr, unsigned long element, unsigned int len)
+{
+	unsigned long *p = ptr;
+	unsigned int i;
+
+	if (!element) {
+		memset(ptr, 0, len);
+		return;
+	}
+
+	for (i = 0; i < len / sizeof(*p); i++)
+		p[i] = element;
 }
 
-static void handle_zero_page(struct bio_vec *bvec)
+static void handle_same_page(struct bio_vec *bvec, unsigned long element)
 {
 	struct page *page = bvec->bv_page;
 	void *user_mem;
 
 	user_mem = kmap_atomic(page);
-	memset(user_mem + bvec->bv_offset, 0, bvec->bv_len);
+	fill_same(user_mem + bvec->bv_offset, element, bvec->bv_len);
 	kunmap_atomic(user_mem);
 
 	flush_dcache_page(page);
@@ -203,106 +480,188 @@ static inline int is_partial_io(struct bio_vec *bvec)
 	return bvec->bv_len != PAGE_SIZE;
 }
 
+/* Reads a page back from the backing device, called without slot lock */
+static int handle_wb_page(struct zram *zram, struct bio_vec *bvec,
+			  unsigned long blk, int offset)
+{
+	struct page *page = bvec->bv_page;
+	struct page *wb_page;
+	unsigned char *user_mem, *src;
+	int ret;
+
+	wb_page = alloc_page(GFP_NOIO);
+	if (!wb_page)
+		return -ENOMEM;
+
+	ret = zram_bdev_read(zram, blk, wb_page);
+	if (!ret) {
+		user_mem = kmap_atomic(page);
+		src = kmap_atomic(wb_page);
+		memcpy(user_mem + bvec->bv_offset, src + offset, bvec->bv_len);
+		kunmap_atomic(src);
+		kunmap_atomic(user_mem);
+
+		flush_dcache_page(page);
+	}
+
+	__free_page(wb_page);
+	return ret;
+}
+
 static int zram_bvec_read(struct zram *zram, struct bio_vec *bvec,
 			  u32 index, int offset, struct bio *bio)
 {
 	int ret;
-	size_t clen;
 	struct page *page;
 	struct zobj_header *zheader;
 	unsigned char *user_mem, *cmem, *uncmem = NULL;
 
 	page = bvec->bv_page;
 
-	if (zram_test_flag(zram, index, ZRAM_ZERO)) {
-		handle_zero_page(bvec);
-		return 0;
+	if (is_partial_io(bvec)) {
+		/*
+		 * Use a temporary buffer to decompress the page.  It has
+		 * to be allocated before the slot lock is taken.
+		 */
+		uncmem = kmalloc(PAGE_SIZE, GFP_NOIO);
+		if (!uncmem) {
+			pr_info("Error allocating temp memory!\n");
+			return -ENOMEM;
+		}
+	}
+
+	zram_lock_slot(zram, index);
+	zram_accessed(zram, index);
+
+	if (zram_test_flag(zram, index, ZRAM_SAME)) {
+		unsigned long element = zram->table[index].element;
+
+		zram_unlock_slot(zram, index);
+		handle_same_page(bvec, element);
+		ret = 0;
+		goto out;
+	}
+
+	if (zram_test_flag(zram, index, ZRAM_WB)) {
+		unsigned long blk = zram->table[index].element;
+
+		zram_unlock_slot(zram, index);
+		ret = handle_wb_page(zram, bvec, blk, offset);
+		if (ret)
+			zram_stat64_inc(zram, &zram->stats.failed_reads);
+		goto out;
 	}
 
 	/* Requested page is not present in compressed area */
 	if (unlikely(!zram->table[index].handle)) {
+		zram_unlock_slot(zram, index);
 		pr_debug("Read before write: sector=%lu, size=%u",
 			 (ulong)(bio->bi_sector), bio->bi_size);
-		handle_zero_page(bvec);
-		return 0;
+		handle_same_page(bvec, 0);
+		ret = 0;
+		goto out;
 	}
 
 	/* Page is stored uncompressed since it's incompressible */
 	if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED))) {
 		handle_uncompressed_page(zram, bvec, index, offset);
-		return 0;
-	}
-
-	if (is_partial_io(bvec)) {
-		/* Use  a temporary buffer to decompress the page */
-		uncmem = kmalloc(PAGE_SIZE, GFP_NOIO);
-		if (!uncmem) {
-			pr_info("Error allocating temp memory!\n");
-			return -ENOMEM;
-		}
+		zram_unlock_slot(zram, index);
+		ret = 0;
+		goto out;
 	}
 
 	user_mem = kmap_atomic(page);
 	if (!is_partial_io(bvec))
 		uncmem = user_mem;
-	clen = PAGE_SIZE;
 
 	cmem = zs_map_object(zram->mem_pool, zram->table[index].handle);
 
-	ret = lzo1x_decompress_safe(cmem + sizeof(*zheader),
-				    zram->table[index].size,
-				    uncmem, &clen);
+	ret = zram_decompress(zram, cmem + sizeof(*zheader),
+			      zram_get_obj_size(zram, index), uncmem);
 
-	if (is_partial_io(bvec)) {
+	if (is_partial_io(bvec))
 		memcpy(user_mem + bvec->bv_offset, uncmem + offset,
 		       bvec->bv_len);
-		kfree(uncmem);
-	}
 
 	zs_unmap_object(zram->mem_pool, zram->table[index].handle);
+	zram_unlock_slot(zram, index);
 	kunmap_atomic(user_mem);
 
 	/* Should NEVER happen. Return bio error if it does. */
-	if (unlikely(ret != LZO_E_OK)) {
+	if (unlikely(ret)) {
 		pr_err("Decompression failed! err=%d, page=%u\n", ret, index);
 		zram_stat64_inc(zram, &zram->stats.failed_reads);
-		return ret;
+		goto out;
 	}
 
 	flush_dcache_page(page);
 
-	return 0;
+out:
+	if (is_partial_io(bvec))
+		kfree(uncmem);
+	return ret;
 }
 
 static int zram_read_before_write(struct zram *zram, char *mem, u32 index)
 {
 	int ret;
-	size_t clen = PAGE_SIZE;
 	struct zobj_header *zheader;
 	unsigned char *cmem;
 
-	if (zram_test_flag(zram, index, ZRAM_ZERO) ||
-	    !zram->table[index].handle) {
-		memset(mem, 0, PAGE_SIZE);
+	zram_lock_slot(zram, index);
+
+	if (zram_test_flag(zram, index, ZRAM_SAME)) {
+		unsigned long element = zram->table[index].element;
+
+		zram_unlock_slot(zram, index);
+		fill_same(mem, element, PAGE_SIZE);
 		return 0;
 	}
 
-	cmem = zs_map_object(zram->mem_pool, zram->table[index].handle);
+	if (zram_test_flag(zram, index, ZRAM_WB)) {
+		unsigned long blk = zram->table[index].element;
+		struct page *wb_page;
+
+		zram_unlock_slot(zram, index);
+
+		wb_page = alloc_page(GFP_NOIO);
+		if (!wb_page)
+			return -ENOMEM;
+		ret = zram_bdev_read(zram, blk, wb_page);
+		if (!ret) {
+			cmem = kmap_atomic(wb_page);
+			memcpy(mem, cmem, PAGE_SIZE);
+			kunmap_atomic(cmem);
+		} else {
+			zram_stat64_inc(zram, &zram->stats.failed_reads);
+		}
+		__free_page(wb_page);
+		return ret;
+	}
+
+	if (!zram->table[index].handle) {
+		zram_unlock_slot(zram, index);
+		memset(mem, 0, PAGE_SIZE);
+		return 0;
+	}
 
 	/* Page is stored uncompressed since it's incompressible */
 	if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED))) {
+		cmem = kmap_atomic(zram->table[index].handle);
 		memcpy(mem, cmem, PAGE_SIZE);
 		kunmap_atomic(cmem);
+		zram_unlock_slot(zram, index);
 		return 0;
 	}
 
-	ret = lzo1x_decompress_safe(cmem + sizeof(*zheader),
-				    zram->table[index].size,
-				    mem, &clen);
+	cmem = zs_map_object(zram->mem_pool, zram->table[index].handle);
+	ret = zram_decompress(zram, cmem + sizeof(*zheader),
+			      zram_get_obj_size(zram, index), mem);
 	zs_unmap_object(zram->mem_pool, zram->table[index].handle);
+	zram_unlock_slot(zram, index);
 
 	/* Should NEVER happen. Return bio error if it does. */
-	if (unlikely(ret != LZO_E_OK)) {
+	if (unlikely(ret)) {
 		pr_err("Decompression failed! err=%d, page=%u\n", ret, index);
 		zram_stat64_inc(zram, &zram->stats.failed_reads);
 		return ret;
@@ -314,16 +673,17 @@ static int zram_read_before_write(struct zram *zram, char *mem, u32 index)
 static int zram_bvec_write(struct zram *zram, struct bio_vec *bvec, u32 index,
 			   int offset)
 {
-	int ret;
-	u32 store_offset;
+	int ret, dedup = 0;
 	size_t clen;
+	u32 checksum = 0;
 	void *handle;
+	unsigned long element;
 	struct zobj_header *zheader;
 	struct page *page, *page_store;
+	struct zram_strm *strm = NULL;
 	unsigned char *user_mem, *cmem, *src, *uncmem = NULL;
 
 	page = bvec->bv_page;
-	src = zram->compress_buffer;
 
 	if (is_partial_io(bvec)) {
 		/*
@@ -337,19 +697,12 @@ static int zram_bvec_write(struct zram *zram, struct bio_vec *bvec, u32 index,
 			goto out;
 		}
 		ret = zram_read_before_write(zram, uncmem, index);
-		if (ret) {
-			kfree(uncmem);
+		if (ret)
 			goto out;
-		}
 	}
 
-	/*
-	 * System overwrites unused sectors. Free memory associated
-	 * with this sector now.
-	 */
-	if (zram->table[index].handle ||
-	    zram_test_flag(zram, index, ZRAM_ZERO))
-		zram_free_page(zram, index);
+	/* May sleep, so must be done before mapping the user page */
+	strm = zram_strm_find(zram);
 
 	user_mem = kmap_atomic(page);
 
@@ -359,24 +712,37 @@ static int zram_bvec_write(struct zram *zram, struct bio_vec *bvec, u32 index,
 	else
 		uncmem = user_mem;
 
-	if (page_zero_filled(uncmem)) {
+	if (page_same_filled(uncmem, &element)) {
 		kunmap_atomic(user_mem);
-		if (is_partial_io(bvec))
-			kfree(uncmem);
-		zram_stat_inc(&zram->stats.pages_zero);
-		zram_set_flag(zram, index, ZRAM_ZERO);
+		zram_strm_release(zram, strm);
+		strm = NULL;
+
+		/*
+		 * System overwrites unused sectors. Free memory associated
+		 * with this sector now.
+		 */
+		zram_lock_slot(zram, index);
+		zram_free_page(zram, index);
+		zram->table[index].element = element;
+		zram_set_flag(zram, index, ZRAM_SAME);
+		zram_accessed(zram, index);
+		zram_unlock_slot(zram, index);
+
+		if (element)
+			atomic_inc(&zram->stats.pages_same);
+		else
+			atomic_inc(&zram->stats.pages_zero);
 		ret = 0;
 		goto out;
 	}
 
-	ret = lzo1x_1_compress(uncmem, PAGE_SIZE, src, &clen,
-			       zram->compress_workmem);
+	ret = zram_compress(zram, strm, uncmem, &clen);
 
 	kunmap_atomic(user_mem);
-	if (is_partial_io(bvec))
-			kfree(uncmem);
+	if (!is_partial_io(bvec))
+		uncmem = NULL;
 
-	if (unlikely(ret != LZO_E_OK)) {
+	if (unlikely(ret)) {
 		pr_err("Compression failed! err=%d\n", ret);
 		goto out;
 	}
@@ -396,13 +762,25 @@ static int zram_bvec_write(struct zram *zram, struct bio_vec *bvec, u32 index,
 			goto out;
 		}
 
-		store_offset = 0;
-		zram_set_flag(zram, index, ZRAM_UNCOMPRESSED);
-		zram_stat_inc(&zram->stats.pages_expand);
 		handle = page_store;
-		src = kmap_atomic(page);
+		src = uncmem ? uncmem : kmap_atomic(page);
 		cmem = kmap_atomic(page_store);
-		goto memstore;
+		memcpy(cmem, src, clen);
+		kunmap_atomic(cmem);
+		if (!uncmem)
+			kunmap_atomic(src);
+		goto install;
+	}
+
+	/* Share an identical object already stored, e.g. by a forked child */
+	if (zram->dedup) {
+		checksum = jhash(strm->buffer, clen, 0);
+		handle = zs_dedup_get(zram->mem_pool, strm->buffer, clen,
+				      checksum);
+		if (handle) {
+			dedup = 1;
+			goto install;
+		}
 	}
 
 	handle = zs_malloc(zram->mem_pool, clen + sizeof(*zheader));
@@ -414,37 +792,53 @@ static int zram_bvec_write(struct zram *zram, struct bio_vec *bvec, u32 index,
 	}
 	cmem = zs_map_object(zram->mem_pool, handle);
 
-memstore:
 #if 0
 	/* Back-reference needed for memory defragmentation */
-	if (!zram_test_flag(zram, index, ZRAM_UNCOMPRESSED)) {
-		zheader = (struct zobj_header *)cmem;
-		zheader->table_idx = index;
-		cmem += sizeof(*zheader);
-	}
+	zheader = (struct zobj_header *)cmem;
+	zheader->table_idx = index;
+	cmem += sizeof(*zheader);
 #endif
 
-	memcpy(cmem, src, clen);
+	memcpy(cmem, strm->buffer, clen);
+	zs_unmap_object(zram->mem_pool, handle);
 
-	if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED))) {
-		kunmap_atomic(cmem);
-		kunmap_atomic(src);
-	} else {
-		zs_unmap_object(zram->mem_pool, handle);
-	}
+	if (zram->dedup &&
+	    !zs_dedup_add(zram->mem_pool, handle, clen, checksum))
+		dedup = 1;
+
+install:
+	zram_strm_release(zram, strm);
+	strm = NULL;
+
+	/*
+	 * System overwrites unused sectors. Free memory associated
+	 * with this sector now.
+	 */
+	zram_lock_slot(zram, index);
+	zram_free_page(zram, index);
 
 	zram->table[index].handle = handle;
-	zram->table[index].size = clen;
+	zram_set_obj_size(zram, index, clen);
+	if (clen == PAGE_SIZE)
+		zram_set_flag(zram, index, ZRAM_UNCOMPRESSED);
+	if (dedup)
+		zram_set_flag(zram, index, ZRAM_DEDUP);
+	zram_accessed(zram, index);
+	zram_unlock_slot(zram, index);
 
 	/* Update stats */
 	zram_stat64_add(zram, &zram->stats.compr_size, clen);
-	zram_stat_inc(&zram->stats.pages_stored);
-	if (clen <= PAGE_SIZE / 2)
-		zram_stat_inc(&zram->stats.good_compress);
-
-	return 0;
+	atomic_inc(&zram->stats.pages_stored);
+	if (clen == PAGE_SIZE)
+		atomic_inc(&zram->stats.pages_expand);
+	else if (clen <= PAGE_SIZE / 2)
+		atomic_inc(&zram->stats.good_compress);
 
 out:
+	if (strm)
+		zram_strm_release(zram, strm);
+	if (is_partial_io(bvec))
+		kfree(uncmem);
 	if (ret)
 		zram_stat64_inc(zram, &zram->stats.failed_writes);
 	return ret;
@@ -453,21 +847,322 @@ out:
 static int zram_bvec_rw(struct zram *zram, struct bio_vec *bvec, u32 index,
 			int offset, struct bio *bio, int rw)
 {
+	if (rw == READ)
+		return zram_bvec_read(zram, bvec, index, offset, bio);
+
+	return zram_bvec_write(zram, bvec, index, offset);
+}
+
+#ifdef CONFIG_ZRAM_WRITEBACK
+/* Pages collected before their bios are submitted together */
+#define ZRAM_WB_BATCH	32
+
+struct zram_wb_batch {
+	atomic_t pending;	/* bios in flight, plus one for the submitter */
+	struct completion done;
+	int error;
+	unsigned int nr;
+	u32 index[ZRAM_WB_BATCH];
+	unsigned long blk[ZRAM_WB_BATCH];
+	struct page *page[ZRAM_WB_BATCH];
+};
+
+int zram_set_backing_dev(struct zram *zram, const char *path)
+{
+	struct block_device *bdev;
+	unsigned long nr_blocks, *bitmap;
+	char *name;
 	int ret;
 
-	if (rw == READ) {
-		down_read(&zram->lock);
-		ret = zram_bvec_read(zram, bvec, index, offset, bio);
-		up_read(&zram->lock);
+	name = kstrndup(path, PATH_MAX, GFP_KERNEL);
+	if (!name)
+		return -ENOMEM;
+	name[strcspn(name, "\n")] = '\0';
+
+	bdev = blkdev_get_by_path(name, FMODE_READ | FMODE_WRITE | FMODE_EXCL,
+				  zram);
+	if (IS_ERR(bdev)) {
+		pr_info("Error opening backing device %s\n", name);
+		ret = PTR_ERR(bdev);
+		goto out_free_name;
+	}
+
+	nr_blocks = i_size_read(bdev->bd_inode) >> PAGE_SHIFT;
+	if (!nr_blocks) {
+		ret = -EINVAL;
+		goto out_put;
+	}
+
+	bitmap = vzalloc(BITS_TO_LONGS(nr_blocks) * sizeof(long));
+	if (!bitmap) {
+		ret = -ENOMEM;
+		goto out_put;
+	}
+
+	ret = set_blocksize(bdev, PAGE_SIZE);
+	if (ret)
+		goto out_free_bitmap;
+
+	zram_reset_backing_dev(zram);
+
+	zram->bdev = bdev;
+	zram->backing_dev = name;
+	zram->nr_blocks = nr_blocks;
+	zram->bitmap = bitmap;
+
+	pr_info("Backing device %s, %lu pages\n", name, nr_blocks);
+	return 0;
+
+out_free_bitmap:
+	vfree(bitmap);
+out_put:
+	blkdev_put(bdev, FMODE_READ | FMODE_WRITE | FMODE_EXCL);
+out_free_name:
+	kfree(name);
+	return ret;
+}
+
+void zram_reset_backing_dev(struct zram *zram)
+{
+	if (!zram->bdev)
+		return;
+
+	blkdev_put(zram->bdev, FMODE_READ | FMODE_WRITE | FMODE_EXCL);
+	vfree(zram->bitmap);
+	kfree(zram->backing_dev);
+
+	zram->bdev = NULL;
+	zram->backing_dev = NULL;
+	zram->bitmap = NULL;
+	zram->nr_blocks = 0;
+}
+
+/*
+ * Marks stored pages idle.  With a non zero age (seconds) only pages
+ * not accessed for at least that long are marked.
+ */
+void zram_mark_idle(struct zram *zram, unsigned long age)
+{
+	size_t index;
+
+	for (index = 0; index < zram->disksize >> PAGE_SHIFT; index++) {
+		zram_lock_slot(zram, index);
+		if (zram->table[index].handle &&
+		    !zram_test_flag(zram, index, ZRAM_SAME) &&
+		    !zram_test_flag(zram, index, ZRAM_WB) &&
+		    (!age || time_after_eq(jiffies,
+				zram->table[index].ac_time + age * HZ)))
+			zram_set_flag(zram, index, ZRAM_IDLE);
+		zram_unlock_slot(zram, index);
+		cond_resched();
+	}
+}
+
+/*
+ * Copies a slot selected for writeback into page and marks it
+ * ZRAM_UNDER_WB.  Returns 0 if the slot was picked.
+ */
+static int zram_wb_pick(struct zram *zram, u32 index, enum zram_wb_mode mode,
+			struct page *page)
+{
+	struct zobj_header *zheader;
+	unsigned char *cmem, *dst;
+	int ret = -EAGAIN;
+
+	zram_lock_slot(zram, index);
+
+	if (!zram->table[index].handle ||
+	    zram_test_flag(zram, index, ZRAM_SAME) ||
+	    zram_test_flag(zram, index, ZRAM_WB) ||
+	    zram_test_flag(zram, index, ZRAM_UNDER_WB))
+		goto out;
+
+	if (mode == ZRAM_WB_IDLE && !zram_test_flag(zram, index, ZRAM_IDLE))
+		goto out;
+	if (mode == ZRAM_WB_HUGE &&
+	    !zram_test_flag(zram, index, ZRAM_UNCOMPRESSED))
+		goto out;
+
+	dst = kmap_atomic(page);
+	if (zram_test_flag(zram, index, ZRAM_UNCOMPRESSED)) {
+		cmem = kmap_atomic(zram->table[index].handle);
+		memcpy(dst, cmem, PAGE_SIZE);
+		kunmap_atomic(cmem);
+		ret = 0;
 	} else {
-		down_write(&zram->lock);
-		ret = zram_bvec_write(zram, bvec, index, offset);
-		up_write(&zram->lock);
+		cmem = zs_map_object(zram->mem_pool,
+				     zram->table[index].handle);
+		ret = zram_decompress(zram, cmem + sizeof(*zheader),
+				      zram_get_obj_size(zram, index), dst);
+		zs_unmap_object(zram->mem_pool, zram->table[index].handle);
 	}
+	kunmap_atomic(dst);
 
+	if (!ret)
+		zram_set_flag(zram, index, ZRAM_UNDER_WB);
+out:
+	zram_unlock_slot(zram, index);
 	return ret;
 }
 
+static void zram_wb_end_io(struct bio *bio, int err)
+{
+	struct zram_wb_batch *wb = bio->bi_private;
+
+	if (err)
+		wb->error = err;
+	bio_put(bio);
+
+	if (atomic_dec_and_test(&wb->pending))
+		complete(&wb->done);
+}
+
+static struct bio *zram_wb_bio_alloc(struct zram *zram,
+				     struct zram_wb_batch *wb, unsigned int i)
+{
+	struct bio *bio;
+
+	bio = bio_alloc(GFP_NOIO, min_t(unsigned int, wb->nr - i,
+					BIO_MAX_PAGES));
+	if (!bio)
+		return NULL;
+
+	bio->bi_bdev = zram->bdev;
+	bio->bi_sector = wb->blk[i] << SECTORS_PER_PAGE_SHIFT;
+	bio->bi_end_io = zram_wb_end_io;
+	bio->bi_private = wb;
+	atomic_inc(&wb->pending);
+
+	return bio;
+}
+
+/*
+ * Writes the batch out, merging pages with consecutive blocks into one
+ * bio, then switches the slots that were not modified in the meantime
+ * over to their blocks and frees the memory they used.
+ */
+static void zram_wb_flush(struct zram *zram, struct zram_wb_batch *wb)
+{
+	struct blk_plug plug;
+	struct bio *bio = NULL;
+	unsigned int i;
+
+	atomic_set(&wb->pending, 1);
+	init_completion(&wb->done);
+	wb->error = 0;
+
+	blk_start_plug(&plug);
+	for (i = 0; i < wb->nr; i++) {
+		if (bio && wb->blk[i] == wb->blk[i - 1] + 1 &&
+		    bio_add_page(bio, wb->page[i], PAGE_SIZE, 0) == PAGE_SIZE)
+			continue;
+
+		if (bio)
+			submit_bio(WRITE, bio);
+
+		bio = zram_wb_bio_alloc(zram, wb, i);
+		if (!bio) {
+			wb->error = -ENOMEM;
+			break;
+		}
+		bio_add_page(bio, wb->page[i], PAGE_SIZE, 0);
+	}
+	if (bio)
+		submit_bio(WRITE, bio);
+	blk_finish_plug(&plug);
+
+	if (!atomic_dec_and_test(&wb->pending))
+		wait_for_completion(&wb->done);
+
+	for (i = 0; i < wb->nr; i++) {
+		u32 index = wb->index[i];
+
+		zram_lock_slot(zram, index);
+		if (wb->error || !zram_test_flag(zram, index, ZRAM_UNDER_WB)) {
+			/* failed, or rewritten or freed while in flight */
+			zram_clear_flag(zram, index, ZRAM_UNDER_WB);
+			zram_unlock_slot(zram, index);
+			zram_free_block(zram, wb->blk[i]);
+			continue;
+		}
+
+		zram_free_page(zram, index);
+		zram->table[index].element = wb->blk[i];
+		zram_set_flag(zram, index, ZRAM_WB);
+		zram_unlock_slot(zram, index);
+
+		atomic_inc(&zram->stats.bd_count);
+		zram_stat64_add(zram, &zram->stats.bd_writes, PAGE_SIZE);
+	}
+
+	wb->nr = 0;
+}
+
+/*
+ * Moves idle or incompressible pages to the backing device.  Called
+ * with init_lock held for read on an initialized device.
+ */
+int zram_writeback(struct zram *zram, enum zram_wb_mode mode)
+{
+	struct zram_wb_batch *wb;
+	unsigned long blk = 0;
+	size_t index;
+	int i, ret = 0;
+
+	if (!zram->bdev)
+		return -ENODEV;
+
+	wb = kzalloc(sizeof(*wb), GFP_KERNEL);
+	if (!wb)
+		return -ENOMEM;
+
+	for (i = 0; i < ZRAM_WB_BATCH; i++) {
+		wb->page[i] = alloc_page(GFP_KERNEL);
+		if (!wb->page[i]) {
+			ret = -ENOMEM;
+			goto out;
+		}
+	}
+
+	mutex_lock(&zram->wb_lock);
+	for (index = 0; index < zram->disksize >> PAGE_SHIFT; index++) {
+		if (zram_wb_pick(zram, index, mode, wb->page[wb->nr]))
+			continue;
+
+		blk = zram_alloc_block(zram, blk);
+		if (blk >= zram->nr_blocks) {
+			zram_lock_slot(zram, index);
+			zram_clear_flag(zram, index, ZRAM_UNDER_WB);
+			zram_unlock_slot(zram, index);
+			ret = -ENOSPC;
+			break;
+		}
+
+		wb->index[wb->nr] = index;
+		wb->blk[wb->nr] = blk;
+		if (++wb->nr == ZRAM_WB_BATCH) {
+			zram_wb_flush(zram, wb);
+			if (wb->error)
+				ret = wb->error;
+		}
+		cond_resched();
+	}
+	if (wb->nr) {
+		zram_wb_flush(zram, wb);
+		if (wb->error)
+			ret = wb->error;
+	}
+	mutex_unlock(&zram->wb_lock);
+
+out:
+	for (i = 0; i < ZRAM_WB_BATCH; i++)
+		if (wb->page[i])
+			__free_page(wb->page[i]);
+	kfree(wb);
+	return ret;
+}
+#endif
+
 static void update_position(u32 *index, int *offset, struct bio_vec *bvec)
 {
 	if (*offset + bvec->bv_len >= PAGE_SIZE)
@@ -587,24 +1282,27 @@ error:
 void __zram_reset_device(struct zram *zram)
 {
 	size_t index;
+	struct zram_strm *strm, *tmp;
 
 	zram->init_done = 0;
 
-	/* Free various per-device buffers */
-	kfree(zram->compress_workmem);
-	free_pages((unsigned long)zram->compress_buffer, 1);
-
-	zram->compress_workmem = NULL;
-	zram->compress_buffer = NULL;
+	/* Free the compression streams, all idle with init_lock held */
+	list_for_each_entry_safe(strm, tmp, &zram->idle_strm, list) {
+		list_del(&strm->list);
+		zram_strm_free(strm);
+	}
 
 	/* Free all pages that are still in this zram device */
 	for (index = 0; index < zram->disksize >> PAGE_SHIFT; index++) {
 		void *handle = zram->table[index].handle;
-		if (!handle)
+		if (!handle || zram_test_flag(zram, index, ZRAM_SAME) ||
+		    zram_test_flag(zram, index, ZRAM_WB))
 			continue;
 
 		if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED)))
 			__free_page(handle);
+		else if (zram_test_flag(zram, index, ZRAM_DEDUP))
+			zs_dedup_put(zram->mem_pool, handle);
 		else
 			zs_free(zram->mem_pool, handle);
 	}
@@ -615,6 +1313,10 @@ void __zram_reset_device(struct zram *zram)
 	zs_destroy_pool(zram->mem_pool);
 	zram->mem_pool = NULL;
 
+#ifdef CONFIG_ZRAM_WRITEBACK
+	zram_reset_backing_dev(zram);
+#endif
+
 	/* Reset stats */
 	memset(&zram->stats, 0, sizeof(zram->stats));
 
@@ -630,8 +1332,9 @@ void zram_reset_device(struct zram *zram)
 
 int zram_init_device(struct zram *zram)
 {
-	int ret;
+	int ret, i;
 	size_t num_pages;
+	struct zram_strm *strm;
 
 	down_write(&zram->init_lock);
 
@@ -642,19 +1345,15 @@ int zram_init_device(struct zram *zram)
 
 	zram_set_disksize(zram, totalram_pages << PAGE_SHIFT);
 
-	zram->compress_workmem = kzalloc(LZO1X_MEM_COMPRESS, GFP_KERNEL);
-	if (!zram->compress_workmem) {
-		pr_err("Error allocating compressor working memory!\n");
-		ret = -ENOMEM;
-		goto fail_no_table;
-	}
-
-	zram->compress_buffer =
-		(void *)__get_free_pages(GFP_KERNEL | __GFP_ZERO, 1);
-	if (!zram->compress_buffer) {
-		pr_err("Error allocating compressor buffer space\n");
-		ret = -ENOMEM;
-		goto fail_no_table;
+	/* One compression stream per cpu so writers rarely have to wait */
+	for (i = 0; i < num_possible_cpus(); i++) {
+		strm = zram_strm_alloc(zram);
+		if (!strm) {
+			pr_err("Error allocating compression stream!\n");
+			ret = -ENOMEM;
+			goto fail_no_table;
+		}
+		list_add(&strm->list, &zram->idle_strm);
 	}
 
 	num_pages = zram->disksize >> PAGE_SHIFT;
@@ -670,7 +1369,8 @@ int zram_init_device(struct zram *zram)
 	/* zram devices sort of resembles non-rotational disks */
 	queue_flag_set_unlocked(QUEUE_FLAG_NONROT, zram->disk->queue);
 
-	zram->mem_pool = zs_create_pool("zram", GFP_NOIO | __GFP_HIGHMEM);
+	zram->mem_pool = zs_create_pool(zram->disk->disk_name,
+					 GFP_NOIO | __GFP_HIGHMEM);
 	if (!zram->mem_pool) {
 		pr_err("Error creating memory pool\n");
 		ret = -ENOMEM;
@@ -699,7 +1399,9 @@ static void zram_slot_free_notify(struct block_device *bdev,
 	struct zram *zram;
 
 	zram = bdev->bd_disk->private_data;
+	zram_lock_slot(zram, index);
 	zram_free_page(zram, index);
+	zram_unlock_slot(zram, index);
 	zram_stat64_inc(zram, &zram->stats.notify_free);
 }
 
@@ -712,9 +1414,16 @@ static int create_device(struct zram *zram, int device_id)
 {
 	int ret = -ENOMEM;
 
-	init_rwsem(&zram->lock);
 	init_rwsem(&zram->init_lock);
 	spin_lock_init(&zram->stat64_lock);
+	spin_lock_init(&zram->strm_lock);
+	INIT_LIST_HEAD(&zram->idle_strm);
+	init_waitqueue_head(&zram->strm_wait);
+	zram->comp = ZRAM_COMP_LZO;
+#ifdef CONFIG_ZRAM_WRITEBACK
+	spin_lock_init(&zram->bitmap_lock);
+	mutex_init(&zram->wb_lock);
+#endif
 
 	zram->queue = blk_alloc_queue(GFP_KERNEL);
 	if (!zram->queue) {
@@ -855,6 +1564,9 @@ static void __exit zram_exit(void)
 		destroy_device(zram);
 		if (zram->init_done)
 			zram_reset_device(zram);
+#ifdef CONFIG_ZRAM_WRITEBACK
+		zram_reset_backing_dev(zram);
+#endif
 		put_disk(zram->disk);
 	}
 
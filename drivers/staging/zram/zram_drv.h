@@ -17,8 +17,11 @@
 
 #include <linux/spinlock.h>
 #include <linux/mutex.h>
+#include <linux/list.h>
+#include <linux/wait.h>
 
 #include "../zsmalloc/zsmalloc.h"
+#include "zram_comp.h"
 
 /*
  * Some arbitrary value. This is just to catch
@@ -66,13 +69,34 @@ static const size_t max_zpage_size = PAGE_SIZE / 4 * 3;
 #define ZRAM_SECTOR_PER_LOGICAL_BLOCK	\
 	(1 << (ZRAM_LOGICAL_BLOCK_SHIFT - SECTOR_SHIFT))
 
-/* Flags for zram pages (table[page_no].flags) */
+/*
+ * The lower ZRAM_FLAG_SHIFT bits of table.value hold the object size
+ * (excluding header), the upper bits the zram_pageflags.
+ */
+#define ZRAM_FLAG_SHIFT 16
+
+/* Flags for zram pages (table[page_no].value) */
 enum zram_pageflags {
 	/* Page is stored uncompressed */
-	ZRAM_UNCOMPRESSED,
+	ZRAM_UNCOMPRESSED = ZRAM_FLAG_SHIFT,
+
+	/* Page is filled with one repeated word, kept in table.element */
+	ZRAM_SAME,
+
+	/* Handle is shared through zs_dedup_get(), release with zs_dedup_put */
+	ZRAM_DEDUP,
 
-	/* Page consists entirely of zeros */
-	ZRAM_ZERO,
+	/* Page lives on the backing device, table.element is the block */
+	ZRAM_WB,
+
+	/* Page is being written to the backing device */
+	ZRAM_UNDER_WB,
+
+	/* Page was not accessed since it was last marked idle */
+	ZRAM_IDLE,
+
+	/* Slot lock, taken with bit_spin_lock around any table access */
+	ZRAM_ACCESS,
 
 	__NR_ZRAM_PAGEFLAGS,
 };
@@ -81,11 +105,15 @@ enum zram_pageflags {
 
 /* Allocated for each disk page */
 struct table {
-	void *handle;
-	u16 size;	/* object size (excluding header) */
-	u8 count;	/* object ref count (not yet used) */
-	u8 flags;
-} __attribute__((aligned(4)));
+	union {
+		void *handle;
+		unsigned long element;	/* fill pattern of ZRAM_SAME pages */
+	};
+	unsigned long value;	/* object size and zram_pageflags */
+#ifdef CONFIG_ZRAM_WRITEBACK
+	unsigned long ac_time;	/* jiffies of the last access */
+#endif
+};
 
 struct zram_stats {
 	u64 compr_size;		/* compressed size of pages stored */
@@ -95,20 +123,50 @@ struct zram_stats {
 	u64 failed_writes;	/* can happen when memory is too low */
 	u64 invalid_io;		/* non-page-aligned I/O requests */
 	u64 notify_free;	/* no. of swap slot free notifications */
-	u32 pages_zero;		/* no. of zero filled pages */
-	u32 pages_stored;	/* no. of pages currently stored */
-	u32 good_compress;	/* % of pages with compression ratio<=50% */
-	u32 pages_expand;	/* % of incompressible pages */
+	atomic_t pages_zero;	/* no. of zero filled pages */
+	atomic_t pages_same;	/* no. of non-zero single pattern pages */
+	atomic_t pages_stored;	/* no. of pages currently stored */
+	atomic_t good_compress;	/* % of pages with compression ratio<=50% */
+	atomic_t pages_expand;	/* % of incompressible pages */
+#ifdef CONFIG_ZRAM_WRITEBACK
+	atomic_t bd_count;	/* no. of pages on the backing device */
+	u64 bd_reads;		/* bytes read back from the backing device */
+	u64 bd_writes;		/* bytes written to the backing device */
+#endif
+};
+
+/*
+ * Compression context.  The device keeps one per possible cpu so that
+ * writes on different cpus compress in parallel.
+ */
+struct zram_strm {
+	void *buffer;		/* compressed output, two pages */
+	void *workmem;		/* backend scratch space */
+	struct list_head list;
 };
 
 struct zram {
 	struct zs_pool *mem_pool;
-	void *compress_workmem;
-	void *compress_buffer;
 	struct table *table;
 	spinlock_t stat64_lock;	/* protect 64-bit stats */
-	struct rw_semaphore lock; /* protect compression buffers and table
-				   * against concurrent read and writes */
+	/* idle compression streams, writers sleep on strm_wait if none */
+	spinlock_t strm_lock;
+	struct list_head idle_strm;
+	wait_queue_head_t strm_wait;
+	/* compression backend, can only be changed before init */
+	unsigned int comp;
+	struct zram_comp_stats comp_stats[__NR_ZRAM_COMP];
+	/* share identical compressed objects, can only be changed before init */
+	int dedup;
+#ifdef CONFIG_ZRAM_WRITEBACK
+	/* backing device for idle and incompressible pages */
+	struct block_device *bdev;
+	char *backing_dev;
+	unsigned long nr_blocks;
+	unsigned long *bitmap;	/* blocks in use on bdev */
+	spinlock_t bitmap_lock;
+	struct mutex wb_lock;	/* one writeback run at a time */
+#endif
 	struct request_queue *queue;
 	struct gendisk *disk;
 	int init_done;
@@ -132,4 +190,17 @@ extern struct attribute_group zram_disk_attr_group;
 extern int zram_init_device(struct zram *zram);
 extern void __zram_reset_device(struct zram *zram);
 
+#ifdef CONFIG_ZRAM_WRITEBACK
+/* zram_writeback() modes */
+enum zram_wb_mode {
+	ZRAM_WB_IDLE,		/* pages marked idle */
+	ZRAM_WB_HUGE,		/* pages stored uncompressed */
+};
+
+extern int zram_set_backing_dev(struct zram *zram, const char *path);
+extern void zram_reset_backing_dev(struct zram *zram);
+extern void zram_mark_idle(struct zram *zram, unsigned long age);
+extern int zram_writeback(struct zram *zram, enum zram_wb_mode mode);
+#endif
+
 #endif
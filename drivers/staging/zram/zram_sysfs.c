@@ -15,6 +15,7 @@
 #include <linux/device.h>
 #include <linux/genhd.h>
 #include <linux/mm.h>
+#include <linux/math64.h>
 
 #include "zram_drv.h"
 
@@ -76,6 +77,82 @@ static ssize_t disksize_store(struct device *dev,
 	return len;
 }
 
+static ssize_t comp_algorithm_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	int i;
+	ssize_t sz = 0;
+	struct zram *zram = dev_to_zram(dev);
+
+	down_read(&zram->init_lock);
+	for (i = 0; i < __NR_ZRAM_COMP; i++) {
+		const char *name = zram_comp_backends[i].name;
+
+		if (i == zram->comp)
+			sz += sprintf(buf + sz, "[%s] ", name);
+		else
+			sz += sprintf(buf + sz, "%s ", name);
+	}
+	up_read(&zram->init_lock);
+
+	/* replace the trailing space */
+	buf[sz - 1] = '\n';
+	return sz;
+}
+
+static ssize_t comp_algorithm_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	int comp;
+	struct zram *zram = dev_to_zram(dev);
+
+	comp = zram_comp_find(buf);
+	if (comp < 0)
+		return comp;
+
+	down_write(&zram->init_lock);
+	if (zram->init_done) {
+		up_write(&zram->init_lock);
+		pr_info("Cannot change algorithm for initialized device\n");
+		return -EBUSY;
+	}
+	zram->comp = comp;
+	up_write(&zram->init_lock);
+
+	return len;
+}
+
+/*
+ * One line per backend: name, kB fed to and produced by the compressor,
+ * compressed size in percent and average ns per page to compress and
+ * decompress.
+ */
+static ssize_t comp_stats_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	int i;
+	ssize_t sz = 0;
+	struct zram *zram = dev_to_zram(dev);
+
+	for (i = 0; i < __NR_ZRAM_COMP; i++) {
+		struct zram_comp_stats *stats = &zram->comp_stats[i];
+		u64 orig = atomic64_read(&stats->orig_size);
+		u64 compr = atomic64_read(&stats->compr_size);
+		u64 ncomp = atomic64_read(&stats->num_compress);
+		u64 ndecomp = atomic64_read(&stats->num_decompress);
+
+		sz += sprintf(buf + sz, "%s %llu %llu %llu %llu %llu\n",
+			zram_comp_backends[i].name, orig >> 10, compr >> 10,
+			orig ? div64_u64(compr * 100, orig) : 0,
+			ncomp ? div64_u64(atomic64_read(&stats->compress_ns),
+					  ncomp) : 0,
+			ndecomp ? div64_u64(atomic64_read(&stats->decompress_ns),
+					    ndecomp) : 0);
+	}
+
+	return sz;
+}
+
 static ssize_t initstate_show(struct device *dev,
 		struct device_attribute *attr, char *buf)
 {
@@ -170,16 +247,195 @@ static ssize_t zero_pages_show(struct device *dev,
 {
 	struct zram *zram = dev_to_zram(dev);
 
-	return sprintf(buf, "%u\n", zram->stats.pages_zero);
+	return sprintf(buf, "%u\n", atomic_read(&zram->stats.pages_zero));
 }
 
+static ssize_t same_pages_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+
+	return sprintf(buf, "%u\n", atomic_read(&zram->stats.pages_same));
+}
+
+static ssize_t dedup_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+
+	return sprintf(buf, "%d\n", zram->dedup);
+}
+
+static ssize_t dedup_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	int ret;
+	unsigned int dedup;
+	struct zram *zram = dev_to_zram(dev);
+
+	ret = kstrtouint(buf, 10, &dedup);
+	if (ret)
+		return ret;
+
+	down_write(&zram->init_lock);
+	if (zram->init_done) {
+		up_write(&zram->init_lock);
+		pr_info("Cannot change dedup for initialized device\n");
+		return -EBUSY;
+	}
+	zram->dedup = !!dedup;
+	up_write(&zram->init_lock);
+
+	return len;
+}
+
+static ssize_t dup_pages_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	u64 refs = 0, bytes;
+	struct zram *zram = dev_to_zram(dev);
+
+	down_read(&zram->init_lock);
+	if (zram->init_done)
+		zs_dedup_stats(zram->mem_pool, &refs, &bytes);
+	up_read(&zram->init_lock);
+
+	return sprintf(buf, "%llu\n", refs);
+}
+
+static ssize_t dup_data_size_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	u64 refs, bytes = 0;
+	struct zram *zram = dev_to_zram(dev);
+
+	down_read(&zram->init_lock);
+	if (zram->init_done)
+		zs_dedup_stats(zram->mem_pool, &refs, &bytes);
+	up_read(&zram->init_lock);
+
+	return sprintf(buf, "%llu\n", bytes);
+}
+
+#ifdef CONFIG_ZRAM_WRITEBACK
+static ssize_t backing_dev_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	ssize_t sz;
+	struct zram *zram = dev_to_zram(dev);
+
+	down_read(&zram->init_lock);
+	sz = sprintf(buf, "%s\n",
+		     zram->backing_dev ? zram->backing_dev : "none");
+	up_read(&zram->init_lock);
+
+	return sz;
+}
+
+static ssize_t backing_dev_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	int ret = 0;
+	struct zram *zram = dev_to_zram(dev);
+
+	down_write(&zram->init_lock);
+	if (zram->init_done) {
+		up_write(&zram->init_lock);
+		pr_info("Cannot change backing_dev for initialized device\n");
+		return -EBUSY;
+	}
+
+	if (sysfs_streq(buf, "none"))
+		zram_reset_backing_dev(zram);
+	else
+		ret = zram_set_backing_dev(zram, buf);
+	up_write(&zram->init_lock);
+
+	return ret ? ret : len;
+}
+
+static ssize_t idle_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	int ret = 0;
+	unsigned long age = 0;
+	struct zram *zram = dev_to_zram(dev);
+
+	if (!sysfs_streq(buf, "all")) {
+		ret = kstrtoul(buf, 10, &age);
+		if (ret || !age)
+			return -EINVAL;
+	}
+
+	down_read(&zram->init_lock);
+	if (zram->init_done)
+		zram_mark_idle(zram, age);
+	else
+		ret = -EINVAL;
+	up_read(&zram->init_lock);
+
+	return ret ? ret : len;
+}
+
+static ssize_t writeback_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	int ret;
+	enum zram_wb_mode mode;
+	struct zram *zram = dev_to_zram(dev);
+
+	if (sysfs_streq(buf, "idle"))
+		mode = ZRAM_WB_IDLE;
+	else if (sysfs_streq(buf, "huge"))
+		mode = ZRAM_WB_HUGE;
+	else
+		return -EINVAL;
+
+	down_read(&zram->init_lock);
+	if (zram->init_done)
+		ret = zram_writeback(zram, mode);
+	else
+		ret = -EINVAL;
+	up_read(&zram->init_lock);
+
+	return ret ? ret : len;
+}
+
+static ssize_t bd_data_size_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+
+	return sprintf(buf, "%llu\n",
+		(u64)atomic_read(&zram->stats.bd_count) << PAGE_SHIFT);
+}
+
+static ssize_t bd_reads_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+
+	return sprintf(buf, "%llu\n",
+		zram_stat64_read(zram, &zram->stats.bd_reads));
+}
+
+static ssize_t bd_writes_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+
+	return sprintf(buf, "%llu\n",
+		zram_stat64_read(zram, &zram->stats.bd_writes));
+}
+#endif
+
 static ssize_t orig_data_size_show(struct device *dev,
 		struct device_attribute *attr, char *buf)
 {
 	struct zram *zram = dev_to_zram(dev);
 
 	return sprintf(buf, "%llu\n",
-		(u64)(zram->stats.pages_stored) << PAGE_SHIFT);
+		(u64)atomic_read(&zram->stats.pages_stored) << PAGE_SHIFT);
 }
 
 static ssize_t compr_data_size_show(struct device *dev,
@@ -200,22 +456,55 @@ static ssize_t mem_used_total_show(struct device *dev,
 	down_read(&zram->init_lock);
 	if (zram->init_done) {
 		val = zs_get_total_size_bytes(zram->mem_pool) +
-			((u64)(zram->stats.pages_expand) << PAGE_SHIFT);
+			((u64)atomic_read(&zram->stats.pages_expand) << PAGE_SHIFT);
 	}
 	up_read(&zram->init_lock);
 
 	return sprintf(buf, "%llu\n", val);
 }
 
+static ssize_t compact_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	int ret = 0;
+	struct zram *zram = dev_to_zram(dev);
+
+	down_read(&zram->init_lock);
+	if (zram->init_done)
+		zs_compact(zram->mem_pool);
+	else
+		ret = -EINVAL;
+	up_read(&zram->init_lock);
+
+	return ret ? ret : len;
+}
+
 static DEVICE_ATTR(disksize, S_IRUGO | S_IWUSR,
 		disksize_show, disksize_store);
 static DEVICE_ATTR(initstate, S_IRUGO, initstate_show, NULL);
+static DEVICE_ATTR(comp_algorithm, S_IRUGO | S_IWUSR,
+		comp_algorithm_show, comp_algorithm_store);
+static DEVICE_ATTR(comp_stats, S_IRUGO, comp_stats_show, NULL);
 static DEVICE_ATTR(reset, S_IWUSR, NULL, reset_store);
+static DEVICE_ATTR(compact, S_IWUSR, NULL, compact_store);
 static DEVICE_ATTR(num_reads, S_IRUGO, num_reads_show, NULL);
 static DEVICE_ATTR(num_writes, S_IRUGO, num_writes_show, NULL);
 static DEVICE_ATTR(invalid_io, S_IRUGO, invalid_io_show, NULL);
 static DEVICE_ATTR(notify_free, S_IRUGO, notify_free_show, NULL);
 static DEVICE_ATTR(zero_pages, S_IRUGO, zero_pages_show, NULL);
+static DEVICE_ATTR(same_pages, S_IRUGO, same_pages_show, NULL);
+static DEVICE_ATTR(dedup, S_IRUGO | S_IWUSR, dedup_show, dedup_store);
+static DEVICE_ATTR(dup_pages, S_IRUGO, dup_pages_show, NULL);
+static DEVICE_ATTR(dup_data_size, S_IRUGO, dup_data_size_show, NULL);
+#ifdef CONFIG_ZRAM_WRITEBACK
+static DEVICE_ATTR(backing_dev, S_IRUGO | S_IWUSR,
+		backing_dev_show, backing_dev_store);
+static DEVICE_ATTR(idle, S_IWUSR, NULL, idle_store);
+static DEVICE_ATTR(writeback, S_IWUSR, NULL, writeback_store);
+static DEVICE_ATTR(bd_data_size, S_IRUGO, bd_data_size_show, NULL);
+static DEVICE_ATTR(bd_reads, S_IRUGO, bd_reads_show, NULL);
+static DEVICE_ATTR(bd_writes, S_IRUGO, bd_writes_show, NULL);
+#endif
 static DEVICE_ATTR(orig_data_size, S_IRUGO, orig_data_size_show, NULL);
 static DEVICE_ATTR(compr_data_size, S_IRUGO, compr_data_size_show, NULL);
 static DEVICE_ATTR(mem_used_total, S_IRUGO, mem_used_total_show, NULL);
@@ -223,12 +512,27 @@ static DEVICE_ATTR(mem_used_total, S_IRUGO, mem_used_total_show, NULL);
 static struct attribute *zram_disk_attrs[] = {
 	&dev_attr_disksize.attr,
 	&dev_attr_initstate.attr,
+	&dev_attr_comp_algorithm.attr,
+	&dev_attr_comp_stats.attr,
 	&dev_attr_reset.attr,
+	&dev_attr_compact.attr,
 	&dev_attr_num_reads.attr,
 	&dev_attr_num_writes.attr,
 	&dev_attr_invalid_io.attr,
 	&dev_attr_notify_free.attr,
 	&dev_attr_zero_pages.attr,
+	&dev_attr_same_pages.attr,
+	&dev_attr_dedup.attr,
+	&dev_attr_dup_pages.attr,
+	&dev_attr_dup_data_size.attr,
+#ifdef CONFIG_ZRAM_WRITEBACK
+	&dev_attr_backing_dev.attr,
+	&dev_attr_idle.attr,
+	&dev_attr_writeback.attr,
+	&dev_attr_bd_data_size.attr,
+	&dev_attr_bd_reads.attr,
+	&dev_attr_bd_writes.attr,
+#endif
 	&dev_attr_orig_data_size.attr,
 	&dev_attr_compr_data_size.attr,
 	&dev_attr_mem_used_total.attr,
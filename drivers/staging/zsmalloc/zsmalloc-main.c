@@ -27,6 +27,10 @@
 #include <linux/cpumask.h>
 #include <linux/cpu.h>
 #include <linux/vmalloc.h>
+#include <linux/rbtree.h>
+#include <linux/bit_spinlock.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 
 #include "zsmalloc.h"
 #include "zsmalloc_int.h"
@@ -43,6 +47,11 @@
 /* per-cpu VM mapping areas for zspage accesses that cross page boundaries */
 static DEFINE_PER_CPU(struct mapping_area, zs_map_area);
 
+/* handles are words in this cache holding the object location */
+static struct kmem_cache *zs_handle_cachep;
+
+static struct dentry *zs_stat_root;
+
 static int is_first_page(struct page *page)
 {
 	return test_bit(PG_private, &page->flags);
@@ -230,30 +239,48 @@ static struct page *get_next_page(struct page *page)
 	return next;
 }
 
-/* Encode <page, obj_idx> as a single handle value */
-static void *obj_location_to_handle(struct page *page, unsigned long obj_idx)
+/* Encode <page, obj_idx> as a single location value */
+static unsigned long location_to_obj(struct page *page, unsigned long obj_idx)
 {
-	unsigned long handle;
+	unsigned long obj;
 
 	if (!page) {
 		BUG_ON(obj_idx);
-		return NULL;
+		return 0;
 	}
 
-	handle = page_to_pfn(page) << OBJ_INDEX_BITS;
-	handle |= (obj_idx & OBJ_INDEX_MASK);
+	obj = page_to_pfn(page) << OBJ_INDEX_BITS;
+	obj |= (obj_idx << OBJ_TAG_BITS) & OBJ_INDEX_MASK;
 
-	return (void *)handle;
+	return obj;
 }
 
-/* Decode <page, obj_idx> pair from the given object handle */
-static void obj_handle_to_location(void *handle, struct page **page,
+/* Decode <page, obj_idx> pair from the given object location */
+static void obj_to_location(unsigned long obj, struct page **page,
 				unsigned long *obj_idx)
 {
-	unsigned long hval = (unsigned long)handle;
+	*page = pfn_to_page(obj >> OBJ_INDEX_BITS);
+	*obj_idx = (obj & OBJ_INDEX_MASK) >> OBJ_TAG_BITS;
+}
+
+static unsigned long handle_to_obj(void *handle)
+{
+	return *(unsigned long *)handle & ~(1UL << HANDLE_PIN_BIT);
+}
+
+static void pin_tag(void *handle)
+{
+	bit_spin_lock(HANDLE_PIN_BIT, (unsigned long *)handle);
+}
+
+static int trypin_tag(void *handle)
+{
+	return bit_spin_trylock(HANDLE_PIN_BIT, (unsigned long *)handle);
+}
 
-	*page = pfn_to_page(hval >> OBJ_INDEX_BITS);
-	*obj_idx = hval & OBJ_INDEX_MASK;
+static void unpin_tag(void *handle)
+{
+	bit_spin_unlock(HANDLE_PIN_BIT, (unsigned long *)handle);
 }
 
 static unsigned long obj_idx_to_offset(struct page *page,
@@ -330,7 +357,7 @@ static void init_zspage(struct page *first_page, struct size_class *class)
 		for (i = 1; i <= objs_on_page; i++) {
 			off += class->size;
 			if (off < PAGE_SIZE) {
-				link->next = obj_location_to_handle(page, i);
+				link->next = location_to_obj(page, i);
 				link += class->size / sizeof(*link);
 			}
 		}
@@ -341,7 +368,7 @@ static void init_zspage(struct page *first_page, struct size_class *class)
 		 * page (if present)
 		 */
 		next_page = get_next_page(page);
-		link->next = obj_location_to_handle(next_page, 0);
+		link->next = location_to_obj(next_page, 0);
 		kunmap_atomic(link);
 		page = next_page;
 		off = (off + class->size) % PAGE_SIZE;
@@ -396,7 +423,7 @@ static struct page *alloc_zspage(struct size_class *class, gfp_t flags)
 
 	init_zspage(first_page, class);
 
-	first_page->freelist = obj_location_to_handle(first_page, 0);
+	first_page->freelist = (void *)location_to_obj(first_page, 0);
 	/* Maximum number of objects we can store in this zspage */
 	first_page->objects = class->zspage_order * PAGE_SIZE / class->size;
 
@@ -425,6 +452,387 @@ static struct page *find_get_zspage(struct size_class *class)
 	return page;
 }
 
+/*
+ * Takes the first free object of a zspage for handle and stores the
+ * tagged handle at the start of the object.  Called with class->lock
+ * held; the caller fixes the zspage's fullness group.
+ */
+static unsigned long obj_malloc(struct size_class *class,
+				struct page *first_page, void *handle)
+{
+	struct link_free *link;
+	struct page *m_page;
+	unsigned long obj, m_objidx, m_offset;
+	void *vaddr;
+
+	obj = (unsigned long)first_page->freelist;
+	obj_to_location(obj, &m_page, &m_objidx);
+	m_offset = obj_idx_to_offset(m_page, m_objidx, class->size);
+
+	vaddr = kmap_atomic(m_page);
+	link = (struct link_free *)(vaddr + m_offset);
+	first_page->freelist = (void *)link->next;
+	link->next = (unsigned long)handle | OBJ_ALLOCATED_TAG;
+	kunmap_atomic(vaddr);
+
+	first_page->inuse++;
+	class->objs_inuse++;
+
+	return obj;
+}
+
+/*
+ * Returns an object to its zspage's freelist, called with class->lock
+ * held.  If this empties the zspage it is unlinked and the caller must
+ * free it with free_zspage().
+ */
+static enum fullness_group obj_free(struct zs_pool *pool,
+				    struct size_class *class, unsigned long obj)
+{
+	struct link_free *link;
+	struct page *first_page, *f_page;
+	unsigned long f_objidx, f_offset;
+	enum fullness_group fullness;
+	void *vaddr;
+
+	obj_to_location(obj, &f_page, &f_objidx);
+	first_page = get_first_page(f_page);
+	f_offset = obj_idx_to_offset(f_page, f_objidx, class->size);
+
+	/* Insert this object in containing zspage's freelist */
+	vaddr = kmap_atomic(f_page);
+	link = (struct link_free *)(vaddr + f_offset);
+	link->next = (unsigned long)first_page->freelist;
+	kunmap_atomic(vaddr);
+	first_page->freelist = (void *)obj;
+
+	first_page->inuse--;
+	class->objs_inuse--;
+	fullness = fix_fullness_group(pool, first_page);
+
+	if (fullness == ZS_EMPTY)
+		class->pages_allocated -= class->zspage_order;
+
+	return fullness;
+}
+
+/* Copies a class sized object, either location may span two pages */
+static void zs_object_copy(unsigned long dst, unsigned long src,
+			   struct size_class *class)
+{
+	struct page *s_page, *d_page;
+	unsigned long s_idx, d_idx, s_off, d_off;
+	void *s_addr, *d_addr;
+	int len, written = 0;
+
+	obj_to_location(src, &s_page, &s_idx);
+	obj_to_location(dst, &d_page, &d_idx);
+	s_off = obj_idx_to_offset(s_page, s_idx, class->size);
+	d_off = obj_idx_to_offset(d_page, d_idx, class->size);
+
+	while (written < class->size) {
+		len = min3((unsigned long)(class->size - written),
+			   PAGE_SIZE - s_off, PAGE_SIZE - d_off);
+
+		s_addr = kmap_atomic(s_page);
+		d_addr = kmap_atomic(d_page);
+		memcpy(d_addr + d_off, s_addr + s_off, len);
+		kunmap_atomic(d_addr);
+		kunmap_atomic(s_addr);
+
+		written += len;
+		s_off += len;
+		d_off += len;
+		if (s_off == PAGE_SIZE) {
+			s_page = get_next_page(s_page);
+			s_off = 0;
+		}
+		if (d_off == PAGE_SIZE) {
+			d_page = get_next_page(d_page);
+			d_off = 0;
+		}
+	}
+}
+
+/*
+ * Moves the allocated objects of zspage src into zspage dst until src
+ * is empty or dst is full.  Objects that are pinned, because they are
+ * mapped or being freed, are left in place.  Called with class->lock
+ * held; returns the number of objects moved.
+ */
+static unsigned long zs_migrate_zspage(struct zs_pool *pool,
+				       struct size_class *class,
+				       struct page *src, struct page *dst)
+{
+	struct page *page = src;
+	unsigned long off = 0, obj_idx = 0, moved = 0;
+	int nr;
+
+	for (nr = 0; nr < src->objects; nr++) {
+		unsigned long head, old, new;
+		void *handle, *vaddr;
+
+		if (!src->inuse || dst->inuse == dst->objects)
+			break;
+
+		if (off >= PAGE_SIZE) {
+			page = get_next_page(page);
+			if (!page)
+				break;
+			off = page->index;
+			obj_idx = 0;
+		}
+
+		vaddr = kmap_atomic(page);
+		head = *(unsigned long *)(vaddr + off);
+		kunmap_atomic(vaddr);
+
+		if ((head & OBJ_ALLOCATED_TAG)) {
+			handle = (void *)(head & ~OBJ_ALLOCATED_TAG);
+			if (trypin_tag(handle)) {
+				old = location_to_obj(page, obj_idx);
+				new = obj_malloc(class, dst, handle);
+				zs_object_copy(new, old, class);
+				/* the pin bit is released below */
+				*(unsigned long *)handle =
+					new | (1UL << HANDLE_PIN_BIT);
+				fix_fullness_group(pool, dst);
+				obj_free(pool, class, old);
+				unpin_tag(handle);
+				moved++;
+			}
+		}
+
+		obj_idx++;
+		off += class->size;
+	}
+
+	return moved;
+}
+
+/*
+ * Moves objects from the least recently filled sparse zspages of a
+ * class into its fullest zspages and frees the zspages that become
+ * empty, until at least @nr_pages pages are freed.  Returns the number
+ * of pages freed.
+ */
+static unsigned long zs_compact_class(struct zs_pool *pool,
+				      struct size_class *class,
+				      unsigned long nr_pages)
+{
+	struct page *src, *dst;
+	unsigned long freed = 0;
+
+	spin_lock(&class->lock);
+	while (freed < nr_pages) {
+		src = class->fullness_list[ZS_ALMOST_EMPTY];
+		if (!src)
+			break;
+		src = list_entry(src->lru.prev, struct page, lru);
+
+		dst = class->fullness_list[ZS_ALMOST_FULL];
+		if (!dst)
+			dst = class->fullness_list[ZS_ALMOST_EMPTY];
+		if (dst == src)
+			break;
+
+		if (!zs_migrate_zspage(pool, class, src, dst))
+			break;
+
+		if (!src->inuse) {
+			spin_unlock(&class->lock);
+			free_zspage(src);
+			freed += class->zspage_order;
+			cond_resched();
+			spin_lock(&class->lock);
+		}
+	}
+	spin_unlock(&class->lock);
+
+	return freed;
+}
+
+static unsigned long __zs_compact(struct zs_pool *pool, unsigned long nr_pages)
+{
+	int i;
+	unsigned long freed = 0;
+
+	for (i = 0; i < ZS_SIZE_CLASSES && freed < nr_pages; i++)
+		freed += zs_compact_class(pool, &pool->size_class[i],
+					  nr_pages - freed);
+
+	atomic_long_add(freed, &pool->pages_compacted);
+	return freed;
+}
+
+/**
+ * zs_compact - compact all size classes of a pool
+ * @pool: pool to compact
+ *
+ * Must be called from process context.  Returns the number of pages
+ * returned to the system.
+ */
+unsigned long zs_compact(struct zs_pool *pool)
+{
+	return __zs_compact(pool, ULONG_MAX);
+}
+EXPORT_SYMBOL_GPL(zs_compact);
+
+static unsigned long zs_class_objs_per_zspage(struct size_class *class)
+{
+	return class->zspage_order * PAGE_SIZE / class->size;
+}
+
+/* Pages compaction could free if objects were perfectly packed */
+static unsigned long zs_class_freeable(struct size_class *class)
+{
+	unsigned long per_zspage = zs_class_objs_per_zspage(class);
+	unsigned long allocated;
+
+	allocated = (unsigned long)class->pages_allocated /
+			class->zspage_order * per_zspage;
+	/* read without class->lock, so only an estimate */
+	if (allocated <= class->objs_inuse)
+		return 0;
+
+	return (allocated - class->objs_inuse) / per_zspage *
+			class->zspage_order;
+}
+
+static int zs_shrinker_shrink(struct shrinker *shrinker,
+			      struct shrink_control *sc)
+{
+	struct zs_pool *pool = container_of(shrinker, struct zs_pool,
+					    shrinker);
+	unsigned long freeable = 0;
+	int i;
+
+	/* only do as much work as reclaim asked for */
+	if (sc->nr_to_scan)
+		__zs_compact(pool, sc->nr_to_scan);
+
+	for (i = 0; i < ZS_SIZE_CLASSES; i++)
+		freeable += zs_class_freeable(&pool->size_class[i]);
+
+	return min_t(unsigned long, freeable, INT_MAX);
+}
+
+#ifdef CONFIG_DEBUG_FS
+static int zs_list_len(struct page *head)
+{
+	struct page *page;
+	int len = 0;
+
+	if (!head)
+		return 0;
+
+	list_for_each_entry(page, &head->lru, lru)
+		len++;
+
+	return len + 1;
+}
+
+static int zs_stats_show(struct seq_file *s, void *v)
+{
+	struct zs_pool *pool = s->private;
+	unsigned long total_allocated = 0, total_used = 0, total_pages = 0;
+	int i;
+
+	seq_printf(s, " %5s %5s %11s %12s %13s %10s %10s %16s\n",
+		   "class", "size", "almost_full", "almost_empty",
+		   "obj_allocated", "obj_used", "pages_used",
+		   "pages_per_zspage");
+
+	for (i = 0; i < ZS_SIZE_CLASSES; i++) {
+		struct size_class *class = &pool->size_class[i];
+		unsigned long pages, used, allocated;
+		int almost_full, almost_empty;
+
+		spin_lock(&class->lock);
+		almost_full = zs_list_len(class->fullness_list[ZS_ALMOST_FULL]);
+		almost_empty = zs_list_len(
+				class->fullness_list[ZS_ALMOST_EMPTY]);
+		pages = class->pages_allocated;
+		used = class->objs_inuse;
+		spin_unlock(&class->lock);
+
+		if (!pages)
+			continue;
+
+		allocated = pages / class->zspage_order *
+				zs_class_objs_per_zspage(class);
+
+		seq_printf(s, " %5d %5d %11d %12d %13lu %10lu %10lu %16d\n",
+			   i, class->size, almost_full, almost_empty,
+			   allocated, used, pages, class->zspage_order);
+
+		total_allocated += allocated;
+		total_used += used;
+		total_pages += pages;
+	}
+
+	seq_printf(s, "\n %5s %5s %11s %12s %13lu %10lu %10lu\n",
+		   "Total", "", "", "", total_allocated, total_used,
+		   total_pages);
+	seq_printf(s, "\n pages_compacted %lu\n",
+		   atomic_long_read(&pool->pages_compacted));
+
+	return 0;
+}
+
+static int zs_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, zs_stats_show, inode->i_private);
+}
+
+static const struct file_operations zs_stats_fops = {
+	.open		= zs_stats_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static void zs_pool_stat_create(struct zs_pool *pool)
+{
+	if (IS_ERR_OR_NULL(zs_stat_root))
+		return;
+
+	pool->stat_dentry = debugfs_create_file(pool->name, S_IRUGO,
+						zs_stat_root, pool,
+						&zs_stats_fops);
+}
+
+static void zs_pool_stat_destroy(struct zs_pool *pool)
+{
+	debugfs_remove(pool->stat_dentry);
+}
+
+static void zs_stat_init(void)
+{
+	zs_stat_root = debugfs_create_dir("zsmalloc", NULL);
+}
+
+static void zs_stat_exit(void)
+{
+	debugfs_remove_recursive(zs_stat_root);
+}
+#else
+static inline void zs_pool_stat_create(struct zs_pool *pool)
+{
+}
+
+static inline void zs_pool_stat_destroy(struct zs_pool *pool)
+{
+}
+
+static inline void zs_stat_init(void)
+{
+}
+
+static inline void zs_stat_exit(void)
+{
+}
+#endif
 
 static int zs_cpu_notifier(struct notifier_block *nb, unsigned long action,
 				void *pcpu)
@@ -464,12 +872,24 @@ static void zs_exit(void)
 	for_each_online_cpu(cpu)
 		zs_cpu_notifier(NULL, CPU_DEAD, (void *)(long)cpu);
 	unregister_cpu_notifier(&zs_cpu_nb);
+
+	zs_stat_exit();
+	if (zs_handle_cachep)
+		kmem_cache_destroy(zs_handle_cachep);
+	zs_handle_cachep = NULL;
 }
 
 static int zs_init(void)
 {
 	int cpu, ret;
 
+	zs_handle_cachep = kmem_cache_create("zs_handle", ZS_HANDLE_SIZE,
+					     0, 0, NULL);
+	if (!zs_handle_cachep)
+		return -ENOMEM;
+
+	zs_stat_init();
+
 	register_cpu_notifier(&zs_cpu_nb);
 	for_each_online_cpu(cpu) {
 		ret = zs_cpu_notifier(NULL, CPU_UP_PREPARE, (void *)(long)cpu);
@@ -514,6 +934,16 @@ struct zs_pool *zs_create_pool(const char *name, gfp_t flags)
 	pool->flags = flags;
 	pool->name = name;
 
+	spin_lock_init(&pool->dedup_lock);
+	pool->dedup_hash_root = RB_ROOT;
+	pool->dedup_handle_root = RB_ROOT;
+
+	pool->shrinker.shrink = zs_shrinker_shrink;
+	pool->shrinker.seeks = DEFAULT_SEEKS;
+	register_shrinker(&pool->shrinker);
+
+	zs_pool_stat_create(pool);
+
 	return pool;
 }
 EXPORT_SYMBOL_GPL(zs_create_pool);
@@ -522,6 +952,9 @@ void zs_destroy_pool(struct zs_pool *pool)
 {
 	int i;
 
+	zs_pool_stat_destroy(pool);
+	unregister_shrinker(&pool->shrinker);
+
 	for (i = 0; i < ZS_SIZE_CLASSES; i++) {
 		int fg;
 		struct size_class *class = &pool->size_class[i];
@@ -542,28 +975,31 @@ EXPORT_SYMBOL_GPL(zs_destroy_pool);
  * zs_malloc - Allocate block of given size from pool.
  * @pool: pool to allocate from
  * @size: size of block to allocate
- * @page: page no. that holds the object
- * @offset: location of object within page
  *
- * On success, <page, offset> identifies block allocated
- * and 0 is returned. On failure, <page, offset> is set to
- * 0 and -ENOMEM is returned.
+ * On success, returns an opaque handle to be passed to zs_map_object()
+ * and zs_free(). The handle stays valid when zs_compact() moves the
+ * object. On failure, NULL is returned.
  *
- * Allocation requests with size > ZS_MAX_ALLOC_SIZE will fail.
+ * Allocation requests with size > ZS_MAX_ALLOC_SIZE - ZS_HANDLE_SIZE
+ * will fail.
  */
 void *zs_malloc(struct zs_pool *pool, size_t size)
 {
-	void *obj;
-	struct link_free *link;
+	void *handle;
+	unsigned long obj;
 	int class_idx;
 	struct size_class *class;
+	struct page *first_page;
 
-	struct page *first_page, *m_page;
-	unsigned long m_objidx, m_offset;
+	if (unlikely(!size || size > ZS_MAX_ALLOC_SIZE - ZS_HANDLE_SIZE))
+		return NULL;
 
-	if (unlikely(!size || size > ZS_MAX_ALLOC_SIZE))
+	handle = kmem_cache_alloc(zs_handle_cachep,
+				  pool->flags & ~__GFP_HIGHMEM);
+	if (!handle)
 		return NULL;
 
+	size += ZS_HANDLE_SIZE;
 	class_idx = get_size_class_index(size);
 	class = &pool->size_class[class_idx];
 	BUG_ON(class_idx != class->index);
@@ -574,75 +1010,65 @@ void *zs_malloc(struct zs_pool *pool, size_t size)
 	if (!first_page) {
 		spin_unlock(&class->lock);
 		first_page = alloc_zspage(class, pool->flags);
-		if (unlikely(!first_page))
+		if (unlikely(!first_page)) {
+			kmem_cache_free(zs_handle_cachep, handle);
 			return NULL;
+		}
 
 		set_zspage_mapping(first_page, class->index, ZS_EMPTY);
 		spin_lock(&class->lock);
 		class->pages_allocated += class->zspage_order;
 	}
 
-	obj = first_page->freelist;
-	obj_handle_to_location(obj, &m_page, &m_objidx);
-	m_offset = obj_idx_to_offset(m_page, m_objidx, class->size);
-
-	link = (struct link_free *)kmap_atomic(m_page) +
-					m_offset / sizeof(*link);
-	first_page->freelist = link->next;
-	memset(link, POISON_INUSE, sizeof(*link));
-	kunmap_atomic(link);
+	obj = obj_malloc(class, first_page, handle);
+	/* must be visible before compaction can see the object */
+	*(unsigned long *)handle = obj;
 
-	first_page->inuse++;
 	/* Now move the zspage to another fullness group, if required */
 	fix_fullness_group(pool, first_page);
 	spin_unlock(&class->lock);
 
-	return obj;
+	return handle;
 }
 EXPORT_SYMBOL_GPL(zs_malloc);
 
-void zs_free(struct zs_pool *pool, void *obj)
+void zs_free(struct zs_pool *pool, void *handle)
 {
-	struct link_free *link;
 	struct page *first_page, *f_page;
-	unsigned long f_objidx, f_offset;
+	unsigned long obj, f_objidx;
 
 	int class_idx;
 	struct size_class *class;
 	enum fullness_group fullness;
 
-	if (unlikely(!obj))
+	if (unlikely(!handle))
 		return;
 
-	obj_handle_to_location(obj, &f_page, &f_objidx);
+	/* the pin keeps compaction from moving the object under us */
+	pin_tag(handle);
+	obj = handle_to_obj(handle);
+	obj_to_location(obj, &f_page, &f_objidx);
 	first_page = get_first_page(f_page);
 
 	get_zspage_mapping(first_page, &class_idx, &fullness);
 	class = &pool->size_class[class_idx];
-	f_offset = obj_idx_to_offset(f_page, f_objidx, class->size);
 
 	spin_lock(&class->lock);
-
-	/* Insert this object in containing zspage's freelist */
-	link = (struct link_free *)((unsigned char *)kmap_atomic(f_page)
-							+ f_offset);
-	link->next = first_page->freelist;
-	kunmap_atomic(link);
-	first_page->freelist = obj;
-
-	first_page->inuse--;
-	fullness = fix_fullness_group(pool, first_page);
-
-	if (fullness == ZS_EMPTY)
-		class->pages_allocated -= class->zspage_order;
-
+	fullness = obj_free(pool, class, obj);
 	spin_unlock(&class->lock);
 
+	unpin_tag(handle);
+	kmem_cache_free(zs_handle_cachep, handle);
+
 	if (fullness == ZS_EMPTY)
 		free_zspage(first_page);
 }
 EXPORT_SYMBOL_GPL(zs_free);
 
+/*
+ * The object stays pinned, and so cannot be moved by compaction, until
+ * zs_unmap_object() is called.
+ */
 void *zs_map_object(struct zs_pool *pool, void *handle)
 {
 	struct page *page;
@@ -655,7 +1081,8 @@ void *zs_map_object(struct zs_pool *pool, void *handle)
 
 	BUG_ON(!handle);
 
-	obj_handle_to_location(handle, &page, &obj_idx);
+	pin_tag(handle);
+	obj_to_location(handle_to_obj(handle), &page, &obj_idx);
 	get_zspage_mapping(get_first_page(page), &class_idx, &fg);
 	class = &pool->size_class[class_idx];
 	off = obj_idx_to_offset(page, obj_idx, class->size);
@@ -679,7 +1106,7 @@ void *zs_map_object(struct zs_pool *pool, void *handle)
 		area->vm_addr = area->vm->addr;
 	}
 
-	return area->vm_addr + off;
+	return area->vm_addr + off + ZS_HANDLE_SIZE;
 }
 EXPORT_SYMBOL_GPL(zs_map_object);
 
@@ -695,7 +1122,7 @@ void zs_unmap_object(struct zs_pool *pool, void *handle)
 
 	BUG_ON(!handle);
 
-	obj_handle_to_location(handle, &page, &obj_idx);
+	obj_to_location(handle_to_obj(handle), &page, &obj_idx);
 	get_zspage_mapping(get_first_page(page), &class_idx, &fg);
 	class = &pool->size_class[class_idx];
 	off = obj_idx_to_offset(page, obj_idx, class->size);
@@ -710,6 +1137,8 @@ void zs_unmap_object(struct zs_pool *pool, void *handle)
 		__flush_tlb_one((unsigned long)area->vm_addr + PAGE_SIZE);
 	}
 	put_cpu_var(zs_map_area);
+
+	unpin_tag(handle);
 }
 EXPORT_SYMBOL_GPL(zs_unmap_object);
 
@@ -725,6 +1154,206 @@ u64 zs_get_total_size_bytes(struct zs_pool *pool)
 }
 EXPORT_SYMBOL_GPL(zs_get_total_size_bytes);
 
+/* Orders entries by (checksum, size); returns the sign of key - entry */
+static int zs_dedup_cmp(struct zs_dedup_entry *entry, u32 checksum,
+			size_t size)
+{
+	if (checksum != entry->checksum)
+		return checksum < entry->checksum ? -1 : 1;
+	if (size != entry->size)
+		return size < entry->size ? -1 : 1;
+	return 0;
+}
+
+static struct zs_dedup_entry *zs_dedup_find_handle(struct zs_pool *pool,
+						   void *handle)
+{
+	struct rb_node *node = pool->dedup_handle_root.rb_node;
+	struct zs_dedup_entry *entry;
+
+	while (node) {
+		entry = rb_entry(node, struct zs_dedup_entry, handle_node);
+		if (handle < entry->handle)
+			node = node->rb_left;
+		else if (handle > entry->handle)
+			node = node->rb_right;
+		else
+			return entry;
+	}
+
+	return NULL;
+}
+
+/**
+ * zs_dedup_get - look up an object with identical contents
+ * @pool: pool to search
+ * @src: contents of the object about to be stored
+ * @size: size of @src
+ * @checksum: hash of @src, chosen by the caller
+ *
+ * Only objects previously registered with zs_dedup_add() are considered.
+ * On a match the object's reference count is raised and its handle is
+ * returned; the reference must be dropped with zs_dedup_put().  Returns
+ * NULL if no identical object exists.
+ */
+void *zs_dedup_get(struct zs_pool *pool, const void *src, size_t size,
+		   u32 checksum)
+{
+	struct rb_node *node;
+	struct zs_dedup_entry *entry, *first = NULL;
+	void *handle = NULL;
+	int cmp;
+
+	spin_lock(&pool->dedup_lock);
+
+	/* find the leftmost entry with this key, hash collisions follow it */
+	node = pool->dedup_hash_root.rb_node;
+	while (node) {
+		entry = rb_entry(node, struct zs_dedup_entry, hash_node);
+		cmp = zs_dedup_cmp(entry, checksum, size);
+		if (cmp < 0) {
+			node = node->rb_left;
+		} else if (cmp > 0) {
+			node = node->rb_right;
+		} else {
+			first = entry;
+			node = node->rb_left;
+		}
+	}
+
+	for (entry = first; entry; ) {
+		void *obj;
+		int same;
+
+		obj = zs_map_object(pool, entry->handle);
+		same = !memcmp(obj, src, size);
+		zs_unmap_object(pool, entry->handle);
+
+		if (same) {
+			entry->refcount++;
+			pool->dedup_refs++;
+			pool->dedup_bytes += size;
+			handle = entry->handle;
+			break;
+		}
+
+		node = rb_next(&entry->hash_node);
+		entry = node ? rb_entry(node, struct zs_dedup_entry,
+					hash_node) : NULL;
+		if (entry && zs_dedup_cmp(entry, checksum, size))
+			entry = NULL;
+	}
+
+	spin_unlock(&pool->dedup_lock);
+
+	return handle;
+}
+EXPORT_SYMBOL_GPL(zs_dedup_get);
+
+/**
+ * zs_dedup_add - make an object available for deduplication
+ * @pool: pool the object was allocated from
+ * @handle: object handle returned by zs_malloc()
+ * @size: size of the object contents
+ * @checksum: hash of the contents, as later passed to zs_dedup_get()
+ *
+ * On success the object is owned by the dedup index with a reference
+ * count of one and must be released with zs_dedup_put() instead of
+ * zs_free().  Returns -ENOMEM if the index entry cannot be allocated,
+ * in which case the object is left untouched.
+ */
+int zs_dedup_add(struct zs_pool *pool, void *handle, size_t size,
+		 u32 checksum)
+{
+	struct rb_node **link, *parent;
+	struct zs_dedup_entry *entry, *new;
+
+	new = kmalloc(sizeof(*new), pool->flags & ~__GFP_HIGHMEM);
+	if (!new)
+		return -ENOMEM;
+
+	new->handle = handle;
+	new->checksum = checksum;
+	new->size = size;
+	new->refcount = 1;
+
+	spin_lock(&pool->dedup_lock);
+
+	link = &pool->dedup_hash_root.rb_node;
+	parent = NULL;
+	while (*link) {
+		parent = *link;
+		entry = rb_entry(parent, struct zs_dedup_entry, hash_node);
+		if (zs_dedup_cmp(entry, checksum, size) < 0)
+			link = &parent->rb_left;
+		else
+			link = &parent->rb_right;
+	}
+	rb_link_node(&new->hash_node, parent, link);
+	rb_insert_color(&new->hash_node, &pool->dedup_hash_root);
+
+	link = &pool->dedup_handle_root.rb_node;
+	parent = NULL;
+	while (*link) {
+		parent = *link;
+		entry = rb_entry(parent, struct zs_dedup_entry, handle_node);
+		if (handle < entry->handle)
+			link = &parent->rb_left;
+		else
+			link = &parent->rb_right;
+	}
+	rb_link_node(&new->handle_node, parent, link);
+	rb_insert_color(&new->handle_node, &pool->dedup_handle_root);
+
+	spin_unlock(&pool->dedup_lock);
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(zs_dedup_add);
+
+/**
+ * zs_dedup_put - drop a reference to a deduplicated object
+ * @pool: pool the object was allocated from
+ * @handle: handle from zs_dedup_get() or registered with zs_dedup_add()
+ *
+ * The object is freed once the last reference is gone.
+ */
+void zs_dedup_put(struct zs_pool *pool, void *handle)
+{
+	struct zs_dedup_entry *entry;
+
+	spin_lock(&pool->dedup_lock);
+	entry = zs_dedup_find_handle(pool, handle);
+	if (WARN_ON(!entry)) {
+		spin_unlock(&pool->dedup_lock);
+		return;
+	}
+
+	if (--entry->refcount) {
+		pool->dedup_refs--;
+		pool->dedup_bytes -= entry->size;
+		spin_unlock(&pool->dedup_lock);
+		return;
+	}
+
+	rb_erase(&entry->hash_node, &pool->dedup_hash_root);
+	rb_erase(&entry->handle_node, &pool->dedup_handle_root);
+	spin_unlock(&pool->dedup_lock);
+
+	kfree(entry);
+	zs_free(pool, handle);
+}
+EXPORT_SYMBOL_GPL(zs_dedup_put);
+
+void zs_dedup_stats(struct zs_pool *pool, u64 *refs, u64 *bytes)
+{
+	spin_lock(&pool->dedup_lock);
+	*refs = pool->dedup_refs;
+	*bytes = pool->dedup_bytes;
+	spin_unlock(&pool->dedup_lock);
+}
+EXPORT_SYMBOL_GPL(zs_dedup_stats);
+
 module_init(zs_init);
 module_exit(zs_exit);
 
@@ -27,5 +27,13 @@ void *zs_map_object(struct zs_pool *pool, void *handle);
 void zs_unmap_object(struct zs_pool *pool, void *handle);
 
 u64 zs_get_total_size_bytes(struct zs_pool *pool);
+unsigned long zs_compact(struct zs_pool *pool);
+
+void *zs_dedup_get(struct zs_pool *pool, const void *src, size_t size,
+		   u32 checksum);
+int zs_dedup_add(struct zs_pool *pool, void *handle, size_t size,
+		 u32 checksum);
+void zs_dedup_put(struct zs_pool *pool, void *handle);
+void zs_dedup_stats(struct zs_pool *pool, u64 *refs, u64 *bytes);
 
 #endif
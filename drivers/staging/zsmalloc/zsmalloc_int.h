@@ -14,6 +14,8 @@
 #define _ZS_MALLOC_INT_H_
 
 #include <linux/kernel.h>
+#include <linux/rbtree.h>
+#include <linux/shrinker.h>
 #include <linux/spinlock.h>
 #include <linux/types.h>
 
@@ -34,12 +36,19 @@
 
 /*
  * Object location (<PFN>, <obj_idx>) is encoded as
- * as single (void *) handle value.
+ * as single unsigned long value.
  *
  * Note that object index <obj_idx> is relative to system
  * page <PFN> it is stored in, so for each sub-page belonging
  * to a zspage, obj_idx starts with 0.
  *
+ * The lowest OBJ_TAG_BITS of a location are always zero. Handles given
+ * out by zs_malloc() point to a word holding the current location, so
+ * that compaction can move objects, and bit HANDLE_PIN_BIT of that word
+ * pins the object while it is mapped or being freed. Every allocated
+ * object starts with a copy of its handle tagged with OBJ_ALLOCATED_TAG,
+ * which tells it apart from the link_free of a free object.
+ *
  * This is made more complicated by various memory models and PAE.
  */
 
@@ -55,13 +64,21 @@
 #endif
 #endif
 #define _PFN_BITS		(MAX_PHYSMEM_BITS - PAGE_SHIFT)
+#define OBJ_TAG_BITS	1
 #define OBJ_INDEX_BITS	(BITS_PER_LONG - _PFN_BITS)
 #define OBJ_INDEX_MASK	((_AC(1, UL) << OBJ_INDEX_BITS) - 1)
 
+#define OBJ_ALLOCATED_TAG	1
+#define HANDLE_PIN_BIT		0
+
+/* Space taken by the handle at the start of every allocated object */
+#define ZS_HANDLE_SIZE		(sizeof(unsigned long))
+
 #define MAX(a, b) ((a) >= (b) ? (a) : (b))
 /* ZS_MIN_ALLOC_SIZE must be multiple of ZS_ALIGN */
 #define ZS_MIN_ALLOC_SIZE \
-	MAX(32, (ZS_MAX_PAGES_PER_ZSPAGE << PAGE_SHIFT >> OBJ_INDEX_BITS))
+	MAX(32, (ZS_MAX_PAGES_PER_ZSPAGE << PAGE_SHIFT >> \
+		 (OBJ_INDEX_BITS - OBJ_TAG_BITS)))
 #define ZS_MAX_ALLOC_SIZE	PAGE_SIZE
 
 /*
@@ -130,6 +147,7 @@ struct size_class {
 
 	/* stats */
 	u64 pages_allocated;
+	unsigned long objs_inuse;
 
 	struct page *fullness_list[_ZS_NR_FULLNESS_GROUPS];
 };
@@ -141,8 +159,22 @@ struct size_class {
  * This must be power of 2 and less than or equal to ZS_ALIGN
  */
 struct link_free {
-	/* Handle of next free chunk (encodes <PFN, obj_idx>) */
-	void *next;
+	/* Location of next free chunk (encodes <PFN, obj_idx>) */
+	unsigned long next;
+};
+
+/*
+ * Reference counted object registered for content deduplication.  It is
+ * indexed both by content hash, to find identical objects on insert, and
+ * by handle, to find the entry again when a reference is dropped.
+ */
+struct zs_dedup_entry {
+	struct rb_node hash_node;
+	struct rb_node handle_node;
+	void *handle;
+	u32 checksum;
+	unsigned int size;
+	unsigned int refcount;
 };
 
 struct zs_pool {
@@ -150,6 +182,19 @@ struct zs_pool {
 
 	gfp_t flags;	/* allocation flags used when growing pool */
 	const char *name;
+
+	/* deduplicated objects, see zs_dedup_get() */
+	spinlock_t dedup_lock;
+	struct rb_root dedup_hash_root;
+	struct rb_root dedup_handle_root;
+	u64 dedup_refs;		/* references sharing an existing object */
+	u64 dedup_bytes;	/* bytes those references did not allocate */
+
+	/* compaction, run from zs_compact() and from memory pressure */
+	struct shrinker shrinker;
+	atomic_long_t pages_compacted;
+
+	struct dentry *stat_dentry;
 };
 
 #endif
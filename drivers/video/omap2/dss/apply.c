@@ -30,10 +30,11 @@
 #include "dss_features.h"
 #include <linux/pm_qos.h>
 
-bool band_changed;
 static int pm_init_cstr = 0;
 extern struct pm_qos_request req;
-#define OVERLAY_AREA_BW_THRESHOLD (1920*1080)
+/* memory throughput last requested for the overlays, KiB/s */
+static u32 dss_tput;
+static DEFINE_MUTEX(tput_lock);
 
 struct callback_states {
 	/*
@@ -99,6 +100,8 @@ struct ovl_priv_data {
 	bool enabled;
 	enum omap_channel channel;
 	u32 fifo_low, fifo_high;
+	/* FIFO drain rate the thresholds were computed for, KiB/s */
+	u32 bandwidth;
 
 	/*
 	 * True if overlay is to be enabled. Used to check and calculate configs
@@ -1367,8 +1370,9 @@ static void omap_dss_mgr_apply_mgr(struct omap_overlay_manager *mgr)
 	DSSDBG("%s %d\n",__FUNCTION__,mp->skip_init);
 }
 
-void dss_tput_request(u32 tput)
+static void dss_tput_set(u32 tput)
 {
+	dss_tput = tput;
 	if(!pm_init_cstr) {
 		pm_qos_add_request(&req, PM_QOS_MEMORY_THROUGHPUT,
 					 tput);
@@ -1378,21 +1382,49 @@ void dss_tput_request(u32 tput)
 		pm_qos_update_request(&req, tput);
 }
 
+void dss_tput_request(u32 tput)
+{
+	mutex_lock(&tput_lock);
+	dss_tput_set(tput);
+	mutex_unlock(&tput_lock);
+}
+
+/*
+ * Drop the throughput request to what the overlays need once applied
+ * settings are on screen.  Settings applied meanwhile, but not programmed
+ * yet, keep what omap_dss_mgr_apply() raised for them.
+ */
+void dss_tput_release(void)
+{
+	mutex_lock(&tput_lock);
+	dss_tput_set(omap_dss_overlay_bandwidth(true));
+	mutex_unlock(&tput_lock);
+}
+EXPORT_SYMBOL(dss_tput_release);
+
 int omap_dss_mgr_apply(struct omap_overlay_manager *mgr)
 {
 	unsigned long flags;
 	struct omap_overlay *ovl;
 	struct omap_overlay_manager_info info;
+	u32 tput;
 	int r;
 
 	DSSDBG("omap_dss_mgr_apply(%s)\n", mgr->name);
 
 	mgr->get_manager_info(mgr, &info);
 
-	/* Set OPP constraint on CORE only when it needed */
-	if (mgr->device && (mgr->device->state == OMAP_DSS_DISPLAY_ACTIVE))
-		if (omap_dss_overlay_ensure_bw())
-			dss_tput_request(PM_QOS_MEMORY_THROUGHPUT_HIGH_VALUE);
+	/*
+	 * Raise L3/EMIF to what the new settings need before GO can latch
+	 * them.  Lowering it waits until they are on screen.
+	 */
+	if (mgr->device && (mgr->device->state == OMAP_DSS_DISPLAY_ACTIVE)) {
+		mutex_lock(&tput_lock);
+		tput = omap_dss_overlay_bandwidth(true);
+		if (tput > dss_tput)
+			dss_tput_set(tput);
+		mutex_unlock(&tput_lock);
+	}
 
 	spin_lock_irqsave(&data_lock, flags);
 
@@ -1607,20 +1639,32 @@ static void dss_apply_fifo_merge(bool use_fifo_merge)
 	dss_data.fifo_merge_dirty = true;
 }
 
+static u32 dss_ovl_calc_bandwidth(struct omap_overlay *ovl,
+		struct omap_overlay_info *oi)
+{
+	struct omap_dss_device *dssdev;
+
+	if (!ovl->manager || !ovl->manager->device)
+		return 0;
+
+	dssdev = ovl->manager->device;
+
+	return dispc_ovl_calc_bandwidth(oi, dssdev->panel.timings.pixel_clock);
+}
+
 static void dss_ovl_setup_fifo(struct omap_overlay *ovl,
 		bool use_fifo_merge)
 {
 	struct ovl_priv_data *op = get_ovl_priv(ovl);
-	struct omap_dss_device *dssdev;
 	u32 fifo_low, fifo_high;
 
 	if (!op->enabled && !op->enabling)
 		return;
 
-	dssdev = ovl->manager->device;
+	op->bandwidth = dss_ovl_calc_bandwidth(ovl, &op->info);
 
 	dispc_ovl_compute_fifo_thresholds(ovl->id, &fifo_low, &fifo_high,
-			use_fifo_merge, ovl_manual_update(ovl));
+			use_fifo_merge, ovl_manual_update(ovl), op->bandwidth);
 
 	dss_apply_ovl_fifo_thresholds(ovl, fifo_low, fifo_high);
 }
@@ -2249,38 +2293,65 @@ err:
 	return r;
 }
 
-bool omap_dss_overlay_ensure_bw(void)
+/*
+ * Memory throughput, in KiB/s, the enabled overlays need while they are on
+ * screen.  With @pending, settings applied but not programmed yet are also
+ * accounted, so that the throughput can be requested before they are.
+ */
+u32 omap_dss_overlay_bandwidth(bool pending)
 {
-	int i;
 	struct omap_overlay *ovl;
-	int num_planes_enabled = 0;
-	bool high_res_screen = false;
 	struct ovl_priv_data *op;
-	struct omap_overlay_info *oi;
+	unsigned long flags;
+	u32 bw, total = 0;
+	int i;
 
-	/* Check if DSS need higher OPP on CORE or not */
-	for (i = 0; i < omap_dss_get_num_overlays(); ++i) {
+	spin_lock_irqsave(&data_lock, flags);
 
+	for (i = 0; i < omap_dss_get_num_overlays(); ++i) {
 		ovl = omap_dss_get_overlay(i);
 		op = get_ovl_priv(ovl);
-		oi = &op->info;
-
-		if (!op->enabled)
-			continue;
 
-		/* Check for high resolution screes, 1080p */
-		if ((oi->width * oi->height) >= OVERLAY_AREA_BW_THRESHOLD)
-			high_res_screen = true;
+		bw = 0;
+		if (op->enabled)
+			bw = dss_ovl_calc_bandwidth(ovl, &op->info);
+		if (pending && op->user_info_dirty)
+			bw = max(bw, dss_ovl_calc_bandwidth(ovl,
+							    &op->user_info));
 
-		++num_planes_enabled;
+		total += bw;
 	}
 
-	if ((num_planes_enabled > 1) && high_res_screen) {
-		if (!band_changed)
-			band_changed = true;
-		return true;
-	} else if (band_changed)
-		band_changed = false;
+	spin_unlock_irqrestore(&data_lock, flags);
 
-	return false;
+	return total;
+}
+EXPORT_SYMBOL(omap_dss_overlay_bandwidth);
+
+void dss_dump_bandwidth(struct seq_file *s)
+{
+	struct omap_overlay *ovl;
+	struct ovl_priv_data *op;
+	unsigned long flags;
+	u32 underflows;
+	int i;
+
+	seq_printf(s, "%-8s %-8s %12s %8s %8s %10s\n", "overlay", "enabled",
+		   "bw (KiB/s)", "low", "high", "underflows");
+
+	for (i = 0; i < omap_dss_get_num_overlays(); ++i) {
+		ovl = omap_dss_get_overlay(i);
+
+		underflows = dispc_ovl_get_fifo_underflows(ovl->id);
+
+		spin_lock_irqsave(&data_lock, flags);
+		op = get_ovl_priv(ovl);
+		seq_printf(s, "%-8s %-8d %12u %8u %8u %10u\n", ovl->name,
+			   op->enabled, op->enabled ? op->bandwidth : 0,
+			   op->fifo_low, op->fifo_high, underflows);
+		spin_unlock_irqrestore(&data_lock, flags);
+	}
+
+	seq_printf(s, "total %u KiB/s, requested %u KiB/s\n",
+		   omap_dss_overlay_bandwidth(false), dss_tput);
 }
@@ -171,6 +171,8 @@ static int dss_initialize_debugfs(void)
 			&dss_dump_regs, &dss_debug_fops);
 	debugfs_create_file("dispc", S_IRUGO, dss_debugfs_dir,
 			&dispc_dump_regs, &dss_debug_fops);
+	debugfs_create_file("bandwidth", S_IRUGO, dss_debugfs_dir,
+			&dss_dump_bandwidth, &dss_debug_fops);
 #ifdef CONFIG_OMAP2_DSS_RFBI
 	debugfs_create_file("rfbi", S_IRUGO, dss_debugfs_dir,
 			&rfbi_dump_regs, &dss_debug_fops);
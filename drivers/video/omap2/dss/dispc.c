@@ -90,6 +90,7 @@ static struct {
 	struct clk *dss_clk;
 
 	u32	fifo_size[MAX_DSS_OVERLAYS];
+	u32	fifo_underflows[MAX_DSS_OVERLAYS];
 
 	spinlock_t irq_lock;
 	u32 irq_error_mask;
@@ -118,6 +119,20 @@ enum omap_color_component {
 	DISPC_COLOR_COMPONENT_UV		= 1 << 1,
 };
 
+static const unsigned fifo_underflow_bits[] = {
+	DISPC_IRQ_GFX_FIFO_UNDERFLOW,
+	DISPC_IRQ_VID1_FIFO_UNDERFLOW,
+	DISPC_IRQ_VID2_FIFO_UNDERFLOW,
+	DISPC_IRQ_VID3_FIFO_UNDERFLOW,
+};
+
+/*
+ * Worst case time for a pipeline DMA request to be served by memory while
+ * the other L3 initiators are busy.  The FIFO low threshold must hold what
+ * the pipeline drains in that time.
+ */
+#define DISPC_DMA_LATENCY_NS	5000
+
 static void _omap_dispc_set_irqs(void);
 
 static inline void dispc_write_reg(const u16 idx, u32 val)
@@ -1169,9 +1184,80 @@ void dispc_enable_fifomerge(bool enable)
 	REG_FLD_MOD(DISPC_CONFIG, enable ? 1 : 0, 14, 14);
 }
 
+static int color_mode_to_bpp(enum omap_color_mode color_mode)
+{
+	switch (color_mode) {
+	case OMAP_DSS_COLOR_CLUT1:
+		return 1;
+	case OMAP_DSS_COLOR_CLUT2:
+		return 2;
+	case OMAP_DSS_COLOR_CLUT4:
+		return 4;
+	case OMAP_DSS_COLOR_CLUT8:
+	case OMAP_DSS_COLOR_NV12:
+		return 8;
+	case OMAP_DSS_COLOR_RGB12U:
+	case OMAP_DSS_COLOR_RGB16:
+	case OMAP_DSS_COLOR_ARGB16:
+	case OMAP_DSS_COLOR_YUV2:
+	case OMAP_DSS_COLOR_UYVY:
+	case OMAP_DSS_COLOR_RGBA16:
+	case OMAP_DSS_COLOR_RGBX16:
+	case OMAP_DSS_COLOR_ARGB16_1555:
+	case OMAP_DSS_COLOR_XRGB16_1555:
+		return 16;
+	case OMAP_DSS_COLOR_RGB24P:
+		return 24;
+	case OMAP_DSS_COLOR_RGB24U:
+	case OMAP_DSS_COLOR_ARGB32:
+	case OMAP_DSS_COLOR_RGBA32:
+	case OMAP_DSS_COLOR_RGBX32:
+		return 32;
+	default:
+		BUG();
+	}
+}
+
+/*
+ * Rate, in KiB/s, at which a plane drains its FIFO while it is on screen,
+ * for a manager running at @pclk kHz.  Each output pixel consumes the
+ * input pixels it is scaled from, and reading a TILER container rotated by
+ * 90 or 270 degrees crosses a page every few pixels, which about halves
+ * the useful throughput of the DMA.
+ */
+u32 dispc_ovl_calc_bandwidth(const struct omap_overlay_info *oi, u32 pclk)
+{
+	u16 outw, outh;
+	int bpp;
+	u64 bw;
+
+	outw = oi->out_width == 0 ? oi->width : oi->out_width;
+	outh = oi->out_height == 0 ? oi->height : oi->out_height;
+	if (!pclk || !oi->paddr || !outw || !outh)
+		return 0;
+
+	bpp = color_mode_to_bpp(oi->color_mode);
+	/* the UV plane of NV12 is half the size of the Y plane */
+	if (oi->color_mode == OMAP_DSS_COLOR_NV12)
+		bpp += bpp / 2;
+
+	/* kbit/s, then KiB/s */
+	bw = (u64)pclk * bpp * oi->width * oi->height;
+	do_div(bw, outw * outh);
+	bw = bw * 125;
+	do_div(bw, 1024);
+
+	if (oi->rotation_type == OMAP_DSS_ROT_TILER &&
+	    (oi->rotation == OMAP_DSS_ROT_90 ||
+	     oi->rotation == OMAP_DSS_ROT_270))
+		bw *= 2;
+
+	return min_t(u64, bw, UINT_MAX);
+}
+
 void dispc_ovl_compute_fifo_thresholds(enum omap_plane plane,
 		u32 *fifo_low, u32 *fifo_high, bool use_fifomerge,
-		bool manual_update)
+		bool manual_update, u32 bandwidth)
 {
 	/*
 	 * All sizes are in bytes. Both the buffer and burst are made of
@@ -1180,6 +1266,7 @@ void dispc_ovl_compute_fifo_thresholds(enum omap_plane plane,
 
 	unsigned buf_unit = dss_feat_get_buffer_size_unit();
 	unsigned ovl_fifo_size, total_fifo_size, burst_size;
+	u64 drain;
 	int i;
 
 	burst_size = dispc_ovl_get_burst_size(plane);
@@ -1202,6 +1289,19 @@ void dispc_ovl_compute_fifo_thresholds(enum omap_plane plane,
 	if (manual_update && dss_has_feature(FEAT_OMAP3_DSI_FIFO_BUG)) {
 		*fifo_low = ovl_fifo_size - burst_size * 2;
 		*fifo_high = total_fifo_size - burst_size;
+	} else if (bandwidth) {
+		/*
+		 * Request data early enough to ride out the DMA latency at
+		 * the rate the plane is read, but no earlier: the wider the
+		 * gap to the high threshold, the longer memory stays idle
+		 * between refills.
+		 */
+		drain = (u64)bandwidth * 1024 * DISPC_DMA_LATENCY_NS;
+		do_div(drain, NSEC_PER_SEC);
+		*fifo_low = roundup((u32)drain, buf_unit) + burst_size;
+		*fifo_low = clamp(*fifo_low, burst_size,
+				  ovl_fifo_size - burst_size);
+		*fifo_high = total_fifo_size - buf_unit;
 	} else {
 		if (cpu_is_omap44xx()) {
 			/* optimization of power consumption for OMAP4 */
@@ -1526,40 +1626,6 @@ static void dispc_ovl_set_rotation_attrs(enum omap_plane plane, u8 rotation,
 	}
 }
 
-static int color_mode_to_bpp(enum omap_color_mode color_mode)
-{
-	switch (color_mode) {
-	case OMAP_DSS_COLOR_CLUT1:
-		return 1;
-	case OMAP_DSS_COLOR_CLUT2:
-		return 2;
-	case OMAP_DSS_COLOR_CLUT4:
-		return 4;
-	case OMAP_DSS_COLOR_CLUT8:
-	case OMAP_DSS_COLOR_NV12:
-		return 8;
-	case OMAP_DSS_COLOR_RGB12U:
-	case OMAP_DSS_COLOR_RGB16:
-	case OMAP_DSS_COLOR_ARGB16:
-	case OMAP_DSS_COLOR_YUV2:
-	case OMAP_DSS_COLOR_UYVY:
-	case OMAP_DSS_COLOR_RGBA16:
-	case OMAP_DSS_COLOR_RGBX16:
-	case OMAP_DSS_COLOR_ARGB16_1555:
-	case OMAP_DSS_COLOR_XRGB16_1555:
-		return 16;
-	case OMAP_DSS_COLOR_RGB24P:
-		return 24;
-	case OMAP_DSS_COLOR_RGB24U:
-	case OMAP_DSS_COLOR_ARGB32:
-	case OMAP_DSS_COLOR_RGBA32:
-	case OMAP_DSS_COLOR_RGBX32:
-		return 32;
-	default:
-		BUG();
-	}
-}
-
 static s32 pixinc(int pixels, u8 ps)
 {
 	if (!cpu_is_omap44xx() && !cpu_is_omap54xx())
@@ -3897,6 +3963,10 @@ static irqreturn_t omap_dispc_irq_handler(int irq, void *arg)
 	if (unhandled_errors) {
 		dispc.error_irqs |= unhandled_errors;
 
+		for (i = 0; i < omap_dss_get_num_overlays(); i++)
+			if (unhandled_errors & fifo_underflow_bits[i])
+				dispc.fifo_underflows[i]++;
+
 		dispc.irq_error_mask &= ~unhandled_errors;
 		_omap_dispc_set_irqs();
 
@@ -3908,17 +3978,24 @@ static irqreturn_t omap_dispc_irq_handler(int irq, void *arg)
 	return IRQ_HANDLED;
 }
 
+/* FIFO underflows of @plane since boot */
+u32 dispc_ovl_get_fifo_underflows(enum omap_plane plane)
+{
+	unsigned long flags;
+	u32 count;
+
+	spin_lock_irqsave(&dispc.irq_lock, flags);
+	count = dispc.fifo_underflows[plane];
+	spin_unlock_irqrestore(&dispc.irq_lock, flags);
+
+	return count;
+}
+
 static void dispc_error_worker(struct work_struct *work)
 {
 	int i;
 	u32 errors;
 	unsigned long flags;
-	static const unsigned fifo_underflow_bits[] = {
-		DISPC_IRQ_GFX_FIFO_UNDERFLOW,
-		DISPC_IRQ_VID1_FIFO_UNDERFLOW,
-		DISPC_IRQ_VID2_FIFO_UNDERFLOW,
-		DISPC_IRQ_VID3_FIFO_UNDERFLOW,
-	};
 
 	static const unsigned sync_lost_bits[] = {
 		DISPC_IRQ_SYNC_LOST,
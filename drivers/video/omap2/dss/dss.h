@@ -227,6 +227,7 @@ int dss_mgr_blank(struct omap_overlay_manager *mgr,
 void seq_print_cbs(struct omap_overlay_manager *mgr,
 		struct seq_file *s);
 int dss_mgr_set_ovls(struct omap_overlay_manager *mgr);
+void dss_dump_bandwidth(struct seq_file *s);
 
 bool dss_ovl_is_enabled(struct omap_overlay *ovl);
 int dss_ovl_enable(struct omap_overlay *ovl);
@@ -467,9 +468,11 @@ int dispc_calc_clock_rates(unsigned long dispc_fclk_rate,
 
 void dispc_ovl_set_global_mflag(enum omap_plane plane, bool mflag);
 void dispc_ovl_set_fifo_threshold(enum omap_plane plane, u32 low, u32 high);
+u32 dispc_ovl_calc_bandwidth(const struct omap_overlay_info *oi, u32 pclk);
 void dispc_ovl_compute_fifo_thresholds(enum omap_plane plane,
 		u32 *fifo_low, u32 *fifo_high, bool use_fifomerge,
-		bool manual_update);
+		bool manual_update, u32 bandwidth);
+u32 dispc_ovl_get_fifo_underflows(enum omap_plane plane);
 int dispc_ovl_setup(enum omap_plane plane, struct omap_overlay_info *oi,
 		bool ilace, bool replication, int x_decim, int y_decim,
 		bool five_taps, bool source_of_wb);
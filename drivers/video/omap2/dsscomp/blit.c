@@ -0,0 +1,662 @@
+/*
+ * linux/drivers/video/omap2/dsscomp/blit.c
+ *
+ * DSS Composition 2D blitter offload
+ *
+ * Copyright (C) 2012 Texas Instruments, Inc
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/sched.h>
+#include <linux/workqueue.h>
+#include <linux/ion.h>
+#include <linux/omap_ion.h>
+#include <linux/sync.h>
+#include <linux/sw_sync.h>
+#include <linux/gcbv-iface.h>
+
+#include <video/omapdss.h>
+#include <video/dsscomp.h>
+#include <plat/dsscomp.h>
+#include "../../../drivers/staging/omapdrm/omap_dmm_tiler.h"
+#include "dsscomp.h"
+#include "tiler-utils.h"
+
+/* buffers to blit into: one shown, one queued to DSS and one blitted */
+#define BLIT_NUM_BUFS		3
+/* how long to wait for a buffer to be free, or a layer to be ready */
+#define BLIT_TIMEOUT_MS		1000
+
+struct blit_buf {
+	struct ion_handle *handle;
+	u32 phys;
+	u32 stride;			/* TILER line increment */
+	struct bvbuffdesc desc;
+	struct bvphysdesc pdesc;
+	struct bvsurfgeom geom;
+	struct sync_fence *busy;	/* signals once DISPC is done with it */
+	bool valid;			/* holds a whole frame */
+};
+
+struct blit_src {
+	struct bvbuffdesc desc;
+	struct bvphysdesc pdesc;
+	struct bvsurfgeom geom;
+	struct bvbltparams bp;
+	struct tiler_pa_info *pa;
+	struct sync_fence *acquire;
+};
+
+/* blits of one frame */
+struct blit_job {
+	struct work_struct work;
+	struct blit_buf *buf;
+	struct blit_buf *prev;		/* last frame, if a blit fails */
+	struct sync_fence *busy;	/* of the prior frame in buf */
+	u32 num;
+	struct blit_src src[DSSCOMP_MAX_BLITS];
+};
+
+static struct dsscomp_dev *cdev;
+
+static struct {
+	struct bventry bv;
+	struct ion_client *ion;
+	struct workqueue_struct *wq;
+	/* advances as each frame is blitted */
+	struct sw_sync_timeline *timeline;
+
+	/* serializes frames */
+	struct mutex mtx;
+	u32 seq;			/* last frame queued */
+	u32 buf_ix;			/* last buffer used */
+	u16 w, h;			/* size of the buffers */
+	struct blit_buf bufs[BLIT_NUM_BUFS];
+
+	/* per frame accounting, under lock */
+	spinlock_t lock;
+	struct {
+		u32 frames;
+		u32 failed;
+		u32 layers;
+		u32 last_layers;
+		u32 last_us, max_us;
+		u64 total_us;
+	} stats;
+} blit;
+
+static enum ocdformat blit_format(struct dss2_ovl_cfg *cfg)
+{
+	switch (cfg->color_mode) {
+	case OMAP_DSS_COLOR_ARGB32:
+		return cfg->pre_mult_alpha ? OCDFMT_BGRA24 : OCDFMT_nBGRA24;
+	case OMAP_DSS_COLOR_RGB24U:
+		return OCDFMT_BGR124;
+	case OMAP_DSS_COLOR_RGB16:
+		return OCDFMT_RGB16;
+	default:
+		return OCDFMT_UNKNOWN;
+	}
+}
+
+static int blit_map(struct bvbuffdesc *desc, struct bvphysdesc *pdesc,
+		    unsigned long *pages, u32 num_pg, u32 offset)
+{
+	enum bverror err;
+
+	pdesc->structsize = sizeof(*pdesc);
+	pdesc->pagesize = PAGE_SIZE;
+	pdesc->pagearray = pages;
+	pdesc->pagecount = num_pg;
+	pdesc->pageoffset = offset;
+
+	desc->structsize = sizeof(*desc);
+	desc->auxtype = BVAT_PHYSDESC;
+	desc->auxptr = pdesc;
+	desc->length = (num_pg << PAGE_SHIFT) - offset;
+
+	/*
+	 * The page list stays until bv_unmap, as gcbv tells buffers apart
+	 * by it.
+	 */
+	err = blit.bv.bv_map(desc);
+	if (err) {
+		pdesc->pagearray = NULL;
+		kfree(pages);
+		return -ENOMEM;
+	}
+
+	return 0;
+}
+
+/*
+ * Map a TILER 2D area for the blitter.  Lines are far apart in TILER
+ * space, so map the pages of each line one after the other.
+ */
+static int blit_map_tiler(struct bvbuffdesc *desc, struct bvphysdesc *pdesc,
+			  u32 phys, u32 w, u32 h, u32 bpp, long *stride)
+{
+	struct tiler_view_t view;
+	unsigned long *pages;
+	u32 offset = phys & ~PAGE_MASK, wpages, x, y;
+
+	tilview_create(&view, phys, w, h);
+	wpages = PAGE_ALIGN(offset + w * bpp) >> PAGE_SHIFT;
+	pages = kmalloc(wpages * h * sizeof(*pages), GFP_KERNEL);
+	if (!pages)
+		return -ENOMEM;
+
+	for (y = 0; y < h; y++)
+		for (x = 0; x < wpages; x++)
+			pages[y * wpages + x] = (phys & PAGE_MASK) +
+				view.v_inc * y + (x << PAGE_SHIFT);
+
+	*stride = wpages << PAGE_SHIFT;
+	return blit_map(desc, pdesc, pages, wpages * h, offset);
+}
+
+/* map the user buffer of a layer, in the context of its process */
+static int blit_map_src(struct blit_src *src, struct dss2_ovl_info *oi)
+{
+	u32 addr = (u32) oi->address, offset = addr & ~PAGE_MASK, phys, i;
+	u32 bpp = oi->cfg.color_mode == OMAP_DSS_COLOR_RGB16 ? 2 : 4;
+	unsigned long *pages;
+
+	src->geom.structsize = sizeof(src->geom);
+	src->geom.format = blit_format(&oi->cfg);
+	src->geom.width = oi->cfg.width;
+	src->geom.height = oi->cfg.height;
+
+	if (oi->addressing != OMAP_DSS_BUFADDR_DIRECT ||
+	    src->geom.format == OCDFMT_UNKNOWN ||
+	    oi->cfg.rotation || oi->cfg.mirror)
+		return -EINVAL;
+
+	phys = tiler_virt2phys(addr);
+	if (!phys)
+		return -EFAULT;
+
+	if (is_tiler_addr(phys))
+		return blit_map_tiler(&src->desc, &src->pdesc, phys,
+				      oi->cfg.width, oi->cfg.height, bpp,
+				      &src->geom.virtstride);
+
+	src->pa = user_block_to_pa(addr & PAGE_MASK,
+		PAGE_ALIGN(oi->cfg.height * oi->cfg.stride + offset) >>
+		PAGE_SHIFT);
+	if (!src->pa)
+		return -EFAULT;
+
+	pages = kmalloc(src->pa->num_pg * sizeof(*pages), GFP_KERNEL);
+	if (!pages)
+		return -ENOMEM;
+	for (i = 0; i < src->pa->num_pg; i++)
+		pages[i] = src->pa->mem[i];
+
+	src->geom.virtstride = oi->cfg.stride;
+	return blit_map(&src->desc, &src->pdesc, pages, src->pa->num_pg,
+			offset);
+}
+
+static void blit_free_buf(struct blit_buf *buf)
+{
+	if (buf->busy)
+		sync_fence_put(buf->busy);
+	if (buf->handle) {
+		blit.bv.bv_unmap(&buf->desc);
+		kfree(buf->pdesc.pagearray);
+		ion_free(blit.ion, buf->handle);
+	}
+	memset(buf, 0, sizeof(*buf));
+}
+
+static int blit_alloc_buf(struct blit_buf *buf, u16 w, u16 h)
+{
+	struct omap_ion_tiler_alloc_data data = {
+		.w = w,
+		.h = h,
+		.fmt = TILER_PIXEL_FMT_32BIT,
+	};
+	struct tiler_view_t view;
+	ion_phys_addr_t phys;
+	size_t size;
+	int r;
+
+	r = omap_ion_tiler_alloc(blit.ion, &data);
+	if (r)
+		return r;
+
+	buf->handle = data.handle;
+	r = ion_phys(blit.ion, buf->handle, &phys, &size);
+	if (r)
+		goto err;
+
+	tilview_create(&view, phys, w, h);
+	buf->phys = phys;
+	buf->stride = view.v_inc;
+
+	buf->geom.structsize = sizeof(buf->geom);
+	buf->geom.format = OCDFMT_BGRA24;
+	buf->geom.width = w;
+	buf->geom.height = h;
+
+	r = blit_map_tiler(&buf->desc, &buf->pdesc, phys, w, h, 4,
+			   &buf->geom.virtstride);
+	if (!r)
+		return 0;
+err:
+	ion_free(blit.ion, buf->handle);
+	buf->handle = NULL;
+	return r;
+}
+
+/*
+ * Size the buffers for a blit window, once nothing uses them.  Buffers
+ * DISPC may still read are kept, and the frame fails with -EBUSY.
+ */
+static int blit_resize(u16 w, u16 h)
+{
+	int i, r = 0;
+
+	if (w == blit.w && h == blit.h)
+		return 0;
+
+	flush_workqueue(blit.wq);
+	for (i = 0; i < BLIT_NUM_BUFS; i++) {
+		if (blit.bufs[i].busy &&
+		    sync_fence_wait(blit.bufs[i].busy, BLIT_TIMEOUT_MS)) {
+			dev_warn(DEV(cdev), "blit buffer %d still in use\n", i);
+			return -EBUSY;
+		}
+	}
+	for (i = 0; i < BLIT_NUM_BUFS; i++)
+		blit_free_buf(&blit.bufs[i]);
+
+	for (i = 0; !r && i < BLIT_NUM_BUFS; i++)
+		r = blit_alloc_buf(&blit.bufs[i], w, h);
+	if (r) {
+		while (i--)
+			blit_free_buf(&blit.bufs[i]);
+		w = h = 0;
+	}
+
+	blit.w = w;
+	blit.h = h;
+	return r;
+}
+
+static void blit_free_job(struct blit_job *job)
+{
+	struct blit_src *src;
+	u32 i;
+
+	for (i = 0; i < job->num; i++) {
+		src = job->src + i;
+		if (src->desc.map)
+			blit.bv.bv_unmap(&src->desc);
+		kfree(src->pdesc.pagearray);
+		tiler_pa_free(src->pa);
+		if (src->acquire)
+			sync_fence_put(src->acquire);
+	}
+	if (job->busy)
+		sync_fence_put(job->busy);
+	kfree(job);
+}
+
+/*
+ * Blit one frame.  Frames are blitted in order on a single thread, so the
+ * timeline (and the overlay waiting on it) only advances once the buffer
+ * is complete.  If a blit fails or its inputs do not become ready in
+ * time, the buffer gets the last frame again rather than showing a
+ * partial one.
+ */
+static void blit_worker(struct work_struct *work)
+{
+	struct blit_job *job = container_of(work, struct blit_job, work);
+	struct blit_buf *buf = job->buf;
+	struct bvbltparams bp = {
+		.structsize = sizeof(bp),
+		.flags = BVFLAG_ROP,
+		.op.rop = 0x0000,	/* clear to transparent */
+		.dstdesc = &buf->desc,
+		.dstgeom = &buf->geom,
+		.dstrect = { 0, 0, buf->geom.width, buf->geom.height },
+	};
+	enum bverror err;
+	bool failed = false;
+	unsigned long flags;
+	ktime_t start;
+	u32 i, us = 0;
+
+	/* do not write the buffer while DISPC still reads it */
+	if (job->busy && sync_fence_wait(job->busy, BLIT_TIMEOUT_MS)) {
+		dev_warn(DEV(cdev), "blit buffer still in use\n");
+		failed = true;
+	}
+
+	for (i = 0; !failed && i < job->num; i++)
+		if (job->src[i].acquire &&
+		    sync_fence_wait(job->src[i].acquire, BLIT_TIMEOUT_MS)) {
+			dev_warn(DEV(cdev), "blit layer %d not ready\n", i);
+			failed = true;
+		}
+
+	if (!failed) {
+		start = ktime_get();
+		err = blit.bv.bv_blt(&bp);
+		for (i = 0; !err && i < job->num; i++)
+			err = blit.bv.bv_blt(&job->src[i].bp);
+		us = ktime_us_delta(ktime_get(), start);
+		if (err) {
+			dev_err(DEV(cdev), "blit of layer %d failed (%d)\n",
+				i, err);
+			failed = true;
+		}
+	}
+
+	if (failed && job->prev) {
+		bp.op.rop = 0xCCCC;	/* copy */
+		bp.src1.desc = &job->prev->desc;
+		bp.src1geom = &job->prev->geom;
+		bp.src1rect = bp.dstrect;
+		if (blit.bv.bv_blt(&bp))
+			dev_err(DEV(cdev), "blit of last frame failed\n");
+	}
+
+	spin_lock_irqsave(&blit.lock, flags);
+	blit.stats.frames++;
+	blit.stats.failed += failed;
+	blit.stats.layers += job->num;
+	blit.stats.last_layers = job->num;
+	blit.stats.last_us = us;
+	blit.stats.max_us = max(blit.stats.max_us, us);
+	blit.stats.total_us += us;
+	spin_unlock_irqrestore(&blit.lock, flags);
+
+	/* the layers are free, and the buffer is ready to be shown */
+	sw_sync_timeline_inc(blit.timeline, 1);
+
+	blit_free_job(job);
+}
+
+static void blit_setup_layer(struct blit_src *src, struct blit_buf *buf,
+			     struct dss2_ovl_cfg *cfg, struct dss2_rect_t *win)
+{
+	struct bvbltparams *bp = &src->bp;
+
+	bp->structsize = sizeof(*bp);
+	bp->flags = BVFLAG_BLEND;
+	bp->op.blend = BVBLEND_SRC1OVER;
+	if (cfg->global_alpha != 255) {
+		bp->op.blend |= BVBLENDDEF_GLOBAL_UCHAR;
+		bp->globalalpha.size8 = cfg->global_alpha;
+	}
+	bp->scalemode = BVSCALE_FASTEST;
+
+	bp->dstdesc = &buf->desc;
+	bp->dstgeom = &buf->geom;
+	bp->dstrect.left = cfg->win.x - win->x;
+	bp->dstrect.top = cfg->win.y - win->y;
+	bp->dstrect.width = cfg->win.w;
+	bp->dstrect.height = cfg->win.h;
+
+	bp->src1.desc = &src->desc;
+	bp->src1geom = &src->geom;
+	bp->src1rect.left = cfg->crop.x;
+	bp->src1rect.top = cfg->crop.y;
+	bp->src1rect.width = cfg->crop.w;
+	bp->src1rect.height = cfg->crop.h;
+
+	/* blend over what is already in the buffer */
+	bp->src2.desc = &buf->desc;
+	bp->src2geom = &buf->geom;
+	bp->src2rect = bp->dstrect;
+}
+
+static struct sync_fence *blit_fence(u32 seq)
+{
+	struct sync_fence *fence;
+	struct sync_pt *pt;
+
+	pt = sw_sync_pt_create(blit.timeline, seq);
+	if (!pt)
+		return NULL;
+	fence = sync_fence_create("dsscomp_blit", pt);
+	if (!fence)
+		sync_pt_free(pt);
+	return fence;
+}
+
+/*
+ * Blend the layers of @b into a buffer with the 2D blitter, and queue the
+ * composition with that buffer on overlay b->blit_ovl.  The overlay waits
+ * for the blit to complete before it is applied.  The acquire fences are
+ * taken over, and release fences are returned as for
+ * dsscomp_gralloc_queue_sync().
+ */
+int dsscomp_blit_queue(struct dsscomp_setup_dispc_blit_data *b,
+		       struct sync_fence **ovl_acquire,
+		       struct sync_fence **ovl_release,
+		       struct sync_fence **blit_acquire,
+		       struct sync_fence **blit_release)
+{
+	struct dsscomp_setup_dispc_data *d = &b->fdispc.dispc;
+	u32 i, seq, num = b->num_blits;
+	u32 num_ovls = min_t(u32, d->num_ovls, MAX_OVERLAYS);
+	struct dss2_ovl_info *oi;
+	struct dss2_rect_t *win;
+	struct blit_job *job = NULL;
+	struct sync_fence *fence;
+	struct blit_buf *buf;
+	u32 ix;
+	int r;
+
+	num = min_t(u32, num, DSSCOMP_MAX_BLITS);
+	for (i = 0; i < num; i++)
+		blit_release[i] = NULL;
+
+	if (!blit.bv.bv_blt) {
+		r = -ENODEV;
+		goto put_fences;
+	}
+
+	r = -EINVAL;
+	if (b->blit_ovl >= num_ovls || !num)
+		goto put_fences;
+
+	oi = d->ovls + b->blit_ovl;
+	win = &oi->cfg.win;
+	for (i = 0; i < num; i++) {
+		struct dss2_rect_t *lw = &b->blits[i].ovl.cfg.win;
+
+		if (lw->x < win->x || lw->y < win->y ||
+		    lw->x + lw->w > win->x + win->w ||
+		    lw->y + lw->h > win->y + win->h)
+			goto put_fences;
+	}
+
+	r = -ENOMEM;
+	job = kzalloc(sizeof(*job), GFP_KERNEL);
+	if (!job)
+		goto put_fences;
+	INIT_WORK(&job->work, blit_worker);
+
+	mutex_lock(&blit.mtx);
+
+	r = blit_resize(win->w, win->h);
+	if (r)
+		goto unlock;
+
+	if (blit.bufs[blit.buf_ix].valid)
+		job->prev = blit.bufs + blit.buf_ix;
+	ix = (blit.buf_ix + 1) % BLIT_NUM_BUFS;
+	buf = blit.bufs + ix;
+
+	for (i = 0; i < num; i++) {
+		struct blit_src *src = job->src + i;
+
+		job->num++;
+		src->acquire = blit_acquire[i];
+		blit_acquire[i] = NULL;
+
+		r = blit_map_src(src, &b->blits[i].ovl);
+		if (r)
+			goto unlock;
+		blit_setup_layer(src, buf, &b->blits[i].ovl.cfg, win);
+	}
+
+	/*
+	 * Without its fences the frame cannot be shown or the layers
+	 * released safely, so create them before committing to it.
+	 */
+	r = -ENOMEM;
+	seq = blit.seq + 1;
+	fence = blit_fence(seq);
+	if (!fence)
+		goto unlock;
+	for (i = 0; i < num; i++) {
+		blit_release[i] = blit_fence(seq);
+		if (!blit_release[i])
+			goto put_release;
+	}
+
+	blit.buf_ix = ix;
+	job->buf = buf;
+	job->busy = buf->busy;
+	buf->busy = NULL;
+	buf->valid = true;
+	blit.seq = seq;
+
+	/* show the buffer once it is blitted */
+	if (ovl_acquire[b->blit_ovl])
+		sync_fence_put(ovl_acquire[b->blit_ovl]);
+	ovl_acquire[b->blit_ovl] = fence;
+
+	oi->addressing = OMAP_DSS_BUFADDR_DIRECT;
+	oi->ba = buf->phys;
+	oi->uv = 0;
+	oi->cfg.width = win->w;
+	oi->cfg.height = win->h;
+	oi->cfg.stride = buf->stride;
+	oi->cfg.color_mode = OMAP_DSS_COLOR_ARGB32;
+	oi->cfg.pre_mult_alpha = true;
+	oi->cfg.rotation = 0;
+	oi->cfg.mirror = false;
+	oi->cfg.crop.x = oi->cfg.crop.y = 0;
+	oi->cfg.crop.w = win->w;
+	oi->cfg.crop.h = win->h;
+
+	queue_work(blit.wq, &job->work);
+
+	/* this takes over the acquire fences of the overlays */
+	r = dsscomp_gralloc_queue_ioctl(d, ovl_acquire, ovl_release,
+					1 << b->blit_ovl);
+
+	/* the buffer is free again once its composition is released */
+	buf->busy = ovl_release[b->blit_ovl];
+	ovl_release[b->blit_ovl] = NULL;
+
+	mutex_unlock(&blit.mtx);
+	return r;
+
+put_release:
+	for (i = 0; i < num; i++)
+		if (blit_release[i]) {
+			sync_fence_put(blit_release[i]);
+			blit_release[i] = NULL;
+		}
+	sync_fence_put(fence);
+unlock:
+	mutex_unlock(&blit.mtx);
+	blit_free_job(job);
+put_fences:
+	for (i = 0; i < num; i++)
+		if (blit_acquire[i])
+			sync_fence_put(blit_acquire[i]);
+	for (i = 0; i < num_ovls; i++)
+		if (ovl_acquire[i])
+			sync_fence_put(ovl_acquire[i]);
+	return r;
+}
+
+void dsscomp_dbg_blit(struct seq_file *s)
+{
+	unsigned long flags;
+	typeof(blit.stats) st;
+
+	spin_lock_irqsave(&blit.lock, flags);
+	st = blit.stats;
+	spin_unlock_irqrestore(&blit.lock, flags);
+
+	seq_printf(s, "blitter: %s, buffers %ux%u\n",
+		   blit.bv.bv_blt ? "present" : "absent", blit.w, blit.h);
+	seq_printf(s, "  frames %u failed %u layers %u\n",
+		   st.frames, st.failed, st.layers);
+	if (!st.frames)
+		return;
+	seq_printf(s, "  last: %u layers in %u us\n",
+		   st.last_layers, st.last_us);
+	seq_printf(s, "  avg %llu us max %u us per frame\n",
+		   div_u64(st.total_us, st.frames), st.max_us);
+}
+
+int dsscomp_blit_init(struct dsscomp_dev *cdev_)
+{
+	cdev = cdev_;
+	mutex_init(&blit.mtx);
+	spin_lock_init(&blit.lock);
+
+	/* the GC320 may not be there */
+	gcbv_init(&blit.bv);
+	if (!blit.bv.bv_blt)
+		return -ENODEV;
+
+	blit.ion = ion_client_create(omap_ion_device, "dsscomp_blit");
+	if (IS_ERR_OR_NULL(blit.ion))
+		goto err;
+	blit.timeline = sw_sync_timeline_create("dsscomp_blit");
+	if (!blit.timeline)
+		goto err;
+	blit.wq = create_singlethread_workqueue("dsscomp_blit");
+	if (!blit.wq)
+		goto err;
+
+	return 0;
+err:
+	dev_err(DEV(cdev), "failed to set up 2D blitter\n");
+	dsscomp_blit_exit();
+	return -ENOMEM;
+}
+
+void dsscomp_blit_exit(void)
+{
+	int i;
+
+	if (blit.wq)
+		destroy_workqueue(blit.wq);
+	for (i = 0; i < BLIT_NUM_BUFS; i++)
+		blit_free_buf(&blit.bufs[i]);
+	if (blit.timeline)
+		sync_timeline_destroy(&blit.timeline->obj);
+	if (!IS_ERR_OR_NULL(blit.ion))
+		ion_client_destroy(blit.ion);
+	memset(&blit.bv, 0, sizeof(blit.bv));
+	blit.wq = NULL;
+	blit.timeline = NULL;
+	blit.ion = NULL;
+	blit.w = blit.h = 0;
+}
@@ -34,6 +34,7 @@
 #include <linux/uaccess.h>
 #include <linux/sched.h>
 #include <linux/syscalls.h>
+#include <linux/sync.h>
 
 #define MODULE_NAME_DSSCOMP	"dsscomp"
 
@@ -286,12 +287,12 @@ static long setup_mgr(struct dsscomp_dev *cdev,
 	if (d->mode & DSSCOMP_SETUP_APPLY)
 		r = dsscomp_delayed_apply(comp);
 
-	/* delete sync object if failed to apply or create file */
-	if (sync) {
+	/*
+	 * delete sync object if failed to apply or create file; a failed
+	 * composition still drops its own reference
+	 */
+	if (sync)
 		r = sync_finalize(sync, r);
-		if (r < 0)
-			sync_drop(sync);
-	}
 	return r;
 }
 
@@ -550,6 +551,118 @@ static void fill_platform_info(struct dsscomp_dev *cdev)
 						DSSCOMP_FBMEM_VRAM;
 }
 
+/* get the sync fences of @n fds, where -1 is none */
+static int get_fences(struct sync_fence **fences, const __s32 *fds, int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++) {
+		fences[i] = NULL;
+		if (fds[i] < 0)
+			continue;
+
+		fences[i] = sync_fence_fdget(fds[i]);
+		if (!fences[i]) {
+			while (i--)
+				if (fences[i])
+					sync_fence_put(fences[i]);
+			return -EBADF;
+		}
+	}
+	return 0;
+}
+
+/* install @n fences as new fds, where -1 is none */
+static int install_fences(__s32 *fds, struct sync_fence **fences, int n)
+{
+	int i, fd, r = 0;
+
+	for (i = 0; i < n; i++) {
+		fds[i] = -1;
+		if (!fences[i])
+			continue;
+
+		fd = get_unused_fd();
+		if (fd < 0) {
+			sync_fence_put(fences[i]);
+			r = r ? : fd;
+			continue;
+		}
+		sync_fence_install(fences[i], fd);
+		fds[i] = fd;
+	}
+	return r;
+}
+
+static long setup_dispc_fences(struct dsscomp_setup_dispc_fences_data *f,
+			       void __user *ptr)
+{
+	struct sync_fence *acquire[ARRAY_SIZE(f->acquire_fd)];
+	struct sync_fence *release[ARRAY_SIZE(f->release_fd)] = { NULL };
+	int n = min_t(u16, f->dispc.num_ovls, ARRAY_SIZE(f->dispc.ovls));
+	long r, err;
+
+	r = get_fences(acquire, f->acquire_fd, n);
+	if (r)
+		return r;
+
+	/* this takes over the acquire fences */
+	r = dsscomp_gralloc_queue_ioctl(&f->dispc, acquire, release, 0);
+
+	err = install_fences(f->release_fd, release, ARRAY_SIZE(release));
+	if (copy_to_user(ptr + offsetof(typeof(*f), release_fd),
+			 f->release_fd, sizeof(f->release_fd)))
+		err = -EFAULT;
+	return r ? : err;
+}
+
+#ifdef CONFIG_DSSCOMP_BLIT
+static long setup_dispc_blit(struct dsscomp_setup_dispc_blit_data *b,
+			     void __user *ptr)
+{
+	struct dsscomp_setup_dispc_fences_data *f = &b->fdispc;
+	struct sync_fence *acquire[ARRAY_SIZE(f->acquire_fd)];
+	struct sync_fence *release[ARRAY_SIZE(f->release_fd)] = { NULL };
+	struct sync_fence *blit_acquire[DSSCOMP_MAX_BLITS];
+	struct sync_fence *blit_release[DSSCOMP_MAX_BLITS] = { NULL };
+	__s32 fds[DSSCOMP_MAX_BLITS];
+	int n = min_t(u16, f->dispc.num_ovls, ARRAY_SIZE(f->dispc.ovls));
+	int nb = min_t(u16, b->num_blits, DSSCOMP_MAX_BLITS);
+	int i;
+	long r, err;
+
+	for (i = 0; i < nb; i++)
+		fds[i] = b->blits[i].acquire_fd;
+
+	r = get_fences(acquire, f->acquire_fd, n);
+	if (r)
+		return r;
+	r = get_fences(blit_acquire, fds, nb);
+	if (r) {
+		for (i = 0; i < n; i++)
+			if (acquire[i])
+				sync_fence_put(acquire[i]);
+		return r;
+	}
+
+	/* this takes over the acquire fences */
+	r = dsscomp_blit_queue(b, acquire, release, blit_acquire,
+			       blit_release);
+
+	err = install_fences(f->release_fd, release, ARRAY_SIZE(release));
+	err = install_fences(fds, blit_release, nb) ? : err;
+	for (i = 0; i < nb; i++)
+		b->blits[i].release_fd = fds[i];
+
+	if (copy_to_user(ptr + offsetof(typeof(*b), fdispc.release_fd),
+			 f->release_fd, sizeof(f->release_fd)) ||
+	    copy_to_user(ptr + offsetof(typeof(*b), blits),
+			 b->blits, sizeof(*b->blits) * nb))
+		err = -EFAULT;
+	return r ? : err;
+}
+#endif
+
 static long comp_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 {
 	int r = 0;
@@ -563,6 +676,7 @@ static long comp_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 			struct dss2_ovl_info ovl[MAX_OVERLAYS];
 		} m;
 		struct dsscomp_setup_dispc_data dispc;
+		struct dsscomp_setup_dispc_fences_data fdispc;
 		struct dsscomp_display_info dis;
 		struct dsscomp_check_ovl_data chk;
 		struct dsscomp_setup_display_data sdis;
@@ -584,9 +698,29 @@ static long comp_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 	case DSSCIOC_SETUP_DISPC:
 	{
 		r = copy_from_user(&u.dispc, ptr, sizeof(u.dispc)) ? :
-		    dsscomp_gralloc_queue_ioctl(&u.dispc);
+		    dsscomp_gralloc_queue_ioctl(&u.dispc, NULL, NULL);
 		break;
 	}
+	case DSSCIOC_SETUP_DISPC_FENCES:
+	{
+		r = copy_from_user(&u.fdispc, ptr, sizeof(u.fdispc)) ? :
+		    setup_dispc_fences(&u.fdispc, ptr);
+		break;
+	}
+#ifdef CONFIG_DSSCOMP_BLIT
+	case DSSCIOC_SETUP_DISPC_BLIT:
+	{
+		/* too big for the stack */
+		struct dsscomp_setup_dispc_blit_data *b;
+
+		b = kmalloc(sizeof(*b), GFP_KERNEL);
+		r = !b ? -ENOMEM :
+		    copy_from_user(b, ptr, sizeof(*b)) ? :
+		    setup_dispc_blit(b, ptr);
+		kfree(b);
+		break;
+	}
+#endif
 	case DSSCIOC_QUERY_DISPLAY:
 	{
 		struct dsscomp_display_info *dis = NULL;
@@ -724,6 +858,12 @@ static int dsscomp_probe(struct platform_device *pdev)
 	} else {
 		debugfs_create_file("comps", S_IRUGO,
 			cdev->dbgfs, dsscomp_dbg_comps, &dsscomp_debug_fops);
+		debugfs_create_file("latency", S_IRUGO,
+			cdev->dbgfs, dsscomp_dbg_latency, &dsscomp_debug_fops);
+#ifdef CONFIG_DSSCOMP_BLIT
+		debugfs_create_file("blit", S_IRUGO,
+			cdev->dbgfs, dsscomp_dbg_blit, &dsscomp_debug_fops);
+#endif
 		debugfs_create_file("gralloc", S_IRUGO,
 			cdev->dbgfs, dsscomp_dbg_gralloc, &dsscomp_debug_fops);
 #ifdef CONFIG_DSSCOMP_DEBUG_LOG
@@ -743,6 +883,8 @@ static int dsscomp_probe(struct platform_device *pdev)
 	/* initialize queues */
 	dsscomp_queue_init(cdev);
 	dsscomp_gralloc_init(cdev);
+	if (dsscomp_blit_init(cdev))
+		dev_info(DEV(cdev), "no 2D blitter for composition\n");
 
 	return 0;
 }
@@ -752,6 +894,7 @@ static int dsscomp_remove(struct platform_device *pdev)
 	struct dsscomp_dev *cdev = platform_get_drvdata(pdev);
 	misc_deregister(&cdev->dev);
 	debugfs_remove_recursive(cdev->dbgfs);
+	dsscomp_blit_exit();
 	dsscomp_queue_exit();
 	dsscomp_gralloc_exit();
 	kfree(cdev);
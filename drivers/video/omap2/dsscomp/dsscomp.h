@@ -25,6 +25,7 @@
 #include <linux/miscdevice.h>
 #include <linux/debugfs.h>
 #include <linux/seq_file.h>
+#include <linux/ktime.h>
 #ifdef CONFIG_DSSCOMP_DEBUG_LOG
 #include <linux/hrtimer.h>
 #endif
@@ -33,6 +34,9 @@
 #define MAX_MANAGERS	3
 #define MAX_DISPLAYS	4
 
+/* compositions waiting to be applied per manager, must be a power of 2 */
+#define DSSCOMP_QUEUE_SIZE	8
+
 #define FULLHD_RESOLUTION (1920 * 1080)
 
 #define DEBUG_OVERLAYS		(1 << 0)
@@ -93,6 +97,8 @@ enum dsscomp_state {
 	DSSCOMP_STATE_DISPLAYED		= 0xD15504CA,
 };
 
+struct sync_fence;
+
 struct dsscomp {
 	enum dsscomp_state state;
 	/*
@@ -116,6 +122,14 @@ struct dsscomp {
 	void *extra_cb_data;
 	bool must_apply;	/* whether composition must be applied */
 
+	/* order on the queue of its manager, 0 if not queued */
+	u32 seq;
+	/* when it was queued, latched by GO and first displayed */
+	ktime_t t_queued, t_programmed, t_displayed;
+
+	/* fences to wait on before reading the buffer of each overlay */
+	struct sync_fence *acquire[MAX_OVERLAYS];
+
 #ifdef CONFIG_DEBUG_FS
 	struct list_head dbg_q;
 	u32 dbg_used;
@@ -138,12 +152,31 @@ int dsscomp_queue_init(struct dsscomp_dev *cdev);
 void dsscomp_queue_exit(void);
 void dsscomp_gralloc_init(struct dsscomp_dev *cdev);
 void dsscomp_gralloc_exit(void);
-int dsscomp_gralloc_queue_ioctl(struct dsscomp_setup_dispc_data *d);
+int dsscomp_gralloc_queue_ioctl(struct dsscomp_setup_dispc_data *d,
+				struct sync_fence **acquire,
+				struct sync_fence **release,
+				u32 phys_mask);
 int dsscomp_wait(struct dsscomp_sync_obj *sync, enum dsscomp_wait_phase phase,
 								int timeout);
 int dsscomp_state_notifier(struct notifier_block *nb,
 						unsigned long arg, void *ptr);
 
+#ifdef CONFIG_DSSCOMP_BLIT
+int dsscomp_blit_init(struct dsscomp_dev *cdev);
+void dsscomp_blit_exit(void);
+int dsscomp_blit_queue(struct dsscomp_setup_dispc_blit_data *b,
+		       struct sync_fence **ovl_acquire,
+		       struct sync_fence **ovl_release,
+		       struct sync_fence **blit_acquire,
+		       struct sync_fence **blit_release);
+#else
+static inline int dsscomp_blit_init(struct dsscomp_dev *cdev)
+{
+	return -ENODEV;
+}
+static inline void dsscomp_blit_exit(void) {}
+#endif
+
 /* basic operation - if not using queues */
 int set_dss_ovl_info(struct dss2_ovl_info *oi);
 int set_dss_wb_info(struct dss2_ovl_info *oi);
@@ -173,6 +206,8 @@ void dump_total_comp_info(struct dsscomp_dev *cdev,
 const char *dsscomp_get_color_name(enum omap_color_mode m);
 
 void dsscomp_dbg_comps(struct seq_file *s);
+void dsscomp_dbg_latency(struct seq_file *s);
+void dsscomp_dbg_blit(struct seq_file *s);
 void dsscomp_dbg_gralloc(struct seq_file *s);
 
 #define log_state_str(s) (\
@@ -23,6 +23,7 @@
 #include <linux/slab.h>
 #include <linux/sched.h>
 #include <linux/vmalloc.h>
+#include <linux/sync.h>
 #include "../../../drivers/staging/omapdrm/omap_dmm_tiler.h"
 #include <video/dsscomp.h>
 #include <plat/dsscomp.h>
@@ -170,7 +171,10 @@ static void dsscomp_gralloc_cb(void *data, int status)
 /* This is just test code for now that does the setup + apply.
    It still uses userspace virtual addresses, but maps non
    TILER buffers into 1D */
-int dsscomp_gralloc_queue_ioctl(struct dsscomp_setup_dispc_data *d)
+int dsscomp_gralloc_queue_ioctl(struct dsscomp_setup_dispc_data *d,
+				struct sync_fence **acquire,
+				struct sync_fence **release,
+				u32 phys_mask)
 {
 	struct tiler_pa_info *pas[MAX_OVERLAYS];
 	s32 ret;
@@ -183,6 +187,10 @@ int dsscomp_gralloc_queue_ioctl(struct dsscomp_setup_dispc_data *d)
 
 		pas[i] = NULL;
 
+		/* already set up by the kernel, e.g. a blit buffer */
+		if (phys_mask & (1 << i))
+			continue;
+
 		/* only supporting DIRECT buffer types */
 
 		/* assume virtual NV12 for now */
@@ -199,7 +207,8 @@ int dsscomp_gralloc_queue_ioctl(struct dsscomp_setup_dispc_data *d)
 				PAGE_ALIGN(oi->cfg.height * oi->cfg.stride +
 					(addr & ~PAGE_MASK)) >> PAGE_SHIFT);
 	}
-	ret = dsscomp_gralloc_queue(d, pas, false, NULL, NULL);
+	ret = dsscomp_gralloc_queue_sync(d, pas, acquire, release, false,
+					 NULL, NULL);
 	for (i = 0; i < d->num_ovls; i++)
 		tiler_pa_free(pas[i]);
 	return ret;
@@ -348,8 +357,17 @@ bool dsscomp_check_mflag(struct dsscomp_setup_dispc_data *d)
 	return true;
 }
 
-int dsscomp_gralloc_queue(struct dsscomp_setup_dispc_data *d,
+/*
+ * Queue a gralloc composition.  If @acquire is not NULL, acquire[i] is a
+ * fence to wait on before DISPC reads the buffer of layer i (or NULL);
+ * the references are always taken over.  If @release is not NULL,
+ * release[i] returns a fence that signals once DISPC no longer reads the
+ * buffer of layer i, or NULL if the layer was not queued.
+ */
+int dsscomp_gralloc_queue_sync(struct dsscomp_setup_dispc_data *d,
 			struct tiler_pa_info **pas,
+			struct sync_fence **acquire,
+			struct sync_fence **release,
 			bool early_callback,
 			void (*cb_fn)(void *, int), void *cb_arg)
 {
@@ -368,6 +386,8 @@ int dsscomp_gralloc_queue(struct dsscomp_setup_dispc_data *d,
 	u32 ms = ktime_to_ms(ktime_get());
 #endif
 	u32 channels[MAX_MANAGERS], ch;
+	struct sync_fence *rel[MAX_MANAGERS];
+	s8 layer_ch[ARRAY_SIZE(d->ovls)];
 	int skip;
 	struct dsscomp_gralloc_t *gsync;
 	struct dss2_rect_t win = { .w = 0 };
@@ -420,6 +440,8 @@ int dsscomp_gralloc_queue(struct dsscomp_setup_dispc_data *d,
 
 	memset(comp, 0, sizeof(comp));
 	memset(ovl_new_use_mask, 0, sizeof(ovl_new_use_mask));
+	memset(rel, 0, sizeof(rel));
+	memset(layer_ch, -1, sizeof(layer_ch));
 
 	if (skip || !dsscomp_is_any_device_active())
 		goto skip_comp;
@@ -641,11 +663,19 @@ skip_map1d:
 		oi->cfg.mflag_en = use_mflag;
 
 		r = dsscomp_set_ovl(comp[ch], oi);
-		if (r)
+		if (r) {
 			dev_err(DEV(cdev), "failed to set ovl%d (%d)\n",
 					oi->cfg.ix, r);
-		else
-			ovl_set_mask |= 1 << oi->cfg.ix;
+			continue;
+		}
+		ovl_set_mask |= 1 << oi->cfg.ix;
+		layer_ch[i] = ch;
+
+		/* the composition waits for the buffer before applying */
+		if (acquire && acquire[i] && !comp[ch]->acquire[oi->cfg.ix]) {
+			comp[ch]->acquire[oi->cfg.ix] = acquire[i];
+			acquire[i] = NULL;
+		}
 	}
 
 	if (slot && slot_used) {
@@ -710,13 +740,31 @@ skip_map1d:
 			continue;
 		}
 
-		r = dsscomp_delayed_apply(comp[ch]);
+		r = dsscomp_delayed_apply_sync(comp[ch],
+					       release ? &rel[ch] : NULL);
 		if (r)
 			dev_err(DEV(cdev), "failed to apply comp (%d)\n", r);
 		else
 			ovl_use_mask[ch] = ovl_new_use_mask[ch];
 	}
 skip_comp:
+	/* give each layer a fence of its own for its composition */
+	for (i = 0; release && i < d->num_ovls; i++) {
+		release[i] = NULL;
+		if (layer_ch[i] >= 0 && rel[layer_ch[i]])
+			release[i] = sync_fence_merge("dsscomp",
+						      rel[layer_ch[i]],
+						      rel[layer_ch[i]]);
+	}
+	for (ch = 0; ch < MAX_MANAGERS; ch++)
+		if (rel[ch])
+			sync_fence_put(rel[ch]);
+
+	/* drop the fences of layers that were not queued */
+	for (i = 0; acquire && i < d->num_ovls; i++)
+		if (acquire[i])
+			sync_fence_put(acquire[i]);
+
 	/* release sync object ref - this completes unapplied compositions */
 	dsscomp_gralloc_cb(gsync, DSS_COMPLETION_RELEASED);
 
@@ -724,6 +772,16 @@ skip_comp:
 
 	return r;
 }
+EXPORT_SYMBOL(dsscomp_gralloc_queue_sync);
+
+int dsscomp_gralloc_queue(struct dsscomp_setup_dispc_data *d,
+			struct tiler_pa_info **pas,
+			bool early_callback,
+			void (*cb_fn)(void *, int), void *cb_arg)
+{
+	return dsscomp_gralloc_queue_sync(d, pas, NULL, NULL, early_callback,
+					  cb_fn, cb_arg);
+}
 EXPORT_SYMBOL(dsscomp_gralloc_queue);
 
 #ifdef CONFIG_EARLYSUSPEND
@@ -24,6 +24,10 @@
 #include <linux/sched.h>
 #include <linux/slab.h>
 #include <linux/ratelimit.h>
+#include <linux/circ_buf.h>
+#include <linux/wait.h>
+#include <linux/sync.h>
+#include <linux/sw_sync.h>
 
 #include <video/omapdss.h>
 #include <video/dsscomp.h>
@@ -35,6 +39,9 @@
 #include "dsscomp.h"
 /* queue state */
 
+/* how long the apply worker waits for a buffer to be ready */
+#define DSSCOMP_ACQUIRE_TIMEOUT_MS	1000
+
 struct pm_qos_request req;
 static DEFINE_MUTEX(mtx);
 
@@ -44,8 +51,46 @@ struct maskref {
 	u32 refs[MAX_OVERLAYS];
 };
 
-static struct {
+static struct mgr_queue {
 	struct workqueue_struct *apply_workq;
+	struct work_struct apply_work;
+
+	/*
+	 * Compositions waiting to be applied.  Producers are serialized by
+	 * mtx, the apply worker is the only consumer and does not lock.
+	 */
+	struct dsscomp *ring[DSSCOMP_QUEUE_SIZE];
+	unsigned long head, tail;
+
+	/*
+	 * Sequence number of the last composition queued, and of the last
+	 * one that reached each dsscomp_wait_phase.  Updated from the DSS
+	 * interrupt under seq_lock.
+	 */
+	u32 seq_queued;
+	u32 seq_done[DSSCOMP_WAIT_RELEASED + 1];
+	spinlock_t seq_lock;
+
+	/*
+	 * Compositions past seq_done[DSSCOMP_WAIT_RELEASED] that are already
+	 * released, bit 0 being the next one.  Superseded or failed ones are
+	 * released ahead of those still on screen, and the release point only
+	 * moves over a contiguous run.
+	 */
+	u64 released;
+
+	/* follows seq_done[DSSCOMP_WAIT_RELEASED], for release fences */
+	struct sw_sync_timeline *timeline;
+
+	/* latency statistics, under seq_lock */
+	struct {
+		u32 displayed;		/* compositions displayed */
+		u32 skipped;		/* superseded before being applied */
+		u64 program_us;		/* total time from queue to GO latch */
+		u64 display_us;		/* total time from queue to display */
+		u32 last_program_us, last_display_us;
+		u32 max_display_us;
+	} stats;
 
 	u32 ovl_mask;			/* overlays used on this display */
 	struct maskref ovl_qmask;	/* overlays queued to this display */
@@ -101,6 +146,8 @@ static void maskref_decmask(struct maskref *om, u32 mask)
  * ===========================================================================
  */
 
+static void dsscomp_apply_worker(struct work_struct *work);
+
 /* Initialize queue structures, and set up state of the displays */
 int dsscomp_queue_init(struct dsscomp_dev *cdev_)
 {
@@ -117,6 +164,8 @@ int dsscomp_queue_init(struct dsscomp_dev *cdev_)
 			create_singlethread_workqueue("dsscomp_apply");
 		if (!mgrq[i].apply_workq)
 			goto error;
+		INIT_WORK(&mgrq[i].apply_work, dsscomp_apply_worker);
+		spin_lock_init(&mgrq[i].seq_lock);
 
 		/* record overlays on this display */
 		mgr = cdev->mgrs[i];
@@ -129,6 +178,12 @@ int dsscomp_queue_init(struct dsscomp_dev *cdev_)
 		if (cdev->wb_ovl && cdev->wb_ovl->info.enabled &&
 			mgr && (cdev->wb_ovl->info.source == (int)mgr->id))
 				mgrq[i].ovl_mask |= 1 << OMAP_DSS_WB;
+
+		/* without a timeline there are no release fences */
+		mgrq[i].timeline = sw_sync_timeline_create(mgr ? mgr->name :
+							   "dsscomp");
+		if (!mgrq[i].timeline)
+			dev_warn(DEV(cdev), "no release timeline for mgr%d\n", i);
 	}
 
 	cb_wkq = create_singlethread_workqueue("dsscomp_cb");
@@ -137,8 +192,11 @@ int dsscomp_queue_init(struct dsscomp_dev *cdev_)
 
 	return 0;
 error:
-	while (i--)
+	while (i--) {
 		destroy_workqueue(mgrq[i].apply_workq);
+		if (mgrq[i].timeline)
+			sync_timeline_destroy(&mgrq[i].timeline->obj);
+	}
 	return -ENOMEM;
 }
 
@@ -365,11 +423,18 @@ EXPORT_SYMBOL(dsscomp_setup);
  */
 void dsscomp_drop(struct dsscomp *comp)
 {
+	int i;
+
 	/* decrement unprogrammed references */
 	if (comp->state < DSSCOMP_STATE_PROGRAMMED)
 		maskref_decmask(&mgrq[comp->ix].ovl_qmask, comp->ovl_mask);
 	comp->state = 0;
 
+	/* fences of compositions that were never applied */
+	for (i = 0; i < ARRAY_SIZE(comp->acquire); i++)
+		if (comp->acquire[i])
+			sync_fence_put(comp->acquire[i]);
+
 	if (debug & DEBUG_COMPOSITIONS)
 		dev_info(DEV(cdev), "[%p] released\n", comp);
 
@@ -431,10 +496,97 @@ static void dsscomp_mgr_delayed_cb(struct work_struct *work)
 	mutex_unlock(&mtx);
 }
 
+static inline void seq_advance(u32 *done, u32 seq)
+{
+	if ((s32)(seq - *done) > 0)
+		*done = seq;
+}
+
+/* sequence numbers skip 0, which means not queued */
+static inline u32 seq_next(u32 seq)
+{
+	return seq + 1 ? : 1;
+}
+
+/* called with seq_lock held */
+static void seq_release(struct mgr_queue *mq, u32 seq)
+{
+	u32 *done = &mq->seq_done[DSSCOMP_WAIT_RELEASED];
+	u32 off = seq - *done - 1;
+
+	if ((s32)(seq - *done) <= 0)
+		return;
+	if (seq < *done)
+		off--;
+	/* no more than the queue and the overlays can be outstanding */
+	if (WARN_ON_ONCE(off >= 64))
+		return;
+
+	mq->released |= 1ULL << off;
+	while (mq->released & 1) {
+		mq->released >>= 1;
+		*done = seq_next(*done);
+	}
+}
+
+/*
+ * Record when a queued composition reaches a phase.  Runs from the DSS
+ * interrupt, so that release fences and the timestamps do not include the
+ * callback work queue.  A composition that is released before being
+ * programmed will never be shown, so it completes every phase.
+ */
+static void dsscomp_signal(struct dsscomp *comp, int status)
+{
+	struct mgr_queue *mq = &mgrq[comp->ix];
+	ktime_t now = ktime_get();
+	unsigned long flags;
+	u32 us;
+
+	if (!comp->seq)
+		return;
+
+	spin_lock_irqsave(&mq->seq_lock, flags);
+
+	if (status == DSS_COMPLETION_PROGRAMMED &&
+	    !comp->t_programmed.tv64) {
+		comp->t_programmed = now;
+		us = ktime_us_delta(now, comp->t_queued);
+		mq->stats.program_us += us;
+		mq->stats.last_program_us = us;
+		seq_advance(&mq->seq_done[DSSCOMP_WAIT_PROGRAMMED], comp->seq);
+	} else if (status == DSS_COMPLETION_DISPLAYED &&
+		   !comp->t_displayed.tv64) {
+		comp->t_displayed = now;
+		us = ktime_us_delta(now, comp->t_queued);
+		mq->stats.displayed++;
+		mq->stats.display_us += us;
+		mq->stats.last_display_us = us;
+		mq->stats.max_display_us = max(mq->stats.max_display_us, us);
+		seq_advance(&mq->seq_done[DSSCOMP_WAIT_DISPLAYED], comp->seq);
+	} else if (status & DSS_COMPLETION_RELEASED) {
+		if (!comp->t_programmed.tv64) {
+			seq_advance(&mq->seq_done[DSSCOMP_WAIT_PROGRAMMED],
+				    comp->seq);
+			seq_advance(&mq->seq_done[DSSCOMP_WAIT_DISPLAYED],
+				    comp->seq);
+		}
+		seq_release(mq, comp->seq);
+		if (mq->timeline &&
+		    mq->timeline->value != mq->seq_done[DSSCOMP_WAIT_RELEASED])
+			sw_sync_timeline_inc(mq->timeline,
+				mq->seq_done[DSSCOMP_WAIT_RELEASED] -
+				mq->timeline->value);
+	}
+
+	spin_unlock_irqrestore(&mq->seq_lock, flags);
+}
+
 u32 dsscomp_mgr_callback(void *data, int id, int status)
 {
 	struct dsscomp *comp = data;
 
+	dsscomp_signal(comp, status);
+
 	if (status == DSS_COMPLETION_PROGRAMMED ||
 	    (status == DSS_COMPLETION_DISPLAYED &&
 	     comp->state != DSSCOMP_STATE_DISPLAYED) ||
@@ -788,11 +940,8 @@ skip_ovl_set:
 		else {
 			/* wait for sync to do smooth animations */
 			mgr->wait_for_vsync(mgr);
-			/* Release OPP constraint on CORE when it posible */
-			if (!omap_dss_overlay_ensure_bw())
-				dss_tput_request(PM_QOS_MEMORY_THROUGHPUT_DEFAULT_VALUE);
-			else
-				dss_tput_request(PM_QOS_MEMORY_THROUGHPUT_HIGH_VALUE);
+			/* new settings are on screen, drop what they free */
+			dss_tput_release();
 		}
 	}
 
@@ -804,11 +953,6 @@ done:
 }
 EXPORT_SYMBOL(dsscomp_apply);
 
-struct dsscomp_apply_work {
-	struct work_struct work;
-	struct dsscomp *comp;
-};
-
 int dsscomp_state_notifier(struct notifier_block *nb,
 						unsigned long arg, void *ptr)
 {
@@ -829,35 +973,190 @@ int dsscomp_state_notifier(struct notifier_block *nb,
 }
 
 
-static void dsscomp_do_apply(struct work_struct *work)
+/*
+ * A composition still waiting to be applied can be skipped if the next one
+ * on the same manager sets up all of its overlays, as nothing of it would
+ * stay on screen.  Writeback and manually updated displays always get
+ * every composition, since their output is consumed frame by frame.
+ */
+static bool dsscomp_superseded(struct dsscomp *comp, struct dsscomp *next)
 {
-	struct dsscomp_apply_work *wk = container_of(work, typeof(*wk), work);
-	/* complete compositions that failed to apply */
-	if (dsscomp_apply(wk->comp))
-		dsscomp_mgr_callback(wk->comp, -1, DSS_COMPLETION_ECLIPSED_SET);
-	kfree(wk);
+	struct omap_overlay_manager *mgr = cdev->mgrs[comp->ix];
+
+	if (!mgr->device || dssdev_manually_updated(mgr->device))
+		return false;
+
+	if ((comp->frm.mode | next->frm.mode) & DSSCOMP_SETUP_MODE_CAPTURE ||
+	    (comp->ovl_mask | next->ovl_mask) & (1 << OMAP_DSS_WB))
+		return false;
+
+	return comp->frm.mode == next->frm.mode &&
+		!(comp->ovl_mask & ~next->ovl_mask);
 }
 
-int dsscomp_delayed_apply(struct dsscomp *comp)
+/*
+ * Wait until the buffers of a composition are ready to be read.  A buffer
+ * that never becomes ready fails the composition, so that it is released
+ * (and its release fences signal) without being displayed.
+ */
+static int dsscomp_wait_acquire(struct dsscomp *comp)
 {
-	/* don't block in case we are called from interrupt context */
-	struct dsscomp_apply_work *wk = kzalloc(sizeof(*wk), GFP_NOWAIT);
-	if (!wk)
-		return -ENOMEM;
+	int i, r = 0;
+
+	for (i = 0; i < ARRAY_SIZE(comp->acquire); i++) {
+		if (!comp->acquire[i])
+			continue;
+		if (!r) {
+			r = sync_fence_wait(comp->acquire[i],
+					    DSSCOMP_ACQUIRE_TIMEOUT_MS);
+			if (r)
+				dev_err(DEV(cdev), "[%p] ovl%d not ready (%d)\n",
+					comp, i, r);
+		}
+		sync_fence_put(comp->acquire[i]);
+		comp->acquire[i] = NULL;
+	}
+
+	return r;
+}
+
+/*
+ * Apply the queued compositions of a manager in order.  dsscomp_apply()
+ * waits for the vsync of each one it displays, so when frames come in
+ * faster than that, the ones already superseded are released rather than
+ * each costing a vsync of their own.
+ */
+static void dsscomp_apply_worker(struct work_struct *work)
+{
+	struct mgr_queue *mq = container_of(work, struct mgr_queue,
+					    apply_work);
+	struct dsscomp *comp, *next;
+	unsigned long head, tail, flags;
+
+	for (;;) {
+		head = ACCESS_ONCE(mq->head);
+		tail = mq->tail;
+		if (!CIRC_CNT(head, tail, DSSCOMP_QUEUE_SIZE))
+			break;
+
+		/* read the entries only after seeing the head */
+		smp_rmb();
+		comp = mq->ring[tail];
+		next = NULL;
+		if (CIRC_CNT(head, tail, DSSCOMP_QUEUE_SIZE) > 1)
+			next = mq->ring[(tail + 1) & (DSSCOMP_QUEUE_SIZE - 1)];
+
+		/* finish reading the entry before it can be reused */
+		smp_mb();
+		mq->tail = (tail + 1) & (DSSCOMP_QUEUE_SIZE - 1);
+
+		if (next && dsscomp_superseded(comp, next)) {
+			spin_lock_irqsave(&mq->seq_lock, flags);
+			mq->stats.skipped++;
+			spin_unlock_irqrestore(&mq->seq_lock, flags);
+
+			if (debug & DEBUG_PHASES)
+				dev_info(DEV(cdev), "[%p] superseded\n", comp);
+			dsscomp_mgr_callback(comp, -1,
+					     DSS_COMPLETION_ECLIPSED_SET);
+			continue;
+		}
+
+		/* complete compositions that failed to apply */
+		if (dsscomp_wait_acquire(comp) || dsscomp_apply(comp))
+			dsscomp_mgr_callback(comp, -1,
+					     DSS_COMPLETION_ECLIPSED_SET);
+	}
+}
+
+/* check that the display of a composition can take it before queuing */
+static int dsscomp_validate(struct dsscomp *comp)
+{
+	u32 display_ix = comp->frm.mgr.ix;
+	struct omap_dss_device *dssdev;
+
+	if (display_ix >= cdev->num_displays)
+		return -ENODEV;
+	dssdev = cdev->displays[display_ix];
+	if (!dssdev || !dssdev->driver || !dssdev->manager ||
+	    dssdev->manager->id >= cdev->num_mgrs)
+		return -ENODEV;
+
+	return 0;
+}
+
+/*
+ * Queue a composition, and if @release is not NULL, also return a fence
+ * that signals once the composition is released, i.e. DISPC no longer
+ * reads any of its buffers.  *@release is NULL if there is no timeline.
+ * The fence must be made before the composition is on the queue, as it
+ * can be released (and freed) right after.
+ */
+int dsscomp_delayed_apply_sync(struct dsscomp *comp,
+			       struct sync_fence **release)
+{
+	struct mgr_queue *mq = &mgrq[comp->ix];
+	unsigned long head, flags;
+	struct sync_pt *pt;
+	int r;
+
+	if (release)
+		*release = NULL;
+
+	r = dsscomp_validate(comp);
 
 	mutex_lock(&mtx);
 
 	BUG_ON(comp->state != DSSCOMP_STATE_ACTIVE);
+
+	head = mq->head;
+	if (!r && !CIRC_SPACE(head, ACCESS_ONCE(mq->tail), DSSCOMP_QUEUE_SIZE))
+		r = -EBUSY;
+
 	comp->state = DSSCOMP_STATE_APPLYING;
 	log_state(comp, dsscomp_delayed_apply, 0);
 
+	/* complete it unapplied, which runs its callbacks and drops it */
+	if (r) {
+		mutex_unlock(&mtx);
+		dsscomp_mgr_callback(comp, -1, DSS_COMPLETION_ECLIPSED_SET);
+		return r;
+	}
+
 	if (debug & DEBUG_PHASES)
 		dev_info(DEV(cdev), "[%p] applying\n", comp);
+
+	/* 0 means not queued */
+	spin_lock_irqsave(&mq->seq_lock, flags);
+	mq->seq_queued = seq_next(mq->seq_queued);
+	comp->seq = mq->seq_queued;
+	spin_unlock_irqrestore(&mq->seq_lock, flags);
+	comp->t_queued = ktime_get();
+
+	if (release && mq->timeline) {
+		pt = sw_sync_pt_create(mq->timeline, comp->seq);
+		if (pt) {
+			*release = sync_fence_create("dsscomp", pt);
+			if (!*release)
+				sync_pt_free(pt);
+		}
+	}
+
+	mq->ring[head] = comp;
+	/* commit the entry before moving the head */
+	smp_wmb();
+	mq->head = (head + 1) & (DSSCOMP_QUEUE_SIZE - 1);
+
 	mutex_unlock(&mtx);
 
-	wk->comp = comp;
-	INIT_WORK(&wk->work, dsscomp_do_apply);
-	return queue_work(mgrq[comp->ix].apply_workq, &wk->work) ? 0 : -EBUSY;
+	queue_work(mq->apply_workq, &mq->apply_work);
+	return 0;
+}
+EXPORT_SYMBOL(dsscomp_delayed_apply_sync);
+
+int dsscomp_delayed_apply(struct dsscomp *comp)
+{
+	return dsscomp_delayed_apply_sync(comp, NULL);
 }
 EXPORT_SYMBOL(dsscomp_delayed_apply);
 
@@ -949,6 +1248,41 @@ void dsscomp_dbg_comps(struct seq_file *s)
 #endif
 }
 
+void dsscomp_dbg_latency(struct seq_file *s)
+{
+	struct mgr_queue *mq;
+	unsigned long flags;
+	u32 i, queued, done[DSSCOMP_WAIT_RELEASED + 1];
+	typeof(mq->stats) st;
+
+	for (i = 0; i < cdev->num_mgrs; i++) {
+		mq = &mgrq[i];
+
+		spin_lock_irqsave(&mq->seq_lock, flags);
+		st = mq->stats;
+		queued = mq->seq_queued;
+		memcpy(done, mq->seq_done, sizeof(done));
+		spin_unlock_irqrestore(&mq->seq_lock, flags);
+
+		seq_printf(s, "%s: queued %u programmed %u displayed %u "
+			   "released %u\n", cdev->mgrs[i]->name, queued,
+			   done[DSSCOMP_WAIT_PROGRAMMED],
+			   done[DSSCOMP_WAIT_DISPLAYED],
+			   done[DSSCOMP_WAIT_RELEASED]);
+		seq_printf(s, "  displayed %u skipped %u\n",
+			   st.displayed, st.skipped);
+		if (!st.displayed)
+			continue;
+		seq_printf(s, "  queue to program: last %u us avg %llu us\n",
+			   st.last_program_us,
+			   div_u64(st.program_us, st.displayed));
+		seq_printf(s, "  queue to display: last %u us avg %llu us "
+			   "max %u us\n", st.last_display_us,
+			   div_u64(st.display_us, st.displayed),
+			   st.max_display_us);
+	}
+}
+
 void dsscomp_dbg_events(struct seq_file *s)
 {
 #ifdef CONFIG_DSSCOMP_DEBUG_LOG
@@ -980,8 +1314,13 @@ void dsscomp_queue_exit(void)
 {
 	if (cdev) {
 		int i;
-		for (i = 0; i < cdev->num_displays; i++)
+		for (i = 0; i < cdev->num_mgrs; i++) {
+			/* the worker empties the queue before it is gone */
+			flush_work_sync(&mgrq[i].apply_work);
 			destroy_workqueue(mgrq[i].apply_workq);
+			if (mgrq[i].timeline)
+				sync_timeline_destroy(&mgrq[i].timeline->obj);
+		}
 		destroy_workqueue(cb_wkq);
 		cdev = NULL;
 	}
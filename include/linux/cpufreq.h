@@ -31,6 +31,7 @@
 
 #define CPUFREQ_TRANSITION_NOTIFIER	(0)
 #define CPUFREQ_POLICY_NOTIFIER		(1)
+#define CPUFREQ_BOOST_NOTIFIER		(2)
 
 #ifdef CONFIG_CPU_FREQ
 int cpufreq_register_notifier(struct notifier_block *nb, unsigned int list);
@@ -134,6 +135,16 @@ struct cpufreq_freqs {
 	u8 flags;		/* flags of cpufreq_driver, see below. */
 };
 
+/********************** cpufreq boost notifiers **********************/
+
+/*
+ * Sent by governors when they start and stop boosting the CPUs on user
+ * interaction, so that platform code can raise the speed of the devices
+ * that serve the CPU (memory, interconnect, GPU) for as long.
+ */
+#define CPUFREQ_BOOST_START	(0)
+#define CPUFREQ_BOOST_END	(1)
+
 
 /**
  * cpufreq_scale - "old * mult / div" calculation for large values (32-bit-arch safe)
@@ -255,6 +266,7 @@ int cpufreq_unregister_driver(struct cpufreq_driver *driver_data);
 
 
 void cpufreq_notify_transition(struct cpufreq_freqs *freqs, unsigned int state);
+void cpufreq_notify_boost(unsigned int state);
 
 
 static inline void cpufreq_verify_within_limits(struct cpufreq_policy *policy, unsigned int min, unsigned int max)
@@ -409,6 +421,52 @@ void cpufreq_frequency_table_get_attr(struct cpufreq_frequency_table *table,
 
 void cpufreq_frequency_table_put_attr(unsigned int cpu);
 
+/*
+ * Energy model of a CPU, for governors that weigh speed against power.
+ * States are in ascending frequency order, CPUFREQ_TABLE_END ends them.
+ */
+struct cpufreq_energy_state {
+	unsigned int	frequency;	/* kHz */
+	unsigned int	u_volt;		/* supply voltage at this frequency */
+	unsigned int	busy_power;	/* mW while running */
+	unsigned int	idle_power;	/* mW while idle */
+};
+
+struct cpufreq_energy_model {
+	struct cpufreq_energy_state *states;
+	unsigned int	volt_slew;	/* uV/us of the supply, 0 if unknown */
+	unsigned int	switch_latency;	/* us to change speed, voltage apart */
+};
+
+extern struct freq_attr cpufreq_freq_attr_energy_model;
+
+/* same rules as for cpufreq_frequency_table_get_attr() */
+void cpufreq_energy_model_get_attr(struct cpufreq_energy_model *model,
+				   unsigned int cpu);
+void cpufreq_energy_model_put_attr(unsigned int cpu);
+struct cpufreq_energy_model *cpufreq_energy_model_get(unsigned int cpu);
+
+/*
+ * Time in us during which a CPU runs at neither speed when going from
+ * @from to @to: the clock switch, and the voltage ramp if it changes.
+ */
+static inline unsigned int cpufreq_energy_transition_latency(
+	struct cpufreq_energy_model *model,
+	struct cpufreq_energy_state *from, struct cpufreq_energy_state *to)
+{
+	unsigned int dv;
+
+	if (from == to)
+		return 0;
+
+	dv = from->u_volt > to->u_volt ? from->u_volt - to->u_volt :
+					 to->u_volt - from->u_volt;
+	if (!dv || !model->volt_slew)
+		return model->switch_latency;
+
+	return model->switch_latency + DIV_ROUND_UP(dv, model->volt_slew);
+}
+
 
 /*********************************************************************
  *                         CPUFREQ STATS                             *
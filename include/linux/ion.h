@@ -61,6 +61,9 @@ enum ion_heap_type {
 #define ION_FLAG_CACHED_NEEDS_SYNC 2	/* mappings of this buffer will created
 					   at mmap time, if this is set
 					   caches must be managed manually */
+#define ION_FLAG_NO_DEFER_FREE 4	/* free this buffer in the context
+					   of the last put, even on heaps
+					   that defer frees to a thread */
 
 #ifdef __KERNEL__
 struct ion_device;
@@ -99,16 +102,40 @@ struct ion_platform_heap {
 	void *priv;
 };
 
+/**
+ * struct ion_platform_policy - ordered list of heaps for one use case
+ * @id:		identifier passed in the heap id mask to select this policy.
+ *		Shares the bit space with heap ids and must not collide
+ *		with any of them.
+ * @name:	used for debug purposes
+ * @nr:		number of entries in @heap_ids
+ * @heap_ids:	heaps to try, first to last, until one allocation succeeds
+ *
+ * Provided by the board file.  Lets one use case prefer, say, a carveout
+ * and fall back to CMA while another goes the other way, which the single
+ * heap id ordering can not express.
+ */
+struct ion_platform_policy {
+	unsigned int id;
+	const char *name;
+	int nr;
+	const unsigned int *heap_ids;
+};
+
 /**
  * struct ion_platform_data - array of platform heaps passed from board file
  * @nr:		number of structures in the array
  * @heaps:	array of platform_heap structions
+ * @nr_policies: number of structures in @policies
+ * @policies:	optional array of allocation policies
  *
  * Provided by the board file in the form of platform data to a platform device.
  */
 struct ion_platform_data {
 	int nr;
 	struct ion_platform_heap *heaps;
+	int nr_policies;
+	struct ion_platform_policy *policies;
 };
 
 /**
@@ -315,6 +342,36 @@ struct ion_handle_data {
 	struct ion_handle *handle;
 };
 
+/**
+ * struct ion_sync_range_data - a range of a shared buffer to sync
+ * @fd:		a file descriptor obtained from ION_IOC_SHARE or ION_IOC_MAP
+ * @offset:	start of the range in bytes
+ * @length:	length of the range in bytes, 0 for the rest of the buffer
+ */
+struct ion_sync_range_data {
+	int fd;
+	size_t offset;
+	size_t length;
+};
+
+#define ION_CACHE_CLEAN		1	/* write dirty lines back to memory */
+#define ION_CACHE_INV		2	/* discard lines, e.g. after dma */
+#define ION_CACHE_CLEAN_INV	(ION_CACHE_CLEAN | ION_CACHE_INV)
+
+/**
+ * struct ion_cache_op_data - a cache operation on a range of a buffer
+ * @fd:		a file descriptor obtained from ION_IOC_SHARE or ION_IOC_MAP
+ * @op:		ION_CACHE_CLEAN, ION_CACHE_INV or ION_CACHE_CLEAN_INV
+ * @offset:	start of the range in bytes
+ * @length:	length of the range in bytes, 0 for the rest of the buffer
+ */
+struct ion_cache_op_data {
+	int fd;
+	unsigned int op;
+	size_t offset;
+	size_t length;
+};
+
 /**
  * struct ion_custom_data - metadata passed to/from userspace for a custom ioctl
  * @cmd:	the custom ioctl function to call
@@ -386,6 +443,26 @@ struct ion_custom_data {
  */
 #define ION_IOC_SYNC		_IOWR(ION_IOC_MAGIC, 7, struct ion_fd_data)
 
+/**
+ * DOC: ION_IOC_SYNC_RANGE - syncs part of a shared buffer to memory
+ *
+ * Like ION_IOC_SYNC, but only for the bytes in the given range.  For
+ * buffers whose user mappings are faulted in only the pages written
+ * since the last sync are cleaned.
+ */
+#define ION_IOC_SYNC_RANGE	_IOWR(ION_IOC_MAGIC, 8, \
+				      struct ion_sync_range_data)
+
+/**
+ * DOC: ION_IOC_CACHE_OP - clean and/or invalidate part of a buffer
+ *
+ * Takes an ion_cache_op_data struct.  Cleaning skips pages that have not
+ * been written through a faulted user mapping since they were last
+ * cleaned.  Ranges above a threshold, tunable in debugfs as
+ * ion/cache_flush_all_threshold, flush the whole cache instead.
+ */
+#define ION_IOC_CACHE_OP	_IOWR(ION_IOC_MAGIC, 9, struct ion_cache_op_data)
+
 /**
  * DOC: ION_IOC_CUSTOM - call architecture specific ion ioctl
  *
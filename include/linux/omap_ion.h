@@ -84,11 +84,15 @@ enum {
 	OMAP_ION_HEAP_TILER,
 	OMAP_ION_HEAP_NONSECURE_TILER,
 	OMAP_ION_HEAP_TILER_RESERVATION,
+	OMAP_ION_HEAP_CMA,
+	/* not a heap, a policy trying the carveout and then CMA */
+	OMAP_ION_HEAP_VIDEO,
 };
 
 #define OMAP_ION_HEAP_TILER_MASK (1 << OMAP_ION_HEAP_TILER)
 #define OMAP_ION_HEAP_NONSECURE_TILER_MASK (1 << OMAP_ION_HEAP_NONSECURE_TILER)
 #define OMAP_ION_HEAP_TILER_RESERVATION_MASK (1 << OMAP_ION_HEAP_TILER_RESERVATION)
+#define OMAP_ION_HEAP_VIDEO_MASK (1 << OMAP_ION_HEAP_VIDEO)
 
 /**
  * allocation flags - the lower 16 bits are used by core ion, the upper 16
@@ -71,6 +71,22 @@ static inline void oom_killer_enable(void)
 
 extern struct task_struct *find_lock_task_mm(struct task_struct *p);
 
+#ifdef CONFIG_ANDROID_LOW_MEMORY_KILLER
+extern void lowmem_task_add(struct task_struct *tsk);
+extern void lowmem_task_remove(struct task_struct *tsk);
+extern void lowmem_task_update(struct task_struct *tsk);
+
+static inline void lowmem_task_init(struct task_struct *tsk)
+{
+	RB_CLEAR_NODE(&tsk->lowmem_node);
+}
+#else
+static inline void lowmem_task_add(struct task_struct *tsk) { }
+static inline void lowmem_task_remove(struct task_struct *tsk) { }
+static inline void lowmem_task_update(struct task_struct *tsk) { }
+static inline void lowmem_task_init(struct task_struct *tsk) { }
+#endif
+
 /* sysctls */
 extern int sysctl_oom_dump_tasks;
 extern int sysctl_oom_kill_allocating_task;
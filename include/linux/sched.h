@@ -855,6 +855,12 @@ enum cpu_idle_type {
 #define SCHED_POWER_SHIFT	10
 #define SCHED_POWER_SCALE	(1L << SCHED_POWER_SHIFT)
 
+/*
+ * Task utilization: the share of wall time a task recently spent running
+ */
+#define SCHED_UTIL_SHIFT	10
+#define SCHED_UTIL_SCALE	(1L << SCHED_UTIL_SHIFT)
+
 /*
  * sched-domains (multiprocessor balancing) declarations:
  */
@@ -1229,6 +1235,12 @@ struct sched_entity {
 
 	u64			nr_migrations;
 
+	/* recent utilization, in SCHED_UTIL_SCALE units */
+	unsigned long		util;
+	u64			util_stamp;	/* rq clock of the last update */
+	u64			util_runtime;	/* sum_exec_runtime then */
+	unsigned int		util_migrated;	/* moved since last enqueue */
+
 #ifdef CONFIG_SCHEDSTATS
 	struct sched_statistics statistics;
 #endif
@@ -1337,6 +1349,11 @@ struct task_struct {
 #ifdef CONFIG_SMP
 	struct plist_node pushable_tasks;
 #endif
+#ifdef CONFIG_ANDROID_LOW_MEMORY_KILLER
+	/* thread group leaders in the lowmemorykiller oom_score_adj index */
+	struct rb_node lowmem_node;
+	int lowmem_adj;
+#endif
 
 	struct mm_struct *mm, *active_mm;
 #ifdef CONFIG_COMPAT_BRK
@@ -2081,6 +2098,26 @@ extern void idle_task_exit(void);
 static inline void idle_task_exit(void) {}
 #endif
 
+#ifdef CONFIG_CPU_FREQ
+/*
+ * Called with the runqueue lock held whenever the load of a cpu changes:
+ * when a CFS task is enqueued or dequeued, and on every scheduler tick.
+ * @time is the runqueue clock in ns.  When a task is enqueued because it
+ * woke up or moved to the cpu, @flags says so and @util is its
+ * utilization in SCHED_UTIL_SCALE units; otherwise both are zero.
+ */
+#define SCHED_CPUFREQ_WAKEUP	(1U << 0)
+#define SCHED_CPUFREQ_MIGRATION	(1U << 1)
+
+struct update_util_data {
+	void (*func)(struct update_util_data *data, u64 time,
+		     unsigned int flags, unsigned long util);
+};
+
+extern void cpufreq_set_update_util_data(int cpu,
+					 struct update_util_data *data);
+#endif
+
 #if defined(CONFIG_NO_HZ) && defined(CONFIG_SMP)
 extern void wake_up_idle_cpu(int cpu);
 #else
@@ -6,6 +6,7 @@
 #include <linux/workqueue.h>
 #include <linux/gfp.h>
 #include <linux/types.h>
+#include <linux/sched.h>
 #include <linux/cgroup.h>
 
 struct vmpressure {
@@ -22,13 +23,30 @@ struct vmpressure {
 	struct work_struct work;
 };
 
+enum vmpressure_levels {
+	VMPRESSURE_LOW = 0,
+	VMPRESSURE_MEDIUM,
+	VMPRESSURE_CRITICAL,
+	VMPRESSURE_NUM_LEVELS,
+};
+
+/* Passed to vmpressure notifiers: the reclaimer that filled the window. */
+struct vmpressure_trigger {
+	char comm[TASK_COMM_LEN];
+	pid_t pid;
+};
+
 struct mem_cgroup;
+struct notifier_block;
 
-#ifdef CONFIG_CGROUP_MEM_RES_CTLR
 extern void vmpressure(gfp_t gfp, struct mem_cgroup *memcg,
 		       unsigned long scanned, unsigned long reclaimed);
 extern void vmpressure_prio(gfp_t gfp, struct mem_cgroup *memcg, int prio);
 
+extern int vmpressure_register_notifier(struct notifier_block *nb);
+extern int vmpressure_unregister_notifier(struct notifier_block *nb);
+
+#ifdef CONFIG_CGROUP_MEM_RES_CTLR
 extern void vmpressure_init(struct vmpressure *vmpr);
 extern struct vmpressure *memcg_to_vmpressure(struct mem_cgroup *memcg);
 extern struct cgroup_subsys_state *vmpressure_to_css(struct vmpressure *vmpr);
@@ -38,10 +56,5 @@ extern int vmpressure_register_event(struct cgroup *cg, struct cftype *cft,
 				     const char *args);
 extern void vmpressure_unregister_event(struct cgroup *cg, struct cftype *cft,
 					struct eventfd_ctx *eventfd);
-#else
-static inline void vmpressure(gfp_t gfp, struct mem_cgroup *memcg,
-			      unsigned long scanned, unsigned long reclaimed) {}
-static inline void vmpressure_prio(gfp_t gfp, struct mem_cgroup *memcg,
-				   int prio) {}
 #endif /* CONFIG_CGROUP_MEM_RES_CTLR */
 #endif /* __LINUX_VMPRESSURE_H */
@@ -82,6 +82,64 @@ DEFINE_EVENT(loadeval, cpufreq_interactive_notyet,
 	    TP_ARGS(cpu_id, load, curtarg, curactual, newtarg)
 );
 
+TRACE_EVENT(cpufreq_interactive_load,
+	    TP_PROTO(unsigned long cpu_id, unsigned long load,
+		     unsigned long curactual, unsigned long newtarg,
+		     unsigned long latency_us, bool sched),
+	    TP_ARGS(cpu_id, load, curactual, newtarg, latency_us, sched),
+
+	    TP_STRUCT__entry(
+		    __field(unsigned long, cpu_id     )
+		    __field(unsigned long, load       )
+		    __field(unsigned long, curactual  )
+		    __field(unsigned long, newtarg    )
+		    __field(unsigned long, latency_us )
+		    __field(bool,          sched      )
+	    ),
+
+	    TP_fast_assign(
+		    __entry->cpu_id = cpu_id;
+		    __entry->load = load;
+		    __entry->curactual = curactual;
+		    __entry->newtarg = newtarg;
+		    __entry->latency_us = latency_us;
+		    __entry->sched = sched;
+	    ),
+
+	    TP_printk("cpu=%lu load=%lu actual=%lu targ=%lu latency=%luus src=%s",
+		      __entry->cpu_id, __entry->load, __entry->curactual,
+		      __entry->newtarg, __entry->latency_us,
+		      __entry->sched ? "sched" : "timer")
+);
+
+TRACE_EVENT(cpufreq_interactive_taskboost,
+	    TP_PROTO(unsigned long cpu_id, unsigned long util,
+		     unsigned long curtarg, unsigned long newtarg,
+		     bool migration),
+	    TP_ARGS(cpu_id, util, curtarg, newtarg, migration),
+
+	    TP_STRUCT__entry(
+		    __field(unsigned long, cpu_id    )
+		    __field(unsigned long, util      )
+		    __field(unsigned long, curtarg   )
+		    __field(unsigned long, newtarg   )
+		    __field(bool,          migration )
+	    ),
+
+	    TP_fast_assign(
+		    __entry->cpu_id = cpu_id;
+		    __entry->util = util;
+		    __entry->curtarg = curtarg;
+		    __entry->newtarg = newtarg;
+		    __entry->migration = migration;
+	    ),
+
+	    TP_printk("cpu=%lu util=%lu cur=%lu targ=%lu on=%s",
+		      __entry->cpu_id, __entry->util, __entry->curtarg,
+		      __entry->newtarg,
+		      __entry->migration ? "migration" : "wakeup")
+);
+
 TRACE_EVENT(cpufreq_interactive_boost,
 	    TP_PROTO(const char *s),
 	    TP_ARGS(s),
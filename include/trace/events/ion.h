@@ -0,0 +1,61 @@
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM ion
+
+#if !defined(_TRACE_ION_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _TRACE_ION_H
+
+#include <linux/types.h>
+#include <linux/tracepoint.h>
+
+TRACE_EVENT(ion_alloc,
+	TP_PROTO(int heap_id, size_t len, unsigned int flags,
+		 unsigned int heap_id_mask, s64 latency_us, int error),
+	TP_ARGS(heap_id, len, flags, heap_id_mask, latency_us, error),
+
+	TP_STRUCT__entry(
+		__field(int, heap_id)
+		__field(size_t, len)
+		__field(unsigned int, flags)
+		__field(unsigned int, heap_id_mask)
+		__field(s64, latency_us)
+		__field(int, error)
+	),
+	TP_fast_assign(
+		__entry->heap_id = heap_id;
+		__entry->len = len;
+		__entry->flags = flags;
+		__entry->heap_id_mask = heap_id_mask;
+		__entry->latency_us = latency_us;
+		__entry->error = error;
+	),
+	TP_printk("heap_id=%d len=%zu flags=0x%x heap_id_mask=0x%x latency_us=%lld error=%d",
+		  __entry->heap_id, __entry->len, __entry->flags,
+		  __entry->heap_id_mask, __entry->latency_us, __entry->error)
+);
+
+TRACE_EVENT(ion_free,
+	TP_PROTO(int heap_id, size_t len, unsigned long flags,
+		 s64 latency_us),
+	TP_ARGS(heap_id, len, flags, latency_us),
+
+	TP_STRUCT__entry(
+		__field(int, heap_id)
+		__field(size_t, len)
+		__field(unsigned long, flags)
+		__field(s64, latency_us)
+	),
+	TP_fast_assign(
+		__entry->heap_id = heap_id;
+		__entry->len = len;
+		__entry->flags = flags;
+		__entry->latency_us = latency_us;
+	),
+	TP_printk("heap_id=%d len=%zu flags=0x%lx latency_us=%lld",
+		  __entry->heap_id, __entry->len, __entry->flags,
+		  __entry->latency_us)
+);
+
+#endif /* _TRACE_ION_H */
+
+/* This part must be outside protection */
+#include <trace/define_trace.h>
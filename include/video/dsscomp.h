@@ -592,6 +592,62 @@ struct dsscomp_setup_dispc_data {
 	struct dss2_ovl_info ovls[5]; /* up to 5 overlays to set up */
 };
 
+/*
+ * ioctl: DSSCIOC_SETUP_DISPC_FENCES, struct dsscomp_setup_dispc_fences_data
+ *
+ * Same as DSSCIOC_SETUP_DISPC, with explicit buffer synchronization.
+ *
+ * acquire_fd[i] is a sync fence fd (e.g. from the GPU or the 2D blitter)
+ * that must signal before DISPC may read the buffer of ovls[i], or -1.
+ * The fds stay owned by the caller.
+ *
+ * On return, release_fd[i] is a new sync fence fd that signals once DISPC
+ * no longer reads the buffer of ovls[i], or -1 if there is none (e.g. the
+ * layer was not queued).  The caller must close these fds.
+ *
+ * Returns 0 on success, non-0 on failure.
+ */
+struct dsscomp_setup_dispc_fences_data {
+	struct dsscomp_setup_dispc_data dispc;
+	__s32 acquire_fd[5];
+	__s32 release_fd[5];
+};
+
+/*
+ * ioctl: DSSCIOC_SETUP_DISPC_BLIT, struct dsscomp_setup_dispc_blit_data
+ *
+ * Same as DSSCIOC_SETUP_DISPC_FENCES, for compositions with more layers
+ * than there are overlays.  The 2D blitter blends the layers in blits[]
+ * (bottom to top) into a buffer of dsscomp that covers the output window
+ * of fdispc.dispc.ovls[blit_ovl], and that overlay shows the result.  The
+ * buffer, format, size and crop of that overlay are set up by dsscomp.
+ *
+ * Each layer is placed by its output window, which must fall inside the
+ * window of the blit overlay.  Its acquire_fd and release_fd work as for
+ * the overlays, but the release fence signals as soon as the blit no
+ * longer reads the buffer.
+ *
+ * Limitations:
+ * - layers must use direct addressing and be ARGB32, RGB24U or RGB16
+ * - layers cannot be rotated or mirrored
+ *
+ * Returns 0 on success, non-0 on failure.
+ */
+#define DSSCOMP_MAX_BLITS	8
+
+struct dsscomp_blit_layer {
+	struct dss2_ovl_info ovl;
+	__s32 acquire_fd;
+	__s32 release_fd;
+};
+
+struct dsscomp_setup_dispc_blit_data {
+	struct dsscomp_setup_dispc_fences_data fdispc;
+	__u16 blit_ovl;		/* index in fdispc.dispc.ovls */
+	__u16 num_blits;	/* # of layers in blits */
+	struct dsscomp_blit_layer blits[DSSCOMP_MAX_BLITS];
+};
+
 /*
  * ioctl: DSSCIOC_WB_COPY, struct dsscomp_wb_copy_data
  *
@@ -734,4 +790,9 @@ struct dsscomp_platform_info {
 
 /*HACK: used as temporary solution to wait for writeback frame to complete */
 #define DSSCIOC_WB_DONE		_IOW('O', 136, __u32)
+
+#define DSSCIOC_SETUP_DISPC_FENCES	\
+		_IOWR('O', 137, struct dsscomp_setup_dispc_fences_data)
+#define DSSCIOC_SETUP_DISPC_BLIT	\
+		_IOWR('O', 138, struct dsscomp_setup_dispc_blit_data)
 #endif
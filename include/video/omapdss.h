@@ -995,8 +995,9 @@ int dispc_scaling_decision(enum omap_plane plane, struct omap_overlay_info *oi,
 
 int omap_dss_manager_unregister_callback(struct omap_overlay_manager *mgr,
 					 struct omapdss_ovl_cb *cb);
-bool omap_dss_overlay_ensure_bw(void);
+u32 omap_dss_overlay_bandwidth(bool pending);
 void dss_tput_request(u32 tput);
+void dss_tput_release(void);
 
 
 /* generic callback handling */
@@ -63,6 +63,7 @@ static void exit_mm(struct task_struct * tsk);
 
 static void __unhash_process(struct task_struct *p, bool group_dead)
 {
+	lowmem_task_remove(p);
 	nr_threads--;
 	detach_pid(p, PIDTYPE_PID);
 	if (group_dead) {
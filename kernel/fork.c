@@ -1231,6 +1231,7 @@ static struct task_struct *copy_process(unsigned long clone_flags,
 		goto fork_out;
 
 	ftrace_graph_init_task(p);
+	lowmem_task_init(p);
 
 	rt_mutex_init_task(p);
 
@@ -1500,6 +1501,7 @@ static struct task_struct *copy_process(unsigned long clone_flags,
 			attach_pid(p, PIDTYPE_SID, task_session(current));
 			list_add_tail(&p->sibling, &p->real_parent->children);
 			list_add_tail_rcu(&p->tasks, &init_task.tasks);
+			lowmem_task_add(p);
 			__this_cpu_inc(process_counts);
 		} else {
 			current->signal->nr_threads++;
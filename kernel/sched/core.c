@@ -1143,6 +1143,7 @@ void set_task_cpu(struct task_struct *p, unsigned int new_cpu)
 
 	if (task_cpu(p) != new_cpu) {
 		p->se.nr_migrations++;
+		p->se.util_migrated = 1;
 		perf_sw_event(PERF_COUNT_SW_CPU_MIGRATIONS, 1, NULL, 0);
 	}
 
@@ -1747,6 +1748,10 @@ static void __sched_fork(struct task_struct *p)
 	p->se.prev_sum_exec_runtime	= 0;
 	p->se.nr_migrations		= 0;
 	p->se.vruntime			= 0;
+	p->se.util			= 0;
+	p->se.util_stamp		= 0;
+	p->se.util_runtime		= 0;
+	p->se.util_migrated		= 0;
 	INIT_LIST_HEAD(&p->se.group_node);
 
 #ifdef CONFIG_SCHEDSTATS
@@ -3265,6 +3270,7 @@ void scheduler_tick(void)
 	update_rq_clock(rq);
 	update_cpu_load_active(rq);
 	curr->sched_class->task_tick(rq, curr, 0);
+	cpufreq_update_util(rq, 0, 0);
 	raw_spin_unlock(&rq->lock);
 
 	perf_event_task_tick();
@@ -4237,6 +4243,7 @@ int idle_cpu(int cpu)
 
 	return 1;
 }
+EXPORT_SYMBOL_GPL(idle_cpu);
 
 /**
  * idle_task - return the idle task for a given cpu.
@@ -0,0 +1,31 @@
+/*
+ *  kernel/sched/cpufreq.c
+ *
+ *  Scheduler hooks for cpufreq governors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ */
+
+#include <linux/export.h>
+
+#include "sched.h"
+
+DEFINE_PER_CPU(struct update_util_data *, cpufreq_update_util_data);
+
+/**
+ * cpufreq_set_update_util_data - set the load change callback of a cpu
+ * @cpu: the cpu whose runqueue events are reported
+ * @data: the callback, or NULL to stop the reports
+ *
+ * The callback runs in scheduler context with the runqueue lock of @cpu
+ * held, possibly on another cpu.  It must not sleep nor wake up tasks.
+ * After clearing the pointer, callers must wait with synchronize_sched()
+ * before freeing @data or tearing down what the callback uses.
+ */
+void cpufreq_set_update_util_data(int cpu, struct update_util_data *data)
+{
+	rcu_assign_pointer(per_cpu(cpufreq_update_util_data, cpu), data);
+}
+EXPORT_SYMBOL_GPL(cpufreq_set_update_util_data);
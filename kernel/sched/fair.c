@@ -2189,6 +2189,39 @@ static inline void hrtick_update(struct rq *rq)
 }
 #endif
 
+/*
+ * Task utilization is the share of wall time the task spent running since
+ * the previous update, averaged with the previous value once at least
+ * UTIL_PERIOD has passed.  A task that did not run for UTIL_HISTORY starts
+ * over, so that it is not boosted for work done long ago.
+ */
+#define UTIL_PERIOD	(8 * NSEC_PER_MSEC)
+#define UTIL_HISTORY	(4 * UTIL_PERIOD)
+
+static void update_task_util(struct sched_entity *se, u64 now)
+{
+	u64 delta = now - se->util_stamp;
+	u64 runtime;
+	unsigned long util;
+
+	/* rq clocks of different cpus may be slightly apart */
+	if ((s64)delta < (s64)UTIL_PERIOD)
+		return;
+
+	runtime = se->sum_exec_runtime - se->util_runtime;
+	if (runtime > delta)
+		runtime = delta;
+	util = div64_u64(runtime << SCHED_UTIL_SHIFT, delta);
+
+	if (delta >= UTIL_HISTORY)
+		se->util = util;
+	else
+		se->util = (se->util + util) / 2;
+
+	se->util_stamp = now;
+	se->util_runtime = se->sum_exec_runtime;
+}
+
 /*
  * The enqueue_task method is called before nr_running is
  * increased. Here we update the fair scheduling stats and
@@ -2199,6 +2232,15 @@ enqueue_task_fair(struct rq *rq, struct task_struct *p, int flags)
 {
 	struct cfs_rq *cfs_rq;
 	struct sched_entity *se = &p->se;
+	unsigned int util_flags = 0;
+
+	if (flags & ENQUEUE_WAKEUP)
+		util_flags |= SCHED_CPUFREQ_WAKEUP;
+	if (se->util_migrated) {
+		util_flags |= SCHED_CPUFREQ_MIGRATION;
+		se->util_migrated = 0;
+	}
+	update_task_util(se, rq->clock);
 
 	for_each_sched_entity(se) {
 		if (se->on_rq)
@@ -2233,6 +2275,7 @@ enqueue_task_fair(struct rq *rq, struct task_struct *p, int flags)
 	if (!se)
 		inc_nr_running(rq);
 	hrtick_update(rq);
+	cpufreq_update_util(rq, util_flags, p->se.util);
 }
 
 static void set_next_buddy(struct sched_entity *se);
@@ -2292,6 +2335,8 @@ static void dequeue_task_fair(struct rq *rq, struct task_struct *p, int flags)
 	if (!se)
 		dec_nr_running(rq);
 	hrtick_update(rq);
+	update_task_util(&p->se, rq->clock);
+	cpufreq_update_util(rq, 0, 0);
 }
 
 #ifdef CONFIG_SMP
@@ -5190,6 +5235,8 @@ static void task_tick_fair(struct rq *rq, struct task_struct *curr, int queued)
 		cfs_rq = cfs_rq_of(se);
 		entity_tick(cfs_rq, se, queued);
 	}
+
+	update_task_util(&curr->se, rq->clock);
 }
 
 /*
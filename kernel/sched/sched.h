@@ -474,6 +474,25 @@ static inline int cpu_of(struct rq *rq)
 #endif
 }
 
+#ifdef CONFIG_CPU_FREQ
+DECLARE_PER_CPU(struct update_util_data *, cpufreq_update_util_data);
+
+/* Tells the cpufreq governor, if it asked to know, that rq's load changed */
+static inline void cpufreq_update_util(struct rq *rq, unsigned int flags,
+				       unsigned long util)
+{
+	struct update_util_data *data;
+
+	data = rcu_dereference_sched(per_cpu(cpufreq_update_util_data,
+					     cpu_of(rq)));
+	if (data)
+		data->func(data, rq->clock, flags, util);
+}
+#else
+static inline void cpufreq_update_util(struct rq *rq, unsigned int flags,
+				       unsigned long util) { }
+#endif
+
 DECLARE_PER_CPU(struct rq, runqueues);
 
 #define cpu_rq(cpu)		(&per_cpu(runqueues, (cpu)))
@@ -0,0 +1,131 @@
+/*
+ * LZ4 - Fast LZ compression algorithm
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * Produces the LZ4 block format described at http://code.google.com/p/lz4/
+ * using a single pass greedy matcher over a 4096 entry hash table.
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/string.h>
+#include <linux/lz4.h>
+#include <asm/unaligned.h>
+#include "lz4defs.h"
+
+static inline u32 lz4_hash(u32 sequence)
+{
+	return (sequence * 2654435761U) >> (32 - LZ4_HASH_LOG);
+}
+
+static inline unsigned char *lz4_put_length(unsigned char *op, size_t len)
+{
+	for (; len >= 255; len -= 255)
+		*op++ = 255;
+	*op++ = len;
+	return op;
+}
+
+static inline unsigned char *lz4_put_literals(unsigned char *op,
+					      unsigned char *token,
+					      const unsigned char *anchor,
+					      size_t len)
+{
+	if (len >= RUN_MASK) {
+		*token = RUN_MASK << ML_BITS;
+		op = lz4_put_length(op, len - RUN_MASK);
+	} else {
+		*token = len << ML_BITS;
+	}
+
+	memcpy(op, anchor, len);
+	return op + len;
+}
+
+int lz4_compress(const unsigned char *src, size_t src_len,
+		 unsigned char *dst, size_t *dst_len, void *wrkmem)
+{
+	u32 *table = wrkmem;
+	const unsigned char *ip = src;
+	const unsigned char *anchor = src;
+	const unsigned char * const iend = src + src_len;
+	const unsigned char * const mflimit = iend - MFLIMIT;
+	const unsigned char * const matchlimit = iend - LASTLITERALS;
+	unsigned char *op = dst;
+	unsigned char *token;
+
+	/* offsets are stored as u32, the block format caps the input anyway */
+	if (src_len > 0x7e000000)
+		return -1;
+
+	memset(table, 0, LZ4_MEM_COMPRESS);
+
+	/* too short to hold a match, emit everything as literals */
+	if (src_len < MFLIMIT + 1)
+		goto last_literals;
+
+	while (ip <= mflimit) {
+		const unsigned char *ref, *p, *r;
+		u32 sequence = LZ4_READ32(ip);
+		u32 h = lz4_hash(sequence);
+		size_t len;
+
+		ref = src + table[h];
+		table[h] = ip - src;
+
+		if (ref >= ip || ip - ref > MAX_DISTANCE ||
+		    LZ4_READ32(ref) != sequence) {
+			ip += 1 + ((ip - anchor) >> LZ4_SKIP_TRIGGER);
+			continue;
+		}
+
+		/* extend the match backwards over pending literals */
+		while (ip > anchor && ref > src && ip[-1] == ref[-1]) {
+			ip--;
+			ref--;
+		}
+
+		/* and forwards, stopping short of the trailing literals */
+		p = ip + MINMATCH;
+		r = ref + MINMATCH;
+		while (p < matchlimit && *p == *r) {
+			p++;
+			r++;
+		}
+
+		token = op++;
+		op = lz4_put_literals(op, token, anchor, ip - anchor);
+
+		put_unaligned_le16(ip - ref, op);
+		op += 2;
+
+		len = p - ip - MINMATCH;
+		if (len >= ML_MASK) {
+			*token |= ML_MASK;
+			op = lz4_put_length(op, len - ML_MASK);
+		} else {
+			*token |= len;
+		}
+
+		ip = p;
+		anchor = ip;
+
+		/* seed the table with the tail of the match */
+		if (ip <= mflimit)
+			table[lz4_hash(LZ4_READ32(ip - 2))] = ip - 2 - src;
+	}
+
+last_literals:
+	token = op++;
+	op = lz4_put_literals(op, token, anchor, iend - anchor);
+
+	*dst_len = op - dst;
+	return 0;
+}
+EXPORT_SYMBOL(lz4_compress);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("LZ4 compressor");
@@ -0,0 +1,105 @@
+/*
+ * LZ4 Decompressor for Linux kernel
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * Decodes the LZ4 block format described at http://code.google.com/p/lz4/
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/string.h>
+#include <linux/lz4.h>
+#include <asm/unaligned.h>
+#include "lz4defs.h"
+
+/*
+ * Read an extended length.  Returns false if the input ends before the
+ * terminating non-255 byte.
+ */
+static inline bool lz4_get_length(const unsigned char **ipp,
+				  const unsigned char *iend, size_t *len)
+{
+	const unsigned char *ip = *ipp;
+	unsigned int s;
+
+	do {
+		if (unlikely(ip >= iend))
+			return false;
+		s = *ip++;
+		*len += s;
+	} while (s == 255);
+
+	*ipp = ip;
+	return true;
+}
+
+int lz4_decompress_unknownoutputsize(const unsigned char *src, size_t src_len,
+				     unsigned char *dest, size_t *dest_len)
+{
+	const unsigned char *ip = src;
+	const unsigned char * const iend = src + src_len;
+	unsigned char *op = dest;
+	unsigned char * const oend = dest + *dest_len;
+	const unsigned char *ref;
+	unsigned int token;
+	size_t len, offset;
+
+	for (;;) {
+		if (unlikely(ip >= iend))
+			goto fail;
+		token = *ip++;
+
+		/* literals */
+		len = token >> ML_BITS;
+		if (len == RUN_MASK && !lz4_get_length(&ip, iend, &len))
+			goto fail;
+		if (unlikely(len > (size_t)(iend - ip) ||
+			     len > (size_t)(oend - op)))
+			goto fail;
+		memcpy(op, ip, len);
+		op += len;
+		ip += len;
+
+		/* the last sequence carries literals only */
+		if (ip == iend)
+			break;
+
+		/* match */
+		if (unlikely(iend - ip < 2))
+			goto fail;
+		offset = get_unaligned_le16(ip);
+		ip += 2;
+		if (unlikely(!offset || offset > (size_t)(op - dest)))
+			goto fail;
+		ref = op - offset;
+
+		len = token & ML_MASK;
+		if (len == ML_MASK && !lz4_get_length(&ip, iend, &len))
+			goto fail;
+		len += MINMATCH;
+		if (unlikely(len > (size_t)(oend - op)))
+			goto fail;
+
+		if (offset >= len) {
+			memcpy(op, ref, len);
+			op += len;
+		} else {
+			/* overlapping copy replicates the last offset bytes */
+			while (len--)
+				*op++ = *ref++;
+		}
+	}
+
+	*dest_len = op - dest;
+	return 0;
+
+fail:
+	return -1;
+}
+EXPORT_SYMBOL(lz4_decompress_unknownoutputsize);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("LZ4 Decompressor");
@@ -0,0 +1,28 @@
+/*
+ * lz4defs.h -- LZ4 block format constants shared by compressor and decompressor
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#define MINMATCH	4
+
+#define COPYLENGTH	8
+#define LASTLITERALS	5
+/* a match must start at least MFLIMIT bytes before the end of input */
+#define MFLIMIT		(COPYLENGTH + MINMATCH)
+#define MAX_DISTANCE	65535
+
+#define ML_BITS		4
+#define ML_MASK		((1U << ML_BITS) - 1)
+#define RUN_BITS	(8 - ML_BITS)
+#define RUN_MASK	((1U << RUN_BITS) - 1)
+
+#define LZ4_HASH_LOG	12
+#define LZ4_HASH_SIZE	(1 << LZ4_HASH_LOG)
+
+/* skip ahead faster through data that does not compress */
+#define LZ4_SKIP_TRIGGER	6
+
+#define LZ4_READ32(p)	get_unaligned((const u32 *)(p))
@@ -19,6 +19,7 @@
 #include <linux/mm.h>
 #include <linux/vmstat.h>
 #include <linux/eventfd.h>
+#include <linux/notifier.h>
 #include <linux/swap.h>
 #include <linux/printk.h>
 #include <linux/slab.h>
@@ -75,6 +76,7 @@ static struct vmpressure *work_to_vmpressure(struct work_struct *work)
 	return container_of(work, struct vmpressure, work);
 }
 
+#ifdef CONFIG_CGROUP_MEM_RES_CTLR
 static struct vmpressure *cg_to_vmpressure(struct cgroup *cg)
 {
 	return css_to_vmpressure(cgroup_subsys_state(cg, mem_cgroup_subsys_id));
@@ -91,18 +93,12 @@ static struct vmpressure *vmpressure_parent(struct vmpressure *vmpr)
 	return memcg_to_vmpressure(memcg);
 }
 
-enum vmpressure_levels {
-	VMPRESSURE_LOW = 0,
-	VMPRESSURE_MEDIUM,
-	VMPRESSURE_CRITICAL,
-	VMPRESSURE_NUM_LEVELS,
-};
-
 static const char * const vmpressure_str_levels[] = {
 	[VMPRESSURE_LOW] = "low",
 	[VMPRESSURE_MEDIUM] = "medium",
 	[VMPRESSURE_CRITICAL] = "critical",
 };
+#endif
 
 static enum vmpressure_levels vmpressure_level(unsigned long pressure)
 {
@@ -135,6 +131,7 @@ static enum vmpressure_levels vmpressure_calc_level(unsigned long scanned,
 	return vmpressure_level(pressure);
 }
 
+#ifdef CONFIG_CGROUP_MEM_RES_CTLR
 struct vmpressure_event {
 	struct eventfd_ctx *efd;
 	enum vmpressure_levels level;
@@ -197,6 +194,96 @@ static void vmpressure_work_fn(struct work_struct *work)
 		 */
 	} while ((vmpr = vmpressure_parent(vmpr)));
 }
+#endif
+
+/*
+ * System wide pressure from global reclaim, delivered to in-kernel
+ * subscribers.  Unlike the per-cgroup eventfd levels this works without
+ * memory cgroups.
+ */
+static void vmpressure_global_work_fn(struct work_struct *work);
+
+static struct vmpressure global_vmpressure = {
+	.sr_lock = __MUTEX_INITIALIZER(global_vmpressure.sr_lock),
+	.events = LIST_HEAD_INIT(global_vmpressure.events),
+	.events_lock = __MUTEX_INITIALIZER(global_vmpressure.events_lock),
+	.work = __WORK_INITIALIZER(global_vmpressure.work,
+				   vmpressure_global_work_fn),
+};
+
+/* under global_vmpressure.sr_lock */
+static struct vmpressure_trigger global_vmpressure_trigger;
+
+static BLOCKING_NOTIFIER_HEAD(vmpressure_notifier);
+
+static void vmpressure_global_work_fn(struct work_struct *work)
+{
+	struct vmpressure *vmpr = work_to_vmpressure(work);
+	struct vmpressure_trigger trigger;
+	unsigned long scanned;
+	unsigned long reclaimed;
+
+	/* see vmpressure_work_fn */
+	if (!vmpr->scanned)
+		return;
+
+	mutex_lock(&vmpr->sr_lock);
+	scanned = vmpr->scanned;
+	reclaimed = vmpr->reclaimed;
+	vmpr->scanned = 0;
+	vmpr->reclaimed = 0;
+	trigger = global_vmpressure_trigger;
+	mutex_unlock(&vmpr->sr_lock);
+
+	blocking_notifier_call_chain(&vmpressure_notifier,
+				     vmpressure_calc_level(scanned, reclaimed),
+				     &trigger);
+}
+
+/**
+ * vmpressure_register_notifier() - Subscribe to system wide pressure
+ * @nb:		notifier block, called with an enum vmpressure_levels
+ *
+ * The notifier is called from process context, at most once per
+ * reclaim window, with the level of the global reclaim in that window
+ * and a struct vmpressure_trigger for the task whose reclaim filled it.
+ */
+int vmpressure_register_notifier(struct notifier_block *nb)
+{
+	return blocking_notifier_chain_register(&vmpressure_notifier, nb);
+}
+EXPORT_SYMBOL_GPL(vmpressure_register_notifier);
+
+/**
+ * vmpressure_unregister_notifier() - Unsubscribe from system wide pressure
+ * @nb:		notifier block passed to vmpressure_register_notifier()
+ */
+int vmpressure_unregister_notifier(struct notifier_block *nb)
+{
+	return blocking_notifier_chain_unregister(&vmpressure_notifier, nb);
+}
+EXPORT_SYMBOL_GPL(vmpressure_unregister_notifier);
+
+static void vmpressure_account(struct vmpressure *vmpr,
+			       struct vmpressure_trigger *trigger,
+			       unsigned long scanned, unsigned long reclaimed)
+{
+	mutex_lock(&vmpr->sr_lock);
+	/* the task whose reclaim fills the window */
+	if (trigger && vmpr->scanned < vmpressure_win &&
+	    vmpr->scanned + scanned >= vmpressure_win) {
+		get_task_comm(trigger->comm, current);
+		trigger->pid = current->pid;
+	}
+	vmpr->scanned += scanned;
+	vmpr->reclaimed += reclaimed;
+	scanned = vmpr->scanned;
+	mutex_unlock(&vmpr->sr_lock);
+
+	if (scanned < vmpressure_win || work_pending(&vmpr->work))
+		return;
+	schedule_work(&vmpr->work);
+}
 
 /**
  * vmpressure() - Account memory pressure through scanned/reclaimed ratio
@@ -214,8 +301,6 @@ static void vmpressure_work_fn(struct work_struct *work)
 void vmpressure(gfp_t gfp, struct mem_cgroup *memcg,
 		unsigned long scanned, unsigned long reclaimed)
 {
-	struct vmpressure *vmpr = memcg_to_vmpressure(memcg);
-
 	/*
 	 * Here we only want to account pressure that userland is able to
 	 * help us with. For example, suppose that DMA zone is under
@@ -241,15 +326,14 @@ void vmpressure(gfp_t gfp, struct mem_cgroup *memcg,
 	if (!scanned)
 		return;
 
-	mutex_lock(&vmpr->sr_lock);
-	vmpr->scanned += scanned;
-	vmpr->reclaimed += reclaimed;
-	scanned = vmpr->scanned;
-	mutex_unlock(&vmpr->sr_lock);
-
-	if (scanned < vmpressure_win || work_pending(&vmpr->work))
-		return;
-	schedule_work(&vmpr->work);
+	if (!memcg)
+		vmpressure_account(&global_vmpressure,
+				   &global_vmpressure_trigger, scanned,
+				   reclaimed);
+#ifdef CONFIG_CGROUP_MEM_RES_CTLR
+	vmpressure_account(memcg_to_vmpressure(memcg), NULL, scanned,
+			   reclaimed);
+#endif
 }
 
 /**
@@ -282,6 +366,7 @@ void vmpressure_prio(gfp_t gfp, struct mem_cgroup *memcg, int prio)
 	vmpressure(gfp, memcg, vmpressure_win, 0);
 }
 
+#ifdef CONFIG_CGROUP_MEM_RES_CTLR
 /**
  * vmpressure_register_event() - Bind vmpressure notifications to an eventfd
  * @cg:		cgroup that is interested in vmpressure notifications
@@ -373,3 +458,4 @@ void vmpressure_init(struct vmpressure *vmpr)
 	INIT_LIST_HEAD(&vmpr->events);
 	INIT_WORK(&vmpr->work, vmpressure_work_fn);
 }
+#endif
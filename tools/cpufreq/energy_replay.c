@@ -0,0 +1,363 @@
+/*
+ * energy_replay: replay CPU load traces against a cpufreq energy model
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * The energy model is read from the energy_model file of a cpufreq policy
+ * (or a copy of it), the load trace either from cpufreq_interactive_load
+ * events captured with ftrace or from plain "<duration_us> <demand_khz>"
+ * lines.  Each window of the trace is run at the speed a policy picked
+ * from the previous window, as a governor would, and the estimated energy
+ * and the windows whose demand exceeded that speed are reported for each
+ * policy, e.g.:
+ *
+ *	cat /sys/kernel/debug/tracing/trace_pipe > load.trace
+ *	energy_replay -c 0 load.trace
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <getopt.h>
+
+#define MAX_STATES	32
+
+struct state {
+	unsigned int freq;	/* kHz */
+	unsigned int volt;	/* uV */
+	unsigned int busy;	/* mW */
+	unsigned int idle;	/* mW */
+};
+
+struct window {
+	unsigned long dur;	/* us */
+	unsigned long demand;	/* kHz worth of work */
+};
+
+struct result {
+	const char *name;
+	double energy;		/* nJ */
+	unsigned long missed;
+	unsigned long switches;
+};
+
+static const char *model_path = "/sys/devices/system/cpu/cpu0/cpufreq/energy_model";
+static int trace_cpu = -1;
+static unsigned int target_load = 90;
+
+static struct state states[MAX_STATES];
+static unsigned int nr_states;
+static unsigned int volt_slew;		/* uV/us */
+static unsigned int switch_latency;	/* us */
+
+static struct window *windows;
+static unsigned long nr_windows;
+
+static int read_model(const char *path)
+{
+	char line[256];
+	struct state *s;
+	FILE *f;
+
+	f = fopen(path, "r");
+	if (!f) {
+		perror(path);
+		return -1;
+	}
+
+	while (fgets(line, sizeof(line), f)) {
+		if (sscanf(line, "slew %u latency %u", &volt_slew,
+			   &switch_latency) == 2)
+			continue;
+		if (nr_states == MAX_STATES)
+			break;
+		s = &states[nr_states];
+		if (sscanf(line, "%u %u %u %u", &s->freq, &s->volt, &s->busy,
+			   &s->idle) == 4)
+			nr_states++;
+	}
+	fclose(f);
+
+	if (!nr_states) {
+		fprintf(stderr, "%s: no energy model states\n", path);
+		return -1;
+	}
+	return 0;
+}
+
+static int add_window(unsigned long dur, unsigned long demand)
+{
+	static unsigned long size;
+	struct window *w;
+
+	if (!dur)
+		return 0;
+
+	if (nr_windows == size) {
+		size = size ? size * 2 : 1024;
+		w = realloc(windows, size * sizeof(*w));
+		if (!w) {
+			perror("realloc");
+			return -1;
+		}
+		windows = w;
+	}
+
+	windows[nr_windows].dur = dur;
+	windows[nr_windows].demand = demand;
+	nr_windows++;
+	return 0;
+}
+
+/*
+ * cpufreq_interactive_load events give the load in percent of the actual
+ * speed over the time since the previous evaluation of that CPU.
+ */
+static int parse_event(const char *p)
+{
+	unsigned long cpu, load, actual, targ, latency;
+
+	if (sscanf(p, "cpufreq_interactive_load: cpu=%lu load=%lu actual=%lu "
+		   "targ=%lu latency=%luus", &cpu, &load, &actual, &targ,
+		   &latency) != 5)
+		return 0;
+	if (trace_cpu >= 0 && cpu != (unsigned long)trace_cpu)
+		return 0;
+
+	return add_window(latency, load * actual / 100);
+}
+
+static int read_trace(const char *path)
+{
+	unsigned long dur, demand;
+	char line[512];
+	const char *p;
+	FILE *f;
+	int ret = 0;
+
+	f = path ? fopen(path, "r") : stdin;
+	if (!f) {
+		perror(path);
+		return -1;
+	}
+
+	while (!ret && fgets(line, sizeof(line), f)) {
+		p = strstr(line, "cpufreq_interactive_load:");
+		if (p)
+			ret = parse_event(p);
+		else if (line[0] != '#' &&
+			 sscanf(line, "%lu %lu", &dur, &demand) == 2)
+			ret = add_window(dur, demand);
+	}
+
+	if (path)
+		fclose(f);
+
+	if (!ret && !nr_windows) {
+		fprintf(stderr, "no load samples in trace\n");
+		ret = -1;
+	}
+	return ret;
+}
+
+static unsigned int transition_latency(const struct state *from,
+				       const struct state *to)
+{
+	unsigned int dv;
+
+	if (from == to)
+		return 0;
+
+	dv = from->volt > to->volt ? from->volt - to->volt :
+		to->volt - from->volt;
+	return switch_latency + (volt_slew ? (dv + volt_slew - 1) / volt_slew : 0);
+}
+
+/* nJ spent running @demand for @dur at @s, after switching from @from */
+static double window_energy(const struct state *from, const struct state *s,
+			    unsigned long dur, unsigned long demand)
+{
+	double busy = (double)demand / s->freq;
+	unsigned int pb;
+
+	if (busy > 1)
+		busy = 1;
+
+	pb = from->busy > s->busy ? from->busy : s->busy;
+	return dur * (busy * s->busy + (1 - busy) * s->idle) +
+		(double)transition_latency(from, s) * pb;
+}
+
+/* slowest state which keeps @demand at or below target_load */
+static const struct state *pick_interactive(const struct state *cur,
+					    const struct window *w)
+{
+	unsigned int i;
+
+	(void)cur;
+	for (i = 0; i < nr_states; i++)
+		if ((uint64_t)w->demand * 100 <=
+		    (uint64_t)states[i].freq * target_load)
+			return &states[i];
+	return &states[nr_states - 1];
+}
+
+/* of the states fast enough for interactive, the cheapest one */
+static const struct state *pick_energy(const struct state *cur,
+				       const struct window *w)
+{
+	const struct state *s, *best = NULL;
+	double e, best_e = 0;
+
+	for (s = pick_interactive(cur, w); s < &states[nr_states]; s++) {
+		e = window_energy(cur, s, w->dur, w->demand);
+		if (!best || e < best_e) {
+			best = s;
+			best_e = e;
+		}
+	}
+	return best;
+}
+
+static const struct state *pick_performance(const struct state *cur,
+					    const struct window *w)
+{
+	(void)cur;
+	(void)w;
+	return &states[nr_states - 1];
+}
+
+static const struct state *pick_powersave(const struct state *cur,
+					  const struct window *w)
+{
+	(void)cur;
+	(void)w;
+	return &states[0];
+}
+
+static const struct policy {
+	const char *name;
+	const struct state *(*pick)(const struct state *cur,
+				    const struct window *w);
+} policies[] = {
+	{ "interactive",	pick_interactive },
+	{ "energy_aware",	pick_energy },
+	{ "performance",	pick_performance },
+	{ "powersave",		pick_powersave },
+};
+
+/*
+ * Like a governor, a policy only knows the load of the window that just
+ * ended and picks the speed the next one runs at.
+ */
+static void replay(const struct policy *p, struct result *r)
+{
+	const struct state *cur = &states[nr_states - 1], *next;
+	unsigned long i;
+
+	memset(r, 0, sizeof(*r));
+	r->name = p->name;
+
+	for (i = 0; i < nr_windows; i++) {
+		next = i ? p->pick(cur, &windows[i - 1]) : cur;
+		if (next != cur)
+			r->switches++;
+		r->energy += window_energy(cur, next, windows[i].dur,
+					   windows[i].demand);
+		if (windows[i].demand > next->freq)
+			r->missed++;
+		cur = next;
+	}
+}
+
+static int cmp_state(const void *a, const void *b)
+{
+	const struct state *x = a, *y = b;
+
+	return x->freq < y->freq ? -1 : x->freq > y->freq;
+}
+
+static void usage(const char *name)
+{
+	printf("Usage: %s [options] [trace]\n"
+	       "  -m, --model <path>    energy model (default %s)\n"
+	       "  -c, --cpu <n>         only replay events of this cpu\n"
+	       "  -l, --load <pct>      interactive target load (default %u)\n"
+	       "  -h, --help            show this message\n"
+	       "The trace is read from stdin if not given.\n",
+	       name, model_path, target_load);
+}
+
+static const struct option opts[] = {
+	{ "model",	1, NULL, 'm' },
+	{ "cpu",	1, NULL, 'c' },
+	{ "load",	1, NULL, 'l' },
+	{ "help",	0, NULL, 'h' },
+	{ NULL,		0, NULL, 0 }
+};
+
+int main(int argc, char *argv[])
+{
+	struct result r;
+	double total_us = 0;
+	unsigned long i;
+	int c;
+
+	while ((c = getopt_long(argc, argv, "m:c:l:h", opts, NULL)) != -1) {
+		switch (c) {
+		case 'm':
+			model_path = optarg;
+			break;
+		case 'c':
+			trace_cpu = strtol(optarg, NULL, 0);
+			break;
+		case 'l':
+			target_load = strtoul(optarg, NULL, 0);
+			break;
+		case 'h':
+			usage(argv[0]);
+			return 0;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (!target_load || target_load > 100) {
+		fprintf(stderr, "invalid target load\n");
+		return 1;
+	}
+
+	if (read_model(model_path) ||
+	    read_trace(optind < argc ? argv[optind] : NULL))
+		return 1;
+
+	qsort(states, nr_states, sizeof(states[0]), cmp_state);
+
+	for (i = 0; i < nr_windows; i++)
+		total_us += windows[i].dur;
+
+	printf("%lu windows, %.3f s, %u states, target load %u%%\n",
+	       nr_windows, total_us / 1e6, nr_states, target_load);
+	printf("  %-14s %12s %10s %8s %10s\n",
+	       "policy", "energy (mJ)", "avg (mW)", "missed", "switches");
+
+	for (i = 0; i < sizeof(policies) / sizeof(policies[0]); i++) {
+		replay(&policies[i], &r);
+		printf("  %-14s %12.3f %10.1f %8lu %10lu\n", r.name,
+		       r.energy / 1e6, r.energy / total_us, r.missed,
+		       r.switches);
+	}
+
+	free(windows);
+	return 0;
+}
@@ -0,0 +1,248 @@
+/*
+ * zram_bench: multithreaded read/write throughput test for zram devices
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * Each thread owns a disjoint region of the device and streams O_DIRECT
+ * writes of half-compressible data through it, then reads it back and
+ * verifies the contents.  Aggregate throughput is printed for both phases,
+ * which makes it easy to compare how zram scales with the number of
+ * concurrent writers, e.g.:
+ *
+ *	for t in 1 2 4; do zram_bench -t $t -s 64; done
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <string.h>
+#include <getopt.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#define PAGE_SIZE	4096
+#define DEFAULT_BS	(64 * 1024)
+
+static const char *device = "/dev/zram0";
+static unsigned int nr_threads = 4;
+static size_t region_size = 32 << 20;	/* per thread */
+static size_t block_size = DEFAULT_BS;
+static int verify = 1;
+
+static pthread_barrier_t barrier;
+
+struct worker {
+	pthread_t thread;
+	unsigned int id;
+	int fd;
+	off_t start;
+	int error;
+};
+
+/*
+ * Fill a block with data that compresses to roughly half its size: the
+ * first half of every page is pseudo random, the second half repeats a
+ * tag identifying the page so verification catches misplaced writes.
+ */
+static void fill_block(unsigned char *buf, size_t len, off_t pos,
+		       unsigned int *seed)
+{
+	size_t i, j;
+
+	for (i = 0; i < len; i += PAGE_SIZE) {
+		uint64_t tag = (uint64_t)(pos + i) / PAGE_SIZE;
+
+		for (j = 0; j < PAGE_SIZE / 2; j++)
+			buf[i + j] = rand_r(seed) & 0xff;
+		for (; j < PAGE_SIZE; j += sizeof(tag))
+			memcpy(buf + i + j, &tag, sizeof(tag));
+	}
+}
+
+static int check_block(const unsigned char *buf, size_t len, off_t pos)
+{
+	size_t i, j;
+
+	for (i = 0; i < len; i += PAGE_SIZE) {
+		uint64_t tag = (uint64_t)(pos + i) / PAGE_SIZE;
+
+		for (j = PAGE_SIZE / 2; j < PAGE_SIZE; j += sizeof(tag))
+			if (memcmp(buf + i + j, &tag, sizeof(tag)))
+				return -1;
+	}
+	return 0;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void *worker_fn(void *arg)
+{
+	struct worker *w = arg;
+	unsigned int seed = w->id + 1;
+	unsigned char *buf;
+	size_t done;
+	ssize_t ret;
+
+	if (posix_memalign((void **)&buf, PAGE_SIZE, block_size)) {
+		w->error = ENOMEM;
+		pthread_barrier_wait(&barrier);
+		pthread_barrier_wait(&barrier);
+		return NULL;
+	}
+
+	/* write phase */
+	pthread_barrier_wait(&barrier);
+	for (done = 0; done < region_size && !w->error; done += block_size) {
+		fill_block(buf, block_size, w->start + done, &seed);
+		ret = pwrite(w->fd, buf, block_size, w->start + done);
+		if (ret != (ssize_t)block_size)
+			w->error = ret < 0 ? errno : EIO;
+	}
+
+	/* read phase */
+	pthread_barrier_wait(&barrier);
+	for (done = 0; done < region_size && !w->error; done += block_size) {
+		ret = pread(w->fd, buf, block_size, w->start + done);
+		if (ret != (ssize_t)block_size)
+			w->error = ret < 0 ? errno : EIO;
+		else if (verify && check_block(buf, block_size, w->start + done))
+			w->error = EILSEQ;
+	}
+
+	free(buf);
+	return NULL;
+}
+
+static void usage(const char *name)
+{
+	printf("Usage: %s [options]\n"
+	       "  -d, --device <path>   zram device (default %s)\n"
+	       "  -t, --threads <n>     number of threads (default %u)\n"
+	       "  -s, --size <MB>       region size per thread (default %zu)\n"
+	       "  -b, --bs <KB>         I/O block size (default %zu)\n"
+	       "  -n, --no-verify       skip data verification on read\n"
+	       "  -h, --help            show this message\n",
+	       name, device, nr_threads, region_size >> 20, block_size >> 10);
+}
+
+static const struct option opts[] = {
+	{ "device",	1, NULL, 'd' },
+	{ "threads",	1, NULL, 't' },
+	{ "size",	1, NULL, 's' },
+	{ "bs",		1, NULL, 'b' },
+	{ "no-verify",	0, NULL, 'n' },
+	{ "help",	0, NULL, 'h' },
+	{ NULL,		0, NULL, 0 }
+};
+
+int main(int argc, char *argv[])
+{
+	struct worker *workers;
+	double t0, t1, t2, total_mb;
+	unsigned int i;
+	int c, fd, ret = 0;
+
+	while ((c = getopt_long(argc, argv, "d:t:s:b:nh", opts, NULL)) != -1) {
+		switch (c) {
+		case 'd':
+			device = optarg;
+			break;
+		case 't':
+			nr_threads = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			region_size = strtoull(optarg, NULL, 0) << 20;
+			break;
+		case 'b':
+			block_size = strtoull(optarg, NULL, 0) << 10;
+			break;
+		case 'n':
+			verify = 0;
+			break;
+		case 'h':
+			usage(argv[0]);
+			return 0;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (!nr_threads || !block_size || block_size % PAGE_SIZE ||
+	    region_size < block_size || region_size % block_size) {
+		fprintf(stderr, "invalid thread count, size or block size\n");
+		return 1;
+	}
+
+	fd = open(device, O_RDWR | O_DIRECT);
+	if (fd < 0) {
+		perror(device);
+		return 1;
+	}
+
+	workers = calloc(nr_threads, sizeof(*workers));
+	if (!workers) {
+		perror("calloc");
+		return 1;
+	}
+
+	/* the main thread joins each barrier to take the timestamps */
+	pthread_barrier_init(&barrier, NULL, nr_threads + 1);
+
+	for (i = 0; i < nr_threads; i++) {
+		workers[i].id = i;
+		workers[i].fd = fd;
+		workers[i].start = (off_t)i * region_size;
+		if (pthread_create(&workers[i].thread, NULL, worker_fn,
+				   &workers[i])) {
+			perror("pthread_create");
+			return 1;
+		}
+	}
+
+	pthread_barrier_wait(&barrier);
+	t0 = now();
+	pthread_barrier_wait(&barrier);
+	t1 = now();
+	for (i = 0; i < nr_threads; i++)
+		pthread_join(workers[i].thread, NULL);
+	t2 = now();
+
+	for (i = 0; i < nr_threads; i++) {
+		if (workers[i].error) {
+			fprintf(stderr, "thread %u: %s\n", i,
+				strerror(workers[i].error));
+			ret = 1;
+		}
+	}
+
+	total_mb = (double)region_size * nr_threads / (1 << 20);
+	printf("%s: %u threads, %.0f MB, bs %zu KB\n",
+	       device, nr_threads, total_mb, block_size >> 10);
+	printf("  write: %8.1f MB/s\n", total_mb / (t1 - t0));
+	printf("  read:  %8.1f MB/s\n", total_mb / (t2 - t1));
+
+	pthread_barrier_destroy(&barrier);
+	free(workers);
+	close(fd);
+	return ret;
+}